@@ -0,0 +1,385 @@
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include <benchmark/benchmark.h>
+#include "ImageSensor/ImageSensor.h"
+#include "CFAPattern/CFAPattern.h"
+#include "SceneGenerator/SceneGenerator.h"
+#include "SensorPipeline/SensorPipeline.h"
+#include "ISP/ISP.h"
+#include "LensShading/LensShading.h"
+#include "Telemetry/Telemetry.h"
+
+namespace
+{
+    // Frame sizes swept by every benchmark: VGA, Full HD, 4K UHD and 8K UHD
+    const std::vector<cv::Size> RESOLUTIONS = {{640, 480}, {1920, 1080}, {3840, 2160}, {7680, 4320}};
+
+    // Sensor bit depths swept by the sensor and ISP benchmarks
+    const std::vector<int> BIT_DEPTHS = {8, 12, 16, 32, 64};
+
+    // Inputs shared by the benchmarks, matching the CLI defaults
+    constexpr const char *CFA_PATTERN = "RGGB";
+    constexpr double NOISE_LEVEL = 0.5;
+    constexpr double BLACK_LEVEL = 0.01;       // Fraction of full scale
+    constexpr double VIGNETTING = 0.6;
+
+    // Frame size of a benchmark run
+    cv::Size frameSize(const benchmark::State &state)
+    {
+        return cv::Size(static_cast<int>(state.range(0)), static_cast<int>(state.range(1)));
+    }
+
+    // Starts counting allocations; call right before the timed loop
+    void startCounting()
+    {
+        Telemetry::resetAllocationTotals();
+        Telemetry::pauseAllocationCounting(false);
+    }
+
+    // Stops the timer and the allocation counters for untimed setup inside the loop
+    void pauseCounting(benchmark::State &state)
+    {
+        state.PauseTiming();
+        Telemetry::pauseAllocationCounting(true);
+    }
+
+    // Restarts the timer and the allocation counters after pauseCounting
+    void resumeCounting(benchmark::State &state)
+    {
+        Telemetry::pauseAllocationCounting(false);
+        state.ResumeTiming();
+    }
+
+    // Reports throughput and allocations per frame once the timed loop is done
+    void reportFrames(benchmark::State &state, cv::Size size, size_t bytesPerPixel)
+    {
+        const double frames = static_cast<double>(state.iterations());
+        const double pixels = static_cast<double>(size.area());
+        state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(size.area()));
+        state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(size.area() * bytesPerPixel));
+        state.counters["MP/s"] = benchmark::Counter(frames * pixels / 1e6, benchmark::Counter::kIsRate);
+        const Telemetry::AllocationTotals allocations = Telemetry::getAllocationTotals();
+        state.counters["alloc_bytes_per_frame"] = static_cast<double>(allocations.bytes) / frames;
+        state.counters["allocs_per_frame"] = static_cast<double>(allocations.mats) / frames;
+    }
+
+    // Size of one sensor sample in bytes
+    size_t sampleBytes(int bitDepth)
+    {
+        return CV_ELEM_SIZE(ImageSensor::cvTypeForBitDepth(bitDepth));
+    }
+
+    // Float scene shared by the sensor benchmarks, rendered once per size
+    cv::Mat benchmarkScene(cv::Size size)
+    {
+        return SceneGenerator::generate("siemens-star", size.width, size.height, CV_32F);
+    }
+
+    // 7x7 Gaussian PSF, the CLI default
+    cv::Mat benchmarkPSF()
+    {
+        cv::Mat gaussian = cv::getGaussianKernel(7, 1.5, CV_64F);
+        return gaussian * gaussian.t();
+    }
+
+    // Sensor holding a captured, noisy mosaic
+    ImageSensor mosaicSensor(cv::Size size, int bitDepth, const CFAPattern &cfaPattern)
+    {
+        ImageSensor sensor(bitDepth, size.width, size.height);
+        sensor.captureLight(benchmarkScene(size));
+        sensor.addNoise(NOISE_LEVEL);
+        sensor.applyCFA(cfaPattern);
+        return sensor;
+    }
+
+    // Demosaiced image at the sensor depth, the input of the ISP benchmarks
+    cv::Mat demosaicedImage(cv::Size size, int bitDepth)
+    {
+        CFAPattern cfaPattern(CFA_PATTERN, size.width, size.height);
+        ImageSensor sensor = mosaicSensor(size, bitDepth, cfaPattern);
+        cv::Mat output;
+        sensor.demosaic(output, CFA_PATTERN);
+        return output;
+    }
+
+    // Every resolution at every sensor bit depth
+    void sensorArguments(benchmark::internal::Benchmark *b)
+    {
+        b->ArgNames({"width", "height", "bits"});
+        for (const auto &size : RESOLUTIONS)
+        {
+            for (int bitDepth : BIT_DEPTHS)
+            {
+                b->Args({size.width, size.height, bitDepth});
+            }
+        }
+        b->Unit(benchmark::kMillisecond)->UseRealTime();
+    }
+
+    // Every resolution at both scene depths
+    void sceneArguments(benchmark::internal::Benchmark *b)
+    {
+        b->ArgNames({"width", "height", "depth"});
+        for (const auto &size : RESOLUTIONS)
+        {
+            for (int depth : {CV_32F, CV_64F})
+            {
+                b->Args({size.width, size.height, depth});
+            }
+        }
+        b->Unit(benchmark::kMillisecond)->UseRealTime();
+    }
+
+    // Renders a named scene without the cache
+    void BM_SceneGenerator(benchmark::State &state, const std::string &name)
+    {
+        const cv::Size size = frameSize(state);
+        const int depth = static_cast<int>(state.range(2));
+        SceneGenerator::setCacheCapacity(0);
+        startCounting();
+        for (auto _ : state)
+        {
+            cv::Mat scene = SceneGenerator::generate(name, size.width, size.height, depth);
+            benchmark::DoNotOptimize(scene.data);
+        }
+        reportFrames(state, size, CV_ELEM_SIZE(depth) * (name == "color-checker" ? 3 : 1));
+        SceneGenerator::setCacheCapacity(SceneGenerator::DEFAULT_CACHE_BYTES);
+    }
+
+    void BM_CaptureLight(benchmark::State &state)
+    {
+        const cv::Size size = frameSize(state);
+        const int bitDepth = static_cast<int>(state.range(2));
+        cv::Mat scene = benchmarkScene(size);
+        ImageSensor sensor(bitDepth, size.width, size.height);
+        startCounting();
+        for (auto _ : state)
+        {
+            sensor.captureLight(scene);
+            benchmark::ClobberMemory();
+        }
+        reportFrames(state, size, sampleBytes(bitDepth));
+    }
+
+    void BM_ApplyDiffraction(benchmark::State &state)
+    {
+        const cv::Size size = frameSize(state);
+        const int bitDepth = static_cast<int>(state.range(2));
+        cv::Mat scene = benchmarkScene(size);
+        cv::Mat psf = benchmarkPSF();
+        ImageSensor sensor(bitDepth, size.width, size.height);
+        startCounting();
+        for (auto _ : state)
+        {
+            pauseCounting(state);
+            sensor.captureLight(scene); // Blur the same frame every time
+            resumeCounting(state);
+            sensor.applyDiffraction(psf);
+        }
+        reportFrames(state, size, sampleBytes(bitDepth));
+    }
+
+    void BM_AddNoise(benchmark::State &state)
+    {
+        const cv::Size size = frameSize(state);
+        const int bitDepth = static_cast<int>(state.range(2));
+        cv::Mat scene = benchmarkScene(size);
+        ImageSensor sensor(bitDepth, size.width, size.height);
+        startCounting();
+        for (auto _ : state)
+        {
+            pauseCounting(state);
+            sensor.captureLight(scene); // Noise is not accumulated over iterations
+            resumeCounting(state);
+            sensor.addNoise(NOISE_LEVEL);
+        }
+        reportFrames(state, size, sampleBytes(bitDepth));
+    }
+
+    void BM_ApplyCFA(benchmark::State &state)
+    {
+        const cv::Size size = frameSize(state);
+        const int bitDepth = static_cast<int>(state.range(2));
+        cv::Mat scene = benchmarkScene(size);
+        CFAPattern cfaPattern(CFA_PATTERN, size.width, size.height);
+        ImageSensor sensor(bitDepth, size.width, size.height);
+        startCounting();
+        for (auto _ : state)
+        {
+            pauseCounting(state);
+            sensor.captureLight(scene); // Filter weights are not compounded over iterations
+            resumeCounting(state);
+            sensor.applyCFA(cfaPattern);
+        }
+        reportFrames(state, size, sampleBytes(bitDepth));
+    }
+
+    void BM_Demosaic(benchmark::State &state, Demosaic::Algorithm algorithm)
+    {
+        const cv::Size size = frameSize(state);
+        const int bitDepth = static_cast<int>(state.range(2));
+        CFAPattern cfaPattern(CFA_PATTERN, size.width, size.height);
+        ImageSensor sensor = mosaicSensor(size, bitDepth, cfaPattern);
+        cv::Mat output;
+        startCounting();
+        for (auto _ : state)
+        {
+            sensor.demosaic(output, CFA_PATTERN, algorithm);
+            benchmark::DoNotOptimize(output.data);
+        }
+        reportFrames(state, size, 3 * sampleBytes(bitDepth));
+    }
+
+    void BM_AutoWhiteBalance(benchmark::State &state)
+    {
+        const cv::Size size = frameSize(state);
+        const int bitDepth = static_cast<int>(state.range(2));
+        cv::Mat input = demosaicedImage(size, bitDepth);
+        startCounting();
+        for (auto _ : state)
+        {
+            cv::Mat output = ISP::autoWhiteBalance(input);
+            benchmark::DoNotOptimize(output.data);
+        }
+        reportFrames(state, size, 3 * sampleBytes(bitDepth));
+    }
+
+    void BM_Denoise(benchmark::State &state)
+    {
+        const cv::Size size = frameSize(state);
+        const int bitDepth = static_cast<int>(state.range(2));
+        cv::Mat input = demosaicedImage(size, bitDepth);
+        startCounting();
+        for (auto _ : state)
+        {
+            cv::Mat output = ISP::denoise(input);
+            benchmark::DoNotOptimize(output.data);
+        }
+        reportFrames(state, size, 3 * sampleBytes(bitDepth));
+    }
+
+    void BM_BlackLevelCompensation(benchmark::State &state)
+    {
+        const cv::Size size = frameSize(state);
+        const int bitDepth = static_cast<int>(state.range(2));
+        cv::Mat input = demosaicedImage(size, bitDepth);
+        const double blackLevel = BLACK_LEVEL * ImageSensor::fullScaleForBitDepth(bitDepth);
+        startCounting();
+        for (auto _ : state)
+        {
+            cv::Mat output = ISP::blackLevelCompensation(input, blackLevel);
+            benchmark::DoNotOptimize(output.data);
+        }
+        reportFrames(state, size, 3 * sampleBytes(bitDepth));
+    }
+
+    void BM_LensShadingCorrection(benchmark::State &state)
+    {
+        const cv::Size size = frameSize(state);
+        const int bitDepth = static_cast<int>(state.range(2));
+        cv::Mat input = demosaicedImage(size, bitDepth);
+        LensShading lensShading = LensShading::fromVignetting(size, VIGNETTING);
+        startCounting();
+        for (auto _ : state)
+        {
+            cv::Mat output = ISP::lensShadingCorrection(input, lensShading);
+            benchmark::DoNotOptimize(output.data);
+        }
+        reportFrames(state, size, 3 * sampleBytes(bitDepth));
+    }
+
+    // End to end, stage by stage as the CLI runs it: capture, blur, noise, CFA, demosaic and ISP
+    void BM_Pipeline(benchmark::State &state)
+    {
+        const cv::Size size = frameSize(state);
+        const int bitDepth = static_cast<int>(state.range(2));
+        cv::Mat scene = benchmarkScene(size);
+        cv::Mat psf = benchmarkPSF();
+        CFAPattern cfaPattern(CFA_PATTERN, size.width, size.height);
+        LensShading lensShading = LensShading::fromVignetting(size, VIGNETTING);
+        const double blackLevel = BLACK_LEVEL * ImageSensor::fullScaleForBitDepth(bitDepth);
+        ImageSensor sensor(bitDepth, size.width, size.height);
+        cv::Mat rgb;
+        startCounting();
+        for (auto _ : state)
+        {
+            sensor.captureLight(scene);
+            sensor.applyDiffraction(psf);
+            sensor.addNoise(NOISE_LEVEL);
+            sensor.applyCFA(cfaPattern);
+            sensor.demosaic(rgb, CFA_PATTERN);
+            cv::Mat output = ISP::blackLevelCompensation(rgb, blackLevel);
+            output = ISP::lensShadingCorrection(output, lensShading);
+            output = ISP::autoWhiteBalance(output);
+            output = ISP::denoise(output);
+            benchmark::DoNotOptimize(output.data);
+        }
+        reportFrames(state, size, sampleBytes(bitDepth));
+    }
+
+    // End to end with the fused tiled sensor pipeline, then demosaic and ISP
+    void BM_PipelineFused(benchmark::State &state)
+    {
+        const cv::Size size = frameSize(state);
+        const int bitDepth = static_cast<int>(state.range(2));
+        cv::Mat scene = benchmarkScene(size);
+        CFAPattern cfaPattern(CFA_PATTERN, size.width, size.height);
+        LensShading lensShading = LensShading::fromVignetting(size, VIGNETTING);
+        const double blackLevel = BLACK_LEVEL * ImageSensor::fullScaleForBitDepth(bitDepth);
+        SensorPipeline pipeline;
+        pipeline.addDiffraction(benchmarkPSF());
+        pipeline.addNoise(NOISE_LEVEL);
+        pipeline.addCFA(cfaPattern);
+        ImageSensor sensor(bitDepth, size.width, size.height);
+        cv::Mat rgb;
+        startCounting();
+        for (auto _ : state)
+        {
+            sensor.simulate(scene, pipeline);
+            sensor.demosaic(rgb, CFA_PATTERN);
+            cv::Mat output = ISP::blackLevelCompensation(rgb, blackLevel);
+            output = ISP::lensShadingCorrection(output, lensShading);
+            output = ISP::autoWhiteBalance(output);
+            output = ISP::denoise(output);
+            benchmark::DoNotOptimize(output.data);
+        }
+        reportFrames(state, size, sampleBytes(bitDepth));
+    }
+}
+
+BENCHMARK(BM_CaptureLight)->Apply(sensorArguments);
+BENCHMARK(BM_ApplyDiffraction)->Apply(sensorArguments);
+BENCHMARK(BM_AddNoise)->Apply(sensorArguments);
+BENCHMARK(BM_ApplyCFA)->Apply(sensorArguments);
+BENCHMARK_CAPTURE(BM_Demosaic, bilinear, Demosaic::BILINEAR)->Apply(sensorArguments);
+BENCHMARK_CAPTURE(BM_Demosaic, malvar, Demosaic::MALVAR)->Apply(sensorArguments);
+BENCHMARK_CAPTURE(BM_Demosaic, directional, Demosaic::DIRECTIONAL)->Apply(sensorArguments);
+BENCHMARK(BM_AutoWhiteBalance)->Apply(sensorArguments);
+BENCHMARK(BM_Denoise)->Apply(sensorArguments);
+BENCHMARK(BM_BlackLevelCompensation)->Apply(sensorArguments);
+BENCHMARK(BM_LensShadingCorrection)->Apply(sensorArguments);
+BENCHMARK(BM_Pipeline)->Apply(sensorArguments);
+BENCHMARK(BM_PipelineFused)->Apply(sensorArguments);
+
+int main(int argc, char **argv)
+{
+    // Every cv::Mat allocation of the suite goes through the telemetry counting allocator
+    Telemetry::setAllocationCounting(true);
+
+    // One scene benchmark per generator, named after the scene
+    for (const auto &name : SceneGenerator::getSceneNames())
+    {
+        benchmark::RegisterBenchmark(("BM_SceneGenerator/" + name).c_str(), BM_SceneGenerator, name)->Apply(sceneArguments);
+    }
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv))
+    {
+        return 1;
+    }
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
@@ -1,10 +1,77 @@
+#include <algorithm>
+#include <cmath>
+#include <fstream>
 #include <iostream>
+#include <memory>
 #include <opencv2/opencv.hpp>
 #include <CLI/CLI.hpp>
 #include "ImageSensor/ImageSensor.h"
 #include "CFAPattern/CFAPattern.h"
 #include "SceneGenerator/SceneGenerator.h"
 #include "ISP/ISP.h"
+#include "BatchRunner/BatchRunner.h"
+#include "VideoPipeline/VideoPipeline.h"
+#include "ISPPipeline/ISPPipeline.h"
+#include "Denoiser/Denoiser.h"
+#include "RawFile/RawFile.h"
+#include "SceneLoader/SceneLoader.h"
+#include "Telemetry/Telemetry.h"
+#include "BufferPool/BufferPool.h"
+#include "TiledSimulator/TiledSimulator.h"
+#include "ImageQuality/ImageQuality.h"
+
+namespace
+{
+    // Streams an image to a binary PPM file band by band (16-bit samples above a maximum of 255)
+    class PPMWriter
+    {
+    public:
+        PPMWriter(const std::string &path, int width, int height, double maxValue)
+            : stream(path, std::ios::binary), maxValue(static_cast<int>(std::min(maxValue, 65535.0)))
+        {
+            if (!stream)
+            {
+                throw std::runtime_error("Cannot create PPM file: " + path);
+            }
+            stream << "P6\n" << width << " " << height << "\n" << this->maxValue << "\n";
+        }
+
+        // Appends BGR rows, converted to big-endian RGB samples
+        void writeRows(const cv::Mat &bgr)
+        {
+            const int bytesPerSample = (maxValue > 255) ? 2 : 1;
+            cv::Mat samples;
+            bgr.convertTo(samples, (bytesPerSample == 2) ? CV_16UC3 : CV_8UC3);
+            std::vector<char> row(static_cast<size_t>(samples.cols) * 3 * bytesPerSample);
+            for (int i = 0; i < samples.rows; ++i)
+            {
+                for (int k = 0; k < samples.cols * 3; ++k)
+                {
+                    int source = k - k % 3 + 2 - k % 3; // BGR to RGB
+                    if (bytesPerSample == 2)
+                    {
+                        uint16_t v = std::min<uint16_t>(samples.ptr<uint16_t>(i)[source], static_cast<uint16_t>(maxValue));
+                        row[2 * k] = static_cast<char>(v >> 8);
+                        row[2 * k + 1] = static_cast<char>(v & 0xFF);
+                    }
+                    else
+                    {
+                        row[k] = static_cast<char>(samples.ptr<uchar>(i)[source]);
+                    }
+                }
+                stream.write(row.data(), static_cast<std::streamsize>(row.size()));
+            }
+            if (!stream)
+            {
+                throw std::runtime_error("Failed to write PPM rows");
+            }
+        }
+
+    private:
+        std::ofstream stream;
+        int maxValue;
+    };
+}
 
 int main(int argc, char **argv)
 {
@@ -17,7 +84,49 @@ int main(int argc, char **argv)
     double noiseLevel = 0.5;
     std::string cfaPatternStr = CFAPattern::DEFAULT_CFA_PATTERN;
     std::vector<std::string> colorWeights;
-    std::string patternType = "gradient"; // Default pattern type
+    std::string patternType = "gradient";     // Default pattern type
+    std::string demosaicAlgorithm = "malvar"; // Demosaicing algorithm
+    bool fused = false;                       // Run the sensor stages as one fused pipeline
+    bool debug = false;                       // Dump intermediate sensor data after every stage
+    uint64_t seed = 0;                        // Seed for the noise generator
+    bool physicalNoise = false;               // Use the physically-based noise model instead of Gaussian noise
+    NoiseModel::Parameters noiseParams;       // Parameters of the physically-based noise model
+    std::string psfType = "gaussian";         // PSF used to simulate optical diffraction
+    double wavelength = 0.55;                 // Wavelength for the Airy PSF (micrometers)
+    double fNumber = 2.8;                     // F-number for the Airy PSF
+    double pixelPitch = 1.4;                  // Pixel pitch for the Airy PSF (micrometers)
+    int psfSize = 31;                         // Side of the Airy PSF kernel
+    int spectralBands = 0;                    // Number of wavelength bands, 0 for the monochrome pipeline
+    double illuminantTemperature = 0.0;       // Black body illuminant temperature (K), 0 for equal energy
+    std::string batchSpec;                    // Sweep spec for headless batch mode
+    int threads = 0;                          // Worker threads for batch mode, 0 for all hardware threads
+    bool headless = false;                    // Skip the preview windows
+    int videoFrames = 0;                      // Number of frames to stream, 0 for a single still capture
+    double frameRate = 30.0;                  // Target frame rate of the stream
+    double readoutTime = 0.0;                 // Rolling shutter readout time (s), 0 for a global shutter
+    double motionX = 0.0;                     // Horizontal scene motion in pixels per second
+    double motionY = 0.0;                     // Vertical scene motion in pixels per second
+    bool realTime = false;                    // Pace the stream to the target frame rate
+    bool runISP = false;                      // Run the ISP chain on the demosaiced image
+    double gamma = 2.2;                       // Gamma of the ISP output encoding
+    bool runRawISP = false;                   // Run the raw-domain ISP on the mosaic before demosaicing
+    double rawDenoise = 0.0;                  // Range sigma of the CFA-aware denoiser (digital numbers)
+    std::string denoiseAlgorithm = "none";    // Denoiser run on the demosaiced image at its native depth
+    double denoiseSigma = 0.0;                // Noise sigma for the denoiser (digital numbers), 0 to estimate it
+    double vignetting = 1.0;                  // Relative illumination at the corners, 1 for no lens shading
+    bool floatScene = false;                  // Render the scene as float32 even for float64 runs
+    std::string precisionName = "float32";    // Arithmetic of the simulation working type
+    bool validatePrecision = false;           // Also run a float64 reference and report the error against it
+    std::string rawOutput;                    // Raw container file receiving the unprocessed mosaic
+    std::string inputFile;                    // Scene file (EXR, HDR, DNG, image or raw container) instead of a generated pattern
+    bool autoExposure = false;                // Scale the input scene to a mean luminance of 18%
+    bool telemetry = false;                   // Print the per-stage time and allocation breakdown
+    std::string traceFile;                    // Chrome trace JSON receiving every stage call
+    bool poolBuffers = false;                 // Recycle every cv::Mat buffer through the global buffer pool
+    int tileRows = 0;                         // Rows per tile of the out-of-core mode, 0 to simulate the frame in memory
+    int tileCols = 0;                         // Columns per tile of the out-of-core mode, 0 for full-width strips
+    std::string rgbOutput;                    // PPM file receiving the demosaiced image of the out-of-core mode
+    bool analyze = false;                     // Print image quality metrics of the demosaiced image
 
     app.add_option("-w,--width", width, "Sensor width in pixels")->default_val(width);
     app.add_option("-j,--height", height, "Sensor height in pixels")->default_val(height);
@@ -25,62 +134,535 @@ int main(int argc, char **argv)
     app.add_option("-n,--noise", noiseLevel, "Noise level (standard deviation of Gaussian noise)")->default_val(noiseLevel);
     app.add_option("-c,--cfapattern", cfaPatternStr, "CFA pattern (e.g., RCCB)")->default_val(cfaPatternStr);
     app.add_option("--color-weight", colorWeights, "Change existing color weight (e.g., R:0.25)");
-    app.add_option("-p,--pattern", patternType, "Pattern type (gradient, checkerboard, slanted-edge, radial-lines)")->default_val(patternType);
+    app.add_option("-p,--pattern", patternType, "Pattern type (gradient, checkerboard, slanted-edge, radial-lines, siemens-star, zone-plate, iso12233, color-checker)")->default_val(patternType);
+    app.add_option("--raw-output", rawOutput, "Write the raw mosaic (every frame in --video mode) to this bit-packed raw container file");
+    app.add_option("-i,--input", inputFile, "Scene file (EXR, HDR, DNG, TIFF, PNG, JPEG or .sraw); the sensor takes its size");
+    app.add_flag("--auto-exposure", autoExposure, "Scale the --input scene to a mean luminance of 18%");
+    app.add_flag("--float-scene", floatScene, "Render the scene as float32 even with --precision float64 or --validate-precision");
+    app.add_option("--precision", precisionName, "Arithmetic of the simulation (float64, float32, fixed); fixed needs an integer bit depth")->default_val(precisionName);
+    app.add_flag("--validate-precision", validatePrecision, "Repeat the simulation in float64 and print the error of the raw data against it");
+
+    app.add_option("-d,--demosaic", demosaicAlgorithm, "Demosaicing algorithm (bilinear, malvar, directional)")->default_val(demosaicAlgorithm);
+    app.add_flag("--fused", fused, "Run diffraction, noise and CFA as a single fused tiled pipeline");
+    app.add_flag("--debug", debug, "Print the range and first 10x10 values of the sensor data after every stage");
+    app.add_option("--seed", seed, "Seed for the noise generator")->default_val(seed);
+    app.add_flag("--noise-model", physicalNoise, "Use the physically-based noise model (shot, read, dark current, PRNU/DSNU, ADC)");
+    app.add_option("--full-well", noiseParams.fullWellCapacity, "Full well capacity in electrons")->default_val(noiseParams.fullWellCapacity);
+    app.add_option("--read-noise", noiseParams.readNoise, "Read noise in electrons RMS")->default_val(noiseParams.readNoise);
+    app.add_option("--dark-current", noiseParams.darkCurrent, "Dark current in electrons/s at 25 C")->default_val(noiseParams.darkCurrent);
+    app.add_option("--temperature", noiseParams.temperature, "Sensor temperature in degrees C")->default_val(noiseParams.temperature);
+    app.add_option("--exposure", noiseParams.exposureTime, "Exposure time in seconds")->default_val(noiseParams.exposureTime);
+    app.add_option("--prnu", noiseParams.prnu, "PRNU as relative gain RMS")->default_val(noiseParams.prnu);
+    app.add_option("--dsnu", noiseParams.dsnu, "DSNU in electrons RMS")->default_val(noiseParams.dsnu);
+    app.add_option("--black-level", noiseParams.blackLevel, "ADC black level in digital numbers")->default_val(noiseParams.blackLevel);
+
+    app.add_option("--psf", psfType, "PSF type (gaussian, airy)")->default_val(psfType);
+    app.add_option("--wavelength", wavelength, "Wavelength for the Airy PSF in micrometers")->default_val(wavelength);
+    app.add_option("--fnumber", fNumber, "F-number for the Airy PSF")->default_val(fNumber);
+    app.add_option("--pixel-pitch", pixelPitch, "Pixel pitch for the Airy PSF in micrometers")->default_val(pixelPitch);
+    app.add_option("--psf-size", psfSize, "Side of the Airy PSF kernel in pixels (odd)")->default_val(psfSize);
+    app.add_option("--spectral-bands", spectralBands, "Render the scene in this many wavelength bands (400-700 nm) with per-band PSF and CFA response")->default_val(spectralBands);
+    app.add_option("--illuminant-temperature", illuminantTemperature, "Black body illuminant temperature in K for spectral rendering (0 for equal energy)")->default_val(illuminantTemperature);
+
+    app.add_option("--batch", batchSpec, "Run the parameter sweep described in this YAML/JSON file without a GUI");
+    app.add_option("--threads", threads, "Worker threads for --batch (0 for all hardware threads)")->default_val(threads);
+    app.add_flag("--headless", headless, "Do not open preview windows");
+    app.add_option("--video", videoFrames, "Stream this many frames through the pipelined video mode and report the frame rate")->default_val(videoFrames);
+    app.add_option("--fps", frameRate, "Target frame rate of the video stream")->default_val(frameRate);
+    app.add_option("--readout-time", readoutTime, "Rolling shutter readout time in seconds (0 for a global shutter)")->default_val(readoutTime);
+    app.add_option("--motion-x", motionX, "Horizontal scene motion in pixels per second")->default_val(motionX);
+    app.add_option("--motion-y", motionY, "Vertical scene motion in pixels per second")->default_val(motionY);
+    app.add_flag("--real-time", realTime, "Pace the video stream to the target frame rate");
+    app.add_flag("--isp", runISP, "Run black level, auto white balance and gamma on the demosaiced image");
+    app.add_option("--gamma", gamma, "Gamma of the ISP output encoding")->default_val(gamma);
+    app.add_flag("--raw-isp", runRawISP, "Run black level, white balance from CFA statistics and denoising on the mosaic");
+    app.add_option("--raw-denoise", rawDenoise, "Range sigma of the CFA-aware denoiser in digital numbers (0 to disable)")->default_val(rawDenoise);
+    app.add_option("--denoise", denoiseAlgorithm, "Denoise the demosaiced image (none, guided, bilateral, wavelet, nlm)")->default_val(denoiseAlgorithm);
+    app.add_option("--vignetting", vignetting, "Relative illumination at the corners (cos^4 falloff), corrected by the ISP from a 17x13 gain grid")->default_val(vignetting);
+    app.add_option("--denoise-sigma", denoiseSigma, "Noise sigma for --denoise in digital numbers (0 to estimate it from the image)")->default_val(denoiseSigma);
+    app.add_flag("--telemetry", telemetry, "Print the time and allocations of every pipeline stage");
+    app.add_flag("--pool-buffers", poolBuffers, "Recycle every image buffer through a frame buffer pool instead of the heap");
+    app.add_option("--trace", traceFile, "Write every stage call to this Chrome trace / Perfetto JSON file");
+    app.add_option("--tile-rows", tileRows, "Simulate out of core in tiles of this many rows, streaming the mosaic to --raw-output (0 to disable)")->default_val(tileRows);
+    app.add_option("--tile-cols", tileCols, "Columns per tile for --tile-rows (0 for full-width strips)")->default_val(tileCols);
+    app.add_option("--rgb-output", rgbOutput, "Demosaic the --tile-rows output and stream it to this binary PPM file");
+    app.add_flag("--analyze", analyze, "Print PSNR, SSIM, color error, demosaic artifacts, slanted-edge MTF and patch SNR of the demosaiced image");
 
     CLI11_PARSE(app, argc, argv);
+    const SensorKernels::Precision precision = SensorKernels::parsePrecision(precisionName);
 
-    // Create the CFA pattern object
-    CFAPattern cfaPattern(cfaPatternStr, width, height);
-    cfaPattern.updateColorWeights(colorWeights);
+    // Float64 runs, and runs validated against one, start from a float64 scene
+    const int sceneDepth = (floatScene || (precision != SensorKernels::FLOAT64 && !validatePrecision)) ? CV_32F : CV_64F;
 
-    // Create a sample scene based on the specified pattern type
-    cv::Mat scene;
-    if (patternType == "gradient")
+    // Pooling goes first so telemetry counts allocations on top of it
+    if (poolBuffers)
     {
-        scene = SceneGenerator::generateGradient(width, height);
+        BufferPool::setDefaultPooling(true);
     }
-    else if (patternType == "checkerboard")
+
+    // Stage telemetry, reported once the simulation is done
+    if (telemetry || !traceFile.empty())
+    {
+        Telemetry::setEnabled(true);
+        if (!traceFile.empty())
+        {
+            Telemetry::startTrace();
+        }
+    }
+    auto reportTelemetry = [&]
+    {
+        if (telemetry)
+        {
+            Telemetry::printReport(std::cout);
+        }
+        if (poolBuffers)
+        {
+            std::cout << "Buffer pool: " << BufferPool::global().getHeapAllocations() << " heap allocations, "
+                      << BufferPool::global().getPooledBytes() / (1024 * 1024) << " MB idle" << std::endl;
+        }
+        if (!traceFile.empty())
+        {
+            Telemetry::writeTrace(traceFile);
+            std::cout << "Trace written to " << traceFile << std::endl;
+        }
+    };
+
+    if (!batchSpec.empty())
+    {
+        BatchRunner runner(BatchRunner::loadSpec(batchSpec), threads);
+        std::vector<BatchRunner::Result> results = runner.run();
+
+        int failures = 0;
+        for (const auto &result : results)
+        {
+            if (!result.error.empty())
+            {
+                std::cerr << "Job " << result.job.index << " failed: " << result.error << std::endl;
+                ++failures;
+            }
+        }
+        std::cout << "Ran " << results.size() << " jobs, " << failures << " failed" << std::endl;
+        reportTelemetry();
+        return failures == 0 ? 0 : 1;
+    }
+
+    std::vector<std::string> sceneNames = SceneGenerator::getSceneNames();
+    if (inputFile.empty() && std::find(sceneNames.begin(), sceneNames.end(), patternType) == sceneNames.end())
     {
-        scene = SceneGenerator::generateCheckerboard(width, height, 8, 8);
+        std::cerr << "Unknown pattern type: " << patternType << std::endl;
+        return 1;
     }
-    else if (patternType == "slanted-edge")
+
+    // PSF used to simulate optical diffraction; the Gaussian is kept as its separable factors
+    cv::Mat gaussian = cv::getGaussianKernel(7, 1.5, CV_64F);
+    cv::Mat psf;
+    if (psfType == "gaussian")
     {
-        scene = SceneGenerator::generateSlantedEdge(width, height, 20.0);
+        psf = gaussian * gaussian.t();
     }
-    else if (patternType == "radial-lines")
+    else if (psfType == "airy")
     {
-        scene = SceneGenerator::generateRadialLines(width, height, 16);
+        psf = PSFConvolver::airyPSF(wavelength, fNumber, pixelPitch, psfSize);
     }
     else
     {
-        std::cerr << "Unknown pattern type: " << patternType << std::endl;
+        std::cerr << "Unknown PSF type: " << psfType << std::endl;
         return 1;
     }
 
+    // The streaming modes run the float32 kernels
+    if ((tileRows > 0 || videoFrames > 0) && (precision != SensorKernels::DEFAULT_PRECISION || validatePrecision))
+    {
+        std::cerr << "--precision and --validate-precision apply to the in-memory still capture" << std::endl;
+        return 1;
+    }
+
+    // Out-of-core mode: bands of tiles stream from the scene to the output files, so memory follows the tile size
+    if (tileRows > 0)
+    {
+        if (rawOutput.empty())
+        {
+            std::cerr << "--tile-rows requires --raw-output" << std::endl;
+            return 1;
+        }
+
+        CFAPattern tiledPattern(cfaPatternStr);
+        tiledPattern.updateColorWeights(colorWeights);
+        TiledSimulator::Config tiledConfig;
+        tiledConfig.bitDepth = bitDepth;
+        tiledConfig.tileRows = tileRows;
+        tiledConfig.tileCols = tileCols;
+        tiledConfig.demosaic = !rgbOutput.empty();
+        tiledConfig.algorithm = Demosaic::parseAlgorithm(demosaicAlgorithm);
+        tiledConfig.noiseLevel = noiseLevel;
+        tiledConfig.seed = seed;
+        TiledSimulator simulator(tiledPattern, tiledConfig);
+        simulator.setPSF(psf);
+        if (physicalNoise)
+        {
+            simulator.setNoiseModel(noiseParams);
+        }
+
+        // File scenes are read strip by strip; generated patterns are rendered once as float32
+        std::unique_ptr<SceneLoader> loader;
+        cv::Mat generated;
+        if (!inputFile.empty())
+        {
+            SceneLoader::Options loadOptions;
+            loadOptions.autoExposure = autoExposure;
+            loadOptions.depth = CV_32F;
+            loader = std::make_unique<SceneLoader>(inputFile, loadOptions);
+            width = loader->getSize().width;
+            height = loader->getSize().height;
+        }
+        else
+        {
+            SceneGenerator::generate(patternType, generated, width, height, CV_32F);
+            if (generated.channels() == 3)
+            {
+                cv::transform(generated, generated, cv::Matx13f(0.114f, 0.587f, 0.299f));
+            }
+        }
+
+        RawFile::Header rawHeader;
+        rawHeader.width = width;
+        rawHeader.height = height;
+        rawHeader.bitDepth = bitDepth;
+        rawHeader.packedBits = RawFile::packedBitsForFullScale(ImageSensor::fullScaleForBitDepth(bitDepth), CV_MAT_DEPTH(ImageSensor::cvTypeForBitDepth(bitDepth)));
+        rawHeader.cfaPattern = cfaPatternStr;
+        rawHeader.blackLevel = physicalNoise ? noiseParams.blackLevel : 0.0;
+        rawHeader.physicalNoise = physicalNoise;
+        rawHeader.noiseLevel = noiseLevel;
+        rawHeader.noise = noiseParams;
+        rawHeader.seed = seed;
+        RawFile::Writer writer(rawOutput, rawHeader);
+        std::unique_ptr<PPMWriter> rgbWriter;
+        if (!rgbOutput.empty())
+        {
+            rgbWriter = std::make_unique<PPMWriter>(rgbOutput, width, height, ImageSensor::fullScaleForBitDepth(bitDepth));
+        }
+
+        TiledSimulator::BandSink sink = [&](int, const cv::Mat &raw, const cv::Mat &bgr)
+        {
+            writer.writeRows(raw);
+            if (rgbWriter)
+            {
+                rgbWriter->writeRows(bgr);
+            }
+        };
+        if (loader)
+        {
+            simulator.run(*loader, sink);
+        }
+        else
+        {
+            simulator.run(generated.size(), [&generated](int rowStart, int rowEnd, cv::Mat &rows)
+            {
+                rows = generated.rowRange(rowStart, rowEnd);
+            }, sink);
+        }
+        writer.close();
+        std::cout << "Simulated " << width << "x" << height << " in " << tileRows << "-row tiles to " << rawOutput << std::endl;
+        reportTelemetry();
+        return 0;
+    }
+
+    // Scene files stream strip by strip into the sensor when nothing else needs the whole scene:
+    // the step-by-step still capture without video, lens shading or quality analysis
+    const bool streamScene = !inputFile.empty() && spectralBands <= 0 && !fused && videoFrames <= 0 && vignetting >= 1.0 && !analyze;
+
+    // Load the scene file, or create a sample scene based on the specified pattern type
+    cv::Mat scene;
+    std::unique_ptr<SceneLoader> sceneLoader;
+    if (!inputFile.empty())
+    {
+        SceneLoader::Options loadOptions;
+        loadOptions.autoExposure = autoExposure;
+        loadOptions.depth = sceneDepth;
+        sceneLoader = std::make_unique<SceneLoader>(inputFile, loadOptions);
+        if (!streamScene)
+        {
+            scene = (spectralBands > 0) ? sceneLoader->loadColor() : sceneLoader->loadLuminance();
+        }
+        width = sceneLoader->getSize().width;
+        height = sceneLoader->getSize().height;
+        std::cout << "Loaded " << inputFile << " (" << width << "x" << height << ", exposure " << sceneLoader->getExposure() << ")" << std::endl;
+    }
+    else
+    {
+        SceneGenerator::generate(patternType, scene, width, height, sceneDepth); // Own copy, the cache keeps the original
+    }
+
+    // Create the CFA pattern object
+    CFAPattern cfaPattern(cfaPatternStr, width, height);
+    cfaPattern.updateColorWeights(colorWeights);
+
+    // The monochrome pipelines see the luminance of color charts; spectral rendering uses all three channels
+    if (scene.channels() == 3 && spectralBands <= 0)
+    {
+        cv::Mat luminance;
+        cv::transform(scene, luminance, cv::Matx13f(0.114f, 0.587f, 0.299f));
+        scene = luminance;
+    }
+
+    // Lens shading: the scene is darkened by the vignetting model, the ISP corrects it from the same small grid
+    LensShading lensShading;
+    if (vignetting < 1.0)
+    {
+        lensShading = LensShading::fromVignetting(cv::Size(width, height), vignetting);
+        lensShading.inverted().apply(scene);
+    }
+
     // Create an ImageSensor object with the desired bit depth and dimensions
-    ImageSensor sensor(bitDepth, width, height);
-    sensor.captureLight(scene);
+    ImageSensor sensor(bitDepth, width, height, precision);
+    sensor.setSeed(seed);
+    if (physicalNoise)
+    {
+        sensor.setNoiseModel(noiseParams);
+    }
+    if (debug)
+    {
+        sensor.setDiagnosticsCallback([](const std::string &stage, const cv::Mat &data)
+        {
+            double minVal, maxVal;
+            cv::minMaxLoc(data, &minVal, &maxVal);
+            std::cout << stage << ": min value: " << minVal << ", max value: " << maxVal << std::endl;
+
+            // Print the first 10x10 section of the sensor matrix
+            std::cout << stage << " (first 10x10 values):" << std::endl;
+            std::cout << data(cv::Rect(0, 0, std::min(10, data.cols), std::min(10, data.rows))) << std::endl;
+        });
+    }
+
+    // The noise model's black level is in ADC codes; the ISP works in sensor data units
+    double adcMax = (bitDepth <= 16) ? std::ldexp(1.0, bitDepth) - 1.0 : 65535.0;
+    double sensorBlackLevel = physicalNoise ? noiseParams.blackLevel * ImageSensor::fullScaleForBitDepth(bitDepth) / adcMax : 0.0;
+
+    // Raw container recording the mosaic with the settings that produced it
+    std::unique_ptr<RawFile::Writer> rawWriter;
+    if (!rawOutput.empty())
+    {
+        RawFile::Header rawHeader;
+        rawHeader.width = width;
+        rawHeader.height = height;
+        rawHeader.bitDepth = bitDepth;
+        rawHeader.packedBits = RawFile::packedBitsForFullScale(ImageSensor::fullScaleForBitDepth(bitDepth), sensor.getSensorData().depth());
+        rawHeader.cfaPattern = cfaPatternStr;
+        rawHeader.blackLevel = sensorBlackLevel;
+        rawHeader.physicalNoise = physicalNoise;
+        rawHeader.noiseLevel = noiseLevel;
+        rawHeader.noise = noiseParams;
+        rawHeader.seed = seed;
+        rawWriter = std::make_unique<RawFile::Writer>(rawOutput, rawHeader);
+    }
+
+    // ISP chain: point-wise stages run fused in one tiled pass, buffers are reused across frames
+    ISPPipeline isp;
+    isp.setWhiteLevel(ImageSensor::fullScaleForBitDepth(bitDepth)); // 10 to 14-bit data does not span its 16-bit storage
+    isp.addBlackLevel(sensorBlackLevel);
+    if (!lensShading.empty() && (!runRawISP || videoFrames > 0)) // The video stream has no raw ISP
+    {
+        isp.addLensShading(lensShading);
+    }
+    isp.addAutoWhiteBalance().addGamma(gamma);
+
+    if (videoFrames > 0)
+    {
+        VideoPipeline::Config videoConfig;
+        videoConfig.width = width;
+        videoConfig.height = height;
+        videoConfig.bitDepth = bitDepth;
+        videoConfig.frameRate = frameRate;
+        videoConfig.exposureTime = noiseParams.exposureTime;
+        videoConfig.readoutTime = readoutTime;
+        videoConfig.realTime = realTime;
+        videoConfig.seed = seed;
+
+        VideoPipeline video(videoConfig);
+        video.setSceneSource(VideoPipeline::translatingScene(scene, cv::Point2d(motionX, motionY)));
+        video.setPSF(psf);
+        if (physicalNoise)
+        {
+            video.setNoiseModel(sensor.getNoiseModel());
+        }
+        else
+        {
+            video.setNoise(noiseLevel);
+        }
+        video.setCFA(cfaPattern);
+        video.setDemosaic(Demosaic::parseAlgorithm(demosaicAlgorithm));
+        if (runISP)
+        {
+            video.setISP([&isp](cv::Mat &rgb)
+            {
+                isp.process(rgb, rgb);
+            });
+        }
+
+        if (rawWriter)
+        {
+            video.setSink([&rawWriter](const VideoPipeline::Frame &frame)
+            {
+                rawWriter->writeFrame(frame.raw);
+            });
+        }
+
+        VideoPipeline::Statistics stats = video.run(videoFrames);
+        std::cout << stats.frames << " frames in " << stats.seconds << " s: " << stats.framesPerSecond << " fps" << std::endl;
+        for (size_t s = 0; s < stats.stageNames.size(); ++s)
+        {
+            std::cout << "  " << stats.stageNames[s] << ": " << 1000.0 * stats.stageSeconds[s] / stats.frames << " ms/frame" << std::endl;
+        }
+        reportTelemetry();
+        return 0;
+    }
+
+    // Capture, optics, noise and CFA; run again on the float64 reference sensor when validating
+    auto simulateRaw = [&](ImageSensor &target)
+    {
+        if (spectralBands > 0)
+        {
+            // Each band gets the Airy pattern of its own wavelength; the Gaussian PSF is achromatic
+            std::vector<double> wavelengths = SpectralScene::sampleWavelengths(SpectralScene::DEFAULT_FIRST_WAVELENGTH, SpectralScene::DEFAULT_LAST_WAVELENGTH, spectralBands);
+            std::vector<double> illuminant = (illuminantTemperature > 0.0) ? SpectralScene::blackbodyIlluminant(wavelengths, illuminantTemperature)
+                                                                           : SpectralScene::equalEnergyIlluminant(wavelengths);
+            SpectralScene spectralScene(scene, wavelengths, illuminant);
+            target.captureSpectral(spectralScene, cfaPattern, [&](double bandWavelength)
+            {
+                return (psfType == "airy") ? PSFConvolver::airyPSF(bandWavelength * 1e-3, fNumber, pixelPitch, psfSize) : psf;
+            });
 
-    // Simulate optical diffraction by applying a Gaussian PSF
-    cv::Mat psf = cv::getGaussianKernel(7, 1.5, CV_64F) * cv::getGaussianKernel(7, 1.5, CV_64F).t();
-    sensor.applyDiffraction(psf);
+            if (physicalNoise)
+            {
+                target.applyNoiseModel();
+            }
+            else
+            {
+                target.addNoise(noiseLevel);
+            }
+        }
+        else if (fused)
+        {
+            // Declare the stages once and run them together over tiles
+            SensorPipeline pipeline;
+            pipeline.setSeed(seed);
+            pipeline.addDiffraction(psf);
+            if (physicalNoise)
+            {
+                pipeline.addNoiseModel(target.getNoiseModel());
+            }
+            else
+            {
+                pipeline.addNoise(noiseLevel);
+            }
+            pipeline.addCFA(cfaPattern);
+            target.simulate(scene, pipeline);
+        }
+        else
+        {
+            if (scene.empty())
+            {
+                target.captureLight(*sceneLoader);
+            }
+            else
+            {
+                target.captureLight(scene);
+            }
 
-    // Add noise to the sensor data
-    sensor.addNoise(noiseLevel);
+            // Simulate optical diffraction by applying the PSF
+            if (psfType == "gaussian")
+            {
+                target.applyDiffraction(gaussian.t(), gaussian);
+            }
+            else
+            {
+                target.applyDiffraction(psf);
+            }
 
-    // Apply the custom CFA pattern
-    sensor.applyCFA(cfaPattern);
+            // Add noise to the sensor data
+            if (physicalNoise)
+            {
+                target.applyNoiseModel();
+            }
+            else
+            {
+                target.addNoise(noiseLevel);
+            }
+
+            // Apply the custom CFA pattern
+            target.applyCFA(cfaPattern);
+        }
+    };
+    simulateRaw(sensor);
+
+    if (validatePrecision)
+    {
+        ImageSensor reference(bitDepth, width, height, SensorKernels::FLOAT64);
+        reference.setSeed(seed);
+        if (physicalNoise)
+        {
+            reference.setNoiseModel(noiseParams);
+        }
+        simulateRaw(reference);
+        ImageQuality::PrecisionError error = ImageQuality::precisionError(sensor.getSensorData(), reference.getSensorData(), ImageSensor::fullScaleForBitDepth(bitDepth));
+        std::cout << "Precision " << SensorKernels::precisionName(precision) << " vs float64: " << ImageQuality::format(error) << std::endl;
+    }
+
+    if (rawWriter)
+    {
+        rawWriter->writeFrame(sensor.getSensorData());
+        rawWriter->close();
+    }
+
+    // Raw-domain ISP on the mosaic, a third of the data of the same stages after demosaicing
+    if (runRawISP)
+    {
+        RawISP rawISP(cfaPattern);
+        rawISP.setBlackLevel(sensorBlackLevel);
+        rawISP.setWhiteLevel(ImageSensor::fullScaleForBitDepth(bitDepth));
+        rawISP.setAutoWhiteBalance(true);
+        if (!lensShading.empty())
+        {
+            rawISP.setLensShading(lensShading);
+        }
+        rawISP.setDenoise(rawDenoise);
+        sensor.applyRawISP(rawISP);
+    }
 
     // Demosaic the sensor data to produce a full-color image
     cv::Mat output;
-    sensor.demosaic(output, cfaPatternStr);
+    sensor.demosaic(output, cfaPatternStr, Demosaic::parseAlgorithm(demosaicAlgorithm));
+
+    // Denoise at the sensor bit depth
+    if (denoiseAlgorithm != "none")
+    {
+        Denoiser::Parameters denoiseParams;
+        denoiseParams.sigma = denoiseSigma;
+        Denoiser::process(output, output, Denoiser::parseAlgorithm(denoiseAlgorithm), denoiseParams);
+    }
+
+    // Image quality against the scene, in linear sensor units before the ISP
+    if (analyze)
+    {
+        std::vector<cv::Rect> patches;
+        cv::Rect edgeRoi;
+        if (inputFile.empty() && patternType == "color-checker")
+        {
+            patches = SceneGenerator::getColorCheckerPatches(width, height);
+        }
+        else if (inputFile.empty() && patternType == "slanted-edge")
+        {
+            edgeRoi = cv::Rect(0, 0, width, height);
+        }
+        ImageQuality::Report report = ImageQuality::analyze(output, scene, ImageSensor::fullScaleForBitDepth(bitDepth), patches, edgeRoi);
+        std::cout << "Image quality: " << ImageQuality::format(report) << std::endl;
+    }
 
     // Perform ISP operations
-    // output = ISP::autoWhiteBalance(output);
-    // output = ISP::denoise(output);
-    // output = ISP::blackLevelCompensation(output, 64);            // Example black level value
-    // cv::Mat shadingMap = cv::Mat::ones(height, width, CV_64FC1); // Example shading map (needs to be customized)
-    // output = ISP::lensShadingCorrection(output, shadingMap);
+    if (runISP)
+    {
+        isp.process(output, output);
+    }
 
     // Normalize the output image to 8-bit range for display if the bit depth is greater than 8
     cv::Mat output8U;
@@ -95,16 +677,26 @@ int main(int argc, char **argv)
         output.convertTo(output8U, CV_8UC3);
     }
 
-    // Display the original scene and the simulated sensor output
-    cv::imshow("Original Scene", scene);
-    cv::imshow("Simulated Sensor Output", output8U);
-
     // Save the images for further inspection
-    cv::imwrite("scene.png", scene * 255);      // Save the scene image as grayscale
+    if (!scene.empty())
+    {
+        cv::imwrite("scene.png", scene * 255);  // Save the scene image as grayscale
+    }
     cv::imwrite("sensor_output.png", output8U); // Save the simulated output image
+    reportTelemetry();
 
-    // Wait for a key press indefinitely
-    cv::waitKey(0);
+    if (!headless)
+    {
+        // Display the original scene and the simulated sensor output
+        if (!scene.empty())
+        {
+            cv::imshow("Original Scene", scene);
+        }
+        cv::imshow("Simulated Sensor Output", output8U);
+
+        // Wait for a key press indefinitely
+        cv::waitKey(0);
+    }
 
     return 0;
 }
@@ -0,0 +1,370 @@
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include <pybind11/pybind11.h>
+#include <pybind11/numpy.h>
+#include <pybind11/stl.h>
+#include "ImageSensor/ImageSensor.h"
+#include "CFAPattern/CFAPattern.h"
+#include "SceneGenerator/SceneGenerator.h"
+#include "SensorPipeline/SensorPipeline.h"
+#include "ISP/ISP.h"
+#include "ISPPipeline/ISPPipeline.h"
+#include "ThreadPool/ThreadPool.h"
+
+namespace py = pybind11;
+using namespace pybind11::literals;
+
+namespace
+{
+    // Element type of a cv::Mat depth
+    py::dtype dtypeForDepth(int depth)
+    {
+        switch (depth)
+        {
+        case CV_8U:
+            return py::dtype::of<uint8_t>();
+        case CV_16U:
+            return py::dtype::of<uint16_t>();
+        case CV_32F:
+            return py::dtype::of<float>();
+        case CV_64F:
+            return py::dtype::of<double>();
+        default:
+            throw std::invalid_argument("Unsupported matrix depth");
+        }
+    }
+
+    // cv::Mat depth of a NumPy element type
+    int depthForDtype(const py::dtype &dtype)
+    {
+        if (dtype.is(py::dtype::of<uint8_t>()))
+        {
+            return CV_8U;
+        }
+        if (dtype.is(py::dtype::of<uint16_t>()))
+        {
+            return CV_16U;
+        }
+        if (dtype.is(py::dtype::of<float>()))
+        {
+            return CV_32F;
+        }
+        if (dtype.is(py::dtype::of<double>()))
+        {
+            return CV_64F;
+        }
+        throw std::invalid_argument("Arrays must be uint8, uint16, float32 or float64");
+    }
+
+    /**
+     * @brief Wraps a NumPy array as a cv::Mat header over the same memory.
+     * Rows may be strided (slices of a larger array), but the pixels of a row must be
+     * packed; anything else needs np.ascontiguousarray first. The array must outlive the Mat.
+     * @param array (height, width) or (height, width, channels) array.
+     * @return cv::Mat sharing the buffer of the array.
+     */
+    cv::Mat fromArray(const py::array &array)
+    {
+        if (array.ndim() != 2 && array.ndim() != 3)
+        {
+            throw std::invalid_argument("Arrays must have shape (height, width) or (height, width, channels)");
+        }
+        const int depth = depthForDtype(array.dtype());
+        const int channels = (array.ndim() == 3) ? static_cast<int>(array.shape(2)) : 1;
+        if (channels < 1 || channels > 4)
+        {
+            throw std::invalid_argument("Arrays must have 1 to 4 channels");
+        }
+        const py::ssize_t itemSize = array.itemsize();
+        if (array.strides(array.ndim() - 1) != itemSize || (array.ndim() == 3 && array.strides(1) != channels * itemSize) || array.strides(0) <= 0)
+        {
+            throw std::invalid_argument("Array rows must be contiguous; use np.ascontiguousarray");
+        }
+        return cv::Mat(static_cast<int>(array.shape(0)), static_cast<int>(array.shape(1)), CV_MAKETYPE(depth, channels),
+                       const_cast<void *>(array.data()), static_cast<size_t>(array.strides(0)));
+    }
+
+    /**
+     * @brief Exposes a cv::Mat as a NumPy array without copying.
+     * The array holds a reference to the Mat buffer, which stays alive as long as the array.
+     * @param mat Matrix to expose.
+     * @param writeable False for buffers shared with the library (scene cache, sensor state).
+     * @return (rows, cols) or (rows, cols, channels) array over the Mat buffer.
+     */
+    py::array toArray(const cv::Mat &mat, bool writeable = true)
+    {
+        auto *owner = new cv::Mat(mat);
+        py::capsule base(owner, [](void *p)
+        {
+            delete static_cast<cv::Mat *>(p);
+        });
+
+        std::vector<py::ssize_t> shape = {owner->rows, owner->cols};
+        std::vector<py::ssize_t> strides = {static_cast<py::ssize_t>(owner->step[0]), static_cast<py::ssize_t>(owner->elemSize())};
+        if (owner->channels() > 1)
+        {
+            shape.push_back(owner->channels());
+            strides.push_back(static_cast<py::ssize_t>(owner->elemSize1()));
+        }
+        py::array array(dtypeForDepth(owner->depth()), shape, strides, owner->data, base);
+        if (!writeable)
+        {
+            py::detail::array_proxy(array.ptr())->flags &= ~py::detail::npy_api::NPY_ARRAY_WRITEABLE_;
+        }
+        return array;
+    }
+
+    /**
+     * @brief Simulates a stack of scenes in parallel, one frame per task.
+     * Frame i uses seed + i, so the noise of a frame does not depend on the scheduling.
+     * @param scenes (frames, height, width) float32 or float64 array in [0, 1].
+     * @param out (frames, height, width) array of the sensor type receiving the raw frames, or None.
+     * @param precisionName Arithmetic of the simulation (SensorKernels::parsePrecision).
+     * @return The raw frames (out if given).
+     */
+    py::array simulateBatch(const py::array &scenes, int bitDepth, const std::string &cfaPatternStr, double noiseLevel,
+                            const py::object &psfObject, uint64_t seed, int threads, const py::object &outObject,
+                            const std::string &precisionName)
+    {
+        const SensorKernels::Precision precision = SensorKernels::parsePrecision(precisionName);
+        if (scenes.ndim() != 3)
+        {
+            throw std::invalid_argument("Scenes must have shape (frames, height, width)");
+        }
+        const int frames = static_cast<int>(scenes.shape(0));
+        const int height = static_cast<int>(scenes.shape(1));
+        const int width = static_cast<int>(scenes.shape(2));
+        const int cvType = ImageSensor::cvTypeForBitDepth(bitDepth);
+
+        py::array out;
+        if (outObject.is_none())
+        {
+            out = py::array(dtypeForDepth(CV_MAT_DEPTH(cvType)), std::vector<py::ssize_t>{frames, height, width});
+        }
+        else
+        {
+            out = outObject.cast<py::array>();
+            if (out.ndim() != 3 || out.shape(0) != frames || out.shape(1) != height || out.shape(2) != width ||
+                depthForDtype(out.dtype()) != CV_MAT_DEPTH(cvType) || !out.writeable())
+            {
+                throw std::invalid_argument("Output must be a writeable array of the scenes' shape and the sensor type");
+            }
+        }
+
+        // Headers over every frame, built while the GIL is held
+        std::vector<cv::Mat> sceneFrames(frames);
+        std::vector<cv::Mat> outFrames(frames);
+        for (int i = 0; i < frames; ++i)
+        {
+            sceneFrames[i] = fromArray(scenes[py::int_(i)].cast<py::array>());
+            outFrames[i] = fromArray(out[py::int_(i)].cast<py::array>());
+        }
+        // The PSF is prepared once (separability test, FFT plan) and shared read-only by every frame
+        std::shared_ptr<const PSFConvolver> convolver;
+        if (!psfObject.is_none())
+        {
+            auto prepared = std::make_shared<PSFConvolver>();
+            prepared->setPSF(fromArray(psfObject.cast<py::array>()));
+            convolver = std::move(prepared);
+        }
+        auto cfaPattern = std::make_shared<const CFAPattern>(cfaPatternStr, width, height);
+
+        {
+            py::gil_scoped_release release;
+            ThreadPool::OpenCVThreadsGuard threadsGuard;
+            ThreadPool pool(threads);
+            for (int i = 0; i < frames; ++i)
+            {
+                pool.submit([&, i]
+                {
+                    ImageSensor sensor(bitDepth, width, height, precision);
+                    sensor.setSeed(seed + i);
+
+                    SensorPipeline pipeline;
+                    pipeline.setSeed(seed + i);
+                    if (convolver)
+                    {
+                        pipeline.addDiffraction(convolver);
+                    }
+                    pipeline.addNoise(noiseLevel);
+                    pipeline.addCFA(cfaPattern);
+                    sensor.simulate(sceneFrames[i], pipeline);
+
+                    // The one copy: from the sensor buffer into the caller's frame
+                    sensor.getSensorData().copyTo(outFrames[i]);
+                });
+            }
+            pool.wait();
+        }
+        return out;
+    }
+}
+
+PYBIND11_MODULE(camerasim, m)
+{
+    m.doc() = "Camera sensor simulator. Frames are exchanged with NumPy through the buffer protocol "
+              "without copying, and every stage runs with the GIL released.";
+
+    py::class_<CFAPattern>(m, "CFAPattern")
+        .def(py::init<const std::string &, int, int>(), "pattern"_a = CFAPattern::DEFAULT_CFA_PATTERN, "width"_a = 640, "height"_a = 480)
+        .def("update_color_weights", &CFAPattern::updateColorWeights, "weights"_a, "Changes color weights given as strings such as 'R:0.25'")
+        .def_property_readonly("tile_rows", &CFAPattern::getTileRows)
+        .def_property_readonly("tile_cols", &CFAPattern::getTileCols)
+        .def_property_readonly("pattern", [](const CFAPattern &self)
+        {
+            return toArray(self.getPattern(), false);
+        });
+
+    py::class_<NoiseModel::Parameters>(m, "NoiseParameters")
+        .def(py::init<>())
+        .def_readwrite("full_well_capacity", &NoiseModel::Parameters::fullWellCapacity)
+        .def_readwrite("read_noise", &NoiseModel::Parameters::readNoise)
+        .def_readwrite("dark_current", &NoiseModel::Parameters::darkCurrent)
+        .def_readwrite("temperature", &NoiseModel::Parameters::temperature)
+        .def_readwrite("exposure_time", &NoiseModel::Parameters::exposureTime)
+        .def_readwrite("prnu", &NoiseModel::Parameters::prnu)
+        .def_readwrite("dsnu", &NoiseModel::Parameters::dsnu)
+        .def_readwrite("black_level", &NoiseModel::Parameters::blackLevel);
+
+    // Scenes, PSFs and frames stay owned by the caller; only headers over them cross the boundary
+    py::class_<ImageSensor>(m, "ImageSensor")
+        .def(py::init([](int bitDepth, int width, int height, const std::string &precision)
+        {
+            return ImageSensor(bitDepth, width, height, SensorKernels::parsePrecision(precision));
+        }), "bit_depth"_a = ImageSensor::DEFAULT_BIT_DEPTH, "width"_a = ImageSensor::DEFAULT_WIDTH, "height"_a = ImageSensor::DEFAULT_HEIGHT,
+            "precision"_a = "float32", "Arithmetic of every stage: float64 (reference), float32 or fixed (integer bit depths)")
+        .def("precision", [](const ImageSensor &self)
+        {
+            return SensorKernels::precisionName(self.getPrecision());
+        })
+        .def_static("full_scale", &ImageSensor::fullScaleForBitDepth, "bit_depth"_a)
+        .def("set_seed", &ImageSensor::setSeed, "seed"_a)
+        .def("set_noise_model", &ImageSensor::setNoiseModel, "params"_a)
+        .def("capture_light", [](ImageSensor &self, const py::array &scene)
+        {
+            cv::Mat mat = fromArray(scene);
+            py::gil_scoped_release release;
+            self.captureLight(mat);
+        }, "scene"_a, "Captures a single channel float32/float64 scene in [0, 1]")
+        .def("apply_diffraction", [](ImageSensor &self, const py::array &psf)
+        {
+            cv::Mat mat = fromArray(psf);
+            py::gil_scoped_release release;
+            self.applyDiffraction(mat);
+        }, "psf"_a)
+        .def("add_noise", &ImageSensor::addNoise, "noise_level"_a = ImageSensor::DEFAULT_NOISE_LEVEL, py::call_guard<py::gil_scoped_release>())
+        .def("apply_noise_model", &ImageSensor::applyNoiseModel, py::call_guard<py::gil_scoped_release>())
+        .def("apply_cfa", &ImageSensor::applyCFA, "cfa_pattern"_a, py::call_guard<py::gil_scoped_release>())
+        .def("simulate", [](ImageSensor &self, const py::array &scene, const CFAPattern &cfaPattern, double noiseLevel, const py::object &psf, uint64_t seed)
+        {
+            cv::Mat mat = fromArray(scene);
+            SensorPipeline pipeline;
+            pipeline.setSeed(seed);
+            if (!psf.is_none())
+            {
+                pipeline.addDiffraction(fromArray(psf.cast<py::array>()).clone());
+            }
+            pipeline.addNoise(noiseLevel);
+            pipeline.addCFA(cfaPattern);
+            py::gil_scoped_release release;
+            self.simulate(mat, pipeline);
+        }, "scene"_a, "cfa_pattern"_a, "noise_level"_a = ImageSensor::DEFAULT_NOISE_LEVEL, "psf"_a = py::none(), "seed"_a = 0,
+           "Runs diffraction, noise and CFA as one fused pipeline")
+        .def("demosaic", [](ImageSensor &self, const std::string &cfaPattern, const std::string &algorithm)
+        {
+            Demosaic::Algorithm parsed = Demosaic::parseAlgorithm(algorithm);
+            cv::Mat output;
+            {
+                py::gil_scoped_release release;
+                self.demosaic(output, cfaPattern, parsed);
+            }
+            return toArray(output);
+        }, "cfa_pattern"_a, "algorithm"_a = "malvar", "Returns the demosaiced BGR image")
+        .def_property_readonly("sensor_data", [](const ImageSensor &self)
+        {
+            return toArray(self.getSensorData(), false);
+        }, "Read-only view of the raw frame; later stages may update it in place, so copy it to keep it");
+
+    py::class_<ISPPipeline>(m, "ISPPipeline")
+        .def(py::init([](int bitDepth, double whiteLevel)
+        {
+            auto isp = std::make_unique<ISPPipeline>();
+            isp->setWhiteLevel((whiteLevel > 0.0 || bitDepth <= 0) ? whiteLevel : ImageSensor::fullScaleForBitDepth(bitDepth));
+            return isp;
+        }), "bit_depth"_a = 0, "white_level"_a = 0.0, "White level from the sensor bit depth or given directly; one is required for uint16 input")
+        .def("add_black_level", &ISPPipeline::addBlackLevel, "black_level"_a, py::return_value_policy::reference_internal)
+        .def("add_auto_white_balance", &ISPPipeline::addAutoWhiteBalance, py::return_value_policy::reference_internal)
+        .def("add_white_balance", [](ISPPipeline &self, float b, float g, float r) -> ISPPipeline &
+        {
+            return self.addWhiteBalance(cv::Vec3f(b, g, r));
+        }, "b"_a, "g"_a, "r"_a, py::return_value_policy::reference_internal)
+        .def("add_gamma", &ISPPipeline::addGamma, "gamma"_a, py::return_value_policy::reference_internal)
+        .def("add_sharpen", &ISPPipeline::addSharpen, "amount"_a, "sigma"_a, py::return_value_policy::reference_internal)
+        .def("set_white_level", &ISPPipeline::setWhiteLevel, "white_level"_a)
+        .def("process", [](ISPPipeline &self, const py::array &input, const py::object &out)
+        {
+            cv::Mat in = fromArray(input);
+            cv::Mat output = out.is_none() ? cv::Mat() : fromArray(out.cast<py::array>());
+            const uchar *target = output.data;
+            {
+                py::gil_scoped_release release;
+                self.process(in, output);
+            }
+            if (target != nullptr && output.data != target)
+            {
+                throw std::invalid_argument("Output array does not match the size and type of the result");
+            }
+            return out.is_none() ? toArray(output) : out.cast<py::array>();
+        }, "input"_a, "out"_a = py::none(), "Runs every stage; the result is written into out when given");
+
+    py::class_<ISP>(m, "ISP")
+        .def_static("auto_white_balance", [](const py::array &input)
+        {
+            cv::Mat in = fromArray(input);
+            cv::Mat output;
+            {
+                py::gil_scoped_release release;
+                ISP::autoWhiteBalance(in, output);
+            }
+            return toArray(output);
+        }, "input"_a)
+        .def_static("black_level_compensation", [](const py::array &input, double blackLevel)
+        {
+            cv::Mat in = fromArray(input);
+            cv::Mat output;
+            {
+                py::gil_scoped_release release;
+                ISP::blackLevelCompensation(in, output, blackLevel);
+            }
+            return toArray(output);
+        }, "input"_a, "black_level"_a)
+        .def_static("denoise", [](const py::array &input)
+        {
+            cv::Mat in = fromArray(input);
+            cv::Mat output;
+            {
+                py::gil_scoped_release release;
+                ISP::denoise(in, output);
+            }
+            return toArray(output);
+        }, "input"_a);
+
+    m.def("scene_names", &SceneGenerator::getSceneNames);
+    m.def("generate_scene", [](const std::string &name, int width, int height, const py::dtype &dtype)
+    {
+        const int depth = depthForDtype(dtype);
+        cv::Mat scene;
+        {
+            py::gil_scoped_release release;
+            scene = SceneGenerator::generate(name, width, height, depth);
+        }
+        return toArray(scene, false); // Shared with the scene cache
+    }, "name"_a, "width"_a, "height"_a, "dtype"_a = py::dtype::of<float>(), "Renders a generated scene in [0, 1] (read-only, shared with the scene cache)");
+
+    m.def("simulate_batch", &simulateBatch, "scenes"_a, "bit_depth"_a = ImageSensor::DEFAULT_BIT_DEPTH, "cfa_pattern"_a = CFAPattern::DEFAULT_CFA_PATTERN,
+          "noise_level"_a = ImageSensor::DEFAULT_NOISE_LEVEL, "psf"_a = py::none(), "seed"_a = 0, "threads"_a = 0, "out"_a = py::none(),
+          "precision"_a = "float32", "Simulates (frames, height, width) scenes in parallel into raw frames of the sensor type; frame i uses seed + i");
+}
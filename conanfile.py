@@ -6,8 +6,11 @@ class ISPProjectConan(ConanFile):
     name = "ISPProject"
     version = "1.0"
     settings = "os", "compiler", "build_type", "arch"
+    options = {"with_benchmark": [True, False], "with_python": [True, False]}
     generators = "CMakeToolchain", "CMakeDeps"
     default_options = {
+        "with_benchmark": False,  # Google Benchmark for the bench target (BUILD_BENCHMARKS)
+        "with_python": False,  # pybind11 for the camerasim Python module (BUILD_PYTHON)
         "opencv/*:shared": True,
         "opencv/*:with_contrib": True  # Ensure the contrib modules are included
     }
@@ -15,6 +18,10 @@ class ISPProjectConan(ConanFile):
     def requirements(self):
         self.requires("opencv/4.5.5")
         self.requires("cli11/2.2.0")
+        if self.options.with_benchmark:
+            self.requires("benchmark/1.8.3")
+        if self.options.with_python:
+            self.requires("pybind11/2.11.1")
 
     def layout(self):
         cmake_layout(self)
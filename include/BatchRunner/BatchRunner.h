@@ -0,0 +1,170 @@
+#ifndef BATCHRUNNER_H
+#define BATCHRUNNER_H
+
+#include <opencv2/opencv.hpp>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include "CFAPattern/CFAPattern.h"
+#include "ImageQuality/ImageQuality.h"
+#include "PSFConvolver/PSFConvolver.h"
+#include "SceneLoader/SceneLoader.h"
+#include "SensorKernels/SensorKernels.h"
+#include "StageCache/StageCache.h"
+
+/**
+ * @brief Headless parameter sweep over many sensor configurations.
+ *
+ * A sweep spec (YAML or JSON, read with cv::FileStorage) lists values for each axis:
+ *
+ *     width: 640
+ *     height: 480
+ *     seed: 0
+ *     outputDir: sweep
+ *     demosaic: malvar          # empty to skip demosaicing
+ *     psf: gaussian             # gaussian, airy or none
+ *     bitDepths: [8, 12, 16]
+ *     noiseLevels: [0.5, 2.0]
+ *     cfaPatterns: [RGGB, RCCB]
+ *     scenes: [gradient, checkerboard, studio.exr]   # generated scene names or scene files
+ *     rawFormat: sraw           # png (PNG/TIFF) or sraw (RawFile container, bit packed)
+ *     analyze: 1                # measure image quality of every job in-process
+ *     saveImages: 0             # skip writing frames, keep only the manifest
+ *     cacheMegabytes: 1024      # stage cache for capture and diffraction, 0 to disable
+ *     cacheDir: sweep/cache     # spill evicted stage outputs here (empty to drop them)
+ *     spillMegabytes: 4096      # disk capacity of cacheDir
+ *     precision: float32        # float64, float32 or fixed (integer bit depths only)
+ *
+ * The cartesian product of the axes is run as one job per configuration on a
+ * work-stealing thread pool. Scenes, CFA patterns and the PSF convolver (with its
+ * separability test and FFT plan) are built once and shared read-only by all jobs. Scene
+ * files (EXR, HDR, DNG, images or RawFile containers) are decoded by a
+ * SceneLoader::Prefetcher while the jobs of the previous scene run, and
+ * resized to the sweep frame size. Every job writes its raw frame (and demosaiced image) to the
+ * output directory, and a results.yml manifest summarizes the sweep. With analyze set, each
+ * demosaiced image is measured against its scene by ImageQuality (slanted-edge MTF on the
+ * slanted-edge scene, patch SNR on the color checker) and the metrics go to the manifest, so
+ * large sweeps need not save images at all.
+ *
+ * Jobs that share a scene, bit depth and PSF share their capture and diffraction outputs
+ * through a StageCache, so a noise-vs-CFA sweep computes them once per scene and bit depth.
+ */
+class BatchRunner
+{
+public:
+    // Default values
+    static constexpr const char *DEFAULT_OUTPUT_DIR = "sweep";
+    static constexpr const char *MANIFEST_FILE = "results.yml";
+
+    // Sweep axes and settings shared by all jobs
+    struct SweepSpec
+    {
+        int width = 640;
+        int height = 480;
+        uint64_t seed = 0;                        // Same seed for every job, so configurations see the same noise draws
+        std::string outputDir = DEFAULT_OUTPUT_DIR;
+        std::string demosaic = "malvar";          // Demosaicing algorithm, empty to save only raw frames
+        std::string psf = "gaussian";             // gaussian, airy or none
+        double wavelength = 0.55;                 // Airy PSF wavelength (micrometers)
+        double fNumber = 2.8;                     // Airy PSF f-number
+        double pixelPitch = 1.4;                  // Airy PSF pixel pitch (micrometers)
+        int psfSize = 31;                         // Airy PSF kernel side
+        std::vector<int> bitDepths = {16};
+        std::vector<double> noiseLevels = {0.5};
+        std::vector<std::string> cfaPatterns = {CFAPattern::DEFAULT_CFA_PATTERN};
+        std::vector<std::string> scenes = {"gradient"};
+        std::string rawFormat = "png";            // png (PNG, or TIFF for float frames) or sraw (RawFile container)
+        bool analyze = false;                     // Measure image quality of every demosaiced image
+        bool saveImages = true;                   // Write the raw frames and demosaiced images
+        int cacheMegabytes = 1024;                // Memory of the stage cache, 0 to disable it
+        std::string cacheDir;                     // Spill directory of the stage cache, empty to drop evicted entries
+        int spillMegabytes = static_cast<int>(StageCache::DEFAULT_SPILL_BYTES >> 20); // Disk capacity of the spill directory
+        std::string precision = "float32";        // Arithmetic of every job (SensorKernels::parsePrecision)
+    };
+
+    // One point of the sweep
+    struct Job
+    {
+        int index = 0;
+        int bitDepth = 16;
+        double noiseLevel = 0.0;
+        std::string cfaPattern;
+        std::string scene;
+    };
+
+    // Outcome of one job
+    struct Result
+    {
+        Job job;
+        std::string rawFile;          // Raw frame path, empty on failure
+        std::string rgbFile;          // Demosaiced image path, empty if not requested or on failure
+        double mean = 0.0;            // Mean of the raw frame
+        double stddev = 0.0;          // Standard deviation of the raw frame
+        double seconds = 0.0;         // Wall time of the job
+        bool analyzed = false;        // True if quality holds measurements
+        ImageQuality::Report quality; // Image quality of the demosaiced image against the scene
+        std::string error;            // Error message, empty on success
+    };
+
+    /**
+     * @brief Reads a sweep spec; missing keys keep their defaults and scalars count as one-value axes.
+     * @param path YAML or JSON file.
+     * @return Parsed spec.
+     */
+    static SweepSpec loadSpec(const std::string &path);
+
+    /**
+     * @brief Constructor: Builds the shared inputs of a sweep.
+     * @param spec Sweep spec.
+     * @param numThreads Number of worker threads, 0 for one per hardware thread.
+     */
+    explicit BatchRunner(const SweepSpec &spec, int numThreads = 0);
+
+    /**
+     * @brief Expands the spec into the cartesian product of its axes.
+     * @return One job per configuration.
+     */
+    std::vector<Job> expandJobs() const;
+
+    /**
+     * @brief Runs every job, writes the outputs and the manifest.
+     * Jobs that fail are reported in their result instead of stopping the sweep.
+     * @return Results in job order.
+     */
+    std::vector<Result> run();
+
+private:
+    SweepSpec spec;
+    int numThreads;
+    SensorKernels::Precision precision;                                    // Parsed spec.precision
+    std::map<std::string, std::shared_ptr<const cv::Mat>> scenes;          // Shared generated scenes by name
+    std::vector<std::string> sceneFiles;                                   // Scene files, loaded during run()
+    std::map<std::string, std::shared_ptr<const CFAPattern>> cfaPatterns;  // Shared CFA patterns by string
+    std::shared_ptr<const PSFConvolver> convolver;                        // Shared prepared PSF, nullptr for none
+    std::shared_ptr<StageCache> stageCache;                               // Capture and diffraction outputs shared by the jobs, or nullptr
+
+    /**
+     * @brief Loads a scene file at the sweep frame size.
+     * @param loader Opened scene file.
+     * @return Single channel scene of the working depth of the precision.
+     */
+    cv::Mat loadScene(const SceneLoader &loader) const;
+
+    /**
+     * @brief Simulates one configuration and writes its outputs.
+     * @param job Job to run.
+     * @param scene Scene of the job.
+     * @return Result of the job.
+     */
+    Result runJob(const Job &job, const cv::Mat &scene) const;
+
+    /**
+     * @brief Writes the manifest of a finished sweep.
+     * @param results Results in job order.
+     */
+    void writeManifest(const std::vector<Result> &results) const;
+};
+
+#endif // BATCHRUNNER_H
@@ -0,0 +1,103 @@
+#ifndef BOUNDEDQUEUE_H
+#define BOUNDEDQUEUE_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <stdexcept>
+
+/**
+ * @brief Blocking FIFO with a fixed capacity, connecting two pipeline stages.
+ *
+ * push blocks while the queue is full, so a fast producer can run at most capacity
+ * items ahead of its consumer and memory stays bounded. close wakes every waiter:
+ * producers stop, consumers drain what is left and then see the end of the stream.
+ */
+template <typename T>
+class BoundedQueue
+{
+public:
+    /**
+     * @brief Constructor: Creates an empty queue.
+     * @param capacity Maximum number of queued items, must be positive.
+     */
+    explicit BoundedQueue(size_t capacity)
+        : capacity(capacity)
+    {
+        if (capacity == 0)
+        {
+            throw std::invalid_argument("Queue capacity must be positive");
+        }
+    }
+
+    /**
+     * @brief Appends an item, waiting for room if the queue is full.
+     * @param item Item to append.
+     * @return False if the queue was closed and the item was dropped.
+     */
+    bool push(T item)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        notFull.wait(lock, [this]
+        {
+            return closed || items.size() < capacity;
+        });
+        if (closed)
+        {
+            return false;
+        }
+
+        items.push_back(std::move(item));
+        lock.unlock();
+        notEmpty.notify_one();
+        return true;
+    }
+
+    /**
+     * @brief Removes the oldest item, waiting for one if the queue is empty.
+     * @param item Receives the item.
+     * @return False once the queue is closed and drained.
+     */
+    bool pop(T &item)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        notEmpty.wait(lock, [this]
+        {
+            return closed || !items.empty();
+        });
+        if (items.empty())
+        {
+            return false;
+        }
+
+        item = std::move(items.front());
+        items.pop_front();
+        lock.unlock();
+        notFull.notify_one();
+        return true;
+    }
+
+    /**
+     * @brief Ends the stream: pending pushes fail and pops return false once drained.
+     */
+    void close()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            closed = true;
+        }
+        notFull.notify_all();
+        notEmpty.notify_all();
+    }
+
+private:
+    size_t capacity;
+    std::deque<T> items;
+    std::mutex mutex;
+    std::condition_variable notFull;
+    std::condition_variable notEmpty;
+    bool closed = false;
+};
+
+#endif // BOUNDEDQUEUE_H
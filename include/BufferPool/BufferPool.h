@@ -0,0 +1,210 @@
+#ifndef BUFFERPOOL_H
+#define BUFFERPOOL_H
+
+#include <opencv2/opencv.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief Thread-safe pool of reusable frame buffers.
+ *
+ * Released buffers are kept and handed out again for the next request of the same
+ * size and type, so a pipeline running frame after frame stops allocating after the
+ * first frame. The pool keeps at most maxPooledBytes of idle buffers, dropping the
+ * oldest ones beyond that.
+ *
+ * The pool is also a cv::MatAllocator (getAllocator): matrices created with it take
+ * their data from idle blocks of the same byte size and hand it back when their last
+ * reference goes away, so stage outputs created with cv::Mat::create are recycled
+ * without explicit release calls. The cv::UMatData descriptors of those matrices are
+ * recycled too, so a warm pool serves cv::Mat::create without touching the heap.
+ * global() is a process-wide pool that is never destroyed; setDefaultPooling routes
+ * every cv::Mat allocation through it.
+ */
+class BufferPool
+{
+public:
+    // Default values
+    static constexpr size_t DEFAULT_MAX_POOLED_BYTES = size_t(256) << 20;
+
+    /**
+     * @brief Constructor: Creates an empty pool.
+     * @param maxPooledBytes Upper bound on the memory held by idle buffers.
+     */
+    explicit BufferPool(size_t maxPooledBytes = DEFAULT_MAX_POOLED_BYTES);
+
+    /**
+     * @brief Destructor: Frees the idle buffers.
+     * Matrices allocated through getAllocator must be released before the pool.
+     */
+    ~BufferPool();
+
+    BufferPool(const BufferPool &) = delete;
+    BufferPool &operator=(const BufferPool &) = delete;
+
+    /**
+     * @brief Gets the process-wide pool. It is never destroyed, so matrices allocated
+     * through it may outlive any other object.
+     * @return Global pool.
+     */
+    static BufferPool &global();
+
+    /**
+     * @brief Routes every cv::Mat allocation of the process through global(), or restores
+     * the allocator that was the default before.
+     * @param enabled True to pool all allocations.
+     */
+    static void setDefaultPooling(bool enabled);
+
+    /**
+     * @brief Gets a buffer, reusing an idle one of the same size and type if possible.
+     * The contents are undefined.
+     * @param size Buffer size.
+     * @param type OpenCV type.
+     * @return Continuous buffer owned by the caller until released.
+     */
+    cv::Mat acquire(cv::Size size, int type);
+
+    /**
+     * @brief Returns a buffer to the pool and empties the caller's header.
+     * Views into other matrices are not pooled.
+     * @param buffer Buffer obtained from acquire.
+     */
+    void release(cv::Mat &buffer);
+
+    /**
+     * @brief Gets the allocator recycling blocks of this pool.
+     * Assign it to cv::Mat::allocator before create(); the block returns to the pool
+     * when the last matrix sharing it is released.
+     * @return Allocator owned by the pool.
+     */
+    cv::MatAllocator *getAllocator();
+
+    /**
+     * @brief Gets the number of blocks the allocator had to take from the heap.
+     * Stays constant in a steady-state frame loop once the pool is warm.
+     * @return Heap allocations since construction.
+     */
+    uint64_t getHeapAllocations() const;
+
+    /**
+     * @brief Gets the memory held by idle buffers.
+     * @return Bytes held by the pool.
+     */
+    size_t getPooledBytes() const;
+
+    /**
+     * @brief Frees every idle buffer.
+     */
+    void clear();
+
+private:
+    /**
+     * @brief cv::MatAllocator taking data blocks from the pool.
+     */
+    class Allocator : public cv::MatAllocator
+    {
+    public:
+        /**
+         * @brief Constructor: Binds the allocator to its pool.
+         * @param pool Owning pool.
+         */
+        explicit Allocator(BufferPool &pool);
+
+        /**
+         * @brief Allocates matrix data, reusing an idle block of the same size if possible.
+         * @param dims Number of dimensions.
+         * @param sizes Size of every dimension.
+         * @param type OpenCV type.
+         * @param data User data to wrap instead of allocating, or nullptr.
+         * @param step Steps, filled in unless user data with explicit steps is given.
+         * @param flags Access flags (unused).
+         * @param usageFlags Usage flags (unused).
+         * @return Data descriptor owned by this allocator.
+         */
+        cv::UMatData *allocate(int dims, const int *sizes, int type, void *data, size_t *step, cv::AccessFlag flags, cv::UMatUsageFlags usageFlags) const override;
+
+        /**
+         * @brief Prepares existing data for access; host memory needs nothing.
+         * @param data Data descriptor.
+         * @param accessFlags Access flags (unused).
+         * @param usageFlags Usage flags (unused).
+         * @return True if data is valid.
+         */
+        bool allocate(cv::UMatData *data, cv::AccessFlag accessFlags, cv::UMatUsageFlags usageFlags) const override;
+
+        /**
+         * @brief Returns the block and the descriptor to the pool.
+         * @param data Data descriptor.
+         */
+        void deallocate(cv::UMatData *data) const override;
+
+    private:
+        BufferPool &pool;
+    };
+
+    /**
+     * @brief Idle allocator block, stamped with the order it was returned in.
+     */
+    struct IdleBlock
+    {
+        uint64_t age;
+        void *block;
+    };
+
+    size_t maxPooledBytes;
+    size_t pooledBytes = 0;
+    std::vector<cv::Mat> idleBuffers;                                  // Oldest first
+    std::unordered_map<size_t, std::deque<IdleBlock>> idleBlocks;      // Free lists by byte size, oldest first
+    std::vector<void *> idleHeaders;                                   // Storage of destroyed cv::UMatData descriptors
+    uint64_t returnedBlocks = 0;
+    uint64_t heapAllocations = 0;
+    Allocator allocator;
+    mutable std::mutex mutex;
+
+    /**
+     * @brief Takes an idle block of exactly the given size, or allocates one.
+     * @param bytes Block size.
+     * @return Block of at least bytes bytes.
+     */
+    void *takeBlock(size_t bytes);
+
+    /**
+     * @brief Keeps a block for reuse, freeing the oldest idle memory beyond the limit.
+     * @param block Block from takeBlock.
+     * @param bytes Block size.
+     */
+    void returnBlock(void *block, size_t bytes);
+
+    /**
+     * @brief Constructs a descriptor in idle descriptor storage, or in new storage.
+     * @param owner Allocator the descriptor belongs to.
+     * @return Fresh descriptor.
+     */
+    cv::UMatData *takeHeader(const cv::MatAllocator *owner);
+
+    /**
+     * @brief Destroys a descriptor and keeps its storage for reuse.
+     * @param header Descriptor from takeHeader.
+     */
+    void returnHeader(cv::UMatData *header);
+
+    /**
+     * @brief Frees every idle block and descriptor storage. Called with the mutex held.
+     */
+    void freeIdleMemory();
+
+    /**
+     * @brief Drops the oldest idle buffers and blocks until the pool fits its limit.
+     * Called with the mutex held. Dropped buffers are handed to the caller, to be released
+     * once the mutex is unlocked: their data may come from this pool's own allocator.
+     * @param dropped Receives the dropped buffers.
+     */
+    void trim(std::vector<cv::Mat> &dropped);
+};
+
+#endif // BUFFERPOOL_H
@@ -3,7 +3,6 @@
 
 #include <opencv2/opencv.hpp>
 #include <string>
-#include <map>
 #include <vector>
 
 class CFAPattern
@@ -15,21 +14,59 @@ public:
         RED,
         GREEN,
         BLUE,
-        CLEAR
+        CLEAR,
+        YELLOW,
+        CYAN,
+        NUM_COLORS
     };
 
     // Default CFA pattern string
     static constexpr const char *DEFAULT_CFA_PATTERN = "RCCB";
 
-    // Constructor: Initializes the CFA pattern matrix based on the input string and dimensions
+    // Supported tile sizes (square tiles, e.g. 2x2 Bayer, 4x4 Quad-Bayer, 6x6 X-Trans)
+    static constexpr int MIN_TILE_SIZE = 2;
+    static constexpr int MAX_TILE_SIZE = 6;
+
+    /**
+     * @brief Constructor: Initializes the compact CFA tile from the input string.
+     * The pattern string lists the tile row by row and must describe a square tile of
+     * 2x2 up to 6x6 colors (R, G, B, C for clear, Y for yellow, Cy for cyan). The pattern repeats over the frame, so width and height
+     * are only kept for API compatibility and no frame-sized data is allocated.
+     */
     CFAPattern(const std::string &patternString = DEFAULT_CFA_PATTERN, int width = 640, int height = 480);
 
     /**
-     * @brief Gets the CFA pattern matrix.
-     * @return cv::Mat representing the CFA pattern.
+     * @brief Gets the CFA tile.
+     * @return cv::Mat of size tile rows x tile cols (CV_8UC1) holding Color values.
      */
     const cv::Mat &getPattern() const;
 
+    /**
+     * @brief Gets the number of rows of the CFA tile.
+     * @return Tile rows.
+     */
+    int getTileRows() const;
+
+    /**
+     * @brief Gets the number of columns of the CFA tile.
+     * @return Tile columns.
+     */
+    int getTileCols() const;
+
+    /**
+     * @brief Gets the color of a sensor pixel.
+     * @param row Row of the pixel.
+     * @param col Column of the pixel.
+     * @return Color of the filter over that pixel.
+     */
+    Color getColor(int row, int col) const;
+
+    /**
+     * @brief Gets the distinct colors used by the tile.
+     * @return Colors in ascending enum order.
+     */
+    std::vector<Color> getColors() const;
+
     /**
      * @brief Sets the weight for an existing color.
      * @param color The color to set the weight for.
@@ -39,7 +76,7 @@ public:
 
     /**
      * @brief Updates color weights based on a vector of strings.
-     * @param colorWeights Vector of strings in the format "R:0.25" to update color weights.
+     * @param colorWeights Vector of strings in the format "R:0.25" (or "Cy:0.7") to update color weights.
      */
     void updateColorWeights(const std::vector<std::string> &colorWeights);
 
@@ -50,9 +87,76 @@ public:
      */
     double getColorWeight(Color color) const;
 
+    /**
+     * @brief Gets the flat weight table of the tile.
+     * @return Pointer to tile rows x tile cols weights, stored row by row.
+     */
+    const float *getWeightTable() const;
+
+    /**
+     * @brief Expands the weight table to full rows so a row of pixels is one multiply.
+     * @param width Number of columns to expand to.
+     * @param colOffset Global column of the first expanded column.
+     * @return cv::Mat of size tile rows x width (CV_32FC1).
+     */
+    cv::Mat expandWeights(int width, int colOffset = 0) const;
+
+    /**
+     * @brief Multiplies every pixel by the weight of its filter color, in place.
+     * @param data Single channel CV_8U, CV_16U, CV_32F or CV_64F matrix.
+     * @param rowOffset Global row of data's first row, for tiles of a larger frame.
+     * @param colOffset Global column of data's first column, for tiles of a larger frame.
+     */
+    void apply(cv::Mat &data, int rowOffset = 0, int colOffset = 0) const;
+
+    /**
+     * @brief Sets the spectral transmission curve of a filter color.
+     * @param color The color to set the curve for.
+     * @param wavelengths Sample wavelengths in nm, ascending.
+     * @param transmission Transmission at each sample wavelength (0 to 1).
+     */
+    void setSpectralResponse(Color color, const std::vector<double> &wavelengths, const std::vector<double> &transmission);
+
+    /**
+     * @brief Gets the transmission of a filter color at a wavelength.
+     * The curve is interpolated linearly and held constant beyond its end points.
+     * @param color The color of the filter.
+     * @param wavelength Wavelength in nm.
+     * @return Transmission of the filter.
+     */
+    double getTransmission(Color color, double wavelength) const;
+
+    /**
+     * @brief Expands the transmission at one wavelength to full rows, like expandWeights.
+     * @param wavelength Wavelength in nm.
+     * @param width Number of columns to expand to.
+     * @param colOffset Global column of the first expanded column.
+     * @return cv::Mat of size tile rows x width (CV_32FC1).
+     */
+    cv::Mat expandSpectralWeights(double wavelength, int width, int colOffset = 0) const;
+
+    /**
+     * @brief Expands one value per filter color to full rows, like expandWeights.
+     * Lets per-color parameters (black levels, gains) be applied without branching per pixel.
+     * @param values One value per Color, indexed by the Color enum.
+     * @param width Number of columns to expand to.
+     * @param colOffset Global column of the first expanded column.
+     * @return cv::Mat of size tile rows x width (CV_32FC1).
+     */
+    cv::Mat expandColorValues(const std::vector<double> &values, int width, int colOffset = 0) const;
+
 private:
-    cv::Mat cfaPattern;                   // CFA pattern matrix
-    std::map<Color, double> colorWeights; // Map to store default color weights
+    // Sampled spectral transmission of one filter color
+    struct SpectralCurve
+    {
+        std::vector<double> wavelengths; // nm, ascending
+        std::vector<double> values;      // Transmission per wavelength
+    };
+
+    cv::Mat cfaPattern;                        // CFA tile (tile rows x tile cols)
+    std::vector<double> colorWeights;          // Weight per Color
+    std::vector<float> weightTable;            // Weight per tile position, row by row
+    std::vector<SpectralCurve> spectralCurves; // Transmission curve per Color
 
     /**
      * @brief Checks if the given character is a valid CFA pattern character.
@@ -60,6 +164,32 @@ private:
      * @return True if the character is valid, false otherwise.
      */
     bool isValidCFAPatternChar(char ch) const;
+
+    /**
+     * @brief Splits a pattern string into color codes ("Cy" is a single code).
+     * @param patternString The pattern string.
+     * @return One color per tile position.
+     */
+    std::vector<Color> parsePatternString(const std::string &patternString) const;
+
+    /**
+     * @brief Rebuilds the flat weight table after the tile or a color weight changed.
+     */
+    void updateWeightTable();
+
+    /**
+     * @brief Fills in smooth default transmission curves for every color.
+     */
+    void initSpectralCurves();
+
+    /**
+     * @brief Expands a per-tile-position table to full rows.
+     * @param table Tile rows x tile cols values, row by row.
+     * @param width Number of columns to expand to.
+     * @param colOffset Global column of the first expanded column.
+     * @return cv::Mat of size tile rows x width (CV_32FC1).
+     */
+    cv::Mat expandTable(const float *table, int width, int colOffset) const;
 };
 
 #endif // CFAPATTERN_H
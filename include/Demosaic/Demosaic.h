@@ -0,0 +1,74 @@
+#ifndef DEMOSAIC_H
+#define DEMOSAIC_H
+
+#include <opencv2/opencv.hpp>
+#include <string>
+#include "CFAPattern/CFAPattern.h"
+
+/**
+ * @brief Demosaic engine working natively on 8/16-bit and float mosaics.
+ *
+ * Every filter color of the CFA tile is interpolated to full resolution in a float
+ * working type, then the RGB output is solved per pixel from the spectral response
+ * of the filters (clear = R+G+B, yellow = R+G, cyan = G+B), so RCCB, RCCC and RYYCy
+ * produce real color instead of treating clear pixels as green.
+ */
+class Demosaic
+{
+public:
+    // Enumeration for the demosaicing algorithms
+    enum Algorithm
+    {
+        BILINEAR,   // Normalized bilinear interpolation, any tile from 2x2 to 6x6
+        MALVAR,     // Malvar-He-Cutler gradient-corrected interpolation, 2x2 Bayer-like tiles
+        DIRECTIONAL // Edge-directed (Hamilton-Adams) interpolation, 2x2 Bayer-like tiles
+    };
+
+    // Default algorithm
+    static constexpr Algorithm DEFAULT_ALGORITHM = MALVAR;
+
+    /**
+     * @brief Demosaics a single channel mosaic into a 3-channel BGR image.
+     * Algorithms that need a 2x2 tile with one doubled color on a diagonal fall back to
+     * BILINEAR for other layouts.
+     * @param raw Single channel CV_8U, CV_16U, CV_32F or CV_64F mosaic.
+     * @param output cv::Mat receiving the BGR image with the depth of raw.
+     * @param cfaPattern CFAPattern describing the mosaic.
+     * @param algorithm Interpolation algorithm.
+     */
+    static void process(const cv::Mat &raw, cv::Mat &output, const CFAPattern &cfaPattern, Algorithm algorithm = DEFAULT_ALGORITHM);
+
+    /**
+     * @brief Checks whether an algorithm runs on a layout without falling back to BILINEAR.
+     * @param cfaPattern CFAPattern describing the mosaic.
+     * @param algorithm Interpolation algorithm.
+     * @return True if process uses the algorithm as requested.
+     */
+    static bool supports(const CFAPattern &cfaPattern, Algorithm algorithm);
+
+    /**
+     * @brief Gets how far an algorithm reads around each output pixel.
+     * A tile demosaiced with at least this many extra rows and columns on every side
+     * matches the same pixels of the whole frame.
+     * @param cfaPattern CFAPattern describing the mosaic.
+     * @param algorithm Interpolation algorithm.
+     * @return Halo in pixels.
+     */
+    static int getHaloSize(const CFAPattern &cfaPattern, Algorithm algorithm = DEFAULT_ALGORITHM);
+
+    /**
+     * @brief Parses an algorithm name.
+     * @param name One of "bilinear", "malvar" or "directional".
+     * @return The corresponding algorithm.
+     */
+    static Algorithm parseAlgorithm(const std::string &name);
+
+    /**
+     * @brief Gets the RGB response of a filter color.
+     * @param color The filter color.
+     * @return Response to red, green and blue light.
+     */
+    static cv::Vec3d getRGBResponse(CFAPattern::Color color);
+};
+
+#endif // DEMOSAIC_H
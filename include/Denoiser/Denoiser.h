@@ -0,0 +1,127 @@
+#ifndef DENOISER_H
+#define DENOISER_H
+
+#include <opencv2/opencv.hpp>
+#include <string>
+
+/**
+ * @brief Denoising that runs natively on 8/16-bit and float images.
+ *
+ * Every algorithm works in float32 on the original value range and writes the input
+ * depth back, so 16-bit data never goes through an 8-bit round trip. Multi-channel
+ * images are filtered channel by channel. Costs are per megapixel and per channel,
+ * counted in arithmetic operations per pixel, with rough timings for an 8-core x86
+ * desktop running OpenCV's parallel backend:
+ *
+ *   GUIDED     6 box filters + ~10 point ops, ~30 ops/pixel          ~3-5 ms/MP
+ *   BILATERAL  (2r+1)^2 taps with r = 1.5 sigmaSpace, ~60 ops/pixel ~5-10 ms/MP
+ *   WAVELET    per level a 5+5 tap separable pass + shrinkage,
+ *              ~25 ops/pixel/level                                    ~5-10 ms/MP (3 levels)
+ *   NLM        per search offset ~8 whole-tile passes (difference,
+ *              square, integral, 4-tap box, exp, 2 accumulations),
+ *              (2S+1)^2 offsets: ~400 ops/pixel for S = 3            ~40-80 ms/MP (S = 3, patch 3x3)
+ *
+ * NLM grows with the square of the search radius; S = 5 costs about 2.5x S = 3.
+ */
+class Denoiser
+{
+public:
+    // Enumeration for the denoising algorithms
+    enum Algorithm
+    {
+        GUIDED,    // Self-guided filter, edge-preserving, O(1) per pixel in the window size
+        BILATERAL, // Bilateral filter on float data
+        WAVELET,   // Undecimated (a trous) B3-spline wavelet with soft shrinkage
+        NLM        // Tiled non-local means with integral-image patch distances
+    };
+
+    // Default algorithm
+    static constexpr Algorithm DEFAULT_ALGORITHM = GUIDED;
+
+    struct Parameters
+    {
+        double sigma = 0.0;                 // Noise standard deviation in data units, 0 to estimate it from the image
+        double strength = 1.0;              // Multiplier on the filtering strength
+        int guidedRadius = 2;               // Window radius of the guided filter
+        double bilateralSigmaSpace = 1.5;   // Spatial sigma of the bilateral filter (pixels)
+        int waveletLevels = 3;              // Number of wavelet scales
+        int nlmPatchRadius = 1;             // NLM patch radius (1 for 3x3 patches)
+        int nlmSearchRadius = 3;            // NLM search radius S
+        int nlmTileRows = 64;               // Rows per NLM tile; bounds the per-thread scratch memory
+    };
+
+    /**
+     * @brief Denoises an image with default parameters and an estimated noise level.
+     * @param input CV_8U, CV_16U, CV_32F or CV_64F image with any number of channels.
+     * @param output Result, of the same size and type as the input.
+     * @param algorithm Denoising algorithm.
+     */
+    static void process(const cv::Mat &input, cv::Mat &output, Algorithm algorithm = DEFAULT_ALGORITHM);
+
+    /**
+     * @brief Denoises an image. input and output may be the same matrix.
+     * @param input CV_8U, CV_16U, CV_32F or CV_64F image with any number of channels.
+     * @param output Result, of the same size and type as the input.
+     * @param algorithm Denoising algorithm.
+     * @param params Algorithm parameters.
+     */
+    static void process(const cv::Mat &input, cv::Mat &output, Algorithm algorithm, const Parameters &params);
+
+    /**
+     * @brief Estimates the noise standard deviation from the finest diagonal wavelet details.
+     * Uses the median absolute deviation, which ignores edges and texture.
+     * @param image Image of any depth; multi-channel images use their first channel.
+     * @return Noise standard deviation in data units.
+     */
+    static double estimateNoiseSigma(const cv::Mat &image);
+
+    /**
+     * @brief Parses an algorithm name.
+     * @param name One of "guided", "bilateral", "wavelet" or "nlm".
+     * @return The corresponding algorithm.
+     */
+    static Algorithm parseAlgorithm(const std::string &name);
+
+private:
+    /**
+     * @brief Denoises one float channel.
+     * @param src CV_32FC1 channel.
+     * @param dst Output channel (CV_32FC1).
+     * @param algorithm Denoising algorithm.
+     * @param params Algorithm parameters.
+     * @param sigma Noise standard deviation of the channel.
+     */
+    static void processChannel(const cv::Mat &src, cv::Mat &dst, Algorithm algorithm, const Parameters &params, double sigma);
+
+    /**
+     * @brief Self-guided filter: a local linear model of the channel on itself.
+     * @param src CV_32FC1 channel.
+     * @param dst Output channel (CV_32FC1).
+     * @param radius Window radius.
+     * @param sigma Noise standard deviation; its square is the regularization.
+     */
+    static void guided(const cv::Mat &src, cv::Mat &dst, int radius, double sigma);
+
+    /**
+     * @brief A trous B3-spline wavelet shrinkage.
+     * @param src CV_32FC1 channel.
+     * @param dst Output channel (CV_32FC1).
+     * @param levels Number of detail levels.
+     * @param sigma Noise standard deviation.
+     */
+    static void wavelet(const cv::Mat &src, cv::Mat &dst, int levels, double sigma);
+
+    /**
+     * @brief Non-local means over row tiles, with patch distances from integral images.
+     * Each search offset is one set of whole-tile passes instead of a per-pixel patch loop.
+     * @param src CV_32FC1 channel.
+     * @param dst Output channel (CV_32FC1).
+     * @param patchRadius Patch radius P.
+     * @param searchRadius Search radius S.
+     * @param tileRows Rows per tile.
+     * @param sigma Noise standard deviation.
+     */
+    static void nonLocalMeans(const cv::Mat &src, cv::Mat &dst, int patchRadius, int searchRadius, int tileRows, double sigma);
+};
+
+#endif // DENOISER_H
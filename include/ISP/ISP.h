@@ -2,7 +2,13 @@
 #define ISP_H
 
 #include <opencv2/opencv.hpp>
+#include "LensShading/LensShading.h"
 
+/**
+ * @brief Standalone ISP functions.
+ * Each function has a returning form and an output-parameter form; the latter reuses
+ * the output buffer from call to call and may run in place (output == input).
+ */
 class ISP
 {
 public:
@@ -14,12 +20,26 @@ public:
     static cv::Mat autoWhiteBalance(const cv::Mat &input);
 
     /**
-     * @brief Performs denoising on the input image.
+     * @brief Performs gray-world auto white balance into an output buffer.
+     * @param input 3-channel image.
+     * @param output Output image of the input type; may be the input.
+     */
+    static void autoWhiteBalance(const cv::Mat &input, cv::Mat &output);
+
+    /**
+     * @brief Performs denoising on the input image at its native bit depth.
      * @param input Input image in the Bayer domain.
      * @return Denoised image.
      */
     static cv::Mat denoise(const cv::Mat &input);
 
+    /**
+     * @brief Performs denoising at the native bit depth into an output buffer.
+     * @param input Input image.
+     * @param output Output image of the input type; may be the input.
+     */
+    static void denoise(const cv::Mat &input, cv::Mat &output);
+
     /**
      * @brief Performs black level compensation on the input image.
      * @param input Input image in the Bayer domain.
@@ -28,13 +48,29 @@ public:
      */
     static cv::Mat blackLevelCompensation(const cv::Mat &input, double blackLevel);
 
+    /**
+     * @brief Performs black level compensation into an output buffer.
+     * @param input Input image.
+     * @param output Output image of the input type; may be the input.
+     * @param blackLevel Black level value to be subtracted.
+     */
+    static void blackLevelCompensation(const cv::Mat &input, cv::Mat &output, double blackLevel);
+
     /**
      * @brief Performs lens shading correction on the input image.
      * @param input Input image in the Bayer domain.
-     * @param shadingMap Shading map for correction.
+     * @param lensShading Gain grids, interpolated on the fly (see LensShading::fromVignetting and fromFlatField).
      * @return Lens shading corrected image.
      */
-    static cv::Mat lensShadingCorrection(const cv::Mat &input, const cv::Mat &shadingMap);
+    static cv::Mat lensShadingCorrection(const cv::Mat &input, const LensShading &lensShading);
+
+    /**
+     * @brief Performs lens shading correction into an output buffer.
+     * @param input Input image.
+     * @param output Output image of the input type; may be the input.
+     * @param lensShading Gain grids, interpolated on the fly.
+     */
+    static void lensShadingCorrection(const cv::Mat &input, cv::Mat &output, const LensShading &lensShading);
 };
 
 #endif // ISP_H
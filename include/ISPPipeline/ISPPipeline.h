@@ -0,0 +1,209 @@
+#ifndef ISPPIPELINE_H
+#define ISPPIPELINE_H
+
+#include <opencv2/opencv.hpp>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include "BufferPool/BufferPool.h"
+#include "Denoiser/Denoiser.h"
+#include "LensShading/LensShading.h"
+
+/**
+ * @brief Composable ISP for demosaiced (BGR) frames.
+ *
+ * Stages are registered in order and planned into segments: runs of consecutive
+ * point-wise stages (black level, lens shading, white balance, color correction,
+ * gamma, ...) are fused into a single pass where each row is loaded once, goes through
+ * every stage while in cache, and is stored once. Neighborhood stages (bilateral
+ * denoise, sharpen, ...) run on row tiles in parallel; each tile reads the real neighboring
+ * rows of the frame as its overlap. Denoiser stages run on the whole frame. Intermediate frames are float32 buffers taken from
+ * a BufferPool and reused from frame to frame, so memory stays bounded at two working
+ * frames. Point-wise stages see values normalized so the white level is 1.0.
+ */
+class ISPPipeline
+{
+public:
+    // Default values
+    static constexpr int DEFAULT_TILE_ROWS = 64;
+    static constexpr int GAMMA_LUT_SIZE = 4096;
+
+    // Rows sampled for frame statistics (auto white balance): one every STATISTICS_ROW_STRIDE
+    static constexpr int STATISTICS_ROW_STRIDE = 8;
+
+    // Point-wise kernel: count interleaved BGR float pixels of one frame row, processed in place
+    using PointKernel = std::function<void(float *pixels, int count, int row)>;
+
+    // Neighborhood kernel: filters a row tile of a CV_32FC3 frame into a preallocated tile of the same size
+    using RegionKernel = std::function<void(const cv::Mat &src, cv::Mat &dst)>;
+
+    /**
+     * @brief Constructor: Creates an empty pipeline.
+     * @param pool Buffer pool for the working frames, shared with other pipelines if given.
+     */
+    explicit ISPPipeline(std::shared_ptr<BufferPool> pool = nullptr);
+
+    /**
+     * @brief Adds black level subtraction; the remaining range is stretched back to the white level.
+     * @param blackLevel Black level in input digital numbers.
+     * @return Reference to this pipeline for chaining.
+     */
+    ISPPipeline &addBlackLevel(double blackLevel);
+
+    /**
+     * @brief Adds lens shading correction from a single gain grid.
+     * @param gainMap Single channel gain grid of any size (at least 2x2), interpolated on the fly.
+     * @return Reference to this pipeline for chaining.
+     */
+    ISPPipeline &addLensShading(const cv::Mat &gainMap);
+
+    /**
+     * @brief Adds lens shading correction.
+     * @param lensShading Correction with one grid, or one grid per B, G, R channel.
+     * @return Reference to this pipeline for chaining.
+     */
+    ISPPipeline &addLensShading(const LensShading &lensShading);
+
+    /**
+     * @brief Adds fixed white balance gains.
+     * @param gains Gains for the blue, green and red channels.
+     * @return Reference to this pipeline for chaining.
+     */
+    ISPPipeline &addWhiteBalance(const cv::Vec3f &gains);
+
+    /**
+     * @brief Adds gray-world auto white balance, with gains measured on every frame.
+     * @return Reference to this pipeline for chaining.
+     */
+    ISPPipeline &addAutoWhiteBalance();
+
+    /**
+     * @brief Adds a color correction matrix.
+     * @param ccm 3x3 matrix applied to (R, G, B) column vectors.
+     * @return Reference to this pipeline for chaining.
+     */
+    ISPPipeline &addColorCorrection(const cv::Matx33f &ccm);
+
+    /**
+     * @brief Adds gamma encoding through a lookup table; values are clipped to [0, 1].
+     * @param gamma Gamma value (e.g. 2.2 encodes with exponent 1/2.2).
+     * @return Reference to this pipeline for chaining.
+     */
+    ISPPipeline &addGamma(double gamma);
+
+    /**
+     * @brief Adds edge-preserving bilateral denoising.
+     * @param sigmaColor Range sigma in normalized units.
+     * @param sigmaSpace Spatial sigma in pixels.
+     * @return Reference to this pipeline for chaining.
+     */
+    ISPPipeline &addDenoise(double sigmaColor, double sigmaSpace);
+
+    /**
+     * @brief Adds denoising with one of the Denoiser algorithms.
+     * Runs on the whole frame, not on row tiles: the algorithms pad and estimate the
+     * noise on their own input, which would leave seams and vary the strength per tile.
+     * @param algorithm Denoising algorithm.
+     * @param params Algorithm parameters; sigma is in normalized units, 0 to estimate it per frame.
+     * @return Reference to this pipeline for chaining.
+     */
+    ISPPipeline &addDenoise(Denoiser::Algorithm algorithm, const Denoiser::Parameters &params);
+
+    /**
+     * @brief Adds unsharp-mask sharpening.
+     * @param amount Strength of the added detail.
+     * @param sigma Sigma of the Gaussian blur in pixels.
+     * @return Reference to this pipeline for chaining.
+     */
+    ISPPipeline &addSharpen(double amount, double sigma);
+
+    /**
+     * @brief Adds a custom point-wise stage, fused with its point-wise neighbors.
+     * @param name Stage name.
+     * @param kernel Kernel processing one row in place.
+     * @return Reference to this pipeline for chaining.
+     */
+    ISPPipeline &addPointwiseStage(const std::string &name, PointKernel kernel);
+
+    /**
+     * @brief Adds a custom neighborhood stage, run on row tiles in parallel.
+     * @param name Stage name.
+     * @param kernel Kernel filtering one tile; it may read rows outside src through its parent frame.
+     * @return Reference to this pipeline for chaining.
+     */
+    ISPPipeline &addNeighborhoodStage(const std::string &name, RegionKernel kernel);
+
+    /**
+     * @brief Sets the number of rows per tile.
+     * @param rows Tile height in rows, must be positive.
+     */
+    void setTileRows(int rows);
+
+    /**
+     * @brief Sets the input value that maps to 1.0. Required for 16-bit input, whose storage
+     * does not tell the sensor bit depth; 8-bit input defaults to 255 and float input to the
+     * float sensor full scale (ImageSensor::fullScaleForBitDepth).
+     * @param whiteLevel White level in input digital numbers, 0 to derive it from the type.
+     */
+    void setWhiteLevel(double whiteLevel);
+
+    /**
+     * @brief Gets the stage names in order.
+     * @return Stage names.
+     */
+    std::vector<std::string> getStageNames() const;
+
+    /**
+     * @brief Runs every stage on a frame. input and output may be the same matrix.
+     * @param input 3-channel BGR image (CV_8U, CV_16U, CV_32F or CV_64F).
+     * @param output Result, of the same size and type as the input.
+     */
+    void process(const cv::Mat &input, cv::Mat &output);
+
+private:
+    struct Stage
+    {
+        std::string name;
+        bool pointwise = true;
+        bool wholeFrame = false;     // Neighborhood stage given the whole frame instead of row tiles
+        PointKernel pointKernel;
+        RegionKernel regionKernel;
+        std::function<void(cv::Size frameSize, double whiteLevel)> prepare; // Optional per-frame setup before the pass
+        std::function<void(const cv::Vec3d &means)> statistics;             // Optional consumer of the mean BGR at the stage input
+    };
+
+    std::vector<Stage> stages;
+    std::shared_ptr<BufferPool> pool;
+    int tileRows = DEFAULT_TILE_ROWS;
+    double whiteLevel = 0.0;
+
+    /**
+     * @brief Runs a fused run of point-wise stages from src to dst.
+     * @param src Source frame (any depth), values scaled by inScale on load.
+     * @param dst Destination frame (any depth), values scaled by outScale on store.
+     * @param first Index of the first stage of the run.
+     * @param last One past the last stage of the run.
+     * @param inScale Scale applied when loading.
+     * @param outScale Scale applied when storing.
+     */
+    void runPointwise(const cv::Mat &src, cv::Mat &dst, size_t first, size_t last, double inScale, double outScale);
+
+    /**
+     * @brief Adds a neighborhood stage that filters the whole frame in one call.
+     * @param name Stage name.
+     * @param kernel Kernel filtering the frame; it may reallocate its output.
+     * @return Reference to this pipeline for chaining.
+     */
+    ISPPipeline &addWholeFrameStage(const std::string &name, RegionKernel kernel);
+
+    /**
+     * @brief Runs a neighborhood stage over row tiles in parallel, or on the whole frame.
+     * @param stage Stage to run.
+     * @param src Source CV_32FC3 frame.
+     * @param dst Destination CV_32FC3 frame, distinct from src.
+     */
+    void runNeighborhood(const Stage &stage, const cv::Mat &src, cv::Mat &dst) const;
+};
+
+#endif // ISPPIPELINE_H
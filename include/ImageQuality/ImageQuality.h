@@ -0,0 +1,193 @@
+#ifndef IMAGEQUALITY_H
+#define IMAGEQUALITY_H
+
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <vector>
+
+/**
+ * @brief In-process image quality metrics on simulated output.
+ *
+ * Measures the in-memory images directly, so sweeps get numbers instead of files to
+ * post-process: ISO 12233 slanted-edge MTF, per-patch signal-to-noise, PSNR and SSIM
+ * against the ideal scene, CIELAB color error and demosaic artifacts (false color and
+ * zipper). Row loops run through cv::parallel_for_ and the MTF uses cv::dft.
+ *
+ * Images are compared in their own units: pass the peak value (e.g.
+ * ImageSensor::fullScaleForBitDepth) so that a scene value of 1.0 maps to it.
+ */
+class ImageQuality
+{
+public:
+    // Default values
+    static constexpr int DEFAULT_OVERSAMPLING = 4;      // Edge spread function bins per pixel (ISO 12233)
+    static constexpr double DEFAULT_PATCH_MARGIN = 0.2; // Fraction of a patch trimmed on every side before measuring it
+
+    // SSIM constants (Gaussian window of 11 pixels, sigma 1.5)
+    static constexpr int SSIM_WINDOW = 11;
+    static constexpr double SSIM_SIGMA = 1.5;
+    static constexpr double SSIM_K1 = 0.01;
+    static constexpr double SSIM_K2 = 0.03;
+
+    // Slanted-edge spatial frequency response
+    struct MTFResult
+    {
+        double edgeAngle = 0.0;             // Edge angle from the nearest axis in degrees
+        std::vector<double> frequencies;    // Frequencies in cycles per pixel, up to 1
+        std::vector<double> mtf;            // Modulation transfer, 1 at zero frequency
+        double mtf50 = 0.0;                 // Frequency where the MTF falls to 0.5
+        double mtf10 = 0.0;                 // Frequency where the MTF falls to 0.1
+        double mtfNyquist = 0.0;            // MTF at 0.5 cycles per pixel
+    };
+
+    // Noise statistics of one uniform patch
+    struct PatchStats
+    {
+        cv::Rect region;                    // Measured region
+        double mean = 0.0;                  // Mean of the luminance
+        double stddev = 0.0;                // Standard deviation of the luminance
+        double snr = 0.0;                   // mean / stddev
+        double snrDb = 0.0;                 // 20 log10(snr)
+    };
+
+    // Demosaic artifact measures, relative to the peak value
+    struct DemosaicArtifacts
+    {
+        double falseColor = 0.0;            // Mean chroma error on edges of the reference
+        double zipper = 0.0;                // Mean alternating (pixel-to-pixel) luminance error on edges of the reference
+    };
+
+    // Compact summary of one simulated image against its scene
+    struct Report
+    {
+        double psnr = 0.0;                  // dB
+        double ssim = 0.0;                  // Mean structural similarity of the luminance
+        double deltaE = 0.0;                // Mean CIE76 color error
+        double falseColor = 0.0;            // See DemosaicArtifacts
+        double zipper = 0.0;                // See DemosaicArtifacts
+        double mtf50 = 0.0;                 // Slanted-edge MTF50 in cycles per pixel, 0 if not measured
+        double mtfNyquist = 0.0;            // Slanted-edge MTF at Nyquist, 0 if not measured
+        double meanSNRDb = 0.0;             // Mean patch SNR in dB, 0 if no patches were given
+    };
+
+    // Deviation of a reduced-precision simulation from its float64 reference, in data units
+    struct PrecisionError
+    {
+        double maxAbs = 0.0;                // Largest absolute difference
+        double meanAbs = 0.0;               // Mean absolute difference
+        double rmse = 0.0;                  // Root mean square difference
+        double psnr = 0.0;                  // dB, infinite for identical data
+        double mismatched = 0.0;            // Fraction of values that differ
+    };
+
+    /**
+     * @brief Measures the MTF of a slanted edge (ISO 12233 e-SFR).
+     * The edge is located per row by the centroid of the derivative, fitted with a line,
+     * and every pixel is projected onto the edge normal into an oversampled edge spread
+     * function. Its windowed derivative is transformed with cv::dft. Edges closer to
+     * horizontal are measured on the transposed region.
+     * @param image Single channel or BGR image (BGR is reduced to luminance).
+     * @param roi Region containing one edge, or an empty rectangle for the whole image.
+     * @param oversampling Edge spread function bins per pixel.
+     * @return Spatial frequency response.
+     */
+    static MTFResult slantedEdgeMTF(const cv::Mat &image, const cv::Rect &roi = cv::Rect(), int oversampling = DEFAULT_OVERSAMPLING);
+
+    /**
+     * @brief Measures the noise of uniform patches.
+     * @param image Single channel or BGR image (BGR is reduced to luminance).
+     * @param patches Patch regions; each is trimmed by margin on every side.
+     * @param margin Fraction of the patch size trimmed on every side.
+     * @return Statistics per patch, in the order given.
+     */
+    static std::vector<PatchStats> patchStatistics(const cv::Mat &image, const std::vector<cv::Rect> &patches, double margin = DEFAULT_PATCH_MARGIN);
+
+    /**
+     * @brief Computes the peak signal-to-noise ratio.
+     * @param image Image to measure.
+     * @param reference Ideal image of the same size and number of channels.
+     * @param peak Largest possible value.
+     * @return PSNR in dB (infinite for identical images).
+     */
+    static double psnr(const cv::Mat &image, const cv::Mat &reference, double peak);
+
+    /**
+     * @brief Computes the mean structural similarity of the luminance.
+     * @param image Image to measure.
+     * @param reference Ideal image of the same size.
+     * @param peak Largest possible value.
+     * @return Mean SSIM, 1 for identical images.
+     */
+    static double ssim(const cv::Mat &image, const cv::Mat &reference, double peak);
+
+    /**
+     * @brief Computes the mean CIE76 color difference of linear BGR images.
+     * @param image BGR image to measure.
+     * @param reference Ideal BGR image of the same size.
+     * @param peak Value of linear white (1.0 in the reference scene).
+     * @return Mean Delta E*ab.
+     */
+    static double deltaE(const cv::Mat &image, const cv::Mat &reference, double peak);
+
+    /**
+     * @brief Measures false color and zipper artifacts where the reference has edges.
+     * @param image Demosaiced BGR image.
+     * @param reference Ideal BGR image of the same size.
+     * @param peak Largest possible value.
+     * @return Artifact measures relative to peak.
+     */
+    static DemosaicArtifacts demosaicArtifacts(const cv::Mat &image, const cv::Mat &reference, double peak);
+
+    /**
+     * @brief Runs every metric that applies and summarizes them.
+     * The image is first matched to the reference with one gain per channel, so that
+     * exposure, CFA transmission and white balance do not count as errors.
+     * @param image Simulated image, single channel or BGR.
+     * @param scene Ideal scene in [0, 1], single channel or BGR.
+     * @param peak Value a scene intensity of 1.0 maps to in image.
+     * @param patches Uniform patches for the SNR, or empty to skip it.
+     * @param edgeRoi Region with a slanted edge for the MTF, or an empty rectangle to skip it.
+     * @return Summary of the metrics.
+     */
+    static Report analyze(const cv::Mat &image, const cv::Mat &scene, double peak, const std::vector<cv::Rect> &patches = std::vector<cv::Rect>(), const cv::Rect &edgeRoi = cv::Rect());
+
+    /**
+     * @brief Compares a simulation with its float64 reference (same scene, seed and stages).
+     * @param data Raw or processed data of the run to validate.
+     * @param reference Same data from the float64 run, of the same size and channels.
+     * @param peak Largest possible value (the full scale of the sensor).
+     * @return Error statistics.
+     */
+    static PrecisionError precisionError(const cv::Mat &data, const cv::Mat &reference, double peak);
+
+    /**
+     * @brief Writes a report as one line of name=value pairs.
+     * @param report Report to format.
+     * @return Formatted report.
+     */
+    static std::string format(const Report &report);
+
+    /**
+     * @brief Writes precision error statistics as one line of name=value pairs.
+     * @param error Statistics to format.
+     * @return Formatted statistics.
+     */
+    static std::string format(const PrecisionError &error);
+
+private:
+    /**
+     * @brief Converts an image to single channel float luminance.
+     * @param image Single channel or BGR image.
+     * @return CV_32FC1 luminance (Rec. 601 weights for BGR).
+     */
+    static cv::Mat luminance(const cv::Mat &image);
+
+    /**
+     * @brief Converts an image to 3-channel float, replicating single channel images.
+     * @param image Single channel or BGR image.
+     * @return CV_32FC3 image.
+     */
+    static cv::Mat toBGR(const cv::Mat &image);
+};
+
+#endif // IMAGEQUALITY_H
@@ -2,8 +2,20 @@
 #define IMAGESENSOR_H
 
 #include <opencv2/opencv.hpp>
-#include <random>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
 #include "CFAPattern/CFAPattern.h"
+#include "SensorPipeline/SensorPipeline.h"
+#include "NoiseGenerator/NoiseGenerator.h"
+#include "NoiseModel/NoiseModel.h"
+#include "Demosaic/Demosaic.h"
+#include "PSFConvolver/PSFConvolver.h"
+#include "SpectralScene/SpectralScene.h"
+#include "RawISP/RawISP.h"
+#include "SceneLoader/SceneLoader.h"
+#include "SensorKernels/SensorKernels.h"
 
 class ImageSensor
 {
@@ -14,48 +26,200 @@ public:
     static constexpr int DEFAULT_HEIGHT = 480;
     static constexpr double DEFAULT_NOISE_LEVEL = 0.05;
 
-    // Constructor: Initializes the sensor array and random noise generator with specified bit depth and dimensions
-    ImageSensor(int bitDepth = DEFAULT_BIT_DEPTH, int width = DEFAULT_WIDTH, int height = DEFAULT_HEIGHT);
+    // Callback receiving the stage name and the sensor data after that stage ran
+    using DiagnosticsCallback = std::function<void(const std::string &stage, const cv::Mat &data)>;
+
+    // Callback returning the PSF for a band center wavelength in nm
+    using SpectralPSF = std::function<cv::Mat(double wavelength)>;
+
+    // Rows per accumulation strip in captureSpectral; each strip has its own lock
+    static constexpr int SPECTRAL_STRIP_ROWS = 64;
+
+    // Constructor: Initializes the sensor array and random noise generator with specified bit depth and dimensions.
+    // The precision selects the arithmetic of every stage: float64 for reference runs, float32
+    // (the default) or fixed-point integer codes, which needs an integer bit depth.
+    ImageSensor(int bitDepth = DEFAULT_BIT_DEPTH, int width = DEFAULT_WIDTH, int height = DEFAULT_HEIGHT, SensorKernels::Precision precision = SensorKernels::DEFAULT_PRECISION);
+
+    /**
+     * @brief Gets the precision policy chosen at construction.
+     * @return Arithmetic of the simulation working type.
+     */
+    SensorKernels::Precision getPrecision() const;
+
+    /**
+     * @brief Gets the OpenCV type that stores a sensor bit depth.
+     * @param bitDepth Bit depth (8, 10, 12, 14, 16, 32 or 64).
+     * @return Single channel OpenCV type.
+     */
+    static int cvTypeForBitDepth(int bitDepth);
+
+    /**
+     * @brief Gets the value a scene intensity of 1.0 is scaled to for a bit depth.
+     * This is the largest code of the bit depth (e.g. 4095 for a 12-bit sensor stored
+     * in CV_16U), and every stage saturates to it.
+     * @param bitDepth Bit depth of the sensor.
+     * @return Full-scale value: 2^bitDepth - 1 for integer sensors, 65535 for float sensors.
+     */
+    static double fullScaleForBitDepth(int bitDepth);
 
     /**
      * @brief Captures light from a scene into the sensor array.
-     * @param scene cv::Mat representing the scene light intensity (single channel, double type).
+     * @param scene cv::Mat representing the scene light intensity (single channel, float or double type).
      */
     void captureLight(const cv::Mat &scene);
 
+    /**
+     * @brief Captures light from a scene file, streamed into the sensor strip by strip.
+     * Strips are converted in parallel straight into the sensor rows, so no full-frame
+     * float scene is allocated. The sensor takes the size of the scene.
+     * @param loader SceneLoader providing the luminance.
+     */
+    void captureLight(const SceneLoader &loader);
+
+    /**
+     * @brief Captures a multi-wavelength scene through per-band optics and CFA filters.
+     * Bands are rendered, blurred with their own PSF and weighted by the CFA transmission
+     * at their wavelength one at a time, in parallel, and accumulated into a single frame
+     * of the working depth that is quantized once. The CFA is applied here, so applyCFA must not follow.
+     * A spectrally flat scene of intensity 1.0 reads full scale under a clear filter.
+     * @param scene SpectralScene providing the bands.
+     * @param cfaPattern CFAPattern providing the filter layout and transmission curves.
+     * @param psf Callback returning the PSF for each band, or an empty function for no blur.
+     */
+    void captureSpectral(const SpectralScene &scene, const CFAPattern &cfaPattern, const SpectralPSF &psf = SpectralPSF());
+
+    /**
+     * @brief Sets the seed of the noise generator.
+     * The same seed reproduces the same noise regardless of the number of threads.
+     * @param seed Seed value.
+     */
+    void setSeed(uint64_t seed);
+
+    /**
+     * @brief Installs an opt-in diagnostics hook called after every stage.
+     * @param callback Callback to install, or an empty function to disable diagnostics.
+     */
+    void setDiagnosticsCallback(DiagnosticsCallback callback);
+
     /**
      * @brief Adds Gaussian noise to the sensor data.
      * @param noiseLevel Standard deviation of the Gaussian noise to be added.
      */
     void addNoise(double noiseLevel = DEFAULT_NOISE_LEVEL);
 
+    /**
+     * @brief Sets up the physically-based noise model.
+     * The fixed-pattern PRNU/DSNU maps are generated here, once, from the current seed.
+     * @param params Noise model parameters.
+     */
+    void setNoiseModel(const NoiseModel::Parameters &params);
+
+    /**
+     * @brief Gets the physically-based noise model.
+     * @return Shared pointer to the noise model, or nullptr if none has been set.
+     */
+    std::shared_ptr<NoiseModel> getNoiseModel() const;
+
+    /**
+     * @brief Applies shot, read and dark current noise, PRNU/DSNU and ADC quantization.
+     * Requires a noise model set with setNoiseModel.
+     */
+    void applyNoiseModel();
+
     /**
      * @brief Applies a Color Filter Array (CFA) to the sensor data, including the option for clear pixels.
      * @param cfaPattern CFAPattern object defining the CFA pattern.
      */
     void applyCFA(const CFAPattern &cfaPattern);
 
+    /**
+     * @brief Runs raw-domain ISP stages (black level, lens shading, white balance, denoise) on the mosaic.
+     * @param rawISP RawISP object configured for the sensor's CFA pattern.
+     */
+    void applyRawISP(const RawISP &rawISP);
+
     /**
      * @brief Demosaics the sensor data to produce a full-color image.
      * @param output cv::Mat to store the demosaiced image (3 channels, appropriate type based on bit depth).
      * @param cfaPatternStr The CFA pattern string.
+     * @param algorithm Demosaicing algorithm.
      */
-    void demosaic(cv::Mat &output, const std::string &cfaPatternStr);
+    void demosaic(cv::Mat &output, const std::string &cfaPatternStr, Demosaic::Algorithm algorithm = Demosaic::DEFAULT_ALGORITHM);
 
     /**
      * @brief Simulates optical diffraction by applying a point spread function (PSF).
+     * Separable kernels run as row and column passes and large kernels through a cached
+     * FFT plan; passing the same PSF every frame reuses its spectrum.
      * @param psf cv::Mat representing the point spread function.
      */
     void applyDiffraction(const cv::Mat &psf);
 
+    /**
+     * @brief Simulates optical diffraction with a separable PSF given by its factors.
+     * @param rowKernel Kernel applied along rows.
+     * @param colKernel Kernel applied along columns.
+     */
+    void applyDiffraction(const cv::Mat &rowKernel, const cv::Mat &colKernel);
+
+    /**
+     * @brief Simulates one frame by running all pipeline stages fused over tiles.
+     * The scene is scaled once into a working buffer of the precision's depth, every tile
+     * goes through all stages while it is in cache, and the result is quantized to the
+     * sensor type once. Fixed-point sensors quantize after the optics instead, and run the
+     * noise and CFA stages on integer codes.
+     * @param scene cv::Mat representing the scene light intensity (single channel).
+     * @param pipeline SensorPipeline declaring the stages to run.
+     */
+    void simulate(const cv::Mat &scene, const SensorPipeline &pipeline);
+
+    /**
+     * @brief Gets the raw sensor data.
+     * @return cv::Mat holding the sensor readout (single channel, type based on bit depth).
+     */
+    const cv::Mat &getSensorData() const;
+
 private:
     cv::Mat sensor;                                // Sensor data array
-    std::default_random_engine generator;          // Random number generator for noise
-    std::normal_distribution<double> distribution; // Gaussian distribution for noise
+    NoiseGenerator noiseGenerator;                 // Counter-based random number generator for noise
+    uint64_t noiseStream = 0;                      // Noise stream id, advanced on every noise call
+    std::shared_ptr<NoiseModel> noiseModel;        // Physically-based noise model with cached fixed-pattern maps
+    PSFConvolver psfConvolver;                     // Diffraction convolution with cached FFT plan
+    DiagnosticsCallback diagnostics;               // Optional hook for inspecting intermediate data
     int bitDepth;                                  // Bit depth of the sensor
     int cvType;                                    // OpenCV type corresponding to the bit depth
+    SensorKernels::Precision precision;            // Arithmetic of the working buffers and kernels
+    int workingDepth;                              // Depth of the float working buffers (CV_32F or CV_64F)
+    SensorKernels::Table kernels;                  // Row kernels specialised for cvType and the precision, resolved once
     int width;                                     // Width of the sensor
     int height;                                    // Height of the sensor
+    cv::Mat signal;                                // Working buffer reused by the fused pipeline
+    cv::Mat convolved;                             // Working buffer reused by applyDiffraction
+    uint64_t frameIndex = 0;                       // Number of frames simulated by the fused pipeline
+
+    /**
+     * @brief Gets the value a scene intensity of 1.0 is scaled to.
+     * @return Full-scale value for the sensor bit depth.
+     */
+    double getFullScale() const;
+
+    /**
+     * @brief Passes the sensor data to the diagnostics hook, if one is installed.
+     * @param stage Name of the stage that just ran.
+     */
+    void reportDiagnostics(const std::string &stage) const;
+
+    /**
+     * @brief Convolves the sensor data with the PSF set in psfConvolver.
+     */
+    void convolveSensor();
+
+    /**
+     * @brief Scales float or double rows and quantizes them into sensor rows.
+     * @param input Single channel CV_32F or CV_64F data.
+     * @param output Sensor rows of the same size, already allocated with cvType.
+     * @param scale Factor applied before quantization.
+     */
+    void quantizeRows(const cv::Mat &input, cv::Mat &output, double scale) const;
 };
 
 #endif // IMAGESENSOR_H
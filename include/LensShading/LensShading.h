@@ -0,0 +1,148 @@
+#ifndef LENSSHADING_H
+#define LENSSHADING_H
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+#include "CFAPattern/CFAPattern.h"
+
+/**
+ * @brief Lens shading correction driven by small per-channel gain grids.
+ *
+ * Gains are stored the way ISPs store them, as a low-resolution grid per channel
+ * (e.g. 17x13 nodes) whose corner nodes sit on the corner pixels of the frame. They are
+ * interpolated bilinearly on the fly, one row at a time, into a gain row that is
+ * multiplied into the image, so no full-resolution map is ever allocated.
+ */
+class LensShading
+{
+public:
+    // Default values
+    static constexpr int DEFAULT_GRID_COLS = 17;
+    static constexpr int DEFAULT_GRID_ROWS = 13;
+
+    /**
+     * @brief Constructor: Creates a correction with no channels (no correction).
+     */
+    LensShading() = default;
+
+    /**
+     * @brief Constructor: Creates a correction with a number of channels, all without a grid.
+     * @param numChannels Number of channels.
+     */
+    explicit LensShading(int numChannels);
+
+    /**
+     * @brief Constructor: Creates a correction with one grid applied to every channel.
+     * @param grid Single channel gain grid, at least 2x2.
+     */
+    explicit LensShading(const cv::Mat &grid);
+
+    /**
+     * @brief Sets the gain grid of one channel.
+     * @param channel Channel index.
+     * @param grid Single channel gain grid, at least 2x2, or an empty matrix for no correction.
+     */
+    void setGrid(int channel, const cv::Mat &grid);
+
+    /**
+     * @brief Gets the gain grid of one channel.
+     * @param channel Channel index.
+     * @return CV_32FC1 grid, empty if the channel is not corrected.
+     */
+    const cv::Mat &getGrid(int channel) const;
+
+    /**
+     * @brief Gets the number of channels.
+     * @return Number of channels; a single channel applies to every image channel.
+     */
+    int getNumChannels() const;
+
+    /**
+     * @brief Checks whether any channel has a grid.
+     * @return True if applying the correction would change nothing.
+     */
+    bool empty() const;
+
+    /**
+     * @brief Gets the correction with every gain inverted, e.g. to simulate the shading itself.
+     * @return LensShading whose grids hold 1 / gain.
+     */
+    LensShading inverted() const;
+
+    /**
+     * @brief Interpolates one channel's grid along a frame row.
+     * Only the columns colStart, colStart + colStep, ... are written, so the gains of
+     * several CFA colors can be interleaved into one row.
+     * @param channel Channel index.
+     * @param row Frame row.
+     * @param frameSize Size of the frame the grid spans.
+     * @param gains Output row of frameSize.width gains.
+     * @param colStart First column written.
+     * @param colStep Column step.
+     */
+    void gainRow(int channel, int row, cv::Size frameSize, float *gains, int colStart = 0, int colStep = 1) const;
+
+    /**
+     * @brief Multiplies one interleaved float row by the interpolated gains.
+     * @param pixels Row of frameSize.width pixels with the given number of channels.
+     * @param channels Number of interleaved channels.
+     * @param row Frame row.
+     * @param frameSize Size of the frame.
+     */
+    void applyRow(float *pixels, int channels, int row, cv::Size frameSize) const;
+
+    /**
+     * @brief Applies the correction in place, row-parallel.
+     * @param image Image of any depth with one channel or as many channels as there are grids.
+     */
+    void apply(cv::Mat &image) const;
+
+    /**
+     * @brief Builds the correction of natural (cos^4) vignetting.
+     * Relative illumination falls off as 1 / (1 + k r^2)^2 with r the distance to the
+     * center normalized to the half diagonal; k is chosen to hit the given corner value.
+     * @param frameSize Size of the frame.
+     * @param cornerIllumination Relative illumination at the corners, in (0, 1].
+     * @param gridCols Number of grid columns.
+     * @param gridRows Number of grid rows.
+     * @return Single channel correction.
+     */
+    static LensShading fromVignetting(cv::Size frameSize, double cornerIllumination, int gridCols = DEFAULT_GRID_COLS, int gridRows = DEFAULT_GRID_ROWS);
+
+    /**
+     * @brief Fits the correction to a captured flat-field frame.
+     * Every node averages the pixels of its grid cell; gains bring each node up to the brightest one.
+     * @param flat Flat-field frame of any depth, one grid is fitted per channel.
+     * @param blackLevel Black level subtracted before fitting, in digital numbers.
+     * @param gridCols Number of grid columns.
+     * @param gridRows Number of grid rows.
+     * @return Correction with one grid per channel of the frame.
+     */
+    static LensShading fromFlatField(const cv::Mat &flat, double blackLevel = 0.0, int gridCols = DEFAULT_GRID_COLS, int gridRows = DEFAULT_GRID_ROWS);
+
+    /**
+     * @brief Fits per-color corrections to a raw flat-field mosaic.
+     * @param raw Single channel flat-field mosaic.
+     * @param cfaPattern CFAPattern of the mosaic.
+     * @param blackLevel Black level subtracted before fitting, in digital numbers.
+     * @param gridCols Number of grid columns.
+     * @param gridRows Number of grid rows.
+     * @return Correction with one channel per Color, empty for colors the tile does not use.
+     */
+    static LensShading fromFlatField(const cv::Mat &raw, const CFAPattern &cfaPattern, double blackLevel = 0.0, int gridCols = DEFAULT_GRID_COLS, int gridRows = DEFAULT_GRID_ROWS);
+
+private:
+    std::vector<cv::Mat> grids; // Per channel (CV_32FC1), empty for no correction
+
+    /**
+     * @brief Averages a value image over the cell of every grid node.
+     * @param values CV_32FC1 values.
+     * @param weights CV_32FC1 weight per pixel (1 where the pixel counts), or empty for all pixels.
+     * @param gridCols Number of grid columns.
+     * @param gridRows Number of grid rows.
+     * @return Gain grid bringing every node to the brightest one.
+     */
+    static cv::Mat fitGrid(const cv::Mat &values, const cv::Mat &weights, int gridCols, int gridRows);
+};
+
+#endif // LENSSHADING_H
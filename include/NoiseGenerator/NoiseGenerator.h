@@ -0,0 +1,82 @@
+#ifndef NOISEGENERATOR_H
+#define NOISEGENERATOR_H
+
+#include <opencv2/opencv.hpp>
+#include <cstdint>
+
+/**
+ * @brief Counter-based Gaussian noise generator.
+ *
+ * Samples come from a Philox4x32-10 generator whose counter is the pixel position
+ * (column block, row) and a caller supplied stream id (e.g. the frame index), so
+ * every sample is a pure function of (seed, stream, row, column). Rows are split
+ * across threads and filled in batches of Philox blocks that the compiler can
+ * vectorize; the output for a given seed is identical for any number of threads
+ * and any tiling of the frame. Streams from 2^62 up are reserved for NoiseModel, which
+ * shares the generator's seed, so caller streams stay below that.
+ */
+class NoiseGenerator
+{
+public:
+    // Default values
+    static constexpr uint64_t DEFAULT_SEED = 0;
+
+    // Constructor: Initializes the generator key from the seed
+    explicit NoiseGenerator(uint64_t seed = DEFAULT_SEED);
+
+    /**
+     * @brief Sets the seed (Philox key).
+     * @param seed Seed value.
+     */
+    void setSeed(uint64_t seed);
+
+    /**
+     * @brief Gets the seed (Philox key).
+     * @return Seed value.
+     */
+    uint64_t getSeed() const;
+
+    /**
+     * @brief Fills a matrix with standard normal samples.
+     * @param output Preallocated single channel CV_32F or CV_64F matrix.
+     * @param stream Stream id separating independent draws (e.g. frame index).
+     * @param rowOffset Global row of output's first row, for tiles of a larger frame.
+     * @param colOffset Global column of output's first column, for tiles of a larger frame.
+     */
+    void fillGaussian(cv::Mat &output, uint64_t stream, int rowOffset = 0, int colOffset = 0) const;
+
+    /**
+     * @brief Adds zero-mean Gaussian noise in place, saturating to the matrix type.
+     * @param data Single channel CV_8U, CV_16U, CV_32F or CV_64F matrix.
+     * @param sigma Standard deviation of the noise.
+     * @param stream Stream id separating independent draws (e.g. frame index).
+     * @param rowOffset Global row of data's first row, for tiles of a larger frame.
+     * @param colOffset Global column of data's first column, for tiles of a larger frame.
+     */
+    void addGaussian(cv::Mat &data, double sigma, uint64_t stream, int rowOffset = 0, int colOffset = 0) const;
+
+    /**
+     * @brief Generates standard normal samples for a run of pixels of one row.
+     * @param stream Stream id separating independent draws.
+     * @param row Global row index.
+     * @param colStart Global column of the first sample.
+     * @param count Number of samples to generate.
+     * @param output Destination for count samples.
+     */
+    void gaussianRow(uint64_t stream, int row, int colStart, int count, float *output) const;
+
+    /**
+     * @brief Generates uniform samples in (0, 1) for a run of pixels of one row.
+     * @param stream Stream id separating independent draws.
+     * @param row Global row index.
+     * @param colStart Global column of the first sample.
+     * @param count Number of samples to generate.
+     * @param output Destination for count samples.
+     */
+    void uniformRow(uint64_t stream, int row, int colStart, int count, float *output) const;
+
+private:
+    uint32_t key[2]; // Philox key derived from the seed
+};
+
+#endif // NOISEGENERATOR_H
@@ -0,0 +1,121 @@
+#ifndef NOISEMODEL_H
+#define NOISEMODEL_H
+
+#include <opencv2/opencv.hpp>
+#include <cstdint>
+#include "NoiseGenerator/NoiseGenerator.h"
+
+/**
+ * @brief Physically-based sensor noise model.
+ *
+ * Converts the captured light to electrons and applies, per pixel:
+ * PRNU gain, DSNU offset, dark current, Poisson shot noise, Gaussian read noise
+ * and ADC quantization to the sensor bit depth. The fixed-pattern PRNU/DSNU maps
+ * are generated once per instance and folded together with the electron scale, so
+ * the per-frame work is one fused multiply-add plus sampling.
+ */
+class NoiseModel
+{
+public:
+    // Default values
+    static constexpr uint64_t DEFAULT_SEED = 0;
+
+    // Mean above which Poisson shot noise is approximated by a Gaussian
+    static constexpr float POISSON_GAUSSIAN_THRESHOLD = 20.0f;
+
+    struct Parameters
+    {
+        double fullWellCapacity = 10000.0;             // Electrons at full scale
+        double readNoise = 2.0;                        // Read noise (electrons RMS)
+        double darkCurrent = 1.0;                      // Dark current at the reference temperature (electrons/s)
+        double darkCurrentReferenceTemperature = 25.0; // Temperature the dark current is specified at (degrees C)
+        double darkCurrentDoublingTemperature = 6.5;   // Temperature increase that doubles the dark current (degrees C)
+        double temperature = 25.0;                     // Sensor temperature (degrees C)
+        double exposureTime = 0.01;                    // Exposure time (s)
+        double prnu = 0.01;                            // Photo response non-uniformity (relative gain RMS)
+        double dsnu = 0.5;                             // Dark signal non-uniformity (electrons RMS)
+        double blackLevel = 0.0;                       // ADC offset (digital numbers)
+    };
+
+    /**
+     * @brief Constructor: Generates and caches the fixed-pattern noise maps.
+     * @param params Noise model parameters.
+     * @param width Width of the sensor.
+     * @param height Height of the sensor.
+     * @param bitDepth Bit depth of the sensor (8, 10, 12, 14, 16, 32 or 64).
+     * @param seed Seed for the fixed-pattern maps and the temporal noise.
+     * @param cacheFixedPattern True to keep full-frame PRNU/DSNU maps, false to regenerate
+     *                          the same values per row when applied (no frame-sized memory).
+     */
+    NoiseModel(const Parameters &params, int width, int height, int bitDepth, uint64_t seed = DEFAULT_SEED, bool cacheFixedPattern = true);
+
+    /**
+     * @brief Applies the noise model in place.
+     * @param data Single channel CV_8U, CV_16U, CV_32F or CV_64F matrix holding the captured light,
+     *             where fullScale corresponds to the full well capacity.
+     * @param fullScale Value of a full-well pixel in data.
+     * @param stream Stream id of the temporal noise (e.g. frame index).
+     * @param rowOffset Global row of data's first row, for tiles of a larger frame.
+     * @param colOffset Global column of data's first column, for tiles of a larger frame.
+     */
+    void apply(cv::Mat &data, double fullScale, uint64_t stream, int rowOffset = 0, int colOffset = 0) const;
+
+    /**
+     * @brief Sets the exposure time without regenerating the fixed-pattern maps.
+     * @param seconds Exposure time in seconds.
+     */
+    void setExposureTime(double seconds);
+
+    /**
+     * @brief Sets the sensor temperature without regenerating the fixed-pattern maps.
+     * @param celsius Temperature in degrees Celsius.
+     */
+    void setTemperature(double celsius);
+
+    /**
+     * @brief Gets the noise model parameters.
+     * @return Parameters in use.
+     */
+    const Parameters &getParameters() const;
+
+    /**
+     * @brief Gets the mean dark signal for the current exposure and temperature.
+     * @return Dark signal in electrons.
+     */
+    double getDarkElectrons() const;
+
+    /**
+     * @brief Gets the cached PRNU gain map.
+     * @return CV_32FC1 map of relative pixel gains, empty if the fixed pattern is not cached.
+     */
+    const cv::Mat &getPRNUMap() const;
+
+    /**
+     * @brief Gets the cached DSNU offset map.
+     * @return CV_32FC1 map of pixel offsets in electrons, empty if the fixed pattern is not cached.
+     */
+    const cv::Mat &getDSNUMap() const;
+
+private:
+    Parameters params;
+    int bitDepth;
+    int width;
+    int height;
+    NoiseGenerator generator; // Temporal noise generator
+    cv::Mat prnuMap;          // Relative gain per pixel, empty if not cached
+    cv::Mat dsnuMap;          // Offset per pixel in electrons, empty if not cached
+
+    /**
+     * @brief Applies the model to a run of pixels of one row.
+     * @param values Captured light in data units, replaced by the quantized readout.
+     * @param count Number of samples.
+     * @param row Global row index.
+     * @param colStart Global column of the first sample.
+     * @param fullScale Value of a full-well pixel in data.
+     * @param stream Stream id of the temporal noise.
+     * @param scratch Buffer of at least 5 * count floats.
+     */
+    void applyRow(float *values, int count, int row, int colStart, double fullScale, uint64_t stream, float *scratch) const;
+};
+
+#endif // NOISEMODEL_H
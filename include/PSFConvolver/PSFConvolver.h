@@ -0,0 +1,146 @@
+#ifndef PSFCONVOLVER_H
+#define PSFCONVOLVER_H
+
+#include <opencv2/opencv.hpp>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/**
+ * @brief Convolution with a point spread function, choosing the cheapest exact method.
+ *
+ * Rank-1 (separable) kernels run as a row pass and a column pass, large kernels go
+ * through an FFT whose PSF spectrum is cached for the frame size and reused across
+ * frames, and small non-separable kernels use direct filtering. All methods match
+ * cv::filter2D with BORDER_REFLECT_101 on the same input.
+ *
+ * Once the PSF is set, apply() is const and safe to call from many threads, so one
+ * prepared convolver can be shared read-only (e.g. by every job of a sweep): the FFT
+ * plans are guarded by a lock and the FFT workspaces are per thread.
+ */
+class PSFConvolver
+{
+public:
+    // Enumeration for the convolution methods
+    enum Method
+    {
+        AUTO,      // Pick the method from the kernel
+        DIRECT,    // cv::filter2D
+        SEPARABLE, // Row and column passes
+        FFT        // Frequency domain with a cached PSF spectrum
+    };
+
+    // Kernel side from which non-separable kernels use the FFT
+    static constexpr int FFT_KERNEL_SIZE = 17;
+
+    // Relative size of the second singular value below which a kernel counts as separable
+    static constexpr double SEPARABILITY_TOLERANCE = 1e-6;
+
+    // FFT plans (frame sizes and depths) kept per PSF
+    static constexpr size_t MAX_FFT_PLANS = 4;
+
+    /**
+     * @brief Sets the point spread function.
+     * Setting a PSF identical to the current one keeps the cached FFT spectrum.
+     * @param psf cv::Mat representing the point spread function.
+     * @param method Convolution method, AUTO to detect separability and size.
+     */
+    void setPSF(const cv::Mat &psf, Method method = AUTO);
+
+    /**
+     * @brief Sets a separable point spread function given by its factors.
+     * @param rowKernel Kernel applied along rows (1 x n or n x 1).
+     * @param colKernel Kernel applied along columns (1 x m or m x 1).
+     */
+    void setSeparablePSF(const cv::Mat &rowKernel, const cv::Mat &colKernel);
+
+    /**
+     * @brief Gets the method used for the current PSF.
+     * @return Resolved convolution method (never AUTO).
+     */
+    Method getMethod() const;
+
+    /**
+     * @brief Gets the size of the current PSF.
+     * @return Kernel size.
+     */
+    cv::Size getKernelSize() const;
+
+    /**
+     * @brief Gets the current PSF.
+     * @return Full kernel (CV_32F), empty if none has been set.
+     */
+    const cv::Mat &getPSF() const;
+
+    /**
+     * @brief Convolves a single channel float image with the PSF.
+     * For DIRECT and SEPARABLE, src may be a row range of a larger frame; the rows
+     * around it are used as halo.
+     * FFT convolution runs at the output depth.
+     * @param src Single channel CV_32F or CV_64F image.
+     * @param dst Output image of depth ddepth.
+     * @param ddepth Output depth, CV_32F or CV_64F.
+     */
+    void apply(const cv::Mat &src, cv::Mat &dst, int ddepth = CV_32F) const;
+
+    /**
+     * @brief Splits a kernel into row and column factors if it has rank 1.
+     * @param psf Kernel to decompose.
+     * @param rowKernel Receives the row factor (1 x n, CV_32F).
+     * @param colKernel Receives the column factor (m x 1, CV_32F).
+     * @param tolerance Relative size of the second singular value treated as zero.
+     * @return True if the kernel is separable.
+     */
+    static bool decomposeSeparable(const cv::Mat &psf, cv::Mat &rowKernel, cv::Mat &colKernel, double tolerance = SEPARABILITY_TOLERANCE);
+
+    /**
+     * @brief Generates the Airy diffraction pattern of a circular aperture.
+     * @param wavelength Wavelength of the light in micrometers.
+     * @param fNumber F-number of the lens.
+     * @param pixelPitch Pixel pitch in micrometers.
+     * @param size Side of the square kernel in pixels (odd).
+     * @return Normalized CV_64F kernel.
+     */
+    static cv::Mat airyPSF(double wavelength, double fNumber, double pixelPitch, int size);
+
+private:
+    cv::Mat psf;         // Full kernel (CV_32F)
+    cv::Mat rowKernel;   // Row factor for SEPARABLE
+    cv::Mat colKernel;   // Column factor for SEPARABLE
+    Method method = DIRECT;
+
+    // FFT plan for one frame size and depth: canvas size and the PSF spectrum at that size
+    struct FFTPlan
+    {
+        cv::Size frameSize;
+        int depth = CV_32F;  // Depth of the transforms, CV_32F or CV_64F
+        cv::Size canvasSize;
+        cv::Mat spectrum;    // Read-only once published
+    };
+
+    // Plans of the current PSF, most recent last; shared by copies of the convolver
+    struct PlanCache
+    {
+        std::mutex mutex;
+        std::vector<FFTPlan> plans;
+    };
+
+    std::shared_ptr<PlanCache> fftPlans = std::make_shared<PlanCache>();
+
+    /**
+     * @brief Gets the FFT plan for a frame size and depth, computing the PSF spectrum unless it is cached.
+     * @param frameSize Size of the frames to convolve.
+     * @param depth Depth of the transforms, CV_32F or CV_64F.
+     * @return Plan sharing the cached spectrum.
+     */
+    FFTPlan prepareFFT(const cv::Size &frameSize, int depth) const;
+
+    /**
+     * @brief Convolves a whole frame in the frequency domain, with per-thread workspaces.
+     * @param src Single channel CV_32F or CV_64F image.
+     * @param dst Output image of the depth of src.
+     */
+    void applyFFT(const cv::Mat &src, cv::Mat &dst) const;
+};
+
+#endif // PSFCONVOLVER_H
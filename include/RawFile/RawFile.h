@@ -0,0 +1,261 @@
+#ifndef RAWFILE_H
+#define RAWFILE_H
+
+#include <opencv2/opencv.hpp>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "NoiseModel/NoiseModel.h"
+
+/**
+ * @brief Raw frame container for captured and intermediate sensor data.
+ *
+ * A file is a fixed HEADER_BYTES header followed by frames of equal size. The header
+ * records the frame size, sensor bit depth, CFA tile, black level, noise settings and
+ * RNG seed. Samples are stored at packedBits per sample: 10, 12 and 14 bits are bit
+ * packed LSB first with every row starting on a byte, 8 and 16 bits are stored as is,
+ * and 32 means float samples. Frames start on FRAME_ALIGNMENT byte boundaries. All
+ * values are little-endian.
+ *
+ * Writer appends frames, whole or in bands of rows, with sequential buffered writes. Reader memory-maps the file:
+ * frames stored with 8, 16 or 32 bits are returned as zero-copy cv::Mat views, and
+ * packed frames are unpacked row-parallel.
+ */
+class RawFile
+{
+public:
+    // Format constants
+    static constexpr char MAGIC[4] = {'S', 'R', 'A', 'W'};
+    static constexpr uint32_t VERSION = 1;
+    static constexpr size_t HEADER_BYTES = 4096;
+    static constexpr size_t FRAME_ALIGNMENT = 64;
+    static constexpr size_t MAX_CFA_PATTERN_LENGTH = 63;
+
+    // Default values
+    static constexpr size_t DEFAULT_WRITE_BUFFER_BYTES = 8u << 20;
+
+    struct Header
+    {
+        int width = 0;                      // Frame width in pixels
+        int height = 0;                     // Frame height in pixels
+        int bitDepth = 16;                  // Sensor bit depth
+        int packedBits = 16;                // Bits per stored sample (8 to 16), or 32 for float samples
+        std::string cfaPattern;             // CFA tile string (e.g. "RGGB"), empty for none
+        double blackLevel = 0.0;            // Black level in stored digital numbers
+        bool physicalNoise = false;         // True if noise came from the physically-based model
+        double noiseLevel = 0.0;            // Gaussian noise level when physicalNoise is false
+        NoiseModel::Parameters noise;       // Noise model parameters when physicalNoise is true
+        uint64_t seed = 0;                  // RNG seed of the simulation
+        uint64_t frameCount = 0;            // Number of frames, filled in by the writer
+    };
+
+    /**
+     * @brief Appends frames to a new file with sequential buffered writes.
+     */
+    class Writer
+    {
+    public:
+        /**
+         * @brief Constructor: Creates the file and writes a provisional header.
+         * @param path Output path.
+         * @param header Frame description; frameCount is ignored.
+         * @param bufferBytes Size of the write buffer.
+         */
+        Writer(const std::string &path, const Header &header, size_t bufferBytes = DEFAULT_WRITE_BUFFER_BYTES);
+
+        /**
+         * @brief Destructor: Closes the file, writing the final frame count.
+         */
+        ~Writer();
+
+        Writer(const Writer &) = delete;
+        Writer &operator=(const Writer &) = delete;
+
+        /**
+         * @brief Packs and appends one frame.
+         * Integer samples above the largest packedBits value are clamped to it.
+         * @param frame Single channel frame of the header size (CV_8U or CV_16U, or CV_32F for 32 bits).
+         */
+        void writeFrame(const cv::Mat &frame);
+
+        /**
+         * @brief Packs and appends the next rows of the current frame.
+         * A frame can be streamed in bands of any height without holding it in memory;
+         * it is counted once its last row is written.
+         * @param rows Single channel rows of the header width (CV_8U or CV_16U, or CV_32F for 32 bits).
+         */
+        void writeRows(const cv::Mat &rows);
+
+        /**
+         * @brief Writes the final frame count and closes the file.
+         * A partially written frame is left out of the count.
+         */
+        void close();
+
+        /**
+         * @brief Gets the number of frames written so far.
+         * @return Frame count.
+         */
+        uint64_t getFrameCount() const;
+
+    private:
+        std::ofstream stream;           // Output stream
+        std::vector<char> buffer;       // Stream buffer
+        std::vector<uint8_t> packed;    // Packing buffer of the rows being written, reused
+        Header header;                  // Header being written
+        int rowsWritten = 0;            // Rows of the current frame written so far
+    };
+
+    /**
+     * @brief Memory-maps a file for reading. Views stay valid while the reader exists.
+     */
+    class Reader
+    {
+    public:
+        /**
+         * @brief Constructor: Maps the file and validates its header.
+         * @param path Input path.
+         */
+        explicit Reader(const std::string &path);
+
+        /**
+         * @brief Destructor: Unmaps the file.
+         */
+        ~Reader();
+
+        Reader(const Reader &) = delete;
+        Reader &operator=(const Reader &) = delete;
+
+        /**
+         * @brief Gets the file header.
+         * @return Header.
+         */
+        const Header &getHeader() const;
+
+        /**
+         * @brief Gets the number of frames.
+         * @return Frame count.
+         */
+        int getNumFrames() const;
+
+        /**
+         * @brief Checks whether frames can be viewed without copying (8, 16 or 32 bits per sample).
+         * @return True if frameView is available.
+         */
+        bool isZeroCopy() const;
+
+        /**
+         * @brief Gets a zero-copy view of a frame in the mapping.
+         * The mapping is private: writes to the view never reach the file.
+         * @param index Frame index.
+         * @return Single channel view (CV_8U, CV_16U or CV_32F).
+         */
+        cv::Mat frameView(int index) const;
+
+        /**
+         * @brief Reads a frame, unpacking bit-packed samples.
+         * @param index Frame index.
+         * @param output Frame (CV_8U for 8 bits, CV_16U up to 16 bits, CV_32F for 32 bits).
+         */
+        void readFrame(int index, cv::Mat &output) const;
+
+        /**
+         * @brief Reads a band of rows of a frame, unpacking only those rows.
+         * @param index Frame index.
+         * @param rowStart First row.
+         * @param rowEnd One past the last row.
+         * @param output Rows (CV_8U for 8 bits, CV_16U up to 16 bits, CV_32F for 32 bits).
+         */
+        void readRows(int index, int rowStart, int rowEnd, cv::Mat &output) const;
+
+    private:
+        Header header;                   // Parsed header
+        const uint8_t *data = nullptr;   // Start of the mapping
+        size_t size = 0;                 // Size of the mapping
+        void *mapping = nullptr;         // Platform mapping handle (Windows only)
+
+        /**
+         * @brief Gets the first byte of a frame.
+         * @param index Frame index.
+         * @return Pointer into the mapping.
+         */
+        const uint8_t *framePointer(int index) const;
+
+        /**
+         * @brief Releases the mapping, if any.
+         */
+        void unmap();
+    };
+
+    /**
+     * @brief Gets the smallest stored sample width that holds a sensor's data without loss.
+     * @param fullScale Largest value of the data (e.g. ImageSensor::fullScaleForBitDepth).
+     * @param depth OpenCV depth of the data; float data is stored as 32-bit floats.
+     * @return Bits per stored sample.
+     */
+    static int packedBitsForFullScale(double fullScale, int depth);
+
+    /**
+     * @brief Gets the OpenCV type that holds samples of a stored width.
+     * @param packedBits Bits per stored sample.
+     * @return CV_8UC1, CV_16UC1 or CV_32FC1.
+     */
+    static int cvTypeForPackedBits(int packedBits);
+
+    /**
+     * @brief Gets the number of bytes of one stored row.
+     * @param width Row width in pixels.
+     * @param packedBits Bits per stored sample.
+     * @return Row size in bytes.
+     */
+    static size_t rowBytes(int width, int packedBits);
+
+    /**
+     * @brief Gets the distance between the starts of two frames in a file.
+     * @param header Header describing the frames.
+     * @return Frame stride in bytes.
+     */
+    static size_t frameStride(const Header &header);
+
+private:
+    /**
+     * @brief Checks a header for consistency.
+     * @param header Header to check.
+     */
+    static void validate(const Header &header);
+
+    /**
+     * @brief Serializes a header into HEADER_BYTES bytes.
+     * @param header Header to serialize.
+     * @param bytes Output buffer of HEADER_BYTES bytes.
+     */
+    static void encodeHeader(const Header &header, uint8_t *bytes);
+
+    /**
+     * @brief Parses a serialized header.
+     * @param bytes Buffer of HEADER_BYTES bytes.
+     * @return Parsed header.
+     */
+    static Header decodeHeader(const uint8_t *bytes);
+
+    /**
+     * @brief Packs one row of integer samples LSB first.
+     * @param src Row of samples.
+     * @param dst Output row of rowBytes(count, bits) bytes.
+     * @param count Number of samples.
+     * @param bits Bits per sample.
+     */
+    static void packRow(const uint16_t *src, uint8_t *dst, int count, int bits);
+
+    /**
+     * @brief Unpacks one row of LSB-first packed samples.
+     * @param src Packed row.
+     * @param dst Output row of samples.
+     * @param count Number of samples.
+     * @param bits Bits per sample.
+     */
+    static void unpackRow(const uint8_t *src, uint16_t *dst, int count, int bits);
+};
+
+#endif // RAWFILE_H
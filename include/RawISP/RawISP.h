@@ -0,0 +1,138 @@
+#ifndef RAWISP_H
+#define RAWISP_H
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+#include "CFAPattern/CFAPattern.h"
+#include "LensShading/LensShading.h"
+
+/**
+ * @brief ISP stages that work on the single channel CFA mosaic, before demosaicing.
+ *
+ * Black level, lens shading and white balance are parameters per filter color. They are
+ * turned into compact per-tile tables (one row of tile-expanded offsets and gains per
+ * tile row), so the fused correction pass is a plain multiply-add per pixel with no
+ * branch on the pixel color. The denoiser filters every CFA phase on its own, so it
+ * only ever averages pixels behind the same filter. Working on the mosaic touches a
+ * third of the data of the same stages run after demosaicing.
+ */
+class RawISP
+{
+public:
+    // Default values
+    static constexpr double DEFAULT_DENOISE_SIGMA_SPACE = 1.5;
+
+    // Rows sampled for the white balance statistics: one every STATISTICS_ROW_STRIDE tile rows
+    static constexpr int STATISTICS_ROW_STRIDE = 4;
+
+    /**
+     * @brief Constructor: Sets up the raw ISP for a CFA layout, with every stage neutral.
+     * @param cfaPattern CFAPattern describing the mosaic.
+     */
+    explicit RawISP(const CFAPattern &cfaPattern);
+
+    /**
+     * @brief Sets the black level of every filter color.
+     * @param blackLevel Black level in digital numbers.
+     */
+    void setBlackLevel(double blackLevel);
+
+    /**
+     * @brief Sets the black level of one filter color.
+     * @param color Filter color.
+     * @param blackLevel Black level in digital numbers.
+     */
+    void setBlackLevel(CFAPattern::Color color, double blackLevel);
+
+    /**
+     * @brief Sets the white level. Required for 16-bit mosaics, whose storage does not tell
+     * the sensor bit depth; 8-bit data defaults to 255 and float data to the float sensor
+     * full scale (ImageSensor::fullScaleForBitDepth).
+     * After black level subtraction the remaining range is stretched back to it.
+     * @param whiteLevel White level in digital numbers, 0 to derive it from the data type.
+     */
+    void setWhiteLevel(double whiteLevel);
+
+    /**
+     * @brief Sets the white balance gain of one filter color.
+     * @param color Filter color.
+     * @param gain Gain applied after black level subtraction.
+     */
+    void setWhiteBalanceGain(CFAPattern::Color color, double gain);
+
+    /**
+     * @brief Measures white balance gains on every processed frame instead of using fixed ones.
+     * @param enabled True to enable gray-world white balance from CFA channel statistics.
+     */
+    void setAutoWhiteBalance(bool enabled);
+
+    /**
+     * @brief Sets the lens shading gain grid of one filter color.
+     * The grid spans the whole frame, its corner nodes sitting on the corner pixels, and is
+     * interpolated bilinearly on the fly.
+     * @param color Filter color.
+     * @param grid Small single channel gain grid (e.g. 17x13), at least 2x2.
+     */
+    void setLensShadingGrid(CFAPattern::Color color, const cv::Mat &grid);
+
+    /**
+     * @brief Sets the lens shading grids of every filter color at once.
+     * @param lensShading Correction with one channel per Color (e.g. from LensShading::fromFlatField),
+     * or a single channel correction applied to every color.
+     */
+    void setLensShading(const LensShading &lensShading);
+
+    /**
+     * @brief Enables the CFA-aware edge-preserving denoiser.
+     * @param sigmaColor Range sigma in digital numbers, 0 to disable denoising.
+     * @param sigmaSpace Spatial sigma in pixels of the same color.
+     */
+    void setDenoise(double sigmaColor, double sigmaSpace = DEFAULT_DENOISE_SIGMA_SPACE);
+
+    /**
+     * @brief Computes gray-world white balance gains from per-color means of the mosaic.
+     * Each color is scaled so that a gray scene reads its RGB response (e.g. clear = R + G + B).
+     * @param raw Single channel mosaic.
+     * @return One gain per Color, 1 for colors the tile does not use.
+     */
+    std::vector<double> computeWhiteBalance(const cv::Mat &raw) const;
+
+    /**
+     * @brief Runs black level, lens shading and white balance as one pass, then the denoiser, in place.
+     * @param raw Single channel CV_8U, CV_16U, CV_32F or CV_64F mosaic.
+     */
+    void process(cv::Mat &raw) const;
+
+private:
+    CFAPattern cfaPattern;
+    std::vector<double> blackLevels;        // Per Color
+    std::vector<double> whiteBalanceGains;  // Per Color
+    LensShading lensShading;                // One channel per Color
+    double whiteLevel = 0.0;
+    bool autoWhiteBalance = false;
+    double denoiseSigmaColor = 0.0;
+    double denoiseSigmaSpace = DEFAULT_DENOISE_SIGMA_SPACE;
+
+    /**
+     * @brief Gets the white level for a data type.
+     * @param depth OpenCV depth of the mosaic.
+     * @throws std::logic_error If no white level is set for 16-bit data.
+     * @return White level in digital numbers.
+     */
+    double getWhiteLevel(int depth) const;
+
+    /**
+     * @brief Runs the fused black level, lens shading and white balance pass.
+     * @param raw Mosaic, processed in place.
+     * @param gains White balance gain per Color.
+     */
+    void correct(cv::Mat &raw, const std::vector<double> &gains) const;
+
+    /**
+     * @brief Denoises every CFA phase plane separately.
+     * @param raw Mosaic, processed in place.
+     */
+    void denoise(cv::Mat &raw) const;
+};
+
+#endif // RAWISP_H
@@ -0,0 +1,180 @@
+#ifndef SCENEGENERATOR_H
+#define SCENEGENERATOR_H
+
+#include <opencv2/opencv.hpp>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Procedural test scenes with values in [0, 1].
+ *
+ * Scenes are rendered row-parallel; each row is evaluated by an inlined kernel into a
+ * float row and stored once at the requested depth. Charts with slanted or curved edges
+ * are antialiased: straight edges through their analytic pixel coverage, stars, zone
+ * plates and charts through supersampling. Scenes can be rendered as CV_64F (the
+ * historical default) or CV_32F, which halves the bandwidth of ImageSensor::captureLight.
+ * generate() keeps rendered scenes in a cache keyed on name, size and depth.
+ */
+class SceneGenerator
+{
+public:
+    // Default values
+    static constexpr int DEFAULT_WIDTH = 640;
+    static constexpr int DEFAULT_HEIGHT = 480;
+    static constexpr int DEFAULT_DEPTH = CV_32F;                  // SensorKernels::workingDepth of the default precision
+    static constexpr int DEFAULT_SUPERSAMPLING = 4;               // Samples per pixel side
+    static constexpr size_t DEFAULT_CACHE_BYTES = 512u << 20;    // Capacity of the scene cache
+
+    /**
+     * @brief Generates a vertical gradient from 0 (top) to 1 (bottom).
+     * @param width Width of the scene.
+     * @param height Height of the scene.
+     * @param depth CV_32F or CV_64F.
+     * @return Single channel scene.
+     */
+    static cv::Mat generateGradient(int width, int height, int depth = DEFAULT_DEPTH);
+
+    /**
+     * @brief Generates a checkerboard.
+     * @param width Width of the scene.
+     * @param height Height of the scene.
+     * @param squaresPerRow Number of squares across.
+     * @param squaresPerCol Number of squares down.
+     * @param depth CV_32F or CV_64F.
+     * @return Single channel scene.
+     */
+    static cv::Mat generateCheckerboard(int width, int height, int squaresPerRow, int squaresPerCol, int depth = DEFAULT_DEPTH);
+
+    /**
+     * @brief Generates an antialiased slanted edge through the center, light on the left.
+     * Each pixel holds the area of it on the light side of the edge.
+     * @param width Width of the scene.
+     * @param height Height of the scene.
+     * @param angle Angle of the edge from the vertical, in degrees.
+     * @param depth CV_32F or CV_64F.
+     * @return Single channel scene.
+     */
+    static cv::Mat generateSlantedEdge(int width, int height, double angle, int depth = DEFAULT_DEPTH);
+
+    /**
+     * @brief Generates one pixel wide lines radiating from the center.
+     * @param width Width of the scene.
+     * @param height Height of the scene.
+     * @param numLines Number of lines.
+     * @param depth CV_32F or CV_64F.
+     * @return Single channel scene.
+     */
+    static cv::Mat generateRadialLines(int width, int height, int numLines, int depth = DEFAULT_DEPTH);
+
+    /**
+     * @brief Generates a supersampled Siemens star on a mid-gray background.
+     * @param width Width of the scene.
+     * @param height Height of the scene.
+     * @param numSpokes Number of dark/light spoke pairs.
+     * @param depth CV_32F or CV_64F.
+     * @param supersampling Samples per pixel side.
+     * @return Single channel scene.
+     */
+    static cv::Mat generateSiemensStar(int width, int height, int numSpokes, int depth = DEFAULT_DEPTH, int supersampling = DEFAULT_SUPERSAMPLING);
+
+    /**
+     * @brief Generates a supersampled circular zone plate, 0.5 + 0.5 cos(pi k r^2).
+     * @param width Width of the scene.
+     * @param height Height of the scene.
+     * @param maxFrequency Spatial frequency in cycles per pixel reached at the inscribed circle.
+     * @param depth CV_32F or CV_64F.
+     * @param supersampling Samples per pixel side.
+     * @return Single channel scene.
+     */
+    static cv::Mat generateZonePlate(int width, int height, double maxFrequency, int depth = DEFAULT_DEPTH, int supersampling = DEFAULT_SUPERSAMPLING);
+
+    /**
+     * @brief Generates an ISO 12233 e-SFR style chart: a 3x3 grid of dark squares tilted
+     * by 5 degrees on a light background, at 4:1 contrast, supersampled.
+     * @param width Width of the scene.
+     * @param height Height of the scene.
+     * @param depth CV_32F or CV_64F.
+     * @param supersampling Samples per pixel side.
+     * @return Single channel scene.
+     */
+    static cv::Mat generateISO12233(int width, int height, int depth = DEFAULT_DEPTH, int supersampling = DEFAULT_SUPERSAMPLING);
+
+    /**
+     * @brief Generates a 6x4 color checker with linear-light reflectances of the classic chart.
+     * @param width Width of the scene.
+     * @param height Height of the scene.
+     * @param depth CV_32F or CV_64F.
+     * @return 3-channel BGR scene.
+     */
+    static cv::Mat generateColorChecker(int width, int height, int depth = DEFAULT_DEPTH);
+
+    /**
+     * @brief Gets the patch regions of the color checker rendered at a size.
+     * @param width Width of the scene.
+     * @param height Height of the scene.
+     * @return Pixel rectangle of each of the 24 patches, row by row like the chart.
+     */
+    static std::vector<cv::Rect> getColorCheckerPatches(int width, int height);
+
+    /**
+     * @brief Generates a scene by name with its default parameters, through the cache.
+     * The returned matrix shares its data with the cache; clone it before modifying it.
+     * @param name One of getSceneNames().
+     * @param width Width of the scene.
+     * @param height Height of the scene.
+     * @param depth CV_32F or CV_64F.
+     * @return Scene (3 channels for "color-checker", 1 otherwise).
+     */
+    static cv::Mat generate(const std::string &name, int width, int height, int depth = DEFAULT_DEPTH);
+
+    /**
+     * @brief Generates a scene by name into a caller-owned buffer, through the cache.
+     * The buffer is reused when it already has the scene size and type, so a frame loop
+     * that modifies its copy of the scene does not allocate.
+     * @param name One of getSceneNames().
+     * @param output Receives a copy of the scene.
+     * @param width Width of the scene.
+     * @param height Height of the scene.
+     * @param depth CV_32F or CV_64F.
+     */
+    static void generate(const std::string &name, cv::Mat &output, int width, int height, int depth = DEFAULT_DEPTH);
+
+    /**
+     * @brief Gets the names accepted by generate().
+     * @return Scene names.
+     */
+    static std::vector<std::string> getSceneNames();
+
+    /**
+     * @brief Sets the capacity of the scene cache; least recently used scenes are evicted beyond it.
+     * @param bytes Capacity in bytes, 0 to disable caching.
+     */
+    static void setCacheCapacity(size_t bytes);
+
+    /**
+     * @brief Drops every cached scene.
+     */
+    static void clearCache();
+
+private:
+    /**
+     * @brief Renders a scene by name, bypassing the cache.
+     * @param name Scene name.
+     * @param width Width of the scene.
+     * @param height Height of the scene.
+     * @param depth CV_32F or CV_64F.
+     * @return Scene.
+     */
+    static cv::Mat render(const std::string &name, int width, int height, int depth);
+
+    /**
+     * @brief Checks the requested scene size and depth.
+     * @param width Width of the scene.
+     * @param height Height of the scene.
+     * @param depth Requested depth.
+     */
+    static void checkArguments(int width, int height, int depth);
+};
+
+#endif // SCENEGENERATOR_H
@@ -0,0 +1,174 @@
+#ifndef SCENELOADER_H
+#define SCENELOADER_H
+
+#include <opencv2/opencv.hpp>
+#include <exception>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "BoundedQueue/BoundedQueue.h"
+#include "RawFile/RawFile.h"
+
+/**
+ * @brief Scene radiance read from image files, converted to luminance or color in strips.
+ *
+ * OpenEXR and Radiance HDR files and 16-bit TIFF/DNG data are taken as linear radiance;
+ * 8/16-bit PNG, JPEG and other formats are sRGB decoded. RawFile containers (.sraw) are
+ * memory-mapped and their rows are read straight from the mapping, so they are never
+ * loaded whole. Decoded images are kept at their native depth and converted strip by
+ * strip, so a large input is never held as a full-frame double copy; readStrip lets
+ * ImageSensor::captureLight stream a scene into the sensor without a float frame at all.
+ */
+class SceneLoader
+{
+public:
+    // Default values
+    static constexpr int DEFAULT_STRIP_ROWS = 256;
+    static constexpr double AUTO_EXPOSURE_TARGET = 0.18;   // Mean luminance after auto exposure
+    static constexpr int AUTO_EXPOSURE_ROW_STRIDE = 8;     // Rows sampled for auto exposure: one every stride
+
+    struct Options
+    {
+        double exposure = 1.0;       // Multiplier applied to the radiance
+        bool autoExposure = false;   // Scale the mean luminance to AUTO_EXPOSURE_TARGET before the multiplier
+        int frameIndex = 0;          // Frame read from a RawFile container
+        int depth = CV_32F;          // Output depth (CV_32F or CV_64F)
+    };
+
+    /**
+     * @brief Decodes files on a background thread ahead of their use.
+     * While the caller simulates one scene, the next one is being decoded.
+     */
+    class Prefetcher
+    {
+    public:
+        /**
+         * @brief Constructor: Starts decoding the first files with default options.
+         * @param paths Files to load, in order.
+         */
+        explicit Prefetcher(const std::vector<std::string> &paths);
+
+        /**
+         * @brief Constructor: Starts decoding the first files.
+         * @param paths Files to load, in order.
+         * @param options Options applied to every file.
+         * @param depth Number of decoded scenes kept ready ahead of the caller.
+         */
+        Prefetcher(const std::vector<std::string> &paths, const Options &options, size_t depth = 1);
+
+        /**
+         * @brief Destructor: Stops the background thread.
+         */
+        ~Prefetcher();
+
+        Prefetcher(const Prefetcher &) = delete;
+        Prefetcher &operator=(const Prefetcher &) = delete;
+
+        /**
+         * @brief Gets the next scene, waiting for it to be decoded.
+         * Rethrows the error of a file that failed to load.
+         * @return The next loader, or nullptr once every file was returned.
+         */
+        std::shared_ptr<const SceneLoader> next();
+
+    private:
+        // Decoded scene or the error that stopped it
+        struct Item
+        {
+            std::shared_ptr<const SceneLoader> loader;
+            std::exception_ptr error;
+        };
+
+        BoundedQueue<Item> queue;
+        std::thread worker;
+    };
+
+    /**
+     * @brief Constructor: Opens a scene file with default options.
+     * @param path Input file.
+     */
+    explicit SceneLoader(const std::string &path);
+
+    /**
+     * @brief Constructor: Opens a scene file; images are decoded, raw containers are mapped.
+     * @param path Input file.
+     * @param options Conversion options.
+     */
+    SceneLoader(const std::string &path, const Options &options);
+
+    /**
+     * @brief Gets the scene size.
+     * @return Size in pixels.
+     */
+    cv::Size getSize() const;
+
+    /**
+     * @brief Gets the number of color channels of the source.
+     * @return 1 or 3.
+     */
+    int getChannels() const;
+
+    /**
+     * @brief Gets the scale applied to the radiance, including auto exposure.
+     * @return Exposure multiplier.
+     */
+    double getExposure() const;
+
+    /**
+     * @brief Converts a band of rows to luminance. Safe to call from several threads.
+     * @param rowStart First row.
+     * @param rowEnd One past the last row.
+     * @param output Luminance rows (single channel, options depth).
+     */
+    void readStrip(int rowStart, int rowEnd, cv::Mat &output) const;
+
+    /**
+     * @brief Converts a band of rows to linear BGR. Safe to call from several threads.
+     * @param rowStart First row.
+     * @param rowEnd One past the last row.
+     * @param output BGR rows (3 channels, options depth); gray sources are replicated.
+     */
+    void readColorStrip(int rowStart, int rowEnd, cv::Mat &output) const;
+
+    /**
+     * @brief Converts the whole scene to luminance, strips in parallel.
+     * @return Single channel scene.
+     */
+    cv::Mat loadLuminance() const;
+
+    /**
+     * @brief Converts the whole scene to linear BGR, e.g. as SpectralScene reflectance.
+     * @return 3-channel scene.
+     */
+    cv::Mat loadColor() const;
+
+private:
+    Options options;
+    cv::Mat image;                       // Decoded image at its native depth, empty for raw containers
+    std::shared_ptr<RawFile::Reader> raw; // Mapped raw container, null for images
+    cv::Size size;
+    int channels = 1;
+    bool srgb = false;                   // True if samples are sRGB encoded
+    double scale = 1.0;                  // Sample value to radiance scale
+    double offset = 0.0;                 // Added after scaling (black level)
+    double exposure = 1.0;               // Final radiance multiplier
+
+    /**
+     * @brief Converts a band of rows to float radiance with the source channel count.
+     * @param rowStart First row.
+     * @param rowEnd One past the last row.
+     * @param outChannels 1 for luminance, 3 for BGR.
+     * @param output Output rows at the options depth.
+     */
+    void convertRows(int rowStart, int rowEnd, int outChannels, cv::Mat &output) const;
+
+    /**
+     * @brief Converts the whole scene strip by strip in parallel.
+     * @param outChannels 1 for luminance, 3 for BGR.
+     * @return Scene.
+     */
+    cv::Mat loadAll(int outChannels) const;
+};
+
+#endif // SCENELOADER_H
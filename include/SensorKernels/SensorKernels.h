@@ -0,0 +1,97 @@
+#ifndef SENSORKERNELS_H
+#define SENSORKERNELS_H
+
+#include <opencv2/opencv.hpp>
+#include <string>
+#include "CFAPattern/CFAPattern.h"
+
+/**
+ * @brief Inner loops of the sensor stages, specialised at compile time.
+ *
+ * Each kernel processes one row and is instantiated per storage type (uchar, ushort,
+ * float, double) and, for the CFA gain, per tile width, so the 2x2 tile is fully
+ * unrolled and every loop body is a plain, vectorizable sequence on a known type.
+ * A Table holds the instantiations for one bit depth; it is resolved once (by the
+ * ImageSensor constructor) instead of switching on the Mat type for every call.
+ *
+ * Integer kernels round and saturate to the declared bit depth, not to the storage
+ * type: a 12-bit sensor stored in CV_16U never holds codes above 4095.
+ *
+ * The arithmetic follows a precision policy chosen with the table: FLOAT64 computes in
+ * double (reference runs), FLOAT32 in float (the default; double sensors keep double),
+ * and FIXED_POINT mirrors ISP hardware on integer sensors: gains and noise enter the
+ * datapath as Q16 integers and every product is rounded back to a code by a shift.
+ */
+class SensorKernels
+{
+public:
+    // Arithmetic of the simulation working type
+    enum Precision
+    {
+        FLOAT64,
+        FLOAT32,
+        FIXED_POINT
+    };
+
+    // Default values
+    static constexpr Precision DEFAULT_PRECISION = FLOAT32;
+    static constexpr int FIXED_POINT_BITS = 16; // Fraction bits of the fixed-point gains and noise samples
+
+    // Scales float or double samples and quantizes them into a row of the sensor type
+    using QuantizeF32 = void (*)(const float *input, uchar *output, int count, double scale, double maxValue);
+    using QuantizeF64 = void (*)(const double *input, uchar *output, int count, double scale, double maxValue);
+
+    // Adds sigma times unit Gaussian samples to a row in place
+    using AddNoise = void (*)(uchar *row, const float *noise, int count, double sigma, double maxValue);
+
+    // Multiplies a row in place by the weights of one tile row, starting at tile column colOffset
+    using ApplyCFA = void (*)(uchar *row, const float *weights, int colOffset, int count, double maxValue);
+
+    // Saturates a row in place to [0, maxValue]; no-op for float types
+    using Clip = void (*)(uchar *row, int count, double maxValue);
+
+    // Kernels for one bit depth
+    struct Table
+    {
+        int depth = CV_16U;                                  // Storage depth of the sensor (CV_8U, CV_16U, CV_32F or CV_64F)
+        Precision precision = DEFAULT_PRECISION;             // Arithmetic of the kernels
+        double maxValue = 65535.0;                           // Largest code of the bit depth (ImageSensor::fullScaleForBitDepth); unused by the float kernels
+        QuantizeF32 quantizeF32 = nullptr;
+        QuantizeF64 quantizeF64 = nullptr;
+        AddNoise addNoise = nullptr;
+        ApplyCFA applyCFA[CFAPattern::MAX_TILE_SIZE + 1] = {}; // Indexed by tile width
+        Clip clip = nullptr;
+    };
+
+    /**
+     * @brief Gets the kernels for a sensor bit depth.
+     * @param bitDepth Bit depth (8, 10, 12, 14, 16, 32 or 64).
+     * @param precision Arithmetic of the kernels; FIXED_POINT needs an integer bit depth (8 to 16).
+     * @return Table of kernels for the storage type of the bit depth.
+     */
+    static Table forBitDepth(int bitDepth, Precision precision = DEFAULT_PRECISION);
+
+    /**
+     * @brief Parses a precision name.
+     * @param name One of "float64", "float32" or "fixed".
+     * @return The corresponding precision.
+     */
+    static Precision parsePrecision(const std::string &name);
+
+    /**
+     * @brief Gets the name of a precision, as accepted by parsePrecision.
+     * @param precision Precision to name.
+     * @return Precision name.
+     */
+    static std::string precisionName(Precision precision);
+
+    /**
+     * @brief Gets the depth of the floating-point working buffers (scene, optics) for a precision.
+     * Fixed-point runs keep the optics in float32 and switch to integer codes at the ADC.
+     * @param precision Precision of the simulation.
+     * @return CV_64F for FLOAT64, CV_32F otherwise.
+     */
+    static int workingDepth(Precision precision);
+};
+
+#endif // SENSORKERNELS_H
@@ -0,0 +1,201 @@
+#ifndef SENSORPIPELINE_H
+#define SENSORPIPELINE_H
+
+#include <opencv2/opencv.hpp>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "CFAPattern/CFAPattern.h"
+#include "NoiseGenerator/NoiseGenerator.h"
+#include "NoiseModel/NoiseModel.h"
+#include "PSFConvolver/PSFConvolver.h"
+#include "SensorKernels/SensorKernels.h"
+#include "StageCache/StageCache.h"
+
+/**
+ * @brief Declarative list of sensor stages that are executed together over row tiles.
+ *
+ * Instead of every stage converting the whole frame to CV_64FC1 and back, the stages
+ * are declared once and run back to back on a small CV_32FC1 tile that stays in cache.
+ * Quantization to the sensor bit depth happens once, at readout, in ImageSensor::simulate.
+ * Float64 reference runs use CV_64FC1 buffers instead; fixed-point runs quantize each tile
+ * after the optics and run the point-wise stages on integer codes, like ISP hardware.
+ *
+ * With a StageCache attached, the deterministic head of the pipeline (capture of the
+ * scene, then diffraction) runs over the whole frame and each output is memoized under a
+ * fingerprint of the scene and the stage parameters, so simulations that share a scene
+ * and optics restart from the deepest cached stage. Noise and CFA stages always run.
+ */
+class SensorPipeline
+{
+public:
+    // Default values
+    static constexpr int DEFAULT_TILE_ROWS = 64;
+    static constexpr uint64_t DEFAULT_SEED = 0;
+
+    SensorPipeline();
+
+    /**
+     * @brief Adds an optical diffraction stage (convolution with a PSF).
+     * Diffraction reads neighbouring rows of the captured light, so it has to be declared
+     * before any point-wise stage and at most once. Separable and small kernels run per
+     * tile; kernels large enough for the FFT run once over the whole frame.
+     * @param psf cv::Mat representing the point spread function.
+     * @param method Convolution method, AUTO to detect separability and size.
+     * @return Reference to this pipeline for chaining.
+     */
+    SensorPipeline &addDiffraction(const cv::Mat &psf, PSFConvolver::Method method = PSFConvolver::AUTO);
+
+    /**
+     * @brief Adds an optical diffraction stage sharing a prepared convolver instead of setting one up.
+     * The separability test and FFT plans of the convolver are reused by every pipeline sharing it.
+     * @param convolver Convolver with its PSF set; it must not be modified afterwards.
+     * @return Reference to this pipeline for chaining.
+     */
+    SensorPipeline &addDiffraction(std::shared_ptr<const PSFConvolver> convolver);
+
+    /**
+     * @brief Adds a Gaussian noise stage.
+     * @param noiseLevel Standard deviation of the Gaussian noise to be added.
+     * @return Reference to this pipeline for chaining.
+     */
+    SensorPipeline &addNoise(double noiseLevel);
+
+    /**
+     * @brief Adds a physically-based noise stage.
+     * @param noiseModel Noise model with cached fixed-pattern maps, typically ImageSensor::getNoiseModel().
+     * @return Reference to this pipeline for chaining.
+     */
+    SensorPipeline &addNoiseModel(std::shared_ptr<const NoiseModel> noiseModel);
+
+    /**
+     * @brief Adds a Color Filter Array stage.
+     * @param cfaPattern CFAPattern object defining the CFA pattern.
+     * @return Reference to this pipeline for chaining.
+     */
+    SensorPipeline &addCFA(const CFAPattern &cfaPattern);
+
+    /**
+     * @brief Adds a Color Filter Array stage sharing an existing pattern instead of copying it.
+     * @param cfaPattern Shared CFAPattern object defining the CFA pattern.
+     * @return Reference to this pipeline for chaining.
+     */
+    SensorPipeline &addCFA(std::shared_ptr<const CFAPattern> cfaPattern);
+
+    /**
+     * @brief Sets the number of rows processed per tile.
+     * @param rows Tile height in rows, must be positive.
+     */
+    void setTileRows(int rows);
+
+    /**
+     * @brief Gets the number of rows processed per tile.
+     * @return Tile height in rows.
+     */
+    int getTileRows() const;
+
+    /**
+     * @brief Memoizes the capture and diffraction outputs in a cache, typically shared by many pipelines.
+     * @param cache Stage cache, or nullptr to recompute every frame.
+     */
+    void setStageCache(std::shared_ptr<StageCache> cache);
+
+    /**
+     * @brief Gets the stage cache.
+     * @return Stage cache, or nullptr if none is set.
+     */
+    const std::shared_ptr<StageCache> &getStageCache() const;
+
+    /**
+     * @brief Sets the seed used by the noise stages.
+     * @param seed Seed value.
+     */
+    void setSeed(uint64_t seed);
+
+    /**
+     * @brief Gets the seed used by the noise stages.
+     * @return Seed value.
+     */
+    uint64_t getSeed() const;
+
+    /**
+     * @brief Checks whether any stage has been declared.
+     * @return True if the pipeline has no stages.
+     */
+    bool empty() const;
+
+    /**
+     * @brief Runs the stages that need the whole frame (FFT diffraction), in place.
+     * Must be called once per frame before processTile.
+     * @param signal Full-frame CV_32FC1 or CV_64FC1 working buffer holding the captured light; its depth is kept.
+     */
+    void processFrame(cv::Mat &signal) const;
+
+    /**
+     * @brief Captures a scene and runs the whole-frame stages, through the stage cache if one is set.
+     * Without a cache this is scene.convertTo(signal) followed by processFrame(signal).
+     * @param scene Scene light intensity (single channel, 1.0 at full scale).
+     * @param fullScale Value a scene intensity of 1.0 is scaled to.
+     * @param signal Receives the light for processTile. With a cache it may share its data
+     *               with the cache, so it must not be modified or reused as a buffer.
+     * @param depth Depth of signal (SensorKernels::workingDepth), CV_32F or CV_64F.
+     */
+    void captureFrame(const cv::Mat &scene, double fullScale, cv::Mat &signal, int depth = CV_32F) const;
+
+    /**
+     * @brief Runs all declared stages over one strip of rows.
+     * @param signal Full-frame working buffer holding the captured light.
+     * @param tile Output tile receiving rows [rowStart, rowEnd) after all stages: of the depth
+     *             of signal, or of the sensor type with fixedPoint.
+     * @param rowStart First row of the strip.
+     * @param rowEnd One past the last row of the strip.
+     * @param frameIndex Index of the frame being simulated, used to vary the noise per frame.
+     * @param fullScale Value a scene intensity of 1.0 is scaled to in signal.
+     * @param fixedPoint Fixed-point sensor kernels: the tile is quantized to codes after the
+     *                   optics and the noise and CFA stages run on them; nullptr to stay in float.
+     */
+    void processTile(const cv::Mat &signal, cv::Mat &tile, int rowStart, int rowEnd, uint64_t frameIndex, double fullScale, const SensorKernels::Table *fixedPoint = nullptr) const;
+
+private:
+    enum class StageType
+    {
+        DIFFRACTION,
+        NOISE,
+        NOISE_MODEL,
+        CFA
+    };
+
+    struct Stage
+    {
+        StageType type;
+        std::shared_ptr<const PSFConvolver> convolver; // Convolution for DIFFRACTION
+        double noiseLevel = 0.0;                      // Sigma for NOISE
+        std::shared_ptr<const NoiseModel> noiseModel; // Model for NOISE_MODEL
+        std::shared_ptr<const CFAPattern> cfa;        // Pattern for CFA
+        StageCache::Key fingerprint = 0;              // Fingerprint of the PSF and method for DIFFRACTION
+    };
+
+    std::vector<Stage> stages;                // Declared stages in execution order
+    int tileRows;                             // Rows processed per tile
+    NoiseGenerator noiseGenerator;            // Counter-based generator for the noise stages
+    std::shared_ptr<StageCache> stageCache;   // Memoized capture and diffraction outputs, or nullptr
+
+    /**
+     * @brief Checks whether diffraction runs over the whole frame in processFrame instead of per tile.
+     * @return True for FFT diffraction, and for any diffraction when its output is cached.
+     */
+    bool diffractsWholeFrame() const;
+
+    /**
+     * @brief Runs the point-wise stages on a tile of sensor codes with fixed-point kernels.
+     * Noise uses the same per-pixel streams as the float path.
+     * @param tile Tile of codes holding rows [rowStart, rowStart + tile.rows) of the frame.
+     * @param rowStart First row of the tile in the frame.
+     * @param frameIndex Index of the frame being simulated.
+     * @param fullScale Full-scale value of the codes.
+     * @param kernels Fixed-point kernels of the sensor.
+     */
+    void processCodes(cv::Mat &tile, int rowStart, uint64_t frameIndex, double fullScale, const SensorKernels::Table &kernels) const;
+};
+
+#endif // SENSORPIPELINE_H
@@ -0,0 +1,95 @@
+#ifndef SPECTRALSCENE_H
+#define SPECTRALSCENE_H
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+/**
+ * @brief Scene made of N wavelength bands that are rendered one at a time.
+ *
+ * Bands are produced on demand from a reflectance image and an illuminant spectrum,
+ * so a spectral frame never holds N full-frame copies. Scenes built from explicit
+ * band images are also supported.
+ */
+class SpectralScene
+{
+public:
+    // Default values
+    static constexpr double DEFAULT_FIRST_WAVELENGTH = 400.0; // nm
+    static constexpr double DEFAULT_LAST_WAVELENGTH = 700.0;  // nm
+    static constexpr int DEFAULT_NUM_BANDS = 16;
+
+    /**
+     * @brief Constructor: Scene rendered from a reflectance image under an illuminant.
+     * Single channel reflectance is spectrally flat; 3-channel (BGR) reflectance is spread
+     * over the bands with smooth blue, green and red basis spectra.
+     * @param reflectance Reflectance image (1 or 3 channels, any depth, values in [0, 1]).
+     * @param wavelengths Band center wavelengths in nm.
+     * @param illuminant Relative spectral power of the illuminant per band.
+     */
+    SpectralScene(const cv::Mat &reflectance, const std::vector<double> &wavelengths, const std::vector<double> &illuminant);
+
+    /**
+     * @brief Constructor: Scene from explicit band images.
+     * @param bands Single channel band images, all of the same size.
+     * @param wavelengths Band center wavelengths in nm.
+     */
+    SpectralScene(const std::vector<cv::Mat> &bands, const std::vector<double> &wavelengths);
+
+    /**
+     * @brief Gets the number of bands.
+     * @return Number of bands.
+     */
+    int getNumBands() const;
+
+    /**
+     * @brief Gets the band center wavelengths.
+     * @return Wavelengths in nm.
+     */
+    const std::vector<double> &getWavelengths() const;
+
+    /**
+     * @brief Gets the scene size.
+     * @return Size of every band image.
+     */
+    cv::Size getSize() const;
+
+    /**
+     * @brief Renders one band.
+     * @param band Band index.
+     * @param output cv::Mat receiving the band radiance (CV_32FC1).
+     */
+    void renderBand(int band, cv::Mat &output) const;
+
+    /**
+     * @brief Samples evenly spaced band center wavelengths.
+     * @param first First wavelength in nm.
+     * @param last Last wavelength in nm.
+     * @param count Number of bands.
+     * @return Wavelengths in nm.
+     */
+    static std::vector<double> sampleWavelengths(double first = DEFAULT_FIRST_WAVELENGTH, double last = DEFAULT_LAST_WAVELENGTH, int count = DEFAULT_NUM_BANDS);
+
+    /**
+     * @brief Gets the spectrum of an equal-energy illuminant.
+     * @param wavelengths Band center wavelengths in nm.
+     * @return Relative spectral power per band (all 1).
+     */
+    static std::vector<double> equalEnergyIlluminant(const std::vector<double> &wavelengths);
+
+    /**
+     * @brief Gets the spectrum of a black body, normalized to a peak of 1.
+     * @param wavelengths Band center wavelengths in nm.
+     * @param temperature Color temperature in Kelvin.
+     * @return Relative spectral power per band.
+     */
+    static std::vector<double> blackbodyIlluminant(const std::vector<double> &wavelengths, double temperature);
+
+private:
+    std::vector<double> wavelengths;  // Band center wavelengths (nm)
+    cv::Mat reflectance;              // Reflectance image (CV_32FC1 or CV_32FC3)
+    std::vector<cv::Vec3f> bandMixes; // Per band weights of the B, G, R reflectance channels
+    std::vector<cv::Mat> bands;       // Explicit band images, if given
+};
+
+#endif // SPECTRALSCENE_H
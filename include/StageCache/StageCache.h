@@ -0,0 +1,187 @@
+#ifndef STAGECACHE_H
+#define STAGECACHE_H
+
+#include <opencv2/opencv.hpp>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief Bounded cache of deterministic stage outputs shared across simulations.
+ *
+ * Entries are keyed on a fingerprint of everything that determines the output: the
+ * input frame and the stage parameters. Least recently used entries are evicted beyond
+ * the memory capacity; with a spill directory they are written to disk instead of being
+ * dropped, and read back (and promoted to memory) by a later lookup. The spill files are
+ * bounded as well and removed when the cache is destroyed.
+ *
+ * Cached matrices share their data with every caller that finds them, so they must be
+ * treated as read-only. All methods are thread-safe.
+ */
+class StageCache
+{
+public:
+    // Default values
+    static constexpr size_t DEFAULT_CAPACITY_BYTES = size_t(1024) << 20; // Memory capacity
+    static constexpr size_t DEFAULT_SPILL_BYTES = size_t(4096) << 20;    // Disk capacity of the spill directory
+
+    using Key = uint64_t;
+
+    /**
+     * @brief Incremental 64-bit fingerprint of stage inputs and parameters.
+     * Matrices are hashed over their type, size and pixels, row by row in parallel,
+     * so equal content gives equal keys whatever the buffer or its step.
+     */
+    class Fingerprint
+    {
+    public:
+        /**
+         * @brief Constructor: Starts a fingerprint, optionally chained to the key of a previous stage.
+         * @param seed Key of the stage that produced the input, or 0.
+         */
+        explicit Fingerprint(Key seed = 0);
+
+        /**
+         * @brief Adds the type, size and pixels of a matrix.
+         * @param mat Matrix to hash.
+         * @return Reference to this fingerprint for chaining.
+         */
+        Fingerprint &add(const cv::Mat &mat);
+
+        /**
+         * @brief Adds an integer parameter.
+         * @param value Value to hash.
+         * @return Reference to this fingerprint for chaining.
+         */
+        Fingerprint &add(uint64_t value);
+
+        /**
+         * @brief Adds a floating-point parameter by its bit pattern.
+         * @param value Value to hash.
+         * @return Reference to this fingerprint for chaining.
+         */
+        Fingerprint &add(double value);
+
+        /**
+         * @brief Adds a string parameter.
+         * @param value Value to hash.
+         * @return Reference to this fingerprint for chaining.
+         */
+        Fingerprint &add(const std::string &value);
+
+        /**
+         * @brief Gets the key of everything added so far.
+         * @return Fingerprint value.
+         */
+        Key get() const;
+
+    private:
+        uint64_t hash; // Running hash state
+    };
+
+    // Counters since construction or the last clear()
+    struct Stats
+    {
+        uint64_t hits = 0;          // Lookups served from memory
+        uint64_t diskHits = 0;      // Lookups served from the spill directory
+        uint64_t misses = 0;        // Lookups that found nothing
+        uint64_t evictions = 0;     // Entries evicted from memory (spilled or dropped)
+        uint64_t spillFailures = 0; // Evicted entries whose spill file could not be written in full
+        size_t bytes = 0;           // Bytes held in memory
+        size_t spilledBytes = 0;    // Bytes held in the spill directory
+    };
+
+    /**
+     * @brief Constructor: Creates an empty cache.
+     * @param capacityBytes Memory capacity in bytes, 0 to disable caching.
+     * @param spillDir Directory receiving evicted entries, empty to drop them.
+     * @param spillBytes Disk capacity of the spill directory in bytes.
+     */
+    explicit StageCache(size_t capacityBytes = DEFAULT_CAPACITY_BYTES, const std::string &spillDir = "", size_t spillBytes = DEFAULT_SPILL_BYTES);
+
+    /**
+     * @brief Destructor: Removes the spill files.
+     */
+    ~StageCache();
+
+    StageCache(const StageCache &) = delete;
+    StageCache &operator=(const StageCache &) = delete;
+
+    /**
+     * @brief Looks up an entry in memory, then in the spill directory.
+     * @param key Fingerprint of the stage output.
+     * @param value Receives the cached matrix (shared, read-only) on a hit.
+     * @return True on a hit.
+     */
+    bool find(Key key, cv::Mat &value);
+
+    /**
+     * @brief Stores a stage output; the cache shares the matrix, which must not be modified afterwards.
+     * Entries larger than the capacity are not stored.
+     * @param key Fingerprint of the stage output.
+     * @param value Stage output.
+     */
+    void insert(Key key, const cv::Mat &value);
+
+    /**
+     * @brief Gets the hit, miss and size counters.
+     * @return Current statistics.
+     */
+    Stats getStats() const;
+
+    /**
+     * @brief Drops every entry, in memory and on disk, and resets the counters.
+     */
+    void clear();
+
+private:
+    // Entry held in memory
+    struct Entry
+    {
+        cv::Mat value;                   // Cached output
+        std::list<Key>::iterator order;  // Position in memoryOrder
+    };
+
+    // Entry spilled to disk
+    struct SpilledEntry
+    {
+        size_t bytes = 0;                // Size of the pixels
+        std::list<Key>::iterator order;  // Position in spillOrder
+    };
+
+    size_t capacity;                                  // Memory capacity in bytes
+    std::string spillDir;                             // Spill directory, empty to drop evicted entries
+    size_t spillCapacity;                             // Disk capacity in bytes
+    mutable std::mutex mutex;                         // Guards everything below
+    std::unordered_map<Key, Entry> memory;            // Entries in memory
+    std::list<Key> memoryOrder;                       // Memory keys, most recently used first
+    std::unordered_map<Key, SpilledEntry> spilled;    // Entries on disk
+    std::list<Key> spillOrder;                        // Spilled keys, most recently spilled first
+    Stats stats;                                      // Counters
+
+    /**
+     * @brief Removes least recently used entries until the memory fits the capacity.
+     * Must be called with the mutex held.
+     * @return Evicted entries, to be spilled once the mutex is released.
+     */
+    std::vector<std::pair<Key, cv::Mat>> evict();
+
+    /**
+     * @brief Writes evicted entries to the spill directory and drops the oldest files beyond its capacity.
+     * Spilling is best effort: an entry that cannot be written is dropped.
+     * @param victims Evicted entries.
+     */
+    void spill(const std::vector<std::pair<Key, cv::Mat>> &victims);
+
+    /**
+     * @brief Gets the spill file of a key.
+     * @param key Entry key.
+     * @return Path of the file in the spill directory.
+     */
+    std::string spillPath(Key key) const;
+};
+
+#endif // STAGECACHE_H
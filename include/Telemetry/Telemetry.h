@@ -0,0 +1,192 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <opencv2/opencv.hpp>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Per-stage timing and allocation telemetry for the pipeline hot paths.
+ *
+ * Stages are instrumented with TELEMETRY_SCOPE("name"), which times the enclosing
+ * scope. Every stage accumulates its call count, wall time and the bytes and matrices
+ * allocated by the calling thread while it ran; while a trace is being recorded, each
+ * call is also kept as a Chrome trace event (viewable in chrome://tracing or Perfetto).
+ *
+ * Telemetry is off until setEnabled(true): a disabled scope costs one relaxed atomic
+ * load. The counting allocator also keeps process-wide allocation totals, which
+ * setAllocationCounting turns on without recording stages (e.g. for benchmarks). Building core without CAMERASIM_TELEMETRY (CMake option of the same name)
+ * compiles the scopes out entirely.
+ */
+class Telemetry
+{
+public:
+    // Accumulated measurements of one stage
+    struct StageStats
+    {
+        std::string name;
+        uint64_t calls = 0;
+        double totalMs = 0.0;
+        double minMs = 0.0;
+        double maxMs = 0.0;
+        uint64_t bytesAllocated = 0;   // Bytes of cv::Mat data allocated by the calling thread (pooled or not), nested stages included
+        uint64_t matsCreated = 0;      // cv::Mat buffers allocated by the calling thread, nested stages included
+    };
+
+    // cv::Mat allocations of every thread
+    struct AllocationTotals
+    {
+        uint64_t bytes = 0;            // Bytes of cv::Mat data allocated
+        uint64_t mats = 0;             // cv::Mat buffers allocated
+    };
+
+    /**
+     * @brief Times a scope and records it as a stage call on destruction.
+     */
+    class ScopedTimer
+    {
+    public:
+        /**
+         * @brief Constructor: Starts timing if telemetry is enabled.
+         * @param name Stage name; must outlive the program (a string literal).
+         */
+        explicit ScopedTimer(const char *name)
+            : name(name), active(enabled.load(std::memory_order_relaxed))
+        {
+            if (active)
+            {
+                begin();
+            }
+        }
+
+        /**
+         * @brief Destructor: Records the stage call.
+         */
+        ~ScopedTimer()
+        {
+            if (active)
+            {
+                end();
+            }
+        }
+
+        ScopedTimer(const ScopedTimer &) = delete;
+        ScopedTimer &operator=(const ScopedTimer &) = delete;
+
+    private:
+        const char *name;
+        bool active;
+        std::chrono::steady_clock::time_point start;
+        uint64_t startBytes = 0;
+        uint64_t startMats = 0;
+
+        /**
+         * @brief Samples the clock and the allocation counters of the thread.
+         */
+        void begin();
+
+        /**
+         * @brief Records the elapsed time and allocations.
+         */
+        void end();
+    };
+
+    /**
+     * @brief Turns telemetry on or off at runtime.
+     * While enabled, cv::Mat allocations go through a counting allocator.
+     * @param on True to record stages.
+     */
+    static void setEnabled(bool on);
+
+    /**
+     * @brief Checks whether telemetry is recording.
+     * @return True if enabled.
+     */
+    static bool isEnabled();
+
+    /**
+     * @brief Routes cv::Mat allocations through the counting allocator without recording stages.
+     * The allocator stays installed while either this or setEnabled is on.
+     * @param on True to count allocations.
+     */
+    static void setAllocationCounting(bool on);
+
+    /**
+     * @brief Suspends the process-wide allocation totals, e.g. during untimed setup.
+     * Per-stage allocation statistics are not affected.
+     * @param paused True to stop adding to the totals.
+     */
+    static void pauseAllocationCounting(bool paused);
+
+    /**
+     * @brief Gets the process-wide allocation totals since the last resetAllocationTotals.
+     * @return Allocations counted while the counting allocator was installed and not paused.
+     */
+    static AllocationTotals getAllocationTotals();
+
+    /**
+     * @brief Zeroes the process-wide allocation totals.
+     */
+    static void resetAllocationTotals();
+
+    /**
+     * @brief Starts keeping every stage call as a trace event, dropping earlier events.
+     */
+    static void startTrace();
+
+    /**
+     * @brief Writes the recorded trace events in Chrome trace event JSON format.
+     * @param path Output file.
+     */
+    static void writeTrace(const std::string &path);
+
+    /**
+     * @brief Gets the accumulated stage measurements.
+     * @return Stages, most total time first.
+     */
+    static std::vector<StageStats> getStageStats();
+
+    /**
+     * @brief Prints a per-stage breakdown table.
+     * @param out Output stream.
+     */
+    static void printReport(std::ostream &out);
+
+    /**
+     * @brief Drops the accumulated measurements and trace events.
+     */
+    static void reset();
+
+private:
+    static inline std::atomic<bool> enabled{false};
+
+    /**
+     * @brief Installs the counting allocator while telemetry or allocation counting is on,
+     * and restores the previous default otherwise. Called with the telemetry mutex held.
+     */
+    static void updateAllocator();
+
+    /**
+     * @brief Adds one stage call to the statistics and, while tracing, to the trace.
+     * @param name Stage name.
+     * @param start Start of the call.
+     * @param finish End of the call.
+     * @param bytes Bytes allocated during the call.
+     * @param mats Matrices allocated during the call.
+     */
+    static void record(const char *name, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point finish, uint64_t bytes, uint64_t mats);
+};
+
+#ifdef CAMERASIM_TELEMETRY
+#define TELEMETRY_CONCAT_IMPL(a, b) a##b
+#define TELEMETRY_CONCAT(a, b) TELEMETRY_CONCAT_IMPL(a, b)
+#define TELEMETRY_SCOPE(name) Telemetry::ScopedTimer TELEMETRY_CONCAT(telemetryScope, __LINE__)(name)
+#else
+#define TELEMETRY_SCOPE(name) do {} while (0)
+#endif
+
+#endif // TELEMETRY_H
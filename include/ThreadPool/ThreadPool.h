@@ -0,0 +1,118 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Fixed-size work-stealing thread pool.
+ *
+ * Every worker owns a task deque. Tasks submitted from outside the pool are spread
+ * round-robin over the deques, tasks submitted from a worker go to its own deque.
+ * A worker takes its newest task first and, when its deque is empty, steals the
+ * oldest task of another worker, so long and short jobs balance out on their own.
+ */
+class ThreadPool
+{
+public:
+    using Task = std::function<void()>;
+
+    /**
+     * @brief Runs OpenCV single threaded for its lifetime, then restores the previous count.
+     * Parallelism comes from pool tasks running side by side; nested OpenCV threads would
+     * oversubscribe the cores.
+     */
+    class OpenCVThreadsGuard
+    {
+    public:
+        /**
+         * @brief Constructor: Saves OpenCV's thread count and sets it to 1.
+         */
+        OpenCVThreadsGuard();
+
+        /**
+         * @brief Destructor: Restores the saved thread count.
+         */
+        ~OpenCVThreadsGuard();
+
+        OpenCVThreadsGuard(const OpenCVThreadsGuard &) = delete;
+        OpenCVThreadsGuard &operator=(const OpenCVThreadsGuard &) = delete;
+
+    private:
+        int previous;
+    };
+
+    /**
+     * @brief Constructor: Starts the worker threads.
+     * @param numThreads Number of workers, 0 for one per hardware thread.
+     */
+    explicit ThreadPool(int numThreads = 0);
+
+    /**
+     * @brief Destructor: Runs the remaining tasks and joins the workers.
+     */
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    /**
+     * @brief Queues a task.
+     * @param task Task to run on one of the workers.
+     */
+    void submit(Task task);
+
+    /**
+     * @brief Blocks until every submitted task has finished.
+     * Rethrows the first exception thrown by a task since the last wait.
+     */
+    void wait();
+
+    /**
+     * @brief Gets the number of worker threads.
+     * @return Number of workers.
+     */
+    int getNumThreads() const;
+
+private:
+    // Task deque owned by one worker
+    struct WorkQueue
+    {
+        std::deque<Task> tasks;
+        std::mutex mutex;
+    };
+
+    std::vector<std::unique_ptr<WorkQueue>> queues; // One deque per worker
+    std::vector<std::thread> workers;               // Worker threads
+    std::mutex stateMutex;                          // Guards the counters below
+    std::condition_variable taskAvailable;          // Signaled when a task is queued or on shutdown
+    std::condition_variable allDone;                // Signaled when pending drops to zero
+    size_t queued = 0;                              // Tasks sitting in a deque
+    size_t pending = 0;                             // Tasks queued or running
+    size_t nextQueue = 0;                           // Round-robin deque for outside submissions
+    bool stopping = false;                          // Set by the destructor
+    std::exception_ptr firstError;                  // First exception thrown by a task
+
+    /**
+     * @brief Takes a task from the worker's own deque or steals one from another.
+     * @param index Index of the calling worker.
+     * @param task Receives the task.
+     * @return True if a task was taken.
+     */
+    bool popTask(size_t index, Task &task);
+
+    /**
+     * @brief Main loop of a worker thread.
+     * @param index Index of the worker.
+     */
+    void workerLoop(size_t index);
+};
+
+#endif // THREADPOOL_H
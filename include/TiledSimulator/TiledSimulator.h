@@ -0,0 +1,154 @@
+#ifndef TILEDSIMULATOR_H
+#define TILEDSIMULATOR_H
+
+#include <opencv2/opencv.hpp>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+#include "CFAPattern/CFAPattern.h"
+#include "Demosaic/Demosaic.h"
+#include "ImageSensor/ImageSensor.h"
+#include "NoiseGenerator/NoiseGenerator.h"
+#include "NoiseModel/NoiseModel.h"
+#include "PSFConvolver/PSFConvolver.h"
+#include "SceneLoader/SceneLoader.h"
+#include "SensorKernels/SensorKernels.h"
+
+/**
+ * @brief Out-of-core sensor simulation for frames that do not fit in memory.
+ *
+ * The frame is cut into tiles of tileRows x tileCols (full-width strips by default).
+ * Every tile is read from the scene source with a halo covering the PSF and the
+ * demosaic footprint, then runs diffraction, noise, CFA, readout and demosaicing
+ * on its own; only the interior is kept, so the result matches a whole-frame run.
+ * Noise and the PRNU/DSNU fixed pattern are counter-based and depend on the pixel
+ * position only, never on the tiling.
+ *
+ * Tiles are grouped in bands of one tile row. A batch of bandsInFlight bands is
+ * processed in parallel, then handed to the sink in row order (typically streaming
+ * to RawFile::Writer::writeRows) and its buffers reused for the next batch. Peak
+ * memory is therefore set by the tile size, the frame width and bandsInFlight, not
+ * by the frame height.
+ */
+class TiledSimulator
+{
+public:
+    // Default values
+    static constexpr int DEFAULT_TILE_ROWS = 256;
+    static constexpr int DEFAULT_TILE_COLS = 0; // Full-width strips
+
+    // Fills rows [rowStart, rowEnd) of the scene: single channel, full frame width, 1.0 at full scale.
+    // Called concurrently for disjoint row ranges.
+    using SceneSource = std::function<void(int rowStart, int rowEnd, cv::Mat &rows)>;
+
+    // Receives the finished rows of each band, in row order: the mosaic in the sensor type
+    // and, if demosaicing, the BGR image (empty otherwise)
+    using BandSink = std::function<void(int rowStart, const cv::Mat &raw, const cv::Mat &bgr)>;
+
+    struct Config
+    {
+        int bitDepth = ImageSensor::DEFAULT_BIT_DEPTH;               // Sensor bit depth
+        int tileRows = DEFAULT_TILE_ROWS;                            // Rows per tile, a multiple of the CFA tile rows
+        int tileCols = DEFAULT_TILE_COLS;                            // Columns per tile, a multiple of the CFA tile columns; 0 for full width
+        int bandsInFlight = 0;                                       // Bands processed concurrently, 0 for the number of OpenCV threads
+        bool demosaic = true;                                        // Produce the BGR image as well as the mosaic
+        Demosaic::Algorithm algorithm = Demosaic::DEFAULT_ALGORITHM; // Demosaicing algorithm
+        double noiseLevel = 0.0;                                     // Gaussian noise level, unless a noise model is set
+        uint64_t seed = 0;                                           // Seed of the noise and of the fixed pattern
+    };
+
+    /**
+     * @brief Constructor: Sets up a simulator with the default configuration.
+     * @param cfaPattern CFAPattern of the sensor.
+     */
+    explicit TiledSimulator(const CFAPattern &cfaPattern);
+
+    /**
+     * @brief Constructor: Sets up a simulator.
+     * @param cfaPattern CFAPattern of the sensor.
+     * @param config Sensor and tiling configuration.
+     */
+    TiledSimulator(const CFAPattern &cfaPattern, const Config &config);
+
+    /**
+     * @brief Sets the point spread function of the optics.
+     * @param psf cv::Mat representing the point spread function, or an empty matrix for no blur.
+     */
+    void setPSF(const cv::Mat &psf);
+
+    /**
+     * @brief Uses the physically-based noise model instead of Gaussian noise.
+     * The fixed pattern is regenerated per tile rather than cached for the whole frame.
+     * @param params Noise model parameters.
+     */
+    void setNoiseModel(const NoiseModel::Parameters &params);
+
+    /**
+     * @brief Gets the extra rows and columns read around every tile.
+     * @return Halo width (columns) and height (rows), rounded up to whole CFA tiles.
+     */
+    cv::Size getHaloSize() const;
+
+    /**
+     * @brief Simulates one frame tile by tile.
+     * @param frameSize Size of the sensor.
+     * @param source Scene source, called once per band with the halo rows included.
+     * @param sink Receives the finished bands in row order.
+     */
+    void run(cv::Size frameSize, const SceneSource &source, const BandSink &sink);
+
+    /**
+     * @brief Simulates one frame of a scene file tile by tile; the sensor takes the size of the scene.
+     * @param loader SceneLoader providing the luminance strip by strip.
+     * @param sink Receives the finished bands in row order.
+     */
+    void run(const SceneLoader &loader, const BandSink &sink);
+
+private:
+    // Scene rows and results of one band of tiles
+    struct Band
+    {
+        int rowStart = 0;   // First row of the band
+        int rowEnd = 0;     // One past the last row of the band
+        int inputStart = 0; // First scene row read, halo included
+        int inputEnd = 0;   // One past the last scene row read, halo included
+        cv::Mat scene;      // Scene rows [inputStart, inputEnd)
+        cv::Mat raw;        // Mosaic rows [rowStart, rowEnd)
+        cv::Mat bgr;        // Demosaiced rows [rowStart, rowEnd)
+    };
+
+    // Buffers of one worker, reused from tile to tile
+    struct Workspace
+    {
+        cv::Mat signal;
+        cv::Mat blurred;
+        cv::Mat mosaic;
+        cv::Mat color;
+    };
+
+    CFAPattern cfaPattern;                  // Filter layout and weights
+    Config config;                          // Sensor and tiling configuration
+    SensorKernels::Table kernels;           // Readout kernels for the bit depth
+    std::shared_ptr<const PSFConvolver> convolver; // Prepared PSF shared by every worker, null for no blur
+    bool physicalNoise = false;             // True to use noiseParams instead of Gaussian noise
+    NoiseModel::Parameters noiseParams;     // Parameters of the noise model
+    NoiseGenerator noiseGenerator;          // Counter-based generator for Gaussian noise
+    std::vector<Band> bands;                // Band buffers, reused from batch to batch
+    std::vector<Workspace> workspaces;      // One per worker, reused from run to run
+    uint64_t frameIndex = 0;                // Number of frames simulated, varies the noise per frame
+
+    /**
+     * @brief Runs every stage on one tile of a band and stores its interior.
+     * @param band Band holding the scene rows and receiving the results.
+     * @param colStart First column of the tile.
+     * @param colEnd One past the last column of the tile.
+     * @param frameSize Size of the sensor.
+     * @param noiseModel Noise model, or nullptr for Gaussian noise.
+     * @param frame Index of the frame, used as the noise stream.
+     * @param workspace Buffers of the calling worker.
+     */
+    void processTile(Band &band, int colStart, int colEnd, cv::Size frameSize, const NoiseModel *noiseModel, uint64_t frame, Workspace &workspace) const;
+};
+
+#endif // TILEDSIMULATOR_H
@@ -0,0 +1,177 @@
+#ifndef VIDEOPIPELINE_H
+#define VIDEOPIPELINE_H
+
+#include <opencv2/opencv.hpp>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include "CFAPattern/CFAPattern.h"
+#include "Demosaic/Demosaic.h"
+#include "NoiseModel/NoiseModel.h"
+
+/**
+ * @brief Streaming multi-frame capture with every stage on its own thread.
+ *
+ * Frames flow scene -> optics -> sensor -> CFA -> demosaic -> ISP -> sink through bounded
+ * queues, so frame N+1 is rendered while frame N is demosaiced and at most a few frames
+ * per stage are in flight. The scene is a function of time: with a rolling shutter each
+ * band of rows is rendered at its own readout time. Temporal noise is drawn from the
+ * frame index, so it is independent between frames, while a shared NoiseModel keeps its
+ * fixed-pattern maps across the sequence. The exposure time may change per frame.
+ * Frame buffers come from BufferPool::global() and return to it when a frame is
+ * dropped, so after the first frames the stream stops allocating frame memory.
+ */
+class VideoPipeline
+{
+public:
+    // Default values
+    static constexpr double DEFAULT_FRAME_RATE = 30.0;
+    static constexpr int DEFAULT_QUEUE_DEPTH = 2;
+    static constexpr int DEFAULT_SEGMENT_ROWS = 16;
+
+    struct Config
+    {
+        int width = 640;
+        int height = 480;
+        int bitDepth = 16;
+        double frameRate = DEFAULT_FRAME_RATE;  // Target frame rate (frames/s)
+        double exposureTime = 0.01;             // Exposure at which a scene intensity of 1.0 reads full scale (s)
+        double readoutTime = 0.0;               // Time to read all rows, 0 for a global shutter (s)
+        int segmentRows = DEFAULT_SEGMENT_ROWS; // Rows rendered at the same instant with a rolling shutter
+        int queueDepth = DEFAULT_QUEUE_DEPTH;   // Frames buffered between two stages
+        bool realTime = false;                  // Pace the source to the target frame rate
+        uint64_t seed = 0;                      // Seed of the temporal noise
+    };
+
+    // One frame travelling down the pipeline
+    struct Frame
+    {
+        int64_t index = 0;
+        double timestamp = 0.0;    // Start of the exposure of the first row (s)
+        double exposureTime = 0.0; // Exposure of this frame (s)
+        cv::Mat raw;               // Float signal until the CFA stage, then the raw readout
+        cv::Mat rgb;               // Demosaiced image (BGR)
+    };
+
+    // Throughput of a run
+    struct Statistics
+    {
+        int64_t frames = 0;
+        double seconds = 0.0;                  // Wall time from the first frame to the last
+        double framesPerSecond = 0.0;
+        std::vector<std::string> stageNames;   // Stages in pipeline order
+        std::vector<double> stageSeconds;      // Busy time per stage; the largest bounds the frame rate
+    };
+
+    // Renders rows [rowStart, rowEnd) of the scene at a time in seconds (single channel, values in [0, 1])
+    using SceneSource = std::function<void(double time, int rowStart, int rowEnd, cv::Mat &rows)>;
+
+    // Returns the exposure time of a frame in seconds
+    using ExposureSchedule = std::function<double(int64_t frameIndex)>;
+
+    // Processes a demosaiced image in place
+    using ISPStage = std::function<void(cv::Mat &rgb)>;
+
+    // Receives every finished frame, in order
+    using FrameSink = std::function<void(const Frame &frame)>;
+
+    /**
+     * @brief Constructor: Sets up a pipeline for a sensor configuration.
+     * @param config Sensor and stream configuration.
+     */
+    explicit VideoPipeline(const Config &config);
+
+    /**
+     * @brief Sets the scene source.
+     * @param source Callback rendering rows of the scene at a given time.
+     */
+    void setSceneSource(SceneSource source);
+
+    /**
+     * @brief Sets a per-frame exposure time; without one every frame uses Config::exposureTime.
+     * @param schedule Callback returning the exposure of each frame.
+     */
+    void setExposureSchedule(ExposureSchedule schedule);
+
+    /**
+     * @brief Sets the optics PSF, applied to every frame. An empty PSF disables the stage.
+     * @param psf cv::Mat representing the point spread function.
+     */
+    void setPSF(const cv::Mat &psf);
+
+    /**
+     * @brief Uses additive Gaussian noise in the sensor stage.
+     * @param noiseLevel Standard deviation in digital numbers.
+     */
+    void setNoise(double noiseLevel);
+
+    /**
+     * @brief Uses the physically-based noise model in the sensor stage.
+     * @param noiseModel Noise model whose fixed-pattern maps are kept for the whole sequence.
+     */
+    void setNoiseModel(std::shared_ptr<const NoiseModel> noiseModel);
+
+    /**
+     * @brief Sets the CFA pattern used for filtering and demosaicing.
+     * A demosaicing algorithm the pattern does not support falls back to bilinear.
+     * @param cfaPattern CFAPattern object defining the CFA pattern.
+     */
+    void setCFA(const CFAPattern &cfaPattern);
+
+    /**
+     * @brief Sets the demosaicing algorithm, falling back to bilinear (with a warning) if
+     * the current CFA pattern does not support it. Call after setCFA.
+     * @param algorithm Demosaicing algorithm.
+     */
+    void setDemosaic(Demosaic::Algorithm algorithm);
+
+    /**
+     * @brief Sets the ISP stage run on every demosaiced image.
+     * @param isp Callback processing the image in place, or an empty function for none.
+     */
+    void setISP(ISPStage isp);
+
+    /**
+     * @brief Sets the sink receiving the finished frames.
+     * @param sink Callback receiving every frame.
+     */
+    void setSink(FrameSink sink);
+
+    /**
+     * @brief Streams a number of frames through the pipeline and waits for the last one.
+     * An exception thrown by any stage stops the stream and is rethrown here.
+     * @param frameCount Number of frames to capture.
+     * @return Throughput statistics.
+     */
+    Statistics run(int64_t frameCount);
+
+    /**
+     * @brief Makes a scene source that moves a still image at a constant velocity.
+     * @param scene Single channel image with values in [0, 1].
+     * @param velocity Motion in pixels per second.
+     * @return Scene source.
+     */
+    static SceneSource translatingScene(const cv::Mat &scene, const cv::Point2d &velocity);
+
+private:
+    Config config;
+    SceneSource sceneSource;
+    ExposureSchedule exposureSchedule;
+    cv::Mat psf;
+    double noiseLevel = 0.0;
+    std::shared_ptr<const NoiseModel> noiseModel;
+    CFAPattern cfaPattern;
+    Demosaic::Algorithm demosaicAlgorithm = Demosaic::DEFAULT_ALGORITHM;
+    ISPStage isp;
+    FrameSink sink;
+
+    /**
+     * @brief Renders a frame's scene into a float signal scaled by its exposure.
+     * @param frame Frame whose index, timestamp and exposure are set; receives the signal in raw.
+     */
+    void renderScene(Frame &frame) const;
+};
+
+#endif // VIDEOPIPELINE_H
@@ -0,0 +1,470 @@
+#include "BatchRunner/BatchRunner.h"
+#include "ImageSensor/ImageSensor.h"
+#include "RawFile/RawFile.h"
+#include "SceneGenerator/SceneGenerator.h"
+#include "ThreadPool/ThreadPool.h"
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+namespace
+{
+    // Reads a sequence (or a single scalar) into a list, keeping the default if the key is missing
+    template <typename T>
+    void readList(const cv::FileNode &node, std::vector<T> &values)
+    {
+        if (node.empty() || node.isNone())
+        {
+            return;
+        }
+
+        values.clear();
+        if (node.isSeq())
+        {
+            for (const auto &item : node)
+            {
+                T value;
+                item >> value;
+                values.push_back(value);
+            }
+        }
+        else
+        {
+            T value;
+            node >> value;
+            values.push_back(value);
+        }
+    }
+
+    template <typename T>
+    void readValue(const cv::FileNode &node, T &value)
+    {
+        if (!node.empty() && !node.isNone())
+        {
+            node >> value;
+        }
+    }
+
+    // Writes an image, throwing if the encoder fails, so the job reports the error instead of a missing file
+    void writeImage(const std::string &path, const cv::Mat &image)
+    {
+        if (!cv::imwrite(path, image))
+        {
+            throw std::runtime_error("Cannot write " + path);
+        }
+    }
+}
+
+BatchRunner::SweepSpec BatchRunner::loadSpec(const std::string &path)
+{
+    cv::FileStorage fs(path, cv::FileStorage::READ);
+    if (!fs.isOpened())
+    {
+        throw std::runtime_error("Cannot open sweep spec: " + path);
+    }
+
+    SweepSpec spec;
+    readValue(fs["width"], spec.width);
+    readValue(fs["height"], spec.height);
+    int seed = static_cast<int>(spec.seed); // FileStorage has no 64-bit integers
+    readValue(fs["seed"], seed);
+    spec.seed = static_cast<uint64_t>(seed);
+    readValue(fs["outputDir"], spec.outputDir);
+    readValue(fs["demosaic"], spec.demosaic);
+    readValue(fs["psf"], spec.psf);
+    readValue(fs["wavelength"], spec.wavelength);
+    readValue(fs["fNumber"], spec.fNumber);
+    readValue(fs["pixelPitch"], spec.pixelPitch);
+    readValue(fs["psfSize"], spec.psfSize);
+    readList(fs["bitDepths"], spec.bitDepths);
+    readList(fs["noiseLevels"], spec.noiseLevels);
+    readList(fs["cfaPatterns"], spec.cfaPatterns);
+    readList(fs["scenes"], spec.scenes);
+    readValue(fs["rawFormat"], spec.rawFormat);
+    int analyze = spec.analyze ? 1 : 0; // Booleans are written as 0/1
+    readValue(fs["analyze"], analyze);
+    spec.analyze = (analyze != 0);
+    int saveImages = spec.saveImages ? 1 : 0;
+    readValue(fs["saveImages"], saveImages);
+    spec.saveImages = (saveImages != 0);
+    readValue(fs["cacheMegabytes"], spec.cacheMegabytes);
+    readValue(fs["cacheDir"], spec.cacheDir);
+    readValue(fs["spillMegabytes"], spec.spillMegabytes);
+    readValue(fs["precision"], spec.precision);
+    return spec;
+}
+
+BatchRunner::BatchRunner(const SweepSpec &spec, int numThreads)
+    : spec(spec), numThreads(numThreads), precision(SensorKernels::parsePrecision(spec.precision))
+{
+    if (spec.width <= 0 || spec.height <= 0)
+    {
+        throw std::invalid_argument("Sweep frame size must be positive");
+    }
+    if (spec.bitDepths.empty() || spec.noiseLevels.empty() || spec.cfaPatterns.empty() || spec.scenes.empty())
+    {
+        throw std::invalid_argument("Every sweep axis needs at least one value");
+    }
+    if (spec.rawFormat != "png" && spec.rawFormat != "sraw")
+    {
+        throw std::invalid_argument("Unknown raw format: " + spec.rawFormat);
+    }
+    for (int bitDepth : spec.bitDepths)
+    {
+        SensorKernels::forBitDepth(bitDepth, precision); // Fixed point rejects float bit depths before the sweep starts
+    }
+
+    // Build every shared input once; jobs only read them
+    const std::vector<std::string> sceneNames = SceneGenerator::getSceneNames();
+    for (const auto &name : spec.scenes)
+    {
+        if (std::find(sceneNames.begin(), sceneNames.end(), name) == sceneNames.end())
+        {
+            // Not a generated scene: a file, decoded while the sweep runs
+            if (!std::filesystem::is_regular_file(name))
+            {
+                throw std::invalid_argument("Unknown scene or missing scene file: " + name);
+            }
+            if (std::find(sceneFiles.begin(), sceneFiles.end(), name) == sceneFiles.end())
+            {
+                sceneFiles.push_back(name);
+            }
+        }
+        else if (scenes.find(name) == scenes.end())
+        {
+            // Float32 halves the bandwidth of the scene load unless the sweep is a float64 reference;
+            // color charts are reduced to luminance
+            cv::Mat scene = SceneGenerator::generate(name, spec.width, spec.height, SensorKernels::workingDepth(precision));
+            if (scene.channels() == 3)
+            {
+                cv::Mat luminance;
+                cv::transform(scene, luminance, cv::Matx13f(0.114f, 0.587f, 0.299f));
+                scene = luminance;
+            }
+            scenes[name] = std::make_shared<const cv::Mat>(scene);
+        }
+    }
+    for (const auto &pattern : spec.cfaPatterns)
+    {
+        if (cfaPatterns.find(pattern) == cfaPatterns.end())
+        {
+            cfaPatterns[pattern] = std::make_shared<const CFAPattern>(pattern, spec.width, spec.height);
+        }
+    }
+
+    cv::Mat psf;
+    if (spec.psf == "gaussian")
+    {
+        cv::Mat gaussian = cv::getGaussianKernel(7, 1.5, CV_64F);
+        psf = gaussian * gaussian.t();
+    }
+    else if (spec.psf == "airy")
+    {
+        psf = PSFConvolver::airyPSF(spec.wavelength, spec.fNumber, spec.pixelPitch, spec.psfSize);
+    }
+    else if (spec.psf != "none")
+    {
+        throw std::invalid_argument("Unknown PSF type: " + spec.psf);
+    }
+    if (!psf.empty())
+    {
+        auto prepared = std::make_shared<PSFConvolver>();
+        prepared->setPSF(psf);
+        convolver = std::move(prepared);
+    }
+
+    if (!spec.demosaic.empty())
+    {
+        Demosaic::parseAlgorithm(spec.demosaic); // Fail before the sweep starts
+    }
+    else if (spec.analyze)
+    {
+        throw std::invalid_argument("Image quality analysis needs a demosaicing algorithm");
+    }
+
+    if (spec.cacheMegabytes < 0 || spec.spillMegabytes < 0)
+    {
+        throw std::invalid_argument("Stage cache size must not be negative");
+    }
+    if (spec.cacheMegabytes > 0)
+    {
+        stageCache = std::make_shared<StageCache>(static_cast<size_t>(spec.cacheMegabytes) << 20, spec.cacheDir,
+                                                  static_cast<size_t>(spec.spillMegabytes) << 20);
+    }
+}
+
+std::vector<BatchRunner::Job> BatchRunner::expandJobs() const
+{
+    std::vector<Job> jobs;
+    for (const auto &scene : spec.scenes)
+    {
+        for (const auto &pattern : spec.cfaPatterns)
+        {
+            for (int bitDepth : spec.bitDepths)
+            {
+                for (double noiseLevel : spec.noiseLevels)
+                {
+                    Job job;
+                    job.index = static_cast<int>(jobs.size());
+                    job.bitDepth = bitDepth;
+                    job.noiseLevel = noiseLevel;
+                    job.cfaPattern = pattern;
+                    job.scene = scene;
+                    jobs.push_back(job);
+                }
+            }
+        }
+    }
+    return jobs;
+}
+
+std::vector<BatchRunner::Result> BatchRunner::run()
+{
+    std::filesystem::create_directories(spec.outputDir);
+
+    std::vector<Job> jobs = expandJobs();
+    std::vector<Result> results(jobs.size());
+    {
+        // Scene files are decoded one ahead, in the order their jobs are submitted
+        SceneLoader::Options loadOptions;
+        loadOptions.depth = SensorKernels::workingDepth(precision);
+        std::unique_ptr<SceneLoader::Prefetcher> prefetcher;
+        if (!sceneFiles.empty())
+        {
+            prefetcher = std::make_unique<SceneLoader::Prefetcher>(sceneFiles, loadOptions);
+        }
+
+        ThreadPool::OpenCVThreadsGuard threadsGuard;
+        ThreadPool pool(numThreads);
+        std::vector<std::string> submitted;
+        for (const auto &name : spec.scenes)
+        {
+            if (std::find(submitted.begin(), submitted.end(), name) != submitted.end())
+            {
+                continue;
+            }
+            submitted.push_back(name);
+
+            std::shared_ptr<const cv::Mat> scene;
+            std::string error;
+            auto generated = scenes.find(name);
+            if (generated != scenes.end())
+            {
+                scene = generated->second;
+            }
+            else
+            {
+                // Blocks only until this file is decoded; jobs of earlier scenes keep running meanwhile
+                try
+                {
+                    scene = std::make_shared<const cv::Mat>(loadScene(*prefetcher->next()));
+                }
+                catch (const std::exception &e)
+                {
+                    error = e.what();
+                }
+            }
+
+            for (size_t i = 0; i < jobs.size(); ++i)
+            {
+                if (jobs[i].scene != name)
+                {
+                    continue;
+                }
+                if (!scene)
+                {
+                    results[i].job = jobs[i];
+                    results[i].error = error;
+                    continue;
+                }
+                // Each job writes only its own slot
+                pool.submit([this, &jobs, &results, i, scene]
+                {
+                    results[i] = runJob(jobs[i], *scene);
+                });
+            }
+        }
+        pool.wait();
+    }
+
+    writeManifest(results);
+    return results;
+}
+
+cv::Mat BatchRunner::loadScene(const SceneLoader &loader) const
+{
+    cv::Mat scene = loader.loadLuminance();
+    if (scene.size() != cv::Size(spec.width, spec.height))
+    {
+        cv::Mat resized;
+        cv::resize(scene, resized, cv::Size(spec.width, spec.height), 0, 0, cv::INTER_AREA);
+        scene = resized;
+    }
+    return scene;
+}
+
+BatchRunner::Result BatchRunner::runJob(const Job &job, const cv::Mat &scene) const
+{
+    Result result;
+    result.job = job;
+    auto start = std::chrono::steady_clock::now();
+
+    try
+    {
+        ImageSensor sensor(job.bitDepth, spec.width, spec.height, precision);
+        sensor.setSeed(spec.seed);
+
+        SensorPipeline pipeline;
+        pipeline.setSeed(spec.seed);
+        pipeline.setStageCache(stageCache);
+        if (convolver)
+        {
+            pipeline.addDiffraction(convolver);
+        }
+        pipeline.addNoise(job.noiseLevel);
+        pipeline.addCFA(cfaPatterns.at(job.cfaPattern));
+        sensor.simulate(scene, pipeline);
+
+        const cv::Mat &raw = sensor.getSensorData();
+        cv::Scalar mean, stddev;
+        cv::meanStdDev(raw, mean, stddev);
+        result.mean = mean[0];
+        result.stddev = stddev[0];
+
+        // Scene files contribute their stem; the job index keeps equal stems apart
+        std::ostringstream name;
+        name << std::setw(4) << std::setfill('0') << job.index << "_" << std::filesystem::path(job.scene).stem().string() << "_" << job.cfaPattern
+             << "_" << job.bitDepth << "bit_n" << job.noiseLevel;
+        std::filesystem::path base = std::filesystem::path(spec.outputDir) / name.str();
+
+        if (!spec.saveImages)
+        {
+            // Metrics only, nothing is written
+        }
+        else if (spec.rawFormat == "sraw")
+        {
+            // Bit packed at the sensor's native width with the settings that produced it, no image encoding
+            RawFile::Header header;
+            header.width = spec.width;
+            header.height = spec.height;
+            header.bitDepth = job.bitDepth;
+            header.packedBits = RawFile::packedBitsForFullScale(ImageSensor::fullScaleForBitDepth(job.bitDepth), raw.depth());
+            header.cfaPattern = job.cfaPattern;
+            header.noiseLevel = job.noiseLevel;
+            header.seed = spec.seed;
+            result.rawFile = base.string() + "_raw.sraw";
+            RawFile::Writer writer(result.rawFile, header);
+            writer.writeFrame(raw);
+            writer.close();
+        }
+        else if (raw.depth() == CV_64F)
+        {
+            // PNG holds 8/16-bit frames, float frames go to TIFF
+            result.rawFile = base.string() + "_raw.tiff";
+            cv::Mat raw32F;
+            raw.convertTo(raw32F, CV_32F);
+            writeImage(result.rawFile, raw32F);
+        }
+        else
+        {
+            result.rawFile = base.string() + (raw.depth() == CV_32F ? "_raw.tiff" : "_raw.png");
+            writeImage(result.rawFile, raw);
+        }
+
+        if (!spec.demosaic.empty() && (spec.saveImages || spec.analyze))
+        {
+            cv::Mat output;
+            sensor.demosaic(output, job.cfaPattern, Demosaic::parseAlgorithm(spec.demosaic));
+            if (spec.analyze)
+            {
+                // Measured on the in-memory image, before any conversion for saving
+                std::vector<cv::Rect> patches;
+                cv::Rect edgeRoi;
+                if (job.scene == "color-checker")
+                {
+                    patches = SceneGenerator::getColorCheckerPatches(spec.width, spec.height);
+                }
+                else if (job.scene == "slanted-edge")
+                {
+                    edgeRoi = cv::Rect(0, 0, spec.width, spec.height);
+                }
+                result.quality = ImageQuality::analyze(output, scene, ImageSensor::fullScaleForBitDepth(job.bitDepth), patches, edgeRoi);
+                result.analyzed = true;
+            }
+            if (spec.saveImages)
+            {
+                if (output.depth() != CV_8U && output.depth() != CV_16U)
+                {
+                    output.convertTo(output, CV_16U); // Float sensors already use the 16-bit full scale
+                }
+                result.rgbFile = base.string() + "_rgb.png";
+                writeImage(result.rgbFile, output);
+            }
+        }
+    }
+    catch (const std::exception &e)
+    {
+        result.error = e.what();
+    }
+
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+void BatchRunner::writeManifest(const std::vector<Result> &results) const
+{
+    std::string path = (std::filesystem::path(spec.outputDir) / MANIFEST_FILE).string();
+    cv::FileStorage fs(path, cv::FileStorage::WRITE);
+    if (!fs.isOpened())
+    {
+        throw std::runtime_error("Cannot write sweep manifest: " + path);
+    }
+
+    fs << "precision" << SensorKernels::precisionName(precision);
+    fs << "jobs" << "[";
+    for (const auto &result : results)
+    {
+        fs << "{";
+        fs << "index" << result.job.index;
+        fs << "scene" << result.job.scene;
+        fs << "cfaPattern" << result.job.cfaPattern;
+        fs << "bitDepth" << result.job.bitDepth;
+        fs << "noiseLevel" << result.job.noiseLevel;
+        fs << "rawFile" << result.rawFile;
+        fs << "rgbFile" << result.rgbFile;
+        fs << "mean" << result.mean;
+        fs << "stddev" << result.stddev;
+        fs << "seconds" << result.seconds;
+        if (result.analyzed)
+        {
+            fs << "quality" << "{";
+            fs << "psnr" << result.quality.psnr;
+            fs << "ssim" << result.quality.ssim;
+            fs << "deltaE" << result.quality.deltaE;
+            fs << "falseColor" << result.quality.falseColor;
+            fs << "zipper" << result.quality.zipper;
+            fs << "mtf50" << result.quality.mtf50;
+            fs << "mtfNyquist" << result.quality.mtfNyquist;
+            fs << "snrDb" << result.quality.meanSNRDb;
+            fs << "}";
+        }
+        fs << "error" << result.error;
+        fs << "}";
+    }
+    fs << "]";
+
+    if (stageCache)
+    {
+        StageCache::Stats stats = stageCache->getStats();
+        fs << "stageCache" << "{";
+        fs << "hits" << static_cast<int>(stats.hits); // FileStorage has no 64-bit integers
+        fs << "diskHits" << static_cast<int>(stats.diskHits);
+        fs << "misses" << static_cast<int>(stats.misses);
+        fs << "evictions" << static_cast<int>(stats.evictions);
+        fs << "spillFailures" << static_cast<int>(stats.spillFailures);
+        fs << "}";
+    }
+}
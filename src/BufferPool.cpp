@@ -0,0 +1,269 @@
+#include "BufferPool/BufferPool.h"
+#include <new>
+#include <utility>
+
+namespace
+{
+    // Allocator that was the default before setDefaultPooling(true)
+    cv::MatAllocator *previousDefaultAllocator = nullptr;
+    std::mutex defaultMutex;
+}
+
+BufferPool::BufferPool(size_t maxPooledBytes)
+    : maxPooledBytes(maxPooledBytes), allocator(*this)
+{
+}
+
+BufferPool::~BufferPool()
+{
+    idleBuffers.clear(); // Buffers from the own allocator return their blocks first
+    freeIdleMemory();
+}
+
+BufferPool &BufferPool::global()
+{
+    static BufferPool *pool = new BufferPool();
+    return *pool;
+}
+
+void BufferPool::setDefaultPooling(bool enabled)
+{
+    std::lock_guard<std::mutex> lock(defaultMutex);
+    cv::MatAllocator *pooled = global().getAllocator();
+    if (enabled && cv::Mat::getDefaultAllocator() != pooled)
+    {
+        previousDefaultAllocator = cv::Mat::getDefaultAllocator();
+        cv::Mat::setDefaultAllocator(pooled);
+    }
+    else if (!enabled && cv::Mat::getDefaultAllocator() == pooled)
+    {
+        // Matrices already allocated keep returning their blocks to the global pool
+        cv::Mat::setDefaultAllocator(previousDefaultAllocator);
+    }
+}
+
+cv::Mat BufferPool::acquire(cv::Size size, int type)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        // Newest first: the most recently released buffer is the most likely to be in cache
+        for (size_t i = idleBuffers.size(); i-- > 0;)
+        {
+            if (idleBuffers[i].size() == size && idleBuffers[i].type() == type)
+            {
+                cv::Mat buffer = idleBuffers[i];
+                idleBuffers.erase(idleBuffers.begin() + i);
+                pooledBytes -= buffer.total() * buffer.elemSize();
+                return buffer;
+            }
+        }
+    }
+    return cv::Mat(size, type);
+}
+
+void BufferPool::release(cv::Mat &buffer)
+{
+    if (buffer.empty() || buffer.isSubmatrix() || !buffer.isContinuous())
+    {
+        buffer.release();
+        return;
+    }
+
+    size_t bytes = buffer.total() * buffer.elemSize();
+    std::vector<cv::Mat> dropped;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        idleBuffers.push_back(buffer);
+        pooledBytes += bytes;
+        trim(dropped);
+    }
+    buffer.release();
+}
+
+cv::MatAllocator *BufferPool::getAllocator()
+{
+    return &allocator;
+}
+
+uint64_t BufferPool::getHeapAllocations() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return heapAllocations;
+}
+
+size_t BufferPool::getPooledBytes() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return pooledBytes;
+}
+
+void BufferPool::clear()
+{
+    // Released unlocked, since buffers from the own allocator return their blocks to the pool
+    std::vector<cv::Mat> buffers;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        buffers.swap(idleBuffers);
+    }
+    buffers.clear();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    freeIdleMemory();
+    pooledBytes = 0;
+}
+
+void *BufferPool::takeBlock(size_t bytes)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        // Newest first, like acquire
+        auto list = idleBlocks.find(bytes);
+        if (list != idleBlocks.end() && !list->second.empty())
+        {
+            void *block = list->second.back().block;
+            list->second.pop_back();
+            pooledBytes -= bytes;
+            return block;
+        }
+        ++heapAllocations;
+    }
+    return cv::fastMalloc(bytes);
+}
+
+void BufferPool::returnBlock(void *block, size_t bytes)
+{
+    std::vector<cv::Mat> dropped; // Declared before the lock, so dropped buffers die unlocked
+    std::lock_guard<std::mutex> lock(mutex);
+    idleBlocks[bytes].push_back({returnedBlocks++, block});
+    pooledBytes += bytes;
+    trim(dropped);
+}
+
+cv::UMatData *BufferPool::takeHeader(const cv::MatAllocator *owner)
+{
+    void *storage = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!idleHeaders.empty())
+        {
+            storage = idleHeaders.back();
+            idleHeaders.pop_back();
+        }
+    }
+    if (storage == nullptr)
+    {
+        storage = ::operator new(sizeof(cv::UMatData));
+    }
+    return new (storage) cv::UMatData(owner);
+}
+
+void BufferPool::returnHeader(cv::UMatData *header)
+{
+    header->~UMatData();
+    std::lock_guard<std::mutex> lock(mutex);
+    idleHeaders.push_back(header);
+}
+
+void BufferPool::freeIdleMemory()
+{
+    for (auto &list : idleBlocks)
+    {
+        for (const IdleBlock &idle : list.second)
+        {
+            cv::fastFree(idle.block);
+        }
+    }
+    idleBlocks.clear();
+    for (void *storage : idleHeaders)
+    {
+        ::operator delete(storage);
+    }
+    idleHeaders.clear();
+}
+
+void BufferPool::trim(std::vector<cv::Mat> &dropped)
+{
+    while (pooledBytes > maxPooledBytes && !idleBuffers.empty())
+    {
+        pooledBytes -= idleBuffers.front().total() * idleBuffers.front().elemSize();
+        dropped.push_back(std::move(idleBuffers.front()));
+        idleBuffers.erase(idleBuffers.begin());
+    }
+    while (pooledBytes > maxPooledBytes)
+    {
+        // Oldest block across the free lists; there are only a few distinct frame sizes
+        std::deque<IdleBlock> *oldest = nullptr;
+        size_t oldestBytes = 0;
+        for (auto &list : idleBlocks)
+        {
+            if (!list.second.empty() && (oldest == nullptr || list.second.front().age < oldest->front().age))
+            {
+                oldest = &list.second;
+                oldestBytes = list.first;
+            }
+        }
+        if (oldest == nullptr)
+        {
+            break;
+        }
+        pooledBytes -= oldestBytes;
+        cv::fastFree(oldest->front().block);
+        oldest->pop_front();
+    }
+}
+
+BufferPool::Allocator::Allocator(BufferPool &pool)
+    : pool(pool)
+{
+}
+
+cv::UMatData *BufferPool::Allocator::allocate(int dims, const int *sizes, int type, void *data, size_t *step, cv::AccessFlag, cv::UMatUsageFlags) const
+{
+    // Same layout rules as OpenCV's standard allocator
+    size_t total = CV_ELEM_SIZE(type);
+    for (int i = dims - 1; i >= 0; --i)
+    {
+        if (step != nullptr)
+        {
+            if (data != nullptr && step[i] != CV_AUTOSTEP)
+            {
+                CV_Assert(total <= step[i]);
+                total = step[i];
+            }
+            else
+            {
+                step[i] = total;
+            }
+        }
+        total *= sizes[i];
+    }
+
+    cv::UMatData *u = pool.takeHeader(this);
+    u->data = u->origdata = static_cast<uchar *>(data != nullptr ? data : pool.takeBlock(total));
+    u->size = total;
+    if (data != nullptr)
+    {
+        u->flags |= cv::UMatData::USER_ALLOCATED;
+    }
+    return u;
+}
+
+bool BufferPool::Allocator::allocate(cv::UMatData *data, cv::AccessFlag, cv::UMatUsageFlags) const
+{
+    return data != nullptr;
+}
+
+void BufferPool::Allocator::deallocate(cv::UMatData *data) const
+{
+    if (data == nullptr)
+    {
+        return;
+    }
+    CV_Assert(data->urefcount == 0 && data->refcount == 0);
+    if (!(data->flags & cv::UMatData::USER_ALLOCATED))
+    {
+        pool.returnBlock(data->origdata, data->size);
+        data->origdata = nullptr;
+    }
+    pool.returnHeader(data);
+}
@@ -1,47 +1,70 @@
 #include "CFAPattern/CFAPattern.h"
+#include <algorithm>
+#include <cmath>
 #include <iostream>
 
-CFAPattern::CFAPattern(const std::string &patternString, int width, int height)
-    : cfaPattern(height, width, CV_8UC1)
+namespace
+{
+    template <typename T>
+    void applyWeights(cv::Mat &data, const cv::Mat &weights, int rowOffset)
+    {
+        cv::parallel_for_(cv::Range(0, data.rows), [&](const cv::Range &range)
+        {
+            for (int i = range.start; i < range.end; ++i)
+            {
+                const float *w = weights.ptr<float>((rowOffset + i) % weights.rows);
+                T *row = data.ptr<T>(i);
+                for (int j = 0; j < data.cols; ++j)
+                {
+                    row[j] = cv::saturate_cast<T>(row[j] * w[j]);
+                }
+            }
+        });
+    }
+
+    // Range and spacing of the default transmission curves (nm)
+    constexpr double SPECTRAL_FIRST_WAVELENGTH = 380.0;
+    constexpr double SPECTRAL_LAST_WAVELENGTH = 780.0;
+    constexpr double SPECTRAL_STEP = 5.0;
+
+    double bandPass(double wavelength, double center, double width)
+    {
+        double d = (wavelength - center) / width;
+        return std::exp(-0.5 * d * d);
+    }
+}
+
+CFAPattern::CFAPattern(const std::string &patternString, int /*width*/, int /*height*/)
+    : colorWeights(NUM_COLORS)
 {
     // Initialize default color weights
     colorWeights[RED] = 0.299;
     colorWeights[GREEN] = 0.587;
     colorWeights[BLUE] = 0.114;
     colorWeights[CLEAR] = 1.0;
+    colorWeights[YELLOW] = colorWeights[RED] + colorWeights[GREEN]; // Yellow passes red and green
+    colorWeights[CYAN] = colorWeights[GREEN] + colorWeights[BLUE];  // Cyan passes green and blue
 
-    // Validate the pattern string length
-    if (patternString.length() != 4)
+    // Validate the pattern size
+    std::vector<Color> colors = parsePatternString(patternString);
+    int tileSize = static_cast<int>(std::lround(std::sqrt(static_cast<double>(colors.size()))));
+    if (tileSize < MIN_TILE_SIZE || tileSize > MAX_TILE_SIZE || static_cast<size_t>(tileSize * tileSize) != colors.size())
     {
-        throw std::invalid_argument("CFA pattern string must be 4 characters long (2x2 pattern)");
+        throw std::invalid_argument("CFA pattern string must describe a square tile from 2x2 to 6x6");
     }
 
-    // Populate the CFA pattern matrix
-    for (int i = 0; i < height; ++i)
+    // Populate the CFA tile
+    cfaPattern.create(tileSize, tileSize, CV_8UC1);
+    for (int i = 0; i < tileSize; ++i)
     {
-        for (int j = 0; j < width; ++j)
+        for (int j = 0; j < tileSize; ++j)
         {
-            int patternIndex = (i % 2) * 2 + (j % 2);
-            char patternChar = patternString[patternIndex];
-            switch (patternChar)
-            {
-            case 'R':
-                cfaPattern.at<uchar>(i, j) = RED;
-                break;
-            case 'G':
-                cfaPattern.at<uchar>(i, j) = GREEN;
-                break;
-            case 'B':
-                cfaPattern.at<uchar>(i, j) = BLUE;
-                break;
-            case 'C':
-                cfaPattern.at<uchar>(i, j) = CLEAR;
-                break;
-            default:
-                throw std::invalid_argument("Invalid CFA pattern character");
-            }
+            cfaPattern.at<uchar>(i, j) = static_cast<uchar>(colors[i * tileSize + j]);
         }
     }
+
+    updateWeightTable();
+    initSpectralCurves();
 }
 
 const cv::Mat &CFAPattern::getPattern() const
@@ -49,16 +72,59 @@ const cv::Mat &CFAPattern::getPattern() const
     return cfaPattern;
 }
 
+int CFAPattern::getTileRows() const
+{
+    return cfaPattern.rows;
+}
+
+int CFAPattern::getTileCols() const
+{
+    return cfaPattern.cols;
+}
+
+CFAPattern::Color CFAPattern::getColor(int row, int col) const
+{
+    return static_cast<Color>(cfaPattern.at<uchar>(row % cfaPattern.rows, col % cfaPattern.cols));
+}
+
+std::vector<CFAPattern::Color> CFAPattern::getColors() const
+{
+    std::vector<bool> present(NUM_COLORS, false);
+    for (int i = 0; i < cfaPattern.rows; ++i)
+    {
+        for (int j = 0; j < cfaPattern.cols; ++j)
+        {
+            present[cfaPattern.at<uchar>(i, j)] = true;
+        }
+    }
+
+    std::vector<Color> colors;
+    for (int c = 0; c < NUM_COLORS; ++c)
+    {
+        if (present[c])
+        {
+            colors.push_back(static_cast<Color>(c));
+        }
+    }
+    return colors;
+}
+
 void CFAPattern::setColorWeight(Color color, double weight)
 {
-    colorWeights[color] = weight;
+    colorWeights.at(color) = weight;
+    updateWeightTable();
 }
 
 void CFAPattern::updateColorWeights(const std::vector<std::string> &colorWeights)
 {
     for (const auto &weightStr : colorWeights)
     {
-        if (weightStr.size() >= 3 && weightStr[1] == ':')
+        size_t separator = weightStr.find(':');
+        if (separator == 2 && weightStr.compare(0, 2, "Cy") == 0 && weightStr.size() >= 4)
+        {
+            setColorWeight(CYAN, std::stod(weightStr.substr(3)));
+        }
+        else if (weightStr.size() >= 3 && separator == 1)
         {
             char color = weightStr[0];
             double weight = std::stod(weightStr.substr(2));
@@ -76,6 +142,9 @@ void CFAPattern::updateColorWeights(const std::vector<std::string> &colorWeights
             case 'C':
                 setColorWeight(CLEAR, weight);
                 break;
+            case 'Y':
+                setColorWeight(YELLOW, weight);
+                break;
             default:
                 std::cerr << "Invalid color code for weight change: " << color << std::endl;
             }
@@ -92,7 +161,210 @@ double CFAPattern::getColorWeight(Color color) const
     return colorWeights.at(color);
 }
 
+const float *CFAPattern::getWeightTable() const
+{
+    return weightTable.data();
+}
+
+cv::Mat CFAPattern::expandWeights(int width, int colOffset) const
+{
+    return expandTable(weightTable.data(), width, colOffset);
+}
+
+void CFAPattern::apply(cv::Mat &data, int rowOffset, int colOffset) const
+{
+    if (data.channels() != 1)
+    {
+        throw std::invalid_argument("CFA can only be applied to single channel data");
+    }
+
+    // One row of weights per tile row, so every image row is a plain element-wise multiply
+    cv::Mat weights = expandWeights(data.cols, colOffset);
+    switch (data.depth())
+    {
+    case CV_8U:
+        applyWeights<uchar>(data, weights, rowOffset);
+        break;
+    case CV_16U:
+        applyWeights<ushort>(data, weights, rowOffset);
+        break;
+    case CV_32F:
+        applyWeights<float>(data, weights, rowOffset);
+        break;
+    case CV_64F:
+        applyWeights<double>(data, weights, rowOffset);
+        break;
+    default:
+        throw std::invalid_argument("Unsupported data type for CFA");
+    }
+}
+
+void CFAPattern::setSpectralResponse(Color color, const std::vector<double> &wavelengths, const std::vector<double> &transmission)
+{
+    if (wavelengths.empty() || wavelengths.size() != transmission.size())
+    {
+        throw std::invalid_argument("Spectral response needs one transmission value per wavelength");
+    }
+    if (!std::is_sorted(wavelengths.begin(), wavelengths.end()))
+    {
+        throw std::invalid_argument("Spectral response wavelengths must be ascending");
+    }
+
+    SpectralCurve &curve = spectralCurves.at(color);
+    curve.wavelengths = wavelengths;
+    curve.values = transmission;
+}
+
+double CFAPattern::getTransmission(Color color, double wavelength) const
+{
+    const SpectralCurve &curve = spectralCurves.at(color);
+    if (wavelength <= curve.wavelengths.front())
+    {
+        return curve.values.front();
+    }
+    if (wavelength >= curve.wavelengths.back())
+    {
+        return curve.values.back();
+    }
+
+    size_t upper = std::upper_bound(curve.wavelengths.begin(), curve.wavelengths.end(), wavelength) - curve.wavelengths.begin();
+    size_t lower = upper - 1;
+    double t = (wavelength - curve.wavelengths[lower]) / (curve.wavelengths[upper] - curve.wavelengths[lower]);
+    return curve.values[lower] + t * (curve.values[upper] - curve.values[lower]);
+}
+
+cv::Mat CFAPattern::expandSpectralWeights(double wavelength, int width, int colOffset) const
+{
+    std::vector<double> transmission(NUM_COLORS);
+    for (int c = 0; c < NUM_COLORS; ++c)
+    {
+        transmission[c] = getTransmission(static_cast<Color>(c), wavelength);
+    }
+    return expandColorValues(transmission, width, colOffset);
+}
+
+cv::Mat CFAPattern::expandColorValues(const std::vector<double> &values, int width, int colOffset) const
+{
+    if (values.size() != NUM_COLORS)
+    {
+        throw std::invalid_argument("Expected one value per CFA color");
+    }
+
+    std::vector<float> table(cfaPattern.total());
+    for (int i = 0; i < cfaPattern.rows; ++i)
+    {
+        for (int j = 0; j < cfaPattern.cols; ++j)
+        {
+            table[i * cfaPattern.cols + j] = static_cast<float>(values[cfaPattern.at<uchar>(i, j)]);
+        }
+    }
+    return expandTable(table.data(), width, colOffset);
+}
+
 bool CFAPattern::isValidCFAPatternChar(char ch) const
 {
-    return ch == 'R' || ch == 'G' || ch == 'B' || ch == 'C';
+    return ch == 'R' || ch == 'G' || ch == 'B' || ch == 'C' || ch == 'Y';
+}
+
+std::vector<CFAPattern::Color> CFAPattern::parsePatternString(const std::string &patternString) const
+{
+    std::vector<Color> colors;
+    for (size_t i = 0; i < patternString.size(); ++i)
+    {
+        char patternChar = patternString[i];
+        if (!isValidCFAPatternChar(patternChar))
+        {
+            throw std::invalid_argument("Invalid CFA pattern character");
+        }
+
+        switch (patternChar)
+        {
+        case 'R':
+            colors.push_back(RED);
+            break;
+        case 'G':
+            colors.push_back(GREEN);
+            break;
+        case 'B':
+            colors.push_back(BLUE);
+            break;
+        case 'C':
+            // "Cy" is cyan, a lone "C" is clear
+            if (i + 1 < patternString.size() && patternString[i + 1] == 'y')
+            {
+                colors.push_back(CYAN);
+                ++i;
+            }
+            else
+            {
+                colors.push_back(CLEAR);
+            }
+            break;
+        case 'Y':
+            colors.push_back(YELLOW);
+            break;
+        }
+    }
+    return colors;
+}
+
+void CFAPattern::updateWeightTable()
+{
+    weightTable.resize(cfaPattern.total());
+    for (int i = 0; i < cfaPattern.rows; ++i)
+    {
+        for (int j = 0; j < cfaPattern.cols; ++j)
+        {
+            weightTable[i * cfaPattern.cols + j] = static_cast<float>(colorWeights[cfaPattern.at<uchar>(i, j)]);
+        }
+    }
+}
+
+void CFAPattern::initSpectralCurves()
+{
+    // Smooth band-pass approximations of typical dye filters; yellow and cyan are the
+    // sums of the passes they combine and clear is flat
+    int count = static_cast<int>(std::lround((SPECTRAL_LAST_WAVELENGTH - SPECTRAL_FIRST_WAVELENGTH) / SPECTRAL_STEP)) + 1;
+    spectralCurves.assign(NUM_COLORS, SpectralCurve());
+    for (auto &curve : spectralCurves)
+    {
+        curve.wavelengths.resize(count);
+        curve.values.resize(count);
+    }
+
+    for (int k = 0; k < count; ++k)
+    {
+        double wavelength = SPECTRAL_FIRST_WAVELENGTH + k * SPECTRAL_STEP;
+        double red = bandPass(wavelength, 600.0, 35.0);
+        double green = bandPass(wavelength, 535.0, 35.0);
+        double blue = bandPass(wavelength, 460.0, 30.0);
+
+        double values[NUM_COLORS];
+        values[RED] = red;
+        values[GREEN] = green;
+        values[BLUE] = blue;
+        values[CLEAR] = 1.0;
+        values[YELLOW] = std::min(1.0, red + green);
+        values[CYAN] = std::min(1.0, green + blue);
+        for (int c = 0; c < NUM_COLORS; ++c)
+        {
+            spectralCurves[c].wavelengths[k] = wavelength;
+            spectralCurves[c].values[k] = values[c];
+        }
+    }
+}
+
+cv::Mat CFAPattern::expandTable(const float *table, int width, int colOffset) const
+{
+    cv::Mat expanded(cfaPattern.rows, width, CV_32FC1);
+    for (int i = 0; i < cfaPattern.rows; ++i)
+    {
+        const float *tableRow = &table[i * cfaPattern.cols];
+        float *row = expanded.ptr<float>(i);
+        for (int j = 0; j < width; ++j)
+        {
+            row[j] = tableRow[(colOffset + j) % cfaPattern.cols];
+        }
+    }
+    return expanded;
 }
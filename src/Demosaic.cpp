@@ -0,0 +1,520 @@
+#include "Demosaic/Demosaic.h"
+#include "Telemetry/Telemetry.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+namespace
+{
+    constexpr int BORDER = 2; // Padding needed by the 5x5 kernels
+
+    // Pixel sites of a 2x2 tile with one doubled color on a diagonal (Bayer-like)
+    enum Site
+    {
+        SITE_FIRST,             // First singleton color
+        SITE_SECOND,            // Second singleton color
+        SITE_DOUBLED_FIRST_ROW, // Doubled color in the row of the first singleton
+        SITE_DOUBLED_SECOND_ROW // Doubled color in the row of the second singleton
+    };
+
+    struct QuadLayout
+    {
+        CFAPattern::Color doubled; // Color that appears twice (G, C or Y)
+        CFAPattern::Color first;   // Singleton color sharing a row with the doubled color
+        CFAPattern::Color second;  // Other singleton color
+        Site sites[2][2];          // Site type per (row % 2, col % 2)
+    };
+
+    bool findQuadLayout(const CFAPattern &cfaPattern, QuadLayout &layout)
+    {
+        if (cfaPattern.getTileRows() != 2 || cfaPattern.getTileCols() != 2)
+        {
+            return false;
+        }
+
+        CFAPattern::Color c00 = cfaPattern.getColor(0, 0);
+        CFAPattern::Color c01 = cfaPattern.getColor(0, 1);
+        CFAPattern::Color c10 = cfaPattern.getColor(1, 0);
+        CFAPattern::Color c11 = cfaPattern.getColor(1, 1);
+
+        int firstRow, firstCol;
+        if (c00 == c11 && c01 != c10 && c01 != c00 && c10 != c00)
+        {
+            layout.doubled = c00;
+            layout.first = c01;
+            layout.second = c10;
+            firstRow = 0;
+            firstCol = 1;
+        }
+        else if (c01 == c10 && c00 != c11 && c00 != c01 && c11 != c01)
+        {
+            layout.doubled = c01;
+            layout.first = c00;
+            layout.second = c11;
+            firstRow = 0;
+            firstCol = 0;
+        }
+        else
+        {
+            return false;
+        }
+
+        for (int r = 0; r < 2; ++r)
+        {
+            for (int c = 0; c < 2; ++c)
+            {
+                if (r == firstRow && c == firstCol)
+                {
+                    layout.sites[r][c] = SITE_FIRST;
+                }
+                else if (r != firstRow && c != firstCol)
+                {
+                    layout.sites[r][c] = SITE_SECOND;
+                }
+                else
+                {
+                    layout.sites[r][c] = (r == firstRow) ? SITE_DOUBLED_FIRST_ROW : SITE_DOUBLED_SECOND_ROW;
+                }
+            }
+        }
+        return true;
+    }
+
+    // Malvar-He-Cutler kernels on five padded rows r[0..4] centred on r[2][x]
+    inline float mhcCross(const float *const r[5], int x)
+    {
+        return (4.0f * r[2][x] + 2.0f * (r[1][x] + r[3][x] + r[2][x - 1] + r[2][x + 1]) - (r[0][x] + r[4][x] + r[2][x - 2] + r[2][x + 2])) * 0.125f;
+    }
+
+    inline float mhcHorizontal(const float *const r[5], int x)
+    {
+        return (5.0f * r[2][x] + 4.0f * (r[2][x - 1] + r[2][x + 1]) - (r[2][x - 2] + r[2][x + 2]) - (r[1][x - 1] + r[1][x + 1] + r[3][x - 1] + r[3][x + 1]) + 0.5f * (r[0][x] + r[4][x])) * 0.125f;
+    }
+
+    inline float mhcVertical(const float *const r[5], int x)
+    {
+        return (5.0f * r[2][x] + 4.0f * (r[1][x] + r[3][x]) - (r[0][x] + r[4][x]) - (r[1][x - 1] + r[1][x + 1] + r[3][x - 1] + r[3][x + 1]) + 0.5f * (r[2][x - 2] + r[2][x + 2])) * 0.125f;
+    }
+
+    inline float mhcDiagonal(const float *const r[5], int x)
+    {
+        return (6.0f * r[2][x] + 2.0f * (r[1][x - 1] + r[1][x + 1] + r[3][x - 1] + r[3][x + 1]) - 1.5f * (r[0][x] + r[4][x] + r[2][x - 2] + r[2][x + 2])) * 0.125f;
+    }
+
+    // Hamilton-Adams estimate of the doubled color at a singleton site
+    inline float directionalDoubled(const float *const r[5], int x)
+    {
+        float laplacianH = 2.0f * r[2][x] - r[2][x - 2] - r[2][x + 2];
+        float laplacianV = 2.0f * r[2][x] - r[0][x] - r[4][x];
+        float gradientH = std::abs(r[2][x - 1] - r[2][x + 1]) + std::abs(laplacianH);
+        float gradientV = std::abs(r[1][x] - r[3][x]) + std::abs(laplacianV);
+        float estimateH = 0.5f * (r[2][x - 1] + r[2][x + 1]) + 0.25f * laplacianH;
+        float estimateV = 0.5f * (r[1][x] + r[3][x]) + 0.25f * laplacianV;
+        if (gradientH < gradientV)
+        {
+            return estimateH;
+        }
+        if (gradientV < gradientH)
+        {
+            return estimateV;
+        }
+        return 0.5f * (estimateH + estimateV);
+    }
+
+    void padMosaic(const cv::Mat &source, cv::Mat &padded)
+    {
+        // Reflect-101 keeps the CFA phase of the mirrored pixels
+        cv::copyMakeBorder(source, padded, BORDER, BORDER, BORDER, BORDER, cv::BORDER_REFLECT_101);
+    }
+
+    void rowPointers(const cv::Mat &padded, int y, const float *r[5])
+    {
+        for (int k = 0; k < 5; ++k)
+        {
+            r[k] = padded.ptr<float>(y + k) + BORDER;
+        }
+    }
+
+    void malvarPlanes(const cv::Mat &rawF, const QuadLayout &layout, std::vector<cv::Mat> &planes)
+    {
+        cv::Mat padded;
+        padMosaic(rawF, padded);
+        for (auto &plane : planes)
+        {
+            plane.create(rawF.size(), CV_32FC1);
+        }
+
+        cv::parallel_for_(cv::Range(0, rawF.rows), [&](const cv::Range &range)
+        {
+            const float *r[5];
+            for (int y = range.start; y < range.end; ++y)
+            {
+                rowPointers(padded, y, r);
+                float *d = planes[0].ptr<float>(y);
+                float *f = planes[1].ptr<float>(y);
+                float *s = planes[2].ptr<float>(y);
+
+                // The site type only changes with the column phase, so each phase is a branch-free loop
+                for (int phase = 0; phase < 2; ++phase)
+                {
+                    switch (layout.sites[y & 1][phase])
+                    {
+                    case SITE_FIRST:
+                        for (int x = phase; x < rawF.cols; x += 2)
+                        {
+                            d[x] = mhcCross(r, x);
+                            f[x] = r[2][x];
+                            s[x] = mhcDiagonal(r, x);
+                        }
+                        break;
+                    case SITE_SECOND:
+                        for (int x = phase; x < rawF.cols; x += 2)
+                        {
+                            d[x] = mhcCross(r, x);
+                            f[x] = mhcDiagonal(r, x);
+                            s[x] = r[2][x];
+                        }
+                        break;
+                    case SITE_DOUBLED_FIRST_ROW:
+                        for (int x = phase; x < rawF.cols; x += 2)
+                        {
+                            d[x] = r[2][x];
+                            f[x] = mhcHorizontal(r, x);
+                            s[x] = mhcVertical(r, x);
+                        }
+                        break;
+                    case SITE_DOUBLED_SECOND_ROW:
+                        for (int x = phase; x < rawF.cols; x += 2)
+                        {
+                            d[x] = r[2][x];
+                            f[x] = mhcVertical(r, x);
+                            s[x] = mhcHorizontal(r, x);
+                        }
+                        break;
+                    }
+                }
+            }
+        });
+    }
+
+    void directionalPlanes(const cv::Mat &rawF, const QuadLayout &layout, std::vector<cv::Mat> &planes)
+    {
+        cv::Mat padded;
+        padMosaic(rawF, padded);
+        for (auto &plane : planes)
+        {
+            plane.create(rawF.size(), CV_32FC1);
+        }
+
+        // Pass 1: doubled color everywhere, interpolated along the smoother direction
+        cv::parallel_for_(cv::Range(0, rawF.rows), [&](const cv::Range &range)
+        {
+            const float *r[5];
+            for (int y = range.start; y < range.end; ++y)
+            {
+                rowPointers(padded, y, r);
+                float *d = planes[0].ptr<float>(y);
+                for (int phase = 0; phase < 2; ++phase)
+                {
+                    Site site = layout.sites[y & 1][phase];
+                    if (site == SITE_FIRST || site == SITE_SECOND)
+                    {
+                        for (int x = phase; x < rawF.cols; x += 2)
+                        {
+                            d[x] = directionalDoubled(r, x);
+                        }
+                    }
+                    else
+                    {
+                        for (int x = phase; x < rawF.cols; x += 2)
+                        {
+                            d[x] = r[2][x];
+                        }
+                    }
+                }
+            }
+        });
+
+        // Pass 2: singleton colors from interpolated color differences to the doubled color
+        cv::Mat paddedDoubled;
+        padMosaic(planes[0], paddedDoubled);
+        cv::parallel_for_(cv::Range(0, rawF.rows), [&](const cv::Range &range)
+        {
+            const float *r[5];
+            const float *p[5];
+            for (int y = range.start; y < range.end; ++y)
+            {
+                rowPointers(padded, y, r);
+                rowPointers(paddedDoubled, y, p);
+                const float *d = planes[0].ptr<float>(y);
+                float *f = planes[1].ptr<float>(y);
+                float *s = planes[2].ptr<float>(y);
+                for (int phase = 0; phase < 2; ++phase)
+                {
+                    switch (layout.sites[y & 1][phase])
+                    {
+                    case SITE_FIRST:
+                        for (int x = phase; x < rawF.cols; x += 2)
+                        {
+                            f[x] = r[2][x];
+                            s[x] = d[x] + 0.25f * ((r[1][x - 1] - p[1][x - 1]) + (r[1][x + 1] - p[1][x + 1]) + (r[3][x - 1] - p[3][x - 1]) + (r[3][x + 1] - p[3][x + 1]));
+                        }
+                        break;
+                    case SITE_SECOND:
+                        for (int x = phase; x < rawF.cols; x += 2)
+                        {
+                            f[x] = d[x] + 0.25f * ((r[1][x - 1] - p[1][x - 1]) + (r[1][x + 1] - p[1][x + 1]) + (r[3][x - 1] - p[3][x - 1]) + (r[3][x + 1] - p[3][x + 1]));
+                            s[x] = r[2][x];
+                        }
+                        break;
+                    case SITE_DOUBLED_FIRST_ROW:
+                        for (int x = phase; x < rawF.cols; x += 2)
+                        {
+                            f[x] = d[x] + 0.5f * ((r[2][x - 1] - p[2][x - 1]) + (r[2][x + 1] - p[2][x + 1]));
+                            s[x] = d[x] + 0.5f * ((r[1][x] - p[1][x]) + (r[3][x] - p[3][x]));
+                        }
+                        break;
+                    case SITE_DOUBLED_SECOND_ROW:
+                        for (int x = phase; x < rawF.cols; x += 2)
+                        {
+                            f[x] = d[x] + 0.5f * ((r[1][x] - p[1][x]) + (r[3][x] - p[3][x]));
+                            s[x] = d[x] + 0.5f * ((r[2][x - 1] - p[2][x - 1]) + (r[2][x + 1] - p[2][x + 1]));
+                        }
+                        break;
+                    }
+                }
+            }
+        });
+    }
+
+    // Normalized convolution with a tent kernel spanning the tile, for any layout
+    void bilinearPlanes(const cv::Mat &rawF, const CFAPattern &cfaPattern, const std::vector<CFAPattern::Color> &colors, std::vector<cv::Mat> &planes)
+    {
+        int radius = std::max(cfaPattern.getTileRows(), cfaPattern.getTileCols()) / 2;
+        cv::Mat tent(1, 2 * radius + 1, CV_32FC1);
+        for (int i = 0; i <= 2 * radius; ++i)
+        {
+            tent.at<float>(i) = static_cast<float>(radius + 1 - std::abs(i - radius));
+        }
+
+        cv::Mat maskRows(cfaPattern.getTileRows(), rawF.cols, CV_32FC1);
+        cv::Mat mask(rawF.size(), CV_32FC1);
+        cv::Mat masked, numerator, denominator;
+        for (size_t c = 0; c < colors.size(); ++c)
+        {
+            // Sampling mask of this color, built from one expanded row per tile row
+            for (int y = 0; y < maskRows.rows; ++y)
+            {
+                float *m = maskRows.ptr<float>(y);
+                for (int x = 0; x < rawF.cols; ++x)
+                {
+                    m[x] = (cfaPattern.getColor(y, x) == colors[c]) ? 1.0f : 0.0f;
+                }
+            }
+            for (int y = 0; y < rawF.rows; ++y)
+            {
+                maskRows.row(y % maskRows.rows).copyTo(mask.row(y));
+            }
+
+            cv::multiply(rawF, mask, masked);
+            cv::sepFilter2D(masked, numerator, CV_32F, tent, tent, cv::Point(-1, -1), 0, cv::BORDER_REFLECT_101);
+            cv::sepFilter2D(mask, denominator, CV_32F, tent, tent, cv::Point(-1, -1), 0, cv::BORDER_REFLECT_101);
+
+            cv::Mat &plane = planes[c];
+            plane.create(rawF.size(), CV_32FC1);
+            cv::parallel_for_(cv::Range(0, rawF.rows), [&](const cv::Range &range)
+            {
+                for (int y = range.start; y < range.end; ++y)
+                {
+                    const float *src = rawF.ptr<float>(y);
+                    const float *m = mask.ptr<float>(y);
+                    const float *num = numerator.ptr<float>(y);
+                    const float *den = denominator.ptr<float>(y);
+                    float *dst = plane.ptr<float>(y);
+                    for (int x = 0; x < rawF.cols; ++x)
+                    {
+                        // Keep measured samples; near borders a color may be missing from the window
+                        dst[x] = (m[x] > 0.0f || den[x] <= 0.0f) ? src[x] : num[x] / den[x];
+                    }
+                }
+            });
+        }
+    }
+
+    template <typename T>
+    void combinePlanes(const std::vector<cv::Mat> &planes, const cv::Mat &transform, cv::Mat &output)
+    {
+        const int numPlanes = static_cast<int>(planes.size());
+        std::vector<float> coefficients(3 * numPlanes);
+        for (int c = 0; c < 3; ++c)
+        {
+            for (int p = 0; p < numPlanes; ++p)
+            {
+                coefficients[c * numPlanes + p] = static_cast<float>(transform.at<double>(c, p));
+            }
+        }
+
+        cv::parallel_for_(cv::Range(0, output.rows), [&](const cv::Range &range)
+        {
+            std::vector<const float *> rows(numPlanes);
+            for (int y = range.start; y < range.end; ++y)
+            {
+                for (int p = 0; p < numPlanes; ++p)
+                {
+                    rows[p] = planes[p].ptr<float>(y);
+                }
+                T *out = output.ptr<T>(y);
+                for (int x = 0; x < output.cols; ++x)
+                {
+                    for (int c = 0; c < 3; ++c)
+                    {
+                        float value = 0.0f;
+                        for (int p = 0; p < numPlanes; ++p)
+                        {
+                            value += coefficients[c * numPlanes + p] * rows[p][x];
+                        }
+                        out[3 * x + 2 - c] = cv::saturate_cast<T>(value); // BGR order
+                    }
+                }
+            }
+        });
+    }
+}
+
+void Demosaic::process(const cv::Mat &raw, cv::Mat &output, const CFAPattern &cfaPattern, Algorithm algorithm)
+{
+    TELEMETRY_SCOPE("Demosaic::process");
+    if (raw.channels() != 1)
+    {
+        throw std::invalid_argument("Demosaicing requires a single channel mosaic");
+    }
+
+    cv::Mat rawF;
+    if (raw.depth() == CV_32F)
+    {
+        rawF = raw;
+    }
+    else
+    {
+        raw.convertTo(rawF, CV_32F);
+    }
+
+    // Interpolate every filter color to full resolution
+    std::vector<CFAPattern::Color> colors;
+    std::vector<cv::Mat> planes;
+    QuadLayout layout;
+    bool quad = findQuadLayout(cfaPattern, layout);
+    if (algorithm != BILINEAR && !quad)
+    {
+        std::cerr << "Warning: Demosaicing algorithm requires a 2x2 Bayer-like CFA pattern. Defaulting to bilinear." << std::endl;
+        algorithm = BILINEAR;
+    }
+
+    if (algorithm == BILINEAR)
+    {
+        colors = cfaPattern.getColors();
+        planes.resize(colors.size());
+        bilinearPlanes(rawF, cfaPattern, colors, planes);
+    }
+    else
+    {
+        colors = {layout.doubled, layout.first, layout.second};
+        planes.resize(3);
+        if (algorithm == MALVAR)
+        {
+            malvarPlanes(rawF, layout, planes);
+        }
+        else
+        {
+            directionalPlanes(rawF, layout, planes);
+        }
+    }
+
+    // Solve RGB from the filter responses (least squares when the filters do not span RGB)
+    cv::Mat response(static_cast<int>(colors.size()), 3, CV_64FC1);
+    for (size_t p = 0; p < colors.size(); ++p)
+    {
+        cv::Vec3d rgb = getRGBResponse(colors[p]);
+        for (int c = 0; c < 3; ++c)
+        {
+            response.at<double>(static_cast<int>(p), c) = rgb[c];
+        }
+    }
+    cv::Mat transform;
+    cv::invert(response, transform, cv::DECOMP_SVD);
+
+    output.create(raw.size(), CV_MAKETYPE(raw.depth(), 3));
+    switch (raw.depth())
+    {
+    case CV_8U:
+        combinePlanes<uchar>(planes, transform, output);
+        break;
+    case CV_16U:
+        combinePlanes<ushort>(planes, transform, output);
+        break;
+    case CV_32F:
+        combinePlanes<float>(planes, transform, output);
+        break;
+    case CV_64F:
+        combinePlanes<double>(planes, transform, output);
+        break;
+    default:
+        throw std::invalid_argument("Unsupported data type for demosaicing");
+    }
+}
+
+bool Demosaic::supports(const CFAPattern &cfaPattern, Algorithm algorithm)
+{
+    QuadLayout layout;
+    return algorithm == BILINEAR || findQuadLayout(cfaPattern, layout);
+}
+
+int Demosaic::getHaloSize(const CFAPattern &cfaPattern, Algorithm algorithm)
+{
+    if (algorithm == BILINEAR || !supports(cfaPattern, algorithm))
+    {
+        return std::max(cfaPattern.getTileRows(), cfaPattern.getTileCols()) / 2; // Tent radius
+    }
+    // Malvar reads the 5x5 neighbourhood; the directional second pass reads the first pass one pixel further
+    return (algorithm == MALVAR) ? BORDER : BORDER + 1;
+}
+
+Demosaic::Algorithm Demosaic::parseAlgorithm(const std::string &name)
+{
+    if (name == "bilinear")
+    {
+        return BILINEAR;
+    }
+    if (name == "malvar")
+    {
+        return MALVAR;
+    }
+    if (name == "directional")
+    {
+        return DIRECTIONAL;
+    }
+    throw std::invalid_argument("Unknown demosaicing algorithm: " + name);
+}
+
+cv::Vec3d Demosaic::getRGBResponse(CFAPattern::Color color)
+{
+    switch (color)
+    {
+    case CFAPattern::RED:
+        return cv::Vec3d(1.0, 0.0, 0.0);
+    case CFAPattern::GREEN:
+        return cv::Vec3d(0.0, 1.0, 0.0);
+    case CFAPattern::BLUE:
+        return cv::Vec3d(0.0, 0.0, 1.0);
+    case CFAPattern::CLEAR:
+        return cv::Vec3d(1.0, 1.0, 1.0);
+    case CFAPattern::YELLOW:
+        return cv::Vec3d(1.0, 1.0, 0.0);
+    case CFAPattern::CYAN:
+        return cv::Vec3d(0.0, 1.0, 1.0);
+    default:
+        throw std::invalid_argument("Invalid CFA color");
+    }
+}
@@ -0,0 +1,280 @@
+#include "Denoiser/Denoiser.h"
+#include "Telemetry/Telemetry.h"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
+namespace
+{
+    // Noise standard deviation of each a trous B3-spline detail level for unit white noise
+    constexpr double WAVELET_NOISE_LEVELS[] = {0.889, 0.200, 0.086, 0.041, 0.020, 0.010, 0.005};
+    constexpr int MAX_WAVELET_LEVELS = sizeof(WAVELET_NOISE_LEVELS) / sizeof(WAVELET_NOISE_LEVELS[0]);
+
+    // Soft threshold in units of the level's noise standard deviation
+    constexpr double WAVELET_THRESHOLD = 1.5;
+
+    // NLM filtering parameter in units of sigma, for 3x3 patches
+    constexpr double NLM_H = 0.4;
+
+    // Bilateral range sigma in units of the noise sigma
+    constexpr double BILATERAL_RANGE = 2.0;
+
+    // Median absolute deviation of a unit Gaussian
+    constexpr double MAD_TO_SIGMA = 0.6745;
+
+    // B3-spline kernel with 2^level - 1 zeros between taps
+    cv::Mat dilatedB3Kernel(int level)
+    {
+        const float taps[5] = {1.0f / 16, 4.0f / 16, 6.0f / 16, 4.0f / 16, 1.0f / 16};
+        int step = 1 << level;
+        cv::Mat kernel = cv::Mat::zeros(1, 4 * step + 1, CV_32FC1);
+        for (int k = 0; k < 5; ++k)
+        {
+            kernel.at<float>(0, k * step) = taps[k];
+        }
+        return kernel;
+    }
+
+    // Soft shrinkage: sign(x) * max(|x| - t, 0)
+    void softThreshold(cv::Mat &detail, float threshold)
+    {
+        for (int i = 0; i < detail.rows; ++i)
+        {
+            float *row = detail.ptr<float>(i);
+            for (int j = 0; j < detail.cols; ++j)
+            {
+                float magnitude = std::abs(row[j]) - threshold;
+                row[j] = (magnitude > 0.0f) ? std::copysign(magnitude, row[j]) : 0.0f;
+            }
+        }
+    }
+}
+
+void Denoiser::process(const cv::Mat &input, cv::Mat &output, Algorithm algorithm)
+{
+    process(input, output, algorithm, Parameters());
+}
+
+void Denoiser::process(const cv::Mat &input, cv::Mat &output, Algorithm algorithm, const Parameters &params)
+{
+    TELEMETRY_SCOPE("Denoiser::process");
+    if (input.empty())
+    {
+        throw std::invalid_argument("Denoiser input must not be empty");
+    }
+
+    std::vector<cv::Mat> channels;
+    cv::split(input, channels);
+    for (auto &channel : channels)
+    {
+        cv::Mat channelF;
+        channel.convertTo(channelF, CV_32F);
+        double sigma = (params.sigma > 0.0) ? params.sigma : estimateNoiseSigma(channelF);
+
+        cv::Mat filtered;
+        processChannel(channelF, filtered, algorithm, params, sigma);
+        channel = filtered;
+    }
+
+    cv::Mat merged;
+    cv::merge(channels, merged);
+    merged.convertTo(output, input.type()); // Back to the native depth, saturating
+}
+
+double Denoiser::estimateNoiseSigma(const cv::Mat &image)
+{
+    cv::Mat channel;
+    if (image.channels() > 1)
+    {
+        cv::extractChannel(image, channel, 0);
+        channel.convertTo(channel, CV_32F);
+    }
+    else
+    {
+        image.convertTo(channel, CV_32F);
+    }
+
+    // Finest diagonal Haar detail over 2x2 blocks: unit gain for white noise
+    std::vector<float> details;
+    details.reserve(static_cast<size_t>(channel.rows / 2) * (channel.cols / 2));
+    for (int i = 0; i + 1 < channel.rows; i += 2)
+    {
+        const float *r0 = channel.ptr<float>(i);
+        const float *r1 = channel.ptr<float>(i + 1);
+        for (int j = 0; j + 1 < channel.cols; j += 2)
+        {
+            details.push_back(std::abs(r0[j] - r0[j + 1] - r1[j] + r1[j + 1]) * 0.5f);
+        }
+    }
+    if (details.empty())
+    {
+        return 0.0;
+    }
+
+    auto middle = details.begin() + details.size() / 2;
+    std::nth_element(details.begin(), middle, details.end());
+    return *middle / MAD_TO_SIGMA;
+}
+
+Denoiser::Algorithm Denoiser::parseAlgorithm(const std::string &name)
+{
+    if (name == "guided")
+    {
+        return GUIDED;
+    }
+    if (name == "bilateral")
+    {
+        return BILATERAL;
+    }
+    if (name == "wavelet")
+    {
+        return WAVELET;
+    }
+    if (name == "nlm")
+    {
+        return NLM;
+    }
+    throw std::invalid_argument("Unknown denoising algorithm: " + name);
+}
+
+void Denoiser::processChannel(const cv::Mat &src, cv::Mat &dst, Algorithm algorithm, const Parameters &params, double sigma)
+{
+    sigma *= params.strength;
+    if (sigma <= 0.0)
+    {
+        src.copyTo(dst);
+        return;
+    }
+
+    switch (algorithm)
+    {
+    case GUIDED:
+        guided(src, dst, params.guidedRadius, sigma);
+        break;
+    case BILATERAL:
+        cv::bilateralFilter(src, dst, 0, BILATERAL_RANGE * sigma, params.bilateralSigmaSpace, cv::BORDER_REFLECT_101);
+        break;
+    case WAVELET:
+        wavelet(src, dst, params.waveletLevels, sigma);
+        break;
+    case NLM:
+        nonLocalMeans(src, dst, params.nlmPatchRadius, params.nlmSearchRadius, params.nlmTileRows, sigma);
+        break;
+    default:
+        throw std::invalid_argument("Unsupported denoising algorithm");
+    }
+}
+
+void Denoiser::guided(const cv::Mat &src, cv::Mat &dst, int radius, double sigma)
+{
+    // Self-guided filter: local linear model q = a I + b, a = var / (var + eps)
+    const cv::Size window(2 * radius + 1, 2 * radius + 1);
+    const double eps = sigma * sigma;
+
+    cv::Mat mean, meanSquare, square;
+    cv::boxFilter(src, mean, CV_32F, window, cv::Point(-1, -1), true, cv::BORDER_REFLECT_101);
+    cv::multiply(src, src, square);
+    cv::boxFilter(square, meanSquare, CV_32F, window, cv::Point(-1, -1), true, cv::BORDER_REFLECT_101);
+
+    cv::Mat a(src.size(), CV_32FC1), b(src.size(), CV_32FC1);
+    for (int i = 0; i < src.rows; ++i)
+    {
+        const float *m = mean.ptr<float>(i);
+        const float *m2 = meanSquare.ptr<float>(i);
+        float *pa = a.ptr<float>(i);
+        float *pb = b.ptr<float>(i);
+        for (int j = 0; j < src.cols; ++j)
+        {
+            float variance = std::max(m2[j] - m[j] * m[j], 0.0f);
+            pa[j] = variance / (variance + static_cast<float>(eps));
+            pb[j] = m[j] - pa[j] * m[j];
+        }
+    }
+
+    cv::boxFilter(a, a, CV_32F, window, cv::Point(-1, -1), true, cv::BORDER_REFLECT_101);
+    cv::boxFilter(b, b, CV_32F, window, cv::Point(-1, -1), true, cv::BORDER_REFLECT_101);
+    cv::multiply(a, src, dst);
+    dst += b;
+}
+
+void Denoiser::wavelet(const cv::Mat &src, cv::Mat &dst, int levels, double sigma)
+{
+    levels = std::max(1, std::min(levels, MAX_WAVELET_LEVELS));
+
+    // a trous decomposition: detail_j = c_j - c_{j+1}, c_{j+1} = c_j smoothed by the dilated B3 kernel
+    cv::Mat coarse = src.clone();
+    cv::Mat smoother, detail;
+    dst = cv::Mat::zeros(src.size(), CV_32FC1);
+    for (int level = 0; level < levels; ++level)
+    {
+        cv::Mat kernel = dilatedB3Kernel(level);
+        cv::sepFilter2D(coarse, smoother, CV_32F, kernel, kernel.t(), cv::Point(-1, -1), 0, cv::BORDER_REFLECT_101);
+        cv::subtract(coarse, smoother, detail);
+        softThreshold(detail, static_cast<float>(WAVELET_THRESHOLD * WAVELET_NOISE_LEVELS[level] * sigma));
+        dst += detail;
+        std::swap(coarse, smoother);
+    }
+    dst += coarse;
+}
+
+void Denoiser::nonLocalMeans(const cv::Mat &src, cv::Mat &dst, int patchRadius, int searchRadius, int tileRows, double sigma)
+{
+    if (patchRadius < 0 || searchRadius < 0 || tileRows <= 0)
+    {
+        throw std::invalid_argument("NLM radii must be non-negative and tile rows positive");
+    }
+
+    const int pad = searchRadius + patchRadius;
+    const int patchSide = 2 * patchRadius + 1;
+    const int width = src.cols;
+    const double h = NLM_H * sigma;
+    const double noiseOffset = 2.0 * sigma * sigma;
+
+    cv::Mat padded;
+    cv::copyMakeBorder(src, padded, pad, pad, pad, pad, cv::BORDER_REFLECT_101);
+    dst.create(src.size(), CV_32FC1);
+
+    const int numTiles = (src.rows + tileRows - 1) / tileRows;
+    cv::parallel_for_(cv::Range(0, numTiles), [&](const cv::Range &range)
+    {
+        // Per-worker scratch, sized for one tile
+        cv::Mat diff, integralSum, box, weights, weightSum, valueSum;
+        for (int t = range.start; t < range.end; ++t)
+        {
+            int rowStart = t * tileRows;
+            int rows = std::min(tileRows, src.rows - rowStart);
+            weightSum = cv::Mat::zeros(rows, width, CV_32FC1);
+            valueSum = cv::Mat::zeros(rows, width, CV_32FC1);
+
+            // Pixels of the tile plus a patch margin, in padded coordinates
+            const cv::Rect region(searchRadius, rowStart + searchRadius, width + 2 * patchRadius, rows + 2 * patchRadius);
+            for (int dy = -searchRadius; dy <= searchRadius; ++dy)
+            {
+                for (int dx = -searchRadius; dx <= searchRadius; ++dx)
+                {
+                    // Squared differences for this offset, summed over every patch at once through an integral image
+                    cv::subtract(padded(region), padded(cv::Rect(region.x + dx, region.y + dy, region.width, region.height)), diff);
+                    cv::multiply(diff, diff, diff);
+                    cv::integral(diff, integralSum, CV_64F);
+
+                    cv::subtract(integralSum(cv::Rect(patchSide, patchSide, width, rows)), integralSum(cv::Rect(0, patchSide, width, rows)), box);
+                    cv::subtract(box, integralSum(cv::Rect(patchSide, 0, width, rows)), box);
+                    cv::add(box, integralSum(cv::Rect(0, 0, width, rows)), box);
+
+                    // w = exp(-max(d^2 - 2 sigma^2, 0) / h^2), d^2 the mean squared patch difference
+                    box.convertTo(weights, CV_32F, 1.0 / (patchSide * patchSide), -noiseOffset);
+                    cv::max(weights, 0.0, weights);
+                    weights.convertTo(weights, CV_32F, -1.0 / (h * h));
+                    cv::exp(weights, weights);
+
+                    weightSum += weights;
+                    cv::accumulateProduct(padded(cv::Rect(pad + dx, rowStart + pad + dy, width, rows)), weights, valueSum);
+                }
+            }
+
+            cv::Mat out = dst.rowRange(rowStart, rowStart + rows);
+            cv::divide(valueSum, weightSum, out);
+        }
+    });
+}
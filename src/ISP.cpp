@@ -1,60 +1,70 @@
 #include <opencv2/opencv.hpp>
 #include "ISP/ISP.h"
+#include "Denoiser/Denoiser.h"
+#include "Telemetry/Telemetry.h"
 
 cv::Mat ISP::autoWhiteBalance(const cv::Mat &input)
 {
-    // Convert input image to float type
-    cv::Mat floatImage;
-    input.convertTo(floatImage, CV_32FC3);
+    cv::Mat balanced;
+    autoWhiteBalance(input, balanced);
+    return balanced;
+}
 
+void ISP::autoWhiteBalance(const cv::Mat &input, cv::Mat &output)
+{
+    TELEMETRY_SCOPE("ISP::autoWhiteBalance");
     // Compute the average color per channel
-    cv::Scalar avgColor = cv::mean(floatImage);
+    cv::Scalar avgColor = cv::mean(input);
 
     // Compute scaling factors
     double avgGray = (avgColor[0] + avgColor[1] + avgColor[2]) / 3.0;
     cv::Scalar scaleFactors = avgGray / avgColor;
 
-    // Apply scaling factors to each channel
-    std::vector<cv::Mat> channels(3);
-    cv::split(floatImage, channels);
-    channels[0] *= scaleFactors[0];
-    channels[1] *= scaleFactors[1];
-    channels[2] *= scaleFactors[2];
-    cv::merge(channels, floatImage);
-
-    // Convert back to the original type
-    cv::Mat balanced;
-    floatImage.convertTo(balanced, input.type());
-
-    return balanced;
+    // Scale every channel in one pass at the native type, saturating; no float copy or channel split
+    cv::Matx33f gains = cv::Matx33f::diag(cv::Vec3f(static_cast<float>(scaleFactors[0]), static_cast<float>(scaleFactors[1]), static_cast<float>(scaleFactors[2])));
+    cv::transform(input, output, gains);
 }
 
 cv::Mat ISP::denoise(const cv::Mat &input)
 {
-    // Convert input image to CV_8UC3
-    cv::Mat input8UC3;
-    input.convertTo(input8UC3, CV_8UC3, 1.0 / 256.0); // Assuming the input is 16-bit and needs to be scaled down
-
-    cv::Mat denoised;
-    cv::fastNlMeansDenoisingColored(input8UC3, denoised);
-
-    // Convert back to the original bit depth
     cv::Mat output;
-    denoised.convertTo(output, input.type(), 256.0); // Scaling back to 16-bit if needed
-
+    denoise(input, output);
     return output;
 }
 
+void ISP::denoise(const cv::Mat &input, cv::Mat &output)
+{
+    TELEMETRY_SCOPE("ISP::denoise");
+    // Filters at the native depth with an estimated noise level, no 8-bit round trip
+    Denoiser::process(input, output);
+}
+
 cv::Mat ISP::blackLevelCompensation(const cv::Mat &input, double blackLevel)
 {
     cv::Mat compensated;
-    input.convertTo(compensated, -1, 1, -blackLevel);
+    blackLevelCompensation(input, compensated, blackLevel);
     return compensated;
 }
 
-cv::Mat ISP::lensShadingCorrection(const cv::Mat &input, const cv::Mat &shadingMap)
+void ISP::blackLevelCompensation(const cv::Mat &input, cv::Mat &output, double blackLevel)
+{
+    TELEMETRY_SCOPE("ISP::blackLevelCompensation");
+    input.convertTo(output, -1, 1, -blackLevel);
+}
+
+cv::Mat ISP::lensShadingCorrection(const cv::Mat &input, const LensShading &lensShading)
 {
     cv::Mat corrected;
-    cv::divide(input, shadingMap, corrected, 1.0, input.type());
+    lensShadingCorrection(input, corrected, lensShading);
     return corrected;
 }
+
+void ISP::lensShadingCorrection(const cv::Mat &input, cv::Mat &output, const LensShading &lensShading)
+{
+    TELEMETRY_SCOPE("ISP::lensShadingCorrection");
+    if (output.data != input.data)
+    {
+        input.copyTo(output);
+    }
+    lensShading.apply(output); // Multiplies by gains interpolated from the grid, no full-resolution map
+}
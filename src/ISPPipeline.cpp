@@ -0,0 +1,433 @@
+#include "ISPPipeline/ISPPipeline.h"
+#include "ImageSensor/ImageSensor.h"
+#include "Telemetry/Telemetry.h"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
+namespace
+{
+    // Run of consecutive stages executed as one pass
+    struct Segment
+    {
+        size_t first;
+        size_t last;
+        bool pointwise;
+    };
+}
+
+ISPPipeline::ISPPipeline(std::shared_ptr<BufferPool> pool)
+    : pool(pool ? std::move(pool) : std::make_shared<BufferPool>())
+{
+}
+
+ISPPipeline &ISPPipeline::addBlackLevel(double blackLevel)
+{
+    auto state = std::make_shared<std::pair<float, float>>(0.0f, 1.0f); // Offset and gain in normalized units
+
+    Stage stage;
+    stage.name = "blackLevel";
+    stage.prepare = [state, blackLevel](cv::Size, double whiteLevel)
+    {
+        double black = blackLevel / whiteLevel;
+        state->first = static_cast<float>(black);
+        state->second = static_cast<float>(1.0 / std::max(1.0 - black, 1e-6));
+    };
+    stage.pointKernel = [state](float *pixels, int count, int)
+    {
+        const float offset = state->first;
+        const float gain = state->second;
+        for (int k = 0; k < 3 * count; ++k)
+        {
+            pixels[k] = (pixels[k] - offset) * gain;
+        }
+    };
+    stages.push_back(stage);
+    return *this;
+}
+
+ISPPipeline &ISPPipeline::addLensShading(const cv::Mat &gainMap)
+{
+    return addLensShading(LensShading(gainMap));
+}
+
+ISPPipeline &ISPPipeline::addLensShading(const LensShading &lensShading)
+{
+    if (lensShading.getNumChannels() != 1 && lensShading.getNumChannels() != 3)
+    {
+        throw std::invalid_argument("Lens shading must have one grid or one grid per color channel");
+    }
+
+    // Small grids plus the current frame size; gains are interpolated row by row inside the fused pass
+    auto state = std::make_shared<std::pair<LensShading, cv::Size>>(lensShading, cv::Size());
+
+    Stage stage;
+    stage.name = "lensShading";
+    stage.prepare = [state](cv::Size frameSize, double)
+    {
+        state->second = frameSize;
+    };
+    stage.pointKernel = [state](float *pixels, int, int row)
+    {
+        state->first.applyRow(pixels, 3, row, state->second);
+    };
+    stages.push_back(stage);
+    return *this;
+}
+
+ISPPipeline &ISPPipeline::addWhiteBalance(const cv::Vec3f &gains)
+{
+    Stage stage;
+    stage.name = "whiteBalance";
+    stage.pointKernel = [gains](float *pixels, int count, int)
+    {
+        for (int j = 0; j < count; ++j)
+        {
+            pixels[3 * j] *= gains[0];
+            pixels[3 * j + 1] *= gains[1];
+            pixels[3 * j + 2] *= gains[2];
+        }
+    };
+    stages.push_back(stage);
+    return *this;
+}
+
+ISPPipeline &ISPPipeline::addAutoWhiteBalance()
+{
+    auto gains = std::make_shared<cv::Vec3f>(1.0f, 1.0f, 1.0f);
+
+    Stage stage;
+    stage.name = "autoWhiteBalance";
+    stage.statistics = [gains](const cv::Vec3d &means)
+    {
+        // Gray world: scale every channel to the mean of the three
+        double gray = (means[0] + means[1] + means[2]) / 3.0;
+        for (int c = 0; c < 3; ++c)
+        {
+            (*gains)[c] = (means[c] > 1e-9) ? static_cast<float>(gray / means[c]) : 1.0f;
+        }
+    };
+    stage.pointKernel = [gains](float *pixels, int count, int)
+    {
+        const cv::Vec3f g = *gains;
+        for (int j = 0; j < count; ++j)
+        {
+            pixels[3 * j] *= g[0];
+            pixels[3 * j + 1] *= g[1];
+            pixels[3 * j + 2] *= g[2];
+        }
+    };
+    stages.push_back(stage);
+    return *this;
+}
+
+ISPPipeline &ISPPipeline::addColorCorrection(const cv::Matx33f &ccm)
+{
+    Stage stage;
+    stage.name = "colorCorrection";
+    stage.pointKernel = [ccm](float *pixels, int count, int)
+    {
+        for (int j = 0; j < count; ++j)
+        {
+            float *p = pixels + 3 * j;
+            float b = p[0], g = p[1], r = p[2];
+            p[2] = ccm(0, 0) * r + ccm(0, 1) * g + ccm(0, 2) * b;
+            p[1] = ccm(1, 0) * r + ccm(1, 1) * g + ccm(1, 2) * b;
+            p[0] = ccm(2, 0) * r + ccm(2, 1) * g + ccm(2, 2) * b;
+        }
+    };
+    stages.push_back(stage);
+    return *this;
+}
+
+ISPPipeline &ISPPipeline::addGamma(double gamma)
+{
+    if (gamma <= 0.0)
+    {
+        throw std::invalid_argument("Gamma must be positive");
+    }
+
+    // One extra entry so interpolation at 1.0 stays in range
+    auto lut = std::make_shared<std::vector<float>>(GAMMA_LUT_SIZE + 1);
+    for (int k = 0; k <= GAMMA_LUT_SIZE; ++k)
+    {
+        (*lut)[k] = static_cast<float>(std::pow(static_cast<double>(k) / GAMMA_LUT_SIZE, 1.0 / gamma));
+    }
+
+    Stage stage;
+    stage.name = "gamma";
+    stage.pointKernel = [lut](float *pixels, int count, int)
+    {
+        const float *table = lut->data();
+        for (int k = 0; k < 3 * count; ++k)
+        {
+            float x = std::min(std::max(pixels[k], 0.0f), 1.0f) * GAMMA_LUT_SIZE;
+            int index = std::min(static_cast<int>(x), GAMMA_LUT_SIZE - 1);
+            float t = x - index;
+            pixels[k] = table[index] + t * (table[index + 1] - table[index]);
+        }
+    };
+    stages.push_back(stage);
+    return *this;
+}
+
+ISPPipeline &ISPPipeline::addDenoise(double sigmaColor, double sigmaSpace)
+{
+    return addNeighborhoodStage("denoise", [sigmaColor, sigmaSpace](const cv::Mat &src, cv::Mat &dst)
+    {
+        cv::bilateralFilter(src, dst, 0, sigmaColor, sigmaSpace, cv::BORDER_REFLECT_101);
+    });
+}
+
+ISPPipeline &ISPPipeline::addDenoise(Denoiser::Algorithm algorithm, const Denoiser::Parameters &params)
+{
+    return addWholeFrameStage("denoise", [algorithm, params](const cv::Mat &src, cv::Mat &dst)
+    {
+        Denoiser::process(src, dst, algorithm, params);
+    });
+}
+
+ISPPipeline &ISPPipeline::addSharpen(double amount, double sigma)
+{
+    return addNeighborhoodStage("sharpen", [amount, sigma](const cv::Mat &src, cv::Mat &dst)
+    {
+        cv::Mat blurred;
+        cv::GaussianBlur(src, blurred, cv::Size(0, 0), sigma, sigma, cv::BORDER_REFLECT_101);
+        cv::addWeighted(src, 1.0 + amount, blurred, -amount, 0.0, dst);
+    });
+}
+
+ISPPipeline &ISPPipeline::addPointwiseStage(const std::string &name, PointKernel kernel)
+{
+    Stage stage;
+    stage.name = name;
+    stage.pointKernel = std::move(kernel);
+    stages.push_back(stage);
+    return *this;
+}
+
+ISPPipeline &ISPPipeline::addNeighborhoodStage(const std::string &name, RegionKernel kernel)
+{
+    Stage stage;
+    stage.name = name;
+    stage.pointwise = false;
+    stage.regionKernel = std::move(kernel);
+    stages.push_back(stage);
+    return *this;
+}
+
+ISPPipeline &ISPPipeline::addWholeFrameStage(const std::string &name, RegionKernel kernel)
+{
+    addNeighborhoodStage(name, std::move(kernel));
+    stages.back().wholeFrame = true;
+    return *this;
+}
+
+void ISPPipeline::setTileRows(int rows)
+{
+    if (rows <= 0)
+    {
+        throw std::invalid_argument("Tile rows must be positive");
+    }
+    tileRows = rows;
+}
+
+void ISPPipeline::setWhiteLevel(double whiteLevel)
+{
+    this->whiteLevel = whiteLevel;
+}
+
+std::vector<std::string> ISPPipeline::getStageNames() const
+{
+    std::vector<std::string> names;
+    for (const auto &stage : stages)
+    {
+        names.push_back(stage.name);
+    }
+    return names;
+}
+
+void ISPPipeline::process(const cv::Mat &input, cv::Mat &output)
+{
+    TELEMETRY_SCOPE("ISPPipeline::process");
+    if (input.channels() != 3)
+    {
+        throw std::invalid_argument("ISP pipeline expects a 3-channel image");
+    }
+
+    // 16-bit storage holds 10 to 16-bit sensors, so only 8-bit and float data imply their white level
+    if (whiteLevel <= 0.0 && input.depth() != CV_8U && input.depth() != CV_32F && input.depth() != CV_64F)
+    {
+        throw std::logic_error("ISP pipeline needs a white level for " + std::to_string(8 * input.elemSize1()) + "-bit input");
+    }
+    const double white = (whiteLevel > 0.0) ? whiteLevel : (input.depth() == CV_8U ? 255.0 : ImageSensor::fullScaleForBitDepth(32));
+    for (const auto &stage : stages)
+    {
+        if (stage.prepare)
+        {
+            stage.prepare(input.size(), white);
+        }
+    }
+
+    // Plan: fuse consecutive point-wise stages, neighborhood stages stand alone
+    std::vector<Segment> segments;
+    for (size_t s = 0; s < stages.size(); ++s)
+    {
+        if (stages[s].pointwise && !segments.empty() && segments.back().pointwise)
+        {
+            segments.back().last = s + 1;
+        }
+        else
+        {
+            segments.push_back({s, s + 1, stages[s].pointwise});
+        }
+    }
+
+    output.create(input.size(), input.type());
+    if (segments.empty())
+    {
+        if (output.data != input.data)
+        {
+            input.copyTo(output);
+        }
+        return;
+    }
+
+    // Two float working frames are enough for any chain; -1 means the data is still in input
+    cv::Mat buffers[2];
+    auto workBuffer = [&](int index) -> cv::Mat &
+    {
+        if (buffers[index].empty())
+        {
+            buffers[index] = pool->acquire(input.size(), CV_32FC3);
+        }
+        return buffers[index];
+    };
+
+    int current = -1;
+    for (size_t k = 0; k < segments.size(); ++k)
+    {
+        const Segment &segment = segments[k];
+        const bool lastSegment = (k + 1 == segments.size());
+        const int next = (current == 0) ? 1 : 0;
+
+        if (segment.pointwise)
+        {
+            const cv::Mat &src = (current < 0) ? input : buffers[current];
+            cv::Mat &dst = lastSegment ? output : workBuffer(next);
+            runPointwise(src, dst, segment.first, segment.last, (current < 0) ? 1.0 / white : 1.0, lastSegment ? white : 1.0);
+            current = lastSegment ? current : next;
+            continue;
+        }
+
+        if (current < 0)
+        {
+            // Normalize into a working frame first
+            runPointwise(input, workBuffer(0), 0, 0, 1.0 / white, 1.0);
+            current = 0;
+        }
+        int target = (current == 0) ? 1 : 0;
+        runNeighborhood(stages[segment.first], buffers[current], workBuffer(target));
+        current = target;
+        if (lastSegment)
+        {
+            runPointwise(buffers[current], output, 0, 0, 1.0, white);
+        }
+    }
+
+    pool->release(buffers[0]);
+    pool->release(buffers[1]);
+}
+
+void ISPPipeline::runPointwise(const cv::Mat &src, cv::Mat &dst, size_t first, size_t last, double inScale, double outScale)
+{
+    const int cols = src.cols;
+
+    // Frame statistics for stages that need them, measured at their own input on sampled rows
+    for (size_t s = first; s < last; ++s)
+    {
+        if (!stages[s].statistics)
+        {
+            continue;
+        }
+
+        std::vector<float> row(3 * static_cast<size_t>(cols));
+        cv::Mat rowMat(1, cols, CV_32FC3, row.data());
+        cv::Vec3d sum(0.0, 0.0, 0.0);
+        int count = 0;
+        for (int i = 0; i < src.rows; i += STATISTICS_ROW_STRIDE)
+        {
+            src.row(i).convertTo(rowMat, CV_32F, inScale);
+            for (size_t p = first; p < s; ++p)
+            {
+                stages[p].pointKernel(row.data(), cols, i);
+            }
+            for (int j = 0; j < cols; ++j)
+            {
+                sum[0] += row[3 * j];
+                sum[1] += row[3 * j + 1];
+                sum[2] += row[3 * j + 2];
+            }
+            count += cols;
+        }
+        double n = std::max(count, 1);
+        stages[s].statistics(cv::Vec3d(sum[0] / n, sum[1] / n, sum[2] / n));
+    }
+
+    const int numTiles = (src.rows + tileRows - 1) / tileRows;
+    cv::parallel_for_(cv::Range(0, numTiles), [&](const cv::Range &range)
+    {
+        // Each row is loaded once, runs through every fused stage in cache, and is stored once
+        std::vector<float> row(3 * static_cast<size_t>(cols));
+        cv::Mat rowMat(1, cols, CV_32FC3, row.data());
+        for (int t = range.start; t < range.end; ++t)
+        {
+            int rowEnd = std::min((t + 1) * tileRows, src.rows);
+            for (int i = t * tileRows; i < rowEnd; ++i)
+            {
+                src.row(i).convertTo(rowMat, CV_32F, inScale);
+                for (size_t s = first; s < last; ++s)
+                {
+                    stages[s].pointKernel(row.data(), cols, i);
+                }
+                cv::Mat out = dst.row(i);
+                rowMat.convertTo(out, dst.type(), outScale);
+            }
+        }
+    });
+}
+
+void ISPPipeline::runNeighborhood(const Stage &stage, const cv::Mat &src, cv::Mat &dst) const
+{
+    if (stage.wholeFrame)
+    {
+        // The kernel parallelizes itself; its result lands in the pooled frame
+        cv::Mat result = dst;
+        stage.regionKernel(src, result);
+        if (result.data != dst.data)
+        {
+            result.copyTo(dst);
+        }
+        return;
+    }
+
+    const int numTiles = (src.rows + tileRows - 1) / tileRows;
+    cv::parallel_for_(cv::Range(0, numTiles), [&](const cv::Range &range)
+    {
+        for (int t = range.start; t < range.end; ++t)
+        {
+            int rowStart = t * tileRows;
+            int rowEnd = std::min(rowStart + tileRows, src.rows);
+
+            // The source tile is a view, so filters read the neighboring rows as overlap
+            cv::Mat tile = dst.rowRange(rowStart, rowEnd);
+            const uchar *expected = tile.data;
+            stage.regionKernel(src.rowRange(rowStart, rowEnd), tile);
+            if (tile.data != expected)
+            {
+                throw std::logic_error("Neighborhood stage " + stage.name + " reallocated its output tile");
+            }
+        }
+    });
+}
@@ -0,0 +1,598 @@
+#include "ImageQuality/ImageQuality.h"
+#include "Telemetry/Telemetry.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <sstream>
+#include <stdexcept>
+
+namespace
+{
+    // Smallest region the slanted-edge measurement accepts
+    constexpr int MIN_EDGE_ROI = 8;
+
+    // Reference gradient, relative to the peak, above which a pixel counts as an edge
+    constexpr double EDGE_THRESHOLD = 0.05;
+
+    // Largest gain of the derivative correction, so that it cannot amplify noise without bound
+    constexpr double MAX_DERIVATIVE_CORRECTION = 10.0;
+
+    // CIELAB companding of a linear XYZ ratio
+    inline double labCompand(double t)
+    {
+        constexpr double epsilon = 216.0 / 24389.0;
+        constexpr double kappa = 24389.0 / 27.0;
+        return (t > epsilon) ? std::cbrt(t) : (kappa * t + 16.0) / 116.0;
+    }
+
+    // Converts linear BGR (1.0 at white) to CIELAB, sRGB primaries and D65 white
+    inline void bgrToLab(const float *bgr, double scale, double lab[3])
+    {
+        const double b = bgr[0] * scale;
+        const double g = bgr[1] * scale;
+        const double r = bgr[2] * scale;
+        const double fx = labCompand((0.4124 * r + 0.3576 * g + 0.1805 * b) / 0.95047);
+        const double fy = labCompand(0.2126 * r + 0.7152 * g + 0.0722 * b);
+        const double fz = labCompand((0.0193 * r + 0.1192 * g + 0.9505 * b) / 1.08883);
+        lab[0] = 116.0 * fy - 16.0;
+        lab[1] = 500.0 * (fx - fy);
+        lab[2] = 200.0 * (fy - fz);
+    }
+
+    // Frequency at which a decreasing curve first falls below a level, linearly interpolated
+    double crossing(const std::vector<double> &frequencies, const std::vector<double> &values, double level)
+    {
+        for (size_t k = 1; k < values.size(); ++k)
+        {
+            if (values[k] < level)
+            {
+                double t = (values[k - 1] - level) / (values[k - 1] - values[k]);
+                return frequencies[k - 1] + t * (frequencies[k] - frequencies[k - 1]);
+            }
+        }
+        return frequencies.empty() ? 0.0 : frequencies.back();
+    }
+
+    void checkSameSize(const cv::Mat &image, const cv::Mat &reference)
+    {
+        if (image.empty() || image.size() != reference.size())
+        {
+            throw std::invalid_argument("Image and reference must be non-empty and of the same size");
+        }
+    }
+}
+
+ImageQuality::MTFResult ImageQuality::slantedEdgeMTF(const cv::Mat &image, const cv::Rect &roi, int oversampling)
+{
+    TELEMETRY_SCOPE("ImageQuality::slantedEdgeMTF");
+    if (oversampling < 1)
+    {
+        throw std::invalid_argument("Oversampling must be at least 1");
+    }
+    const cv::Rect region = roi.empty() ? cv::Rect(0, 0, image.cols, image.rows) : (roi & cv::Rect(0, 0, image.cols, image.rows));
+    if (region.width < MIN_EDGE_ROI || region.height < MIN_EDGE_ROI)
+    {
+        throw std::invalid_argument("Slanted-edge region must be at least 8x8 pixels inside the image");
+    }
+
+    // Measured across the edge: a near-horizontal edge is transposed to a near-vertical one
+    cv::Mat edge = luminance(image(region));
+    cv::Mat gradX, gradY;
+    cv::absdiff(edge.colRange(1, edge.cols), edge.colRange(0, edge.cols - 1), gradX);
+    cv::absdiff(edge.rowRange(1, edge.rows), edge.rowRange(0, edge.rows - 1), gradY);
+    if (cv::sum(gradY)[0] > cv::sum(gradX)[0])
+    {
+        cv::Mat transposed;
+        cv::transpose(edge, transposed);
+        edge = transposed;
+    }
+    const int rows = edge.rows;
+    const int cols = edge.cols;
+
+    // Positive derivative points from the dark side to the light side
+    const double polarity = (cv::mean(edge.colRange(cols - cols / 4, cols))[0] >= cv::mean(edge.colRange(0, cols / 4))[0]) ? 1.0 : -1.0;
+
+    // Edge position per row: centroid of the derivative
+    std::vector<double> centroids(rows, 0.0);
+    std::vector<char> valid(rows, 0);
+    cv::parallel_for_(cv::Range(0, rows), [&](const cv::Range &range)
+    {
+        for (int i = range.start; i < range.end; ++i)
+        {
+            const float *row = edge.ptr<float>(i);
+            double weight = 0.0;
+            double moment = 0.0;
+            for (int j = 1; j < cols - 1; ++j)
+            {
+                double d = std::max(polarity * (row[j + 1] - row[j - 1]), 0.0);
+                weight += d;
+                moment += d * j;
+            }
+            if (weight > 0.0)
+            {
+                centroids[i] = moment / weight;
+                valid[i] = 1;
+            }
+        }
+    });
+
+    // Least-squares line through the centroids: position = intercept + slope * row
+    double n = 0.0, sy = 0.0, sx = 0.0, sxx = 0.0, sxy = 0.0;
+    for (int i = 0; i < rows; ++i)
+    {
+        if (valid[i])
+        {
+            n += 1.0;
+            sy += i;
+            sx += centroids[i];
+            sxx += static_cast<double>(i) * i;
+            sxy += static_cast<double>(i) * centroids[i];
+        }
+    }
+    const double denominator = n * sxx - sy * sy;
+    if (n < 2.0 || denominator == 0.0)
+    {
+        throw std::runtime_error("No edge found in the slanted-edge region");
+    }
+    const double slope = (n * sxy - sy * sx) / denominator;
+    const double intercept = (sx - slope * sy) / n;
+    const double cosAngle = 1.0 / std::sqrt(1.0 + slope * slope);
+
+    MTFResult result;
+    result.edgeAngle = std::atan(slope) * 180.0 / CV_PI;
+
+    // Oversampled edge spread function: every pixel binned by its distance to the edge,
+    // accumulated per chunk of rows so that the workers never share a bin
+    const int numBins = cols * oversampling;
+    const int center = numBins / 2;
+    const int numChunks = std::max(std::min(rows, 4 * std::max(cv::getNumThreads(), 1)), 1);
+    std::vector<std::vector<double>> sums(numChunks, std::vector<double>(numBins, 0.0));
+    std::vector<std::vector<int>> counts(numChunks, std::vector<int>(numBins, 0));
+    cv::parallel_for_(cv::Range(0, numChunks), [&](const cv::Range &range)
+    {
+        for (int c = range.start; c < range.end; ++c)
+        {
+            for (int i = c * rows / numChunks; i < (c + 1) * rows / numChunks; ++i)
+            {
+                const float *row = edge.ptr<float>(i);
+                const double position = intercept + slope * i;
+                for (int j = 0; j < cols; ++j)
+                {
+                    int bin = static_cast<int>(std::floor((j - position) * cosAngle * oversampling)) + center;
+                    if (bin >= 0 && bin < numBins)
+                    {
+                        sums[c][bin] += row[j];
+                        ++counts[c][bin];
+                    }
+                }
+            }
+        }
+    });
+
+    std::vector<double> esf(numBins, 0.0);
+    std::vector<int> binCounts(numBins, 0);
+    for (int c = 0; c < numChunks; ++c)
+    {
+        for (int k = 0; k < numBins; ++k)
+        {
+            esf[k] += sums[c][k];
+            binCounts[k] += counts[c][k];
+        }
+    }
+
+    // Empty bins (the far ends, or a too steep edge) take the nearest filled values
+    int previous = -1;
+    for (int k = 0; k < numBins; ++k)
+    {
+        if (binCounts[k] == 0)
+        {
+            continue;
+        }
+        esf[k] /= binCounts[k];
+        if (previous < 0)
+        {
+            std::fill(esf.begin(), esf.begin() + k, esf[k]);
+        }
+        else
+        {
+            for (int m = previous + 1; m < k; ++m)
+            {
+                esf[m] = esf[previous] + (esf[k] - esf[previous]) * (m - previous) / (k - previous);
+            }
+        }
+        previous = k;
+    }
+    if (previous < 0)
+    {
+        throw std::runtime_error("No edge found in the slanted-edge region");
+    }
+    std::fill(esf.begin() + previous + 1, esf.end(), esf[previous]);
+
+    // Line spread function, Hamming windowed around the edge
+    cv::Mat lsf(1, numBins, CV_64F, cv::Scalar(0));
+    double *lsfData = lsf.ptr<double>(0);
+    for (int k = 1; k < numBins - 1; ++k)
+    {
+        double window = 0.54 + 0.46 * std::cos(2.0 * CV_PI * (k - center) / numBins);
+        lsfData[k] = 0.5 * (esf[k + 1] - esf[k - 1]) * window;
+    }
+
+    cv::Mat spectrum;
+    cv::dft(lsf, spectrum, cv::DFT_COMPLEX_OUTPUT);
+    const cv::Vec2d *bins = spectrum.ptr<cv::Vec2d>(0);
+    const double dc = std::hypot(bins[0][0], bins[0][1]);
+    if (dc <= 0.0)
+    {
+        throw std::runtime_error("No edge found in the slanted-edge region");
+    }
+
+    // Bin k is k * oversampling / numBins cycles per pixel; kept up to the sampling frequency
+    const int lastBin = std::min(numBins / 2, numBins / oversampling);
+    for (int k = 0; k <= lastBin; ++k)
+    {
+        double frequency = static_cast<double>(k) * oversampling / numBins;
+
+        // The central difference over two bins is a sinc filter; divide it out
+        double argument = 2.0 * CV_PI * frequency / oversampling;
+        double correction = (k == 0) ? 1.0 : std::min(argument / std::sin(argument), MAX_DERIVATIVE_CORRECTION);
+        result.frequencies.push_back(frequency);
+        result.mtf.push_back(std::hypot(bins[k][0], bins[k][1]) / dc * correction);
+    }
+
+    result.mtf50 = crossing(result.frequencies, result.mtf, 0.5);
+    result.mtf10 = crossing(result.frequencies, result.mtf, 0.1);
+    for (size_t k = 1; k < result.frequencies.size(); ++k)
+    {
+        if (result.frequencies[k] >= 0.5)
+        {
+            double t = (0.5 - result.frequencies[k - 1]) / (result.frequencies[k] - result.frequencies[k - 1]);
+            result.mtfNyquist = result.mtf[k - 1] + t * (result.mtf[k] - result.mtf[k - 1]);
+            break;
+        }
+    }
+    return result;
+}
+
+std::vector<ImageQuality::PatchStats> ImageQuality::patchStatistics(const cv::Mat &image, const std::vector<cv::Rect> &patches, double margin)
+{
+    TELEMETRY_SCOPE("ImageQuality::patchStatistics");
+    if (margin < 0.0 || margin >= 0.5)
+    {
+        throw std::invalid_argument("Patch margin must be in [0, 0.5)");
+    }
+
+    // Validated before the parallel loop so that errors are raised here
+    std::vector<PatchStats> stats(patches.size());
+    for (size_t p = 0; p < patches.size(); ++p)
+    {
+        const cv::Rect &patch = patches[p];
+        int dx = static_cast<int>(patch.width * margin);
+        int dy = static_cast<int>(patch.height * margin);
+        stats[p].region = cv::Rect(patch.x + dx, patch.y + dy, patch.width - 2 * dx, patch.height - 2 * dy) & cv::Rect(0, 0, image.cols, image.rows);
+        if (stats[p].region.empty())
+        {
+            throw std::invalid_argument("Patch lies outside the image");
+        }
+    }
+
+    const cv::Mat lum = luminance(image);
+    cv::parallel_for_(cv::Range(0, static_cast<int>(stats.size())), [&](const cv::Range &range)
+    {
+        for (int p = range.start; p < range.end; ++p)
+        {
+            cv::Scalar mean, stddev;
+            cv::meanStdDev(lum(stats[p].region), mean, stddev);
+            stats[p].mean = mean[0];
+            stats[p].stddev = stddev[0];
+            stats[p].snr = (stddev[0] > 0.0) ? mean[0] / stddev[0] : std::numeric_limits<double>::infinity();
+            stats[p].snrDb = 20.0 * std::log10(stats[p].snr);
+        }
+    });
+    return stats;
+}
+
+double ImageQuality::psnr(const cv::Mat &image, const cv::Mat &reference, double peak)
+{
+    checkSameSize(image, reference);
+    if (image.channels() != reference.channels())
+    {
+        throw std::invalid_argument("Image and reference must have the same number of channels");
+    }
+
+    cv::Mat a, b;
+    image.convertTo(a, CV_64F);
+    reference.convertTo(b, CV_64F);
+    double mse = cv::norm(a, b, cv::NORM_L2SQR) / (static_cast<double>(a.total()) * a.channels());
+    return (mse > 0.0) ? 10.0 * std::log10(peak * peak / mse) : std::numeric_limits<double>::infinity();
+}
+
+ImageQuality::PrecisionError ImageQuality::precisionError(const cv::Mat &data, const cv::Mat &reference, double peak)
+{
+    TELEMETRY_SCOPE("ImageQuality::precisionError");
+    checkSameSize(data, reference);
+    if (data.channels() != reference.channels())
+    {
+        throw std::invalid_argument("Data and reference must have the same number of channels");
+    }
+
+    cv::Mat a, b, difference;
+    data.convertTo(a, CV_64F);
+    reference.convertTo(b, CV_64F);
+    cv::absdiff(a, b, difference);
+    difference = difference.reshape(1);
+
+    PrecisionError error;
+    const double count = static_cast<double>(difference.total());
+    cv::minMaxLoc(difference, nullptr, &error.maxAbs);
+    error.meanAbs = cv::sum(difference)[0] / count;
+    error.rmse = std::sqrt(difference.dot(difference) / count);
+    error.psnr = psnr(data, reference, peak);
+    error.mismatched = cv::countNonZero(difference) / count;
+    return error;
+}
+
+double ImageQuality::ssim(const cv::Mat &image, const cv::Mat &reference, double peak)
+{
+    TELEMETRY_SCOPE("ImageQuality::ssim");
+    checkSameSize(image, reference);
+
+    const cv::Mat x = luminance(image);
+    const cv::Mat y = luminance(reference);
+    const cv::Size window(SSIM_WINDOW, SSIM_WINDOW);
+
+    // Local means, variances and covariance over the Gaussian window
+    cv::Mat muX, muY, xx, yy, xy;
+    cv::GaussianBlur(x, muX, window, SSIM_SIGMA);
+    cv::GaussianBlur(y, muY, window, SSIM_SIGMA);
+    cv::GaussianBlur(x.mul(x), xx, window, SSIM_SIGMA);
+    cv::GaussianBlur(y.mul(y), yy, window, SSIM_SIGMA);
+    cv::GaussianBlur(x.mul(y), xy, window, SSIM_SIGMA);
+
+    const double c1 = (SSIM_K1 * peak) * (SSIM_K1 * peak);
+    const double c2 = (SSIM_K2 * peak) * (SSIM_K2 * peak);
+    std::vector<double> rowSums(x.rows, 0.0);
+    cv::parallel_for_(cv::Range(0, x.rows), [&](const cv::Range &range)
+    {
+        for (int i = range.start; i < range.end; ++i)
+        {
+            const float *mx = muX.ptr<float>(i);
+            const float *my = muY.ptr<float>(i);
+            const float *sxx = xx.ptr<float>(i);
+            const float *syy = yy.ptr<float>(i);
+            const float *sxy = xy.ptr<float>(i);
+            double sum = 0.0;
+            for (int j = 0; j < x.cols; ++j)
+            {
+                double varX = sxx[j] - static_cast<double>(mx[j]) * mx[j];
+                double varY = syy[j] - static_cast<double>(my[j]) * my[j];
+                double cov = sxy[j] - static_cast<double>(mx[j]) * my[j];
+                sum += ((2.0 * mx[j] * my[j] + c1) * (2.0 * cov + c2)) /
+                       ((static_cast<double>(mx[j]) * mx[j] + static_cast<double>(my[j]) * my[j] + c1) * (varX + varY + c2));
+            }
+            rowSums[i] = sum;
+        }
+    });
+    return std::accumulate(rowSums.begin(), rowSums.end(), 0.0) / static_cast<double>(x.total());
+}
+
+double ImageQuality::deltaE(const cv::Mat &image, const cv::Mat &reference, double peak)
+{
+    TELEMETRY_SCOPE("ImageQuality::deltaE");
+    checkSameSize(image, reference);
+    if (peak <= 0.0)
+    {
+        throw std::invalid_argument("Peak value must be positive");
+    }
+
+    const cv::Mat a = toBGR(image);
+    const cv::Mat b = toBGR(reference);
+    const double scale = 1.0 / peak;
+    std::vector<double> rowSums(a.rows, 0.0);
+    cv::parallel_for_(cv::Range(0, a.rows), [&](const cv::Range &range)
+    {
+        for (int i = range.start; i < range.end; ++i)
+        {
+            const float *pa = a.ptr<float>(i);
+            const float *pb = b.ptr<float>(i);
+            double sum = 0.0;
+            for (int j = 0; j < a.cols; ++j)
+            {
+                double labA[3], labB[3];
+                bgrToLab(pa + 3 * j, scale, labA);
+                bgrToLab(pb + 3 * j, scale, labB);
+                sum += std::sqrt((labA[0] - labB[0]) * (labA[0] - labB[0]) + (labA[1] - labB[1]) * (labA[1] - labB[1]) + (labA[2] - labB[2]) * (labA[2] - labB[2]));
+            }
+            rowSums[i] = sum;
+        }
+    });
+    return std::accumulate(rowSums.begin(), rowSums.end(), 0.0) / static_cast<double>(a.total());
+}
+
+ImageQuality::DemosaicArtifacts ImageQuality::demosaicArtifacts(const cv::Mat &image, const cv::Mat &reference, double peak)
+{
+    TELEMETRY_SCOPE("ImageQuality::demosaicArtifacts");
+    checkSameSize(image, reference);
+    if (peak <= 0.0)
+    {
+        throw std::invalid_argument("Peak value must be positive");
+    }
+
+    const cv::Mat a = toBGR(image);
+    const cv::Mat b = toBGR(reference);
+    const cv::Mat lumA = luminance(a);
+    const cv::Mat lumB = luminance(b);
+    const double threshold = EDGE_THRESHOLD * peak;
+
+    // Per row: false color sum, zipper sum and number of edge pixels; borders are skipped
+    std::vector<cv::Vec3d> rowSums(a.rows, cv::Vec3d(0, 0, 0));
+    cv::parallel_for_(cv::Range(1, std::max(a.rows - 1, 1)), [&](const cv::Range &range)
+    {
+        for (int i = range.start; i < range.end; ++i)
+        {
+            const float *pa = a.ptr<float>(i);
+            const float *pb = b.ptr<float>(i);
+            const float *ref = lumB.ptr<float>(i);
+            const float *refUp = lumB.ptr<float>(i - 1);
+            const float *refDown = lumB.ptr<float>(i + 1);
+            const float *lum = lumA.ptr<float>(i);
+            const float *lumUp = lumA.ptr<float>(i - 1);
+            const float *lumDown = lumA.ptr<float>(i + 1);
+            cv::Vec3d sums(0, 0, 0);
+            for (int j = 1; j < a.cols - 1; ++j)
+            {
+                double gx = 0.5 * (ref[j + 1] - ref[j - 1]);
+                double gy = 0.5 * (refDown[j] - refUp[j]);
+                if (std::hypot(gx, gy) < threshold)
+                {
+                    continue;
+                }
+
+                // Chroma as color differences to green, so that luminance errors (blur) do not count
+                const float *ca = pa + 3 * j;
+                const float *cb = pb + 3 * j;
+                double dRG = (ca[2] - ca[1]) - (cb[2] - cb[1]);
+                double dBG = (ca[0] - ca[1]) - (cb[0] - cb[1]);
+                sums[0] += std::sqrt(dRG * dRG + dBG * dBG);
+
+                // Zipper: luminance error that alternates from one pixel to the next
+                double e = lum[j] - ref[j];
+                double eLeft = lum[j - 1] - ref[j - 1];
+                double eRight = lum[j + 1] - ref[j + 1];
+                double eUp = lumUp[j] - refUp[j];
+                double eDown = lumDown[j] - refDown[j];
+                sums[1] += std::max(std::abs(e - 0.5 * (eLeft + eRight)), std::abs(e - 0.5 * (eUp + eDown)));
+                sums[2] += 1.0;
+            }
+            rowSums[i] = sums;
+        }
+    });
+
+    cv::Vec3d total(0, 0, 0);
+    for (const auto &sums : rowSums)
+    {
+        total += sums;
+    }
+
+    DemosaicArtifacts artifacts;
+    if (total[2] > 0.0)
+    {
+        artifacts.falseColor = total[0] / total[2] / peak;
+        artifacts.zipper = total[1] / total[2] / peak;
+    }
+    return artifacts;
+}
+
+ImageQuality::Report ImageQuality::analyze(const cv::Mat &image, const cv::Mat &scene, double peak, const std::vector<cv::Rect> &patches, const cv::Rect &edgeRoi)
+{
+    TELEMETRY_SCOPE("ImageQuality::analyze");
+    checkSameSize(image, scene);
+    if (peak <= 0.0)
+    {
+        throw std::invalid_argument("Peak value must be positive");
+    }
+
+    cv::Mat reference;
+    toBGR(scene).convertTo(reference, CV_32F, peak);
+
+    // One least-squares gain per channel: exposure, CFA transmission and white balance are not errors
+    std::vector<cv::Mat> channels, referenceChannels;
+    cv::split(toBGR(image), channels);
+    cv::split(reference, referenceChannels);
+    for (int c = 0; c < 3; ++c)
+    {
+        double energy = channels[c].dot(channels[c]);
+        double gain = (energy > 0.0) ? channels[c].dot(referenceChannels[c]) / energy : 1.0;
+        channels[c].convertTo(channels[c], CV_32F, gain);
+    }
+    cv::Mat matched;
+    cv::merge(channels, matched);
+
+    Report report;
+    report.psnr = psnr(matched, reference, peak);
+    report.ssim = ssim(matched, reference, peak);
+    report.deltaE = deltaE(matched, reference, peak);
+    DemosaicArtifacts artifacts = demosaicArtifacts(matched, reference, peak);
+    report.falseColor = artifacts.falseColor;
+    report.zipper = artifacts.zipper;
+
+    if (!edgeRoi.empty())
+    {
+        MTFResult mtf = slantedEdgeMTF(image, edgeRoi);
+        report.mtf50 = mtf.mtf50;
+        report.mtfNyquist = mtf.mtfNyquist;
+    }
+
+    // Noise-free patches have an infinite SNR and are left out of the mean
+    int finite = 0;
+    for (const auto &stats : patchStatistics(image, patches))
+    {
+        if (std::isfinite(stats.snrDb))
+        {
+            report.meanSNRDb += stats.snrDb;
+            ++finite;
+        }
+    }
+    if (finite > 0)
+    {
+        report.meanSNRDb /= finite;
+    }
+    return report;
+}
+
+std::string ImageQuality::format(const Report &report)
+{
+    std::ostringstream out;
+    out << "psnr=" << report.psnr << " ssim=" << report.ssim << " deltaE=" << report.deltaE
+        << " falseColor=" << report.falseColor << " zipper=" << report.zipper
+        << " mtf50=" << report.mtf50 << " mtfNyquist=" << report.mtfNyquist << " snrDb=" << report.meanSNRDb;
+    return out.str();
+}
+
+std::string ImageQuality::format(const PrecisionError &error)
+{
+    std::ostringstream out;
+    out << "maxAbs=" << error.maxAbs << " meanAbs=" << error.meanAbs << " rmse=" << error.rmse
+        << " psnr=" << error.psnr << " mismatched=" << error.mismatched;
+    return out.str();
+}
+
+cv::Mat ImageQuality::luminance(const cv::Mat &image)
+{
+    cv::Mat lum;
+    if (image.channels() == 3)
+    {
+        cv::Mat image32F;
+        image.convertTo(image32F, CV_32F);
+        cv::transform(image32F, lum, cv::Matx13f(0.114f, 0.587f, 0.299f));
+    }
+    else if (image.channels() == 1)
+    {
+        image.convertTo(lum, CV_32F);
+    }
+    else
+    {
+        throw std::invalid_argument("Image must have 1 or 3 channels");
+    }
+    return lum;
+}
+
+cv::Mat ImageQuality::toBGR(const cv::Mat &image)
+{
+    cv::Mat bgr;
+    if (image.channels() == 3)
+    {
+        image.convertTo(bgr, CV_32F);
+    }
+    else if (image.channels() == 1)
+    {
+        cv::Mat gray;
+        image.convertTo(gray, CV_32F);
+        cv::merge(std::vector<cv::Mat>{gray, gray, gray}, bgr);
+    }
+    else
+    {
+        throw std::invalid_argument("Image must have 1 or 3 channels");
+    }
+    return bgr;
+}
@@ -1,180 +1,379 @@
 #include "ImageSensor/ImageSensor.h"
+#include "Telemetry/Telemetry.h"
+#include <algorithm>
+#include <cmath>
 #include <iostream>
+#include <mutex>
+#include <vector>
+
+namespace
+{
+    // Adds a band row weighted by the filter transmission to the accumulated frame
+    template <typename T>
+    void accumulateRow(const T *src, const float *w, T *acc, int count)
+    {
+        for (int j = 0; j < count; ++j)
+        {
+            acc[j] += src[j] * static_cast<T>(w[j]);
+        }
+    }
+}
 
 // Constructor with bit depth and dimensions parameters
-ImageSensor::ImageSensor(int bitDepth, int width, int height)
-    : bitDepth(bitDepth), width(width), height(height), distribution(0.0, 1.0)
+ImageSensor::ImageSensor(int bitDepth, int width, int height, SensorKernels::Precision precision)
+    : bitDepth(bitDepth), cvType(cvTypeForBitDepth(bitDepth)), precision(precision), workingDepth(SensorKernels::workingDepth(precision)),
+      kernels(SensorKernels::forBitDepth(bitDepth, precision)), width(width), height(height)
+{
+    // Initialize the sensor matrix with the determined type
+    sensor = cv::Mat::zeros(height, width, cvType);
+}
+
+SensorKernels::Precision ImageSensor::getPrecision() const
+{
+    return precision;
+}
+
+// Determine the OpenCV type based on the bit depth
+int ImageSensor::cvTypeForBitDepth(int bitDepth)
 {
-    // Determine the OpenCV type based on the bit depth
     if (bitDepth == 8)
     {
-        cvType = CV_8UC1;
+        return CV_8UC1;
     }
     else if (bitDepth == 32)
     {
-        cvType = CV_32FC1;
+        return CV_32FC1;
     }
     else if (bitDepth == 64)
     {
-        cvType = CV_64FC1;
+        return CV_64FC1;
     }
     else if (bitDepth == 10 || bitDepth == 12 || bitDepth == 14 || bitDepth == 16)
     {
-        cvType = CV_16UC1;
-    }
-    else
-    {
-        throw std::invalid_argument("Unsupported bit depth");
+        return CV_16UC1;
     }
+    throw std::invalid_argument("Unsupported bit depth");
+}
 
-    // Initialize the sensor matrix with the determined type
-    sensor = cv::Mat::zeros(height, width, cvType);
+double ImageSensor::fullScaleForBitDepth(int bitDepth)
+{
+    // Integer sensors span their own codes; float sensors keep the 16-bit scale
+    return (bitDepth <= 16) ? std::ldexp(1.0, bitDepth) - 1.0 : 65535.0;
 }
 
 // Capture light into the sensor
 void ImageSensor::captureLight(const cv::Mat &scene)
 {
-    if (bitDepth == 8)
+    TELEMETRY_SCOPE("ImageSensor::captureLight");
+    if (scene.channels() != 1)
     {
-        scene.convertTo(sensor, cvType, 255.0); // Scale to 8-bit range
+        throw std::invalid_argument("Scene must be single channel");
     }
-    else
+    cv::Mat light = scene;
+    if (scene.depth() != CV_32F && scene.depth() != CV_64F)
     {
-        scene.convertTo(sensor, cvType, 65535.0); // Scale to full range for higher bit depths
+        scene.convertTo(light, workingDepth);
     }
+
+    sensor.create(light.size(), cvType);
+    const double fullScale = getFullScale();
+    cv::parallel_for_(cv::Range(0, light.rows), [&](const cv::Range &range)
+    {
+        cv::Mat rows = sensor.rowRange(range.start, range.end);
+        quantizeRows(light.rowRange(range.start, range.end), rows, fullScale);
+    });
+    reportDiagnostics("captureLight");
 }
 
-// Add noise to the sensor
-void ImageSensor::addNoise(double noiseLevel)
+// Stream a scene file into the sensor, one strip per task
+void ImageSensor::captureLight(const SceneLoader &loader)
 {
-    cv::Mat noise(sensor.size(), CV_64FC1);            // Create a noise matrix of the same size as the sensor
-    std::normal_distribution<double> d(0, noiseLevel); // Normal distribution with mean 0 and standard deviation noiseLevel
-
-    // Fill the noise matrix with random values from the normal distribution
-    for (int i = 0; i < noise.rows; ++i)
+    TELEMETRY_SCOPE("ImageSensor::captureLight");
+    const cv::Size size = loader.getSize();
+    sensor.create(size, cvType);
+    const double fullScale = getFullScale();
+    const int numStrips = (size.height + SceneLoader::DEFAULT_STRIP_ROWS - 1) / SceneLoader::DEFAULT_STRIP_ROWS;
+    cv::parallel_for_(cv::Range(0, numStrips), [&](const cv::Range &range)
     {
-        for (int j = 0; j < noise.cols; ++j)
+        cv::Mat strip;
+        for (int s = range.start; s < range.end; ++s)
         {
-            noise.at<double>(i, j) = d(generator);
+            int rowStart = s * SceneLoader::DEFAULT_STRIP_ROWS;
+            int rowEnd = std::min(rowStart + SceneLoader::DEFAULT_STRIP_ROWS, size.height);
+            loader.readStrip(rowStart, rowEnd, strip);
+            cv::Mat rows = sensor.rowRange(rowStart, rowEnd);
+            quantizeRows(strip, rows, fullScale);
         }
-    }
+    });
+    reportDiagnostics("captureLight");
+}
+
+// Capture a spectral scene band by band into one accumulated frame
+void ImageSensor::captureSpectral(const SpectralScene &scene, const CFAPattern &cfaPattern, const SpectralPSF &psf)
+{
+    TELEMETRY_SCOPE("ImageSensor::captureSpectral");
+    const cv::Size size = scene.getSize();
+    const std::vector<double> &wavelengths = scene.getWavelengths();
+    const int numBands = scene.getNumBands();
+    const float bandScale = static_cast<float>(1.0 / numBands);
 
-    // Debug information to check the noise values
-    double minNoise, maxNoise;
-    cv::minMaxLoc(noise, &minNoise, &maxNoise);
-    std::cout << "Noise min value: " << minNoise << ", max value: " << maxNoise << std::endl;
+    signal = cv::Mat::zeros(size, CV_MAKETYPE(workingDepth, 1));
+    const int numStrips = (size.height + SPECTRAL_STRIP_ROWS - 1) / SPECTRAL_STRIP_ROWS;
+    std::vector<std::mutex> stripLocks(numStrips);
 
-    // Print the first 10x10 section of the noise matrix
-    std::cout << "Noise matrix (first 10x10 values):" << std::endl;
-    for (int i = 0; i < std::min(10, noise.rows); ++i)
+    cv::parallel_for_(cv::Range(0, numBands), [&](const cv::Range &range)
     {
-        for (int j = 0; j < std::min(10, noise.cols); ++j)
+        // Per worker buffers: only one band per worker is alive at a time
+        cv::Mat band, blurred;
+        PSFConvolver convolver;
+        for (int b = range.start; b < range.end; ++b)
         {
-            std::cout << noise.at<double>(i, j) << " ";
+            scene.renderBand(b, band);
+            if (psf)
+            {
+                convolver.setPSF(psf(wavelengths[b]));
+                convolver.apply(band, blurred, workingDepth);
+            }
+            else if (band.depth() == workingDepth)
+            {
+                blurred = band;
+            }
+            else
+            {
+                band.convertTo(blurred, workingDepth);
+            }
+
+            cv::Mat weights = cfaPattern.expandSpectralWeights(wavelengths[b], size.width);
+            weights *= bandScale;
+
+            // Start at a different strip per band so workers rarely wait on the same lock
+            for (int k = 0; k < numStrips; ++k)
+            {
+                int s = (b + k) % numStrips;
+                int rowStart = s * SPECTRAL_STRIP_ROWS;
+                int rowEnd = std::min(rowStart + SPECTRAL_STRIP_ROWS, size.height);
+
+                std::lock_guard<std::mutex> lock(stripLocks[s]);
+                for (int i = rowStart; i < rowEnd; ++i)
+                {
+                    const float *w = weights.ptr<float>(i % weights.rows);
+                    if (workingDepth == CV_64F)
+                    {
+                        accumulateRow(blurred.ptr<double>(i), w, signal.ptr<double>(i), size.width);
+                    }
+                    else
+                    {
+                        accumulateRow(blurred.ptr<float>(i), w, signal.ptr<float>(i), size.width);
+                    }
+                }
+            }
         }
-        std::cout << std::endl;
-    }
+    });
+
+    // Single quantization of the summed bands
+    sensor.create(size, cvType);
+    const double fullScale = getFullScale();
+    cv::parallel_for_(cv::Range(0, size.height), [&](const cv::Range &range)
+    {
+        cv::Mat rows = sensor.rowRange(range.start, range.end);
+        quantizeRows(signal.rowRange(range.start, range.end), rows, fullScale);
+    });
+    reportDiagnostics("captureSpectral");
+}
+
+// Set the seed of the noise generator
+void ImageSensor::setSeed(uint64_t seed)
+{
+    noiseGenerator.setSeed(seed);
+    noiseStream = 0;
+}
 
-    // Add the noise to the sensor data
-    cv::Mat temp;
-    sensor.convertTo(temp, CV_64FC1); // Convert the sensor data to double for precision
+// Install the diagnostics hook
+void ImageSensor::setDiagnosticsCallback(DiagnosticsCallback callback)
+{
+    diagnostics = std::move(callback);
+}
 
-    // Print the first 10x10 section of the image matrix
-    std::cout << "Image matrix (first 10x10 values):" << std::endl;
-    for (int i = 0; i < std::min(10, temp.rows); ++i)
+// Add noise to the sensor
+void ImageSensor::addNoise(double noiseLevel)
+{
+    TELEMETRY_SCOPE("ImageSensor::addNoise");
+    // Same per-row streams as NoiseGenerator::addGaussian, added in place saturating to the bit depth
+    const uint64_t stream = noiseStream++;
+    cv::parallel_for_(cv::Range(0, sensor.rows), [&](const cv::Range &range)
     {
-        for (int j = 0; j < std::min(10, temp.cols); ++j)
+        std::vector<float> noise(sensor.cols);
+        for (int i = range.start; i < range.end; ++i)
         {
-            std::cout << temp.at<double>(i, j) << " ";
+            noiseGenerator.gaussianRow(stream, i, 0, sensor.cols, noise.data());
+            kernels.addNoise(sensor.ptr(i), noise.data(), sensor.cols, noiseLevel, kernels.maxValue);
         }
-        std::cout << std::endl;
-    }
+    });
+    reportDiagnostics("addNoise");
+}
 
-    temp += noise; // Add the noise to the sensor data
+// Set up the physically-based noise model and its fixed-pattern maps
+void ImageSensor::setNoiseModel(const NoiseModel::Parameters &params)
+{
+    noiseModel = std::make_shared<NoiseModel>(params, width, height, bitDepth, noiseGenerator.getSeed());
+}
+
+std::shared_ptr<NoiseModel> ImageSensor::getNoiseModel() const
+{
+    return noiseModel;
+}
 
-    std::cout << "Image matrix (first 10x10 values after adding noise):" << std::endl;
-    for (int i = 0; i < std::min(10, temp.rows); ++i)
+// Apply the physically-based noise model
+void ImageSensor::applyNoiseModel()
+{
+    TELEMETRY_SCOPE("ImageSensor::applyNoiseModel");
+    if (!noiseModel)
     {
-        for (int j = 0; j < std::min(10, temp.cols); ++j)
-        {
-            std::cout << temp.at<double>(i, j) << " ";
-        }
-        std::cout << std::endl;
+        throw std::logic_error("No noise model has been set");
     }
-    temp.convertTo(sensor, cvType); // Convert back to the original type
+    noiseModel->apply(sensor, getFullScale(), noiseStream++);
+    reportDiagnostics("applyNoiseModel");
 }
 
 // Apply Color Filter Array with CLEAR pixel option
 void ImageSensor::applyCFA(const CFAPattern &cfaPattern)
 {
-    cv::Mat temp;
-    sensor.convertTo(temp, CV_64FC1); // Convert to double for processing
-    const cv::Mat &pattern = cfaPattern.getPattern();
-    for (int i = 0; i < temp.rows; ++i)
+    TELEMETRY_SCOPE("ImageSensor::applyCFA");
+    // Element-wise multiply by the weights of the pixel's tile row, unrolled over the tile width
+    const int tileRows = cfaPattern.getTileRows();
+    const int tileCols = cfaPattern.getTileCols();
+    const float *weights = cfaPattern.getWeightTable();
+    const SensorKernels::ApplyCFA kernel = kernels.applyCFA[tileCols];
+    cv::parallel_for_(cv::Range(0, sensor.rows), [&](const cv::Range &range)
     {
-        for (int j = 0; j < temp.cols; ++j)
+        for (int i = range.start; i < range.end; ++i)
         {
-            CFAPattern::Color color = static_cast<CFAPattern::Color>(pattern.at<uchar>(i, j));
-            double value = temp.at<double>(i, j);
-            switch (color)
-            {
-            case CFAPattern::RED:
-                value *= cfaPattern.getColorWeight(CFAPattern::RED);
-                break;
-            case CFAPattern::GREEN:
-                value *= cfaPattern.getColorWeight(CFAPattern::GREEN);
-                break;
-            case CFAPattern::BLUE:
-                value *= cfaPattern.getColorWeight(CFAPattern::BLUE);
-                break;
-            case CFAPattern::CLEAR:
-                // No modification needed for clear pixels
-                break;
-            }
-            temp.at<double>(i, j) = value;
+            kernel(sensor.ptr(i), weights + (i % tileRows) * tileCols, 0, sensor.cols, kernels.maxValue);
         }
-    }
-    temp.convertTo(sensor, cvType); // Convert back to the original type
+    });
+    reportDiagnostics("applyCFA");
+}
+
+// Run the raw-domain ISP on the mosaic
+void ImageSensor::applyRawISP(const RawISP &rawISP)
+{
+    TELEMETRY_SCOPE("ImageSensor::applyRawISP");
+    rawISP.process(sensor);
+    // Gains may push codes past the bit depth, which the storage type alone does not catch
+    cv::parallel_for_(cv::Range(0, sensor.rows), [&](const cv::Range &range)
+    {
+        for (int i = range.start; i < range.end; ++i)
+        {
+            kernels.clip(sensor.ptr(i), sensor.cols, kernels.maxValue);
+        }
+    });
+    reportDiagnostics("applyRawISP");
 }
 
 // Demosaic the sensor data
-void ImageSensor::demosaic(cv::Mat &output, const std::string &cfaPatternStr)
+void ImageSensor::demosaic(cv::Mat &output, const std::string &cfaPatternStr, Demosaic::Algorithm algorithm)
 {
-    cv::Mat temp;
-    sensor.convertTo(temp, CV_8UC1, 255.0 / ((bitDepth == 8) ? 255.0 : 65535.0)); // Scale down for demosaicing
+    TELEMETRY_SCOPE("ImageSensor::demosaic");
+    // Works on the native sensor type, no 8-bit round trip
+    Demosaic::process(sensor, output, CFAPattern(cfaPatternStr), algorithm);
+}
 
-    int conversionCode;
-    if (cfaPatternStr == "RCCB" || cfaPatternStr == "RGGB")
-    {
-        conversionCode = cv::COLOR_BayerBG2BGR;
-    }
-    else if (cfaPatternStr == "GRBG")
-    {
-        conversionCode = cv::COLOR_BayerGR2BGR;
-    }
-    else if (cfaPatternStr == "GBRG")
+// Apply optical diffraction by convolving with a PSF
+void ImageSensor::applyDiffraction(const cv::Mat &psf)
+{
+    psfConvolver.setPSF(psf); // Picks separable, FFT or direct filtering
+    convolveSensor();
+}
+
+// Apply optical diffraction with a separable PSF
+void ImageSensor::applyDiffraction(const cv::Mat &rowKernel, const cv::Mat &colKernel)
+{
+    psfConvolver.setSeparablePSF(rowKernel, colKernel);
+    convolveSensor();
+}
+
+void ImageSensor::convolveSensor()
+{
+    TELEMETRY_SCOPE("ImageSensor::applyDiffraction");
+    psfConvolver.apply(sensor, convolved, workingDepth); // Buffer kept across frames
+    sensor.create(convolved.size(), cvType);
+    cv::parallel_for_(cv::Range(0, convolved.rows), [&](const cv::Range &range)
     {
-        conversionCode = cv::COLOR_BayerGB2BGR;
-    }
-    else if (cfaPatternStr == "BGGR")
+        cv::Mat rows = sensor.rowRange(range.start, range.end);
+        quantizeRows(convolved.rowRange(range.start, range.end), rows, 1.0); // Back to the sensor type
+    });
+    reportDiagnostics("applyDiffraction");
+}
+
+// Run all pipeline stages over row tiles with a single quantization at readout
+void ImageSensor::simulate(const cv::Mat &scene, const SensorPipeline &pipeline)
+{
+    TELEMETRY_SCOPE("ImageSensor::simulate");
+
+    // Capture and the stages that need the whole frame; light from a stage cache is shared
+    // with it, so it never lands in the reusable working buffer
+    cv::Mat cachedSignal;
+    cv::Mat &light = pipeline.getStageCache() ? cachedSignal : signal;
+    pipeline.captureFrame(scene, getFullScale(), light, workingDepth);
+    sensor.create(light.rows, light.cols, cvType);
+
+    const int tileRows = pipeline.getTileRows();
+    const int numTiles = (light.rows + tileRows - 1) / tileRows;
+    const uint64_t frame = frameIndex++;
+    const SensorKernels::Table *fixedPoint = (precision == SensorKernels::FIXED_POINT) ? &kernels : nullptr;
+
+    cv::parallel_for_(cv::Range(0, numTiles), [&](const cv::Range &range)
     {
-        conversionCode = cv::COLOR_BayerRG2BGR;
-    }
-    else
+        cv::Mat tile; // Reused for every tile handled by this worker
+        for (int t = range.start; t < range.end; ++t)
+        {
+            int rowStart = t * tileRows;
+            int rowEnd = std::min(rowStart + tileRows, light.rows);
+            pipeline.processTile(light, tile, rowStart, rowEnd, frame, getFullScale(), fixedPoint);
+
+            cv::Mat readout = sensor.rowRange(rowStart, rowEnd);
+            if (fixedPoint)
+            {
+                tile.copyTo(readout); // Already codes
+            }
+            else
+            {
+                quantizeRows(tile, readout, 1.0); // Quantize to the bit depth
+            }
+        }
+    });
+    reportDiagnostics("simulate");
+}
+
+const cv::Mat &ImageSensor::getSensorData() const
+{
+    return sensor;
+}
+
+double ImageSensor::getFullScale() const
+{
+    return fullScaleForBitDepth(bitDepth);
+}
+
+void ImageSensor::quantizeRows(const cv::Mat &input, cv::Mat &output, double scale) const
+{
+    for (int i = 0; i < input.rows; ++i)
     {
-        std::cerr << "Warning: Unsupported CFA pattern string for demosaicing. Defaulting to cv::COLOR_BayerBG2BGR." << std::endl;
-        conversionCode = cv::COLOR_BayerBG2BGR;
+        if (input.depth() == CV_32F)
+        {
+            kernels.quantizeF32(input.ptr<float>(i), output.ptr(i), input.cols, scale, kernels.maxValue);
+        }
+        else
+        {
+            kernels.quantizeF64(input.ptr<double>(i), output.ptr(i), input.cols, scale, kernels.maxValue);
+        }
     }
-
-    cv::cvtColor(temp, output, conversionCode);
-    output.convertTo(output, cvType, ((bitDepth == 8) ? 255.0 : 65535.0) / 255.0); // Scale up to original type
 }
 
-// Apply optical diffraction by convolving with a PSF
-void ImageSensor::applyDiffraction(const cv::Mat &psf)
+void ImageSensor::reportDiagnostics(const std::string &stage) const
 {
-    cv::Mat temp;
-    sensor.convertTo(temp, CV_64FC1);  // Convert to double for processing
-    cv::filter2D(temp, temp, -1, psf); // Convolve with the PSF
-    temp.convertTo(sensor, cvType);    // Convert back to the original type
+    if (diagnostics)
+    {
+        diagnostics(stage, sensor);
+    }
 }
@@ -0,0 +1,282 @@
+#include "LensShading/LensShading.h"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+LensShading::LensShading(int numChannels)
+    : grids(numChannels)
+{
+    if (numChannels < 0)
+    {
+        throw std::invalid_argument("Number of channels must not be negative");
+    }
+}
+
+LensShading::LensShading(const cv::Mat &grid)
+    : grids(1)
+{
+    setGrid(0, grid);
+}
+
+void LensShading::setGrid(int channel, const cv::Mat &grid)
+{
+    if (grid.empty())
+    {
+        grids.at(channel).release();
+        return;
+    }
+    if (grid.channels() != 1 || grid.rows < 2 || grid.cols < 2)
+    {
+        throw std::invalid_argument("Lens shading grid must be a single channel grid of at least 2x2 nodes");
+    }
+    grid.convertTo(grids.at(channel), CV_32FC1);
+}
+
+const cv::Mat &LensShading::getGrid(int channel) const
+{
+    return grids.at(channel);
+}
+
+int LensShading::getNumChannels() const
+{
+    return static_cast<int>(grids.size());
+}
+
+bool LensShading::empty() const
+{
+    return std::all_of(grids.begin(), grids.end(), [](const cv::Mat &grid) { return grid.empty(); });
+}
+
+LensShading LensShading::inverted() const
+{
+    LensShading result(getNumChannels());
+    for (int c = 0; c < getNumChannels(); ++c)
+    {
+        if (!grids[c].empty())
+        {
+            cv::divide(1.0, grids[c], result.grids[c]);
+        }
+    }
+    return result;
+}
+
+void LensShading::gainRow(int channel, int row, cv::Size frameSize, float *gains, int colStart, int colStep) const
+{
+    const cv::Mat &grid = grids.at(channel);
+    if (grid.empty())
+    {
+        for (int j = colStart; j < frameSize.width; j += colStep)
+        {
+            gains[j] = 1.0f;
+        }
+        return;
+    }
+
+    // Interpolate the grid vertically at this row, then horizontally per pixel
+    thread_local std::vector<float> nodes;
+    nodes.resize(grid.cols);
+    double fy = (frameSize.height > 1) ? static_cast<double>(row) * (grid.rows - 1) / (frameSize.height - 1) : 0.0;
+    int y0 = std::min(static_cast<int>(fy), grid.rows - 2);
+    float ty = static_cast<float>(fy - y0);
+    const float *g0 = grid.ptr<float>(y0);
+    const float *g1 = grid.ptr<float>(y0 + 1);
+    for (int k = 0; k < grid.cols; ++k)
+    {
+        nodes[k] = g0[k] + ty * (g1[k] - g0[k]);
+    }
+
+    const float xScale = (frameSize.width > 1) ? static_cast<float>(grid.cols - 1) / (frameSize.width - 1) : 0.0f;
+    for (int j = colStart; j < frameSize.width; j += colStep)
+    {
+        float fx = j * xScale;
+        int x0 = std::min(static_cast<int>(fx), grid.cols - 2);
+        float tx = fx - x0;
+        gains[j] = nodes[x0] + tx * (nodes[x0 + 1] - nodes[x0]);
+    }
+}
+
+void LensShading::applyRow(float *pixels, int channels, int row, cv::Size frameSize) const
+{
+    if (grids.size() != 1 && static_cast<int>(grids.size()) != channels)
+    {
+        throw std::invalid_argument("Lens shading needs one grid or one grid per image channel");
+    }
+
+    thread_local std::vector<float> gains;
+    gains.resize(frameSize.width);
+    for (int c = 0; c < static_cast<int>(grids.size()); ++c)
+    {
+        if (grids[c].empty())
+        {
+            continue;
+        }
+        gainRow(c, row, frameSize, gains.data());
+
+        // A single grid scales every channel with the same gain row
+        int first = (grids.size() == 1) ? 0 : c;
+        int last = (grids.size() == 1) ? channels : c + 1;
+        for (int k = first; k < last; ++k)
+        {
+            for (int j = 0; j < frameSize.width; ++j)
+            {
+                pixels[j * channels + k] *= gains[j];
+            }
+        }
+    }
+}
+
+void LensShading::apply(cv::Mat &image) const
+{
+    if (empty())
+    {
+        return;
+    }
+    if (grids.size() != 1 && static_cast<int>(grids.size()) != image.channels())
+    {
+        throw std::invalid_argument("Lens shading needs one grid or one grid per image channel");
+    }
+
+    cv::parallel_for_(cv::Range(0, image.rows), [&](const cv::Range &range)
+    {
+        cv::Mat row(1, image.cols, CV_MAKETYPE(CV_32F, image.channels()));
+        for (int i = range.start; i < range.end; ++i)
+        {
+            image.row(i).convertTo(row, CV_32F);
+            applyRow(row.ptr<float>(), image.channels(), i, image.size());
+
+            cv::Mat out = image.row(i);
+            row.convertTo(out, image.type()); // Saturates to the image type
+        }
+    });
+}
+
+LensShading LensShading::fromVignetting(cv::Size frameSize, double cornerIllumination, int gridCols, int gridRows)
+{
+    if (cornerIllumination <= 0.0 || cornerIllumination > 1.0)
+    {
+        throw std::invalid_argument("Corner illumination must be in (0, 1]");
+    }
+    if (gridCols < 2 || gridRows < 2)
+    {
+        throw std::invalid_argument("Lens shading grid must have at least 2x2 nodes");
+    }
+
+    // cos^4 law: illumination = 1 / (1 + k r^2)^2, r = 1 at the corners
+    const double k = 1.0 / std::sqrt(cornerIllumination) - 1.0;
+    const double halfWidth = 0.5 * (frameSize.width - 1);
+    const double halfHeight = 0.5 * (frameSize.height - 1);
+    const double halfDiagonal2 = std::max(halfWidth * halfWidth + halfHeight * halfHeight, 1e-12);
+
+    cv::Mat grid(gridRows, gridCols, CV_32FC1);
+    for (int gy = 0; gy < gridRows; ++gy)
+    {
+        double dy = 2.0 * halfHeight * gy / (gridRows - 1) - halfHeight;
+        for (int gx = 0; gx < gridCols; ++gx)
+        {
+            double dx = 2.0 * halfWidth * gx / (gridCols - 1) - halfWidth;
+            double falloff = 1.0 + k * (dx * dx + dy * dy) / halfDiagonal2;
+            grid.at<float>(gy, gx) = static_cast<float>(falloff * falloff);
+        }
+    }
+    return LensShading(grid);
+}
+
+LensShading LensShading::fromFlatField(const cv::Mat &flat, double blackLevel, int gridCols, int gridRows)
+{
+    if (flat.empty())
+    {
+        throw std::invalid_argument("Flat-field frame must not be empty");
+    }
+
+    std::vector<cv::Mat> channels;
+    cv::split(flat, channels);
+    LensShading result(static_cast<int>(channels.size()));
+    for (size_t c = 0; c < channels.size(); ++c)
+    {
+        cv::Mat values;
+        channels[c].convertTo(values, CV_32F, 1.0, -blackLevel);
+        result.grids[c] = fitGrid(values, cv::Mat(), gridCols, gridRows);
+    }
+    return result;
+}
+
+LensShading LensShading::fromFlatField(const cv::Mat &raw, const CFAPattern &cfaPattern, double blackLevel, int gridCols, int gridRows)
+{
+    if (raw.empty() || raw.channels() != 1)
+    {
+        throw std::invalid_argument("Flat-field mosaic must be a single channel image");
+    }
+
+    cv::Mat values;
+    raw.convertTo(values, CV_32F, 1.0, -blackLevel);
+
+    LensShading result(CFAPattern::NUM_COLORS);
+    cv::Mat weights(raw.size(), CV_32FC1);
+    for (CFAPattern::Color color : cfaPattern.getColors())
+    {
+        // Weight 1 on the pixels behind this filter, 0 elsewhere
+        std::vector<double> selection(CFAPattern::NUM_COLORS, 0.0);
+        selection[color] = 1.0;
+        const cv::Mat tileRows = cfaPattern.expandColorValues(selection, raw.cols);
+        for (int i = 0; i < raw.rows; ++i)
+        {
+            tileRows.row(i % tileRows.rows).copyTo(weights.row(i));
+        }
+        result.grids[color] = fitGrid(values, weights, gridCols, gridRows);
+    }
+    return result;
+}
+
+cv::Mat LensShading::fitGrid(const cv::Mat &values, const cv::Mat &weights, int gridCols, int gridRows)
+{
+    if (gridCols < 2 || gridRows < 2)
+    {
+        throw std::invalid_argument("Lens shading grid must have at least 2x2 nodes");
+    }
+
+    // Box sums over any cell from integral images of the weighted values and of the weights
+    cv::Mat weighted, valueSums, weightSums;
+    if (weights.empty())
+    {
+        weighted = values;
+    }
+    else
+    {
+        cv::multiply(values, weights, weighted);
+        cv::integral(weights, weightSums, CV_64F);
+    }
+    cv::integral(weighted, valueSums, CV_64F);
+
+    const double cellWidth = static_cast<double>(values.cols - 1) / (gridCols - 1);
+    const double cellHeight = static_cast<double>(values.rows - 1) / (gridRows - 1);
+    cv::Mat means(gridRows, gridCols, CV_64FC1);
+    double brightest = 0.0;
+    for (int gy = 0; gy < gridRows; ++gy)
+    {
+        int y0 = std::max(static_cast<int>(std::lround((gy - 0.5) * cellHeight)), 0);
+        int y1 = std::min(static_cast<int>(std::lround((gy + 0.5) * cellHeight)) + 1, values.rows);
+        for (int gx = 0; gx < gridCols; ++gx)
+        {
+            int x0 = std::max(static_cast<int>(std::lround((gx - 0.5) * cellWidth)), 0);
+            int x1 = std::min(static_cast<int>(std::lround((gx + 0.5) * cellWidth)) + 1, values.cols);
+
+            double sum = valueSums.at<double>(y1, x1) - valueSums.at<double>(y0, x1) - valueSums.at<double>(y1, x0) + valueSums.at<double>(y0, x0);
+            double count = weights.empty() ? static_cast<double>((y1 - y0) * (x1 - x0))
+                                           : weightSums.at<double>(y1, x1) - weightSums.at<double>(y0, x1) - weightSums.at<double>(y1, x0) + weightSums.at<double>(y0, x0);
+            double mean = sum / std::max(count, 1.0);
+            means.at<double>(gy, gx) = mean;
+            brightest = std::max(brightest, mean);
+        }
+    }
+
+    cv::Mat grid(gridRows, gridCols, CV_32FC1);
+    for (int gy = 0; gy < gridRows; ++gy)
+    {
+        for (int gx = 0; gx < gridCols; ++gx)
+        {
+            double mean = means.at<double>(gy, gx);
+            grid.at<float>(gy, gx) = (mean > 1e-9) ? static_cast<float>(brightest / mean) : 1.0f;
+        }
+    }
+    return grid;
+}
@@ -0,0 +1,263 @@
+#include "NoiseGenerator/NoiseGenerator.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+namespace
+{
+    // Philox4x32-10 constants (Salmon et al., "Parallel random numbers: as easy as 1, 2, 3")
+    constexpr uint32_t PHILOX_M0 = 0xD2511F53u;
+    constexpr uint32_t PHILOX_M1 = 0xCD9E8D57u;
+    constexpr uint32_t PHILOX_W0 = 0x9E3779B9u;
+    constexpr uint32_t PHILOX_W1 = 0xBB67AE85u;
+    constexpr int PHILOX_ROUNDS = 10;
+
+    // Philox blocks generated together; each block yields four samples
+    constexpr int BATCH_BLOCKS = 8;
+    constexpr int BATCH_SAMPLES = 4 * BATCH_BLOCKS;
+
+    constexpr float HALF_PI = 1.57079632679f;
+    constexpr float SQRT2 = 1.41421356237f;
+    constexpr float LN2 = 0.69314718056f;
+
+    // Maps 24 random bits to the open interval (0, 1) so the logarithm is always finite
+    inline float toUniform(uint32_t x)
+    {
+        return (static_cast<float>(x >> 8) + 0.5f) * (1.0f / 16777216.0f);
+    }
+
+    // Natural logarithm for x in (0, 1], branch-free so it vectorizes
+    inline float fastLog(float x)
+    {
+        uint32_t bits;
+        std::memcpy(&bits, &x, sizeof(bits));
+        float exponent = static_cast<float>(static_cast<int>((bits >> 23) & 0xFF) - 127);
+        uint32_t mantissaBits = (bits & 0x007FFFFFu) | 0x3F800000u;
+        float m;
+        std::memcpy(&m, &mantissaBits, sizeof(m));
+
+        // Move the mantissa into [sqrt(0.5), sqrt(2)) so the series converges quickly
+        float high = (m > SQRT2) ? 1.0f : 0.0f;
+        m *= 1.0f - 0.5f * high;
+        exponent += high;
+
+        // log(m) = 2 atanh((m - 1) / (m + 1))
+        float s = (m - 1.0f) / (m + 1.0f);
+        float s2 = s * s;
+        float series = 2.0f + s2 * (2.0f / 3.0f + s2 * (2.0f / 5.0f + s2 * (2.0f / 7.0f + s2 * (2.0f / 9.0f))));
+        return s * series + exponent * LN2;
+    }
+
+    // Sine and cosine for x in [-pi/2, pi/2] (Taylor series, error below 1e-7)
+    inline float fastSin(float x)
+    {
+        float x2 = x * x;
+        return x * (1.0f + x2 * (-1.0f / 6.0f + x2 * (1.0f / 120.0f + x2 * (-1.0f / 5040.0f + x2 * (1.0f / 362880.0f + x2 * (-1.0f / 39916800.0f))))));
+    }
+
+    inline float fastCos(float x)
+    {
+        float x2 = x * x;
+        return 1.0f + x2 * (-0.5f + x2 * (1.0f / 24.0f + x2 * (-1.0f / 720.0f + x2 * (1.0f / 40320.0f + x2 * (-1.0f / 3628800.0f + x2 * (1.0f / 479001600.0f))))));
+    }
+
+    // Runs Philox4x32-10 on BATCH_BLOCKS consecutive column blocks (structure of arrays)
+    void philoxBatch(const uint32_t key[2], uint32_t firstBlock, uint32_t row, uint64_t stream, uint32_t out[4][BATCH_BLOCKS])
+    {
+        uint32_t c0[BATCH_BLOCKS], c1[BATCH_BLOCKS], c2[BATCH_BLOCKS], c3[BATCH_BLOCKS];
+        for (int i = 0; i < BATCH_BLOCKS; ++i)
+        {
+            c0[i] = firstBlock + static_cast<uint32_t>(i);
+            c1[i] = row;
+            c2[i] = static_cast<uint32_t>(stream);
+            c3[i] = static_cast<uint32_t>(stream >> 32);
+        }
+
+        uint32_t k0 = key[0];
+        uint32_t k1 = key[1];
+        for (int r = 0; r < PHILOX_ROUNDS; ++r)
+        {
+            for (int i = 0; i < BATCH_BLOCKS; ++i)
+            {
+                uint64_t p0 = static_cast<uint64_t>(PHILOX_M0) * c0[i];
+                uint64_t p1 = static_cast<uint64_t>(PHILOX_M1) * c2[i];
+                uint32_t n0 = static_cast<uint32_t>(p1 >> 32) ^ c1[i] ^ k0;
+                uint32_t n1 = static_cast<uint32_t>(p1);
+                uint32_t n2 = static_cast<uint32_t>(p0 >> 32) ^ c3[i] ^ k1;
+                uint32_t n3 = static_cast<uint32_t>(p0);
+                c0[i] = n0;
+                c1[i] = n1;
+                c2[i] = n2;
+                c3[i] = n3;
+            }
+            k0 += PHILOX_W0;
+            k1 += PHILOX_W1;
+        }
+
+        std::memcpy(out[0], c0, sizeof(c0));
+        std::memcpy(out[1], c1, sizeof(c1));
+        std::memcpy(out[2], c2, sizeof(c2));
+        std::memcpy(out[3], c3, sizeof(c3));
+    }
+
+    // Box-Muller transform of one Philox batch into BATCH_SAMPLES normal samples
+    void gaussianBatch(const uint32_t key[2], uint32_t firstBlock, uint32_t row, uint64_t stream, float *samples)
+    {
+        uint32_t words[4][BATCH_BLOCKS];
+        philoxBatch(key, firstBlock, row, stream, words);
+
+        for (int pair = 0; pair < 2; ++pair)
+        {
+            for (int i = 0; i < BATCH_BLOCKS; ++i)
+            {
+                float radius = std::sqrt(-2.0f * fastLog(toUniform(words[2 * pair][i])));
+
+                // Half angle in [-pi/2, pi/2) so the short series are accurate
+                float halfAngle = HALF_PI * (2.0f * toUniform(words[2 * pair + 1][i]) - 1.0f);
+                float s = fastSin(halfAngle);
+                float c = fastCos(halfAngle);
+
+                samples[4 * i + 2 * pair] = radius * (1.0f - 2.0f * s * s);
+                samples[4 * i + 2 * pair + 1] = radius * (2.0f * s * c);
+            }
+        }
+    }
+
+    // Converts one Philox batch into BATCH_SAMPLES uniform samples
+    void uniformBatch(const uint32_t key[2], uint32_t firstBlock, uint32_t row, uint64_t stream, float *samples)
+    {
+        uint32_t words[4][BATCH_BLOCKS];
+        philoxBatch(key, firstBlock, row, stream, words);
+
+        for (int i = 0; i < BATCH_BLOCKS; ++i)
+        {
+            for (int k = 0; k < 4; ++k)
+            {
+                samples[4 * i + k] = toUniform(words[k][i]);
+            }
+        }
+    }
+
+    template <typename T>
+    void addGaussianRows(const NoiseGenerator &generator, cv::Mat &data, float sigma, uint64_t stream, int rowOffset, int colOffset)
+    {
+        cv::parallel_for_(cv::Range(0, data.rows), [&](const cv::Range &range)
+        {
+            std::vector<float> noise(data.cols);
+            for (int i = range.start; i < range.end; ++i)
+            {
+                generator.gaussianRow(stream, rowOffset + i, colOffset, data.cols, noise.data());
+                T *row = data.ptr<T>(i);
+                for (int j = 0; j < data.cols; ++j)
+                {
+                    row[j] = cv::saturate_cast<T>(row[j] + sigma * noise[j]);
+                }
+            }
+        });
+    }
+}
+
+NoiseGenerator::NoiseGenerator(uint64_t seed)
+{
+    setSeed(seed);
+}
+
+void NoiseGenerator::setSeed(uint64_t seed)
+{
+    key[0] = static_cast<uint32_t>(seed);
+    key[1] = static_cast<uint32_t>(seed >> 32);
+}
+
+uint64_t NoiseGenerator::getSeed() const
+{
+    return (static_cast<uint64_t>(key[1]) << 32) | key[0];
+}
+
+void NoiseGenerator::gaussianRow(uint64_t stream, int row, int colStart, int count, float *output) const
+{
+    float batch[BATCH_SAMPLES];
+    uint32_t block = static_cast<uint32_t>(colStart) >> 2;
+    int skip = colStart & 3; // Samples of the first block that lie left of colStart
+
+    int written = 0;
+    while (written < count)
+    {
+        gaussianBatch(key, block, static_cast<uint32_t>(row), stream, batch);
+        int n = std::min(BATCH_SAMPLES - skip, count - written);
+        std::memcpy(output + written, batch + skip, n * sizeof(float));
+        written += n;
+        skip = 0;
+        block += BATCH_BLOCKS;
+    }
+}
+
+void NoiseGenerator::uniformRow(uint64_t stream, int row, int colStart, int count, float *output) const
+{
+    float batch[BATCH_SAMPLES];
+    uint32_t block = static_cast<uint32_t>(colStart) >> 2;
+    int skip = colStart & 3; // Samples of the first block that lie left of colStart
+
+    int written = 0;
+    while (written < count)
+    {
+        uniformBatch(key, block, static_cast<uint32_t>(row), stream, batch);
+        int n = std::min(BATCH_SAMPLES - skip, count - written);
+        std::memcpy(output + written, batch + skip, n * sizeof(float));
+        written += n;
+        skip = 0;
+        block += BATCH_BLOCKS;
+    }
+}
+
+void NoiseGenerator::fillGaussian(cv::Mat &output, uint64_t stream, int rowOffset, int colOffset) const
+{
+    if (output.channels() != 1 || (output.depth() != CV_32F && output.depth() != CV_64F))
+    {
+        throw std::invalid_argument("Gaussian fill requires a single channel float matrix");
+    }
+
+    cv::parallel_for_(cv::Range(0, output.rows), [&](const cv::Range &range)
+    {
+        std::vector<float> noise(output.cols);
+        for (int i = range.start; i < range.end; ++i)
+        {
+            if (output.depth() == CV_32F)
+            {
+                gaussianRow(stream, rowOffset + i, colOffset, output.cols, output.ptr<float>(i));
+            }
+            else
+            {
+                gaussianRow(stream, rowOffset + i, colOffset, output.cols, noise.data());
+                std::copy(noise.begin(), noise.end(), output.ptr<double>(i));
+            }
+        }
+    });
+}
+
+void NoiseGenerator::addGaussian(cv::Mat &data, double sigma, uint64_t stream, int rowOffset, int colOffset) const
+{
+    if (data.channels() != 1)
+    {
+        throw std::invalid_argument("Noise can only be added to single channel data");
+    }
+
+    float s = static_cast<float>(sigma);
+    switch (data.depth())
+    {
+    case CV_8U:
+        addGaussianRows<uchar>(*this, data, s, stream, rowOffset, colOffset);
+        break;
+    case CV_16U:
+        addGaussianRows<ushort>(*this, data, s, stream, rowOffset, colOffset);
+        break;
+    case CV_32F:
+        addGaussianRows<float>(*this, data, s, stream, rowOffset, colOffset);
+        break;
+    case CV_64F:
+        addGaussianRows<double>(*this, data, s, stream, rowOffset, colOffset);
+        break;
+    default:
+        throw std::invalid_argument("Unsupported data type for noise");
+    }
+}
@@ -0,0 +1,232 @@
+#include "NoiseModel/NoiseModel.h"
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+namespace
+{
+    // Partition of the generator's stream space, shared with plain Gaussian noise of the same
+    // seed: Gaussian noise uses caller streams (frame indices) below 2^62, the model's
+    // temporal substreams set bit 62 (MODEL_STREAM_BIT | 4 * stream + k), and the
+    // fixed-pattern maps take the two top streams, which have bit 63 set
+    constexpr uint64_t PRNU_STREAM = std::numeric_limits<uint64_t>::max();
+    constexpr uint64_t DSNU_STREAM = std::numeric_limits<uint64_t>::max() - 1;
+    constexpr uint64_t MODEL_STREAM_BIT = uint64_t(1) << 62;
+    constexpr uint64_t SHOT_SUBSTREAM = 0;
+    constexpr uint64_t READ_SUBSTREAM = 1;
+    constexpr uint64_t POISSON_SUBSTREAM = 2;
+
+    // Generator stream of one temporal substream of the model
+    uint64_t temporalStream(uint64_t stream, uint64_t substream)
+    {
+        return MODEL_STREAM_BIT | ((4 * stream + substream) & (MODEL_STREAM_BIT - 1));
+    }
+
+    constexpr int POISSON_MAX_ITERATIONS = 256;
+
+    // Exact Poisson sample by CDF inversion, used for small means only
+    float samplePoisson(float mean, float u)
+    {
+        double p = std::exp(-static_cast<double>(mean));
+        double cdf = p;
+        int k = 0;
+        while (u > cdf && k < POISSON_MAX_ITERATIONS)
+        {
+            ++k;
+            p *= mean / k;
+            cdf += p;
+        }
+        return static_cast<float>(k);
+    }
+
+    template <typename T>
+    void applyRows(cv::Mat &data, const std::function<void(float *, int, int, float *)> &rowKernel)
+    {
+        cv::parallel_for_(cv::Range(0, data.rows), [&](const cv::Range &range)
+        {
+            std::vector<float> values(data.cols);
+            std::vector<float> scratch(5 * static_cast<size_t>(data.cols));
+            for (int i = range.start; i < range.end; ++i)
+            {
+                T *row = data.ptr<T>(i);
+                std::copy(row, row + data.cols, values.begin());
+                rowKernel(values.data(), data.cols, i, scratch.data());
+                for (int j = 0; j < data.cols; ++j)
+                {
+                    row[j] = cv::saturate_cast<T>(values[j]);
+                }
+            }
+        });
+    }
+}
+
+NoiseModel::NoiseModel(const Parameters &params, int width, int height, int bitDepth, uint64_t seed, bool cacheFixedPattern)
+    : params(params), bitDepth(bitDepth), width(width), height(height), generator(seed)
+{
+    if (params.fullWellCapacity <= 0.0)
+    {
+        throw std::invalid_argument("Full well capacity must be positive");
+    }
+
+    if (!cacheFixedPattern)
+    {
+        return; // Regenerated row by row in applyRow
+    }
+
+    // Fixed-pattern maps are generated once per sensor instance
+    prnuMap.create(height, width, CV_32FC1);
+    dsnuMap.create(height, width, CV_32FC1);
+    generator.fillGaussian(prnuMap, PRNU_STREAM);
+    prnuMap.convertTo(prnuMap, CV_32FC1, params.prnu, 1.0);
+    generator.fillGaussian(dsnuMap, DSNU_STREAM);
+    dsnuMap.convertTo(dsnuMap, CV_32FC1, params.dsnu);
+}
+
+void NoiseModel::apply(cv::Mat &data, double fullScale, uint64_t stream, int rowOffset, int colOffset) const
+{
+    if (data.channels() != 1)
+    {
+        throw std::invalid_argument("Noise model can only be applied to single channel data");
+    }
+    if (rowOffset < 0 || colOffset < 0 || rowOffset + data.rows > height || colOffset + data.cols > width)
+    {
+        throw std::invalid_argument("Data does not fit the noise model dimensions");
+    }
+
+    auto rowKernel = [&](float *values, int count, int row, float *scratch)
+    {
+        applyRow(values, count, rowOffset + row, colOffset, fullScale, stream, scratch);
+    };
+
+    switch (data.depth())
+    {
+    case CV_8U:
+        applyRows<uchar>(data, rowKernel);
+        break;
+    case CV_16U:
+        applyRows<ushort>(data, rowKernel);
+        break;
+    case CV_32F:
+        applyRows<float>(data, rowKernel);
+        break;
+    case CV_64F:
+        applyRows<double>(data, rowKernel);
+        break;
+    default:
+        throw std::invalid_argument("Unsupported data type for noise model");
+    }
+}
+
+void NoiseModel::applyRow(float *values, int count, int row, int colStart, double fullScale, uint64_t stream, float *scratch) const
+{
+    float *mean = scratch;
+    float *shot = scratch + count;
+    float *read = scratch + 2 * count;
+    const float *gain;
+    const float *offset;
+    if (!prnuMap.empty())
+    {
+        gain = prnuMap.ptr<float>(row) + colStart;
+        offset = dsnuMap.ptr<float>(row) + colStart;
+    }
+    else
+    {
+        // Same counter-based samples as the cached maps, for this run of pixels only
+        float *prnu = scratch + 3 * count;
+        float *dsnu = scratch + 4 * count;
+        generator.gaussianRow(PRNU_STREAM, row, colStart, count, prnu);
+        generator.gaussianRow(DSNU_STREAM, row, colStart, count, dsnu);
+        const float prnuScale = static_cast<float>(params.prnu);
+        const float dsnuScale = static_cast<float>(params.dsnu);
+        for (int j = 0; j < count; ++j)
+        {
+            prnu[j] = prnu[j] * prnuScale + 1.0f;
+            dsnu[j] *= dsnuScale;
+        }
+        gain = prnu;
+        offset = dsnu;
+    }
+
+    // Integer sensors quantize to their ADC codes; float sensors keep a continuous readout
+    const bool quantize = bitDepth <= 16;
+    const double adcMax = quantize ? std::ldexp(1.0, bitDepth) - 1.0 : 65535.0;
+    const float toElectrons = static_cast<float>(params.fullWellCapacity / fullScale);
+    const float toCodes = static_cast<float>(adcMax / params.fullWellCapacity);
+    const float toData = static_cast<float>(fullScale / adcMax);
+    const float dark = static_cast<float>(getDarkElectrons());
+    const float readNoise = static_cast<float>(params.readNoise);
+    const float blackLevel = static_cast<float>(params.blackLevel);
+    const float maxCode = static_cast<float>(adcMax);
+
+    generator.gaussianRow(temporalStream(stream, SHOT_SUBSTREAM), row, colStart, count, shot);
+    generator.gaussianRow(temporalStream(stream, READ_SUBSTREAM), row, colStart, count, read);
+
+    // Expected electrons (PRNU gain and DSNU offset folded into one multiply-add), then
+    // shot noise with the Gaussian approximation of the Poisson distribution
+    bool hasSmallMeans = false;
+    for (int j = 0; j < count; ++j)
+    {
+        float m = std::max(values[j] * toElectrons * gain[j] + offset[j] + dark, 0.0f);
+        mean[j] = m;
+        values[j] = m + std::sqrt(m) * shot[j];
+        hasSmallMeans |= m < POISSON_GAUSSIAN_THRESHOLD;
+    }
+
+    // The Gaussian approximation is poor for small means; sample those exactly
+    if (hasSmallMeans)
+    {
+        generator.uniformRow(temporalStream(stream, POISSON_SUBSTREAM), row, colStart, count, shot);
+        for (int j = 0; j < count; ++j)
+        {
+            if (mean[j] < POISSON_GAUSSIAN_THRESHOLD)
+            {
+                values[j] = samplePoisson(mean[j], shot[j]);
+            }
+        }
+    }
+
+    // Read noise and ADC conversion
+    for (int j = 0; j < count; ++j)
+    {
+        float code = (values[j] + readNoise * read[j]) * toCodes + blackLevel;
+        if (quantize)
+        {
+            code = std::min(std::max(std::floor(code + 0.5f), 0.0f), maxCode);
+        }
+        values[j] = code * toData;
+    }
+}
+
+void NoiseModel::setExposureTime(double seconds)
+{
+    params.exposureTime = seconds;
+}
+
+void NoiseModel::setTemperature(double celsius)
+{
+    params.temperature = celsius;
+}
+
+const NoiseModel::Parameters &NoiseModel::getParameters() const
+{
+    return params;
+}
+
+double NoiseModel::getDarkElectrons() const
+{
+    double doublings = (params.temperature - params.darkCurrentReferenceTemperature) / params.darkCurrentDoublingTemperature;
+    return params.darkCurrent * std::pow(2.0, doublings) * params.exposureTime;
+}
+
+const cv::Mat &NoiseModel::getPRNUMap() const
+{
+    return prnuMap;
+}
+
+const cv::Mat &NoiseModel::getDSNUMap() const
+{
+    return dsnuMap;
+}
@@ -0,0 +1,265 @@
+#include "PSFConvolver/PSFConvolver.h"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace
+{
+    // Bessel function of the first kind of order 1 (rational approximations, absolute error below 1e-8);
+    // std::cyl_bessel_j is missing from libc++
+    double besselJ1(double x)
+    {
+        const double ax = std::abs(x);
+        if (ax < 8.0)
+        {
+            const double y = x * x;
+            const double numerator = x * (72362614232.0 + y * (-7895059235.0 + y * (242396853.1 + y * (-2972611.439 + y * (15704.48260 + y * -30.16036606)))));
+            const double denominator = 144725228442.0 + y * (2300535178.0 + y * (18583304.74 + y * (99447.43394 + y * (376.9991397 + y))));
+            return numerator / denominator;
+        }
+
+        // Asymptotic form with polynomial corrections in 8 / x
+        const double z = 8.0 / ax;
+        const double y = z * z;
+        const double shifted = ax - 2.356194491;
+        const double p = 1.0 + y * (0.183105e-2 + y * (-0.3516396496e-4 + y * (0.2457520174e-5 + y * -0.240337019e-6)));
+        const double q = 0.04687499995 + y * (-0.2002690873e-3 + y * (0.8449199096e-5 + y * (-0.88228987e-6 + y * 0.105787412e-6)));
+        const double value = std::sqrt(0.636619772 / ax) * (std::cos(shifted) * p - z * std::sin(shifted) * q);
+        return (x < 0.0) ? -value : value;
+    }
+
+    // FFT buffers of one thread, reused from frame to frame
+    struct FFTWorkspace
+    {
+        cv::Mat input;
+        cv::Mat canvas;
+        cv::Mat spectrum;
+        cv::Mat product;
+        cv::Mat result;
+    };
+
+    thread_local FFTWorkspace fftWorkspace;
+}
+
+void PSFConvolver::setPSF(const cv::Mat &psf, Method method)
+{
+    if (psf.empty())
+    {
+        throw std::invalid_argument("PSF must not be empty");
+    }
+
+    cv::Mat kernel;
+    psf.convertTo(kernel, CV_32F);
+
+    // Same kernel as before: keep the cached spectrum
+    bool unchanged = !this->psf.empty() && kernel.size() == this->psf.size() &&
+                     cv::norm(kernel, this->psf, cv::NORM_INF) == 0.0 && (method == AUTO || method == this->method);
+    if (unchanged)
+    {
+        return;
+    }
+
+    this->psf = kernel;
+    fftPlans = std::make_shared<PlanCache>(); // Copies keep the plans of their own PSF
+
+    bool separable = decomposeSeparable(kernel, rowKernel, colKernel);
+    if (method == AUTO)
+    {
+        if (separable)
+        {
+            method = SEPARABLE;
+        }
+        else if (std::max(kernel.rows, kernel.cols) >= FFT_KERNEL_SIZE)
+        {
+            method = FFT;
+        }
+        else
+        {
+            method = DIRECT;
+        }
+    }
+    else if (method == SEPARABLE && !separable)
+    {
+        throw std::invalid_argument("PSF is not separable");
+    }
+    this->method = method;
+}
+
+void PSFConvolver::setSeparablePSF(const cv::Mat &rowKernel, const cv::Mat &colKernel)
+{
+    if (rowKernel.empty() || colKernel.empty())
+    {
+        throw std::invalid_argument("Separable PSF factors must not be empty");
+    }
+
+    rowKernel.reshape(1, 1).convertTo(this->rowKernel, CV_32F);
+    colKernel.reshape(1, static_cast<int>(colKernel.total())).convertTo(this->colKernel, CV_32F);
+    psf = this->colKernel * this->rowKernel; // Outer product, kept for the kernel size
+    fftPlans = std::make_shared<PlanCache>();
+    method = SEPARABLE;
+}
+
+PSFConvolver::Method PSFConvolver::getMethod() const
+{
+    return method;
+}
+
+cv::Size PSFConvolver::getKernelSize() const
+{
+    return psf.size();
+}
+
+const cv::Mat &PSFConvolver::getPSF() const
+{
+    return psf;
+}
+
+void PSFConvolver::apply(const cv::Mat &src, cv::Mat &dst, int ddepth) const
+{
+    if (psf.empty())
+    {
+        throw std::logic_error("No PSF has been set");
+    }
+    if (ddepth != CV_32F && ddepth != CV_64F)
+    {
+        throw std::invalid_argument("Convolution output must be CV_32F or CV_64F");
+    }
+
+    switch (method)
+    {
+    case SEPARABLE:
+        cv::sepFilter2D(src, dst, ddepth, rowKernel, colKernel, cv::Point(-1, -1), 0, cv::BORDER_REFLECT_101);
+        break;
+    case FFT:
+    {
+        // The transforms run at the output depth
+        const cv::Mat *input = &src;
+        if (src.depth() != ddepth)
+        {
+            src.convertTo(fftWorkspace.input, ddepth);
+            input = &fftWorkspace.input;
+        }
+        applyFFT(*input, dst);
+        break;
+    }
+    default:
+        cv::filter2D(src, dst, ddepth, psf, cv::Point(-1, -1), 0, cv::BORDER_REFLECT_101);
+        break;
+    }
+}
+
+bool PSFConvolver::decomposeSeparable(const cv::Mat &psf, cv::Mat &rowKernel, cv::Mat &colKernel, double tolerance)
+{
+    cv::Mat kernel;
+    psf.convertTo(kernel, CV_64F);
+
+    // A rank-1 kernel has a single non-zero singular value: psf = s0 * u0 * v0^T
+    cv::SVD svd(kernel);
+    double s0 = svd.w.at<double>(0);
+    if (s0 <= 0.0 || (svd.w.rows > 1 && svd.w.at<double>(1) > tolerance * s0))
+    {
+        return false;
+    }
+
+    cv::Mat col = svd.u.col(0) * std::sqrt(s0);
+    cv::Mat row = svd.vt.row(0) * std::sqrt(s0);
+    if (cv::sum(row)[0] < 0.0)
+    {
+        // Keep both factors positive for the usual non-negative PSFs
+        row = -row;
+        col = -col;
+    }
+    row.convertTo(rowKernel, CV_32F);
+    col.convertTo(colKernel, CV_32F);
+    return true;
+}
+
+cv::Mat PSFConvolver::airyPSF(double wavelength, double fNumber, double pixelPitch, int size)
+{
+    if (size <= 0 || size % 2 == 0)
+    {
+        throw std::invalid_argument("Airy PSF size must be odd and positive");
+    }
+    if (wavelength <= 0.0 || fNumber <= 0.0 || pixelPitch <= 0.0)
+    {
+        throw std::invalid_argument("Airy PSF parameters must be positive");
+    }
+
+    // Intensity (2 J1(x) / x)^2 with x = pi r / (wavelength N), integrated over each pixel
+    constexpr int SUBSAMPLES = 4;
+    const double scale = CV_PI * pixelPitch / (wavelength * fNumber);
+    const int center = size / 2;
+    cv::Mat kernel(size, size, CV_64FC1);
+    for (int i = 0; i < size; ++i)
+    {
+        for (int j = 0; j < size; ++j)
+        {
+            double sum = 0.0;
+            for (int si = 0; si < SUBSAMPLES; ++si)
+            {
+                for (int sj = 0; sj < SUBSAMPLES; ++sj)
+                {
+                    double dy = i - center + (si + 0.5) / SUBSAMPLES - 0.5;
+                    double dx = j - center + (sj + 0.5) / SUBSAMPLES - 0.5;
+                    double x = std::hypot(dx, dy) * scale;
+                    double amplitude = (x < 1e-9) ? 1.0 : 2.0 * besselJ1(x) / x;
+                    sum += amplitude * amplitude;
+                }
+            }
+            kernel.at<double>(i, j) = sum;
+        }
+    }
+    kernel /= cv::sum(kernel)[0];
+    return kernel;
+}
+
+PSFConvolver::FFTPlan PSFConvolver::prepareFFT(const cv::Size &frameSize, int depth) const
+{
+    std::lock_guard<std::mutex> lock(fftPlans->mutex);
+    std::vector<FFTPlan> &plans = fftPlans->plans;
+    for (const FFTPlan &plan : plans)
+    {
+        if (plan.frameSize == frameSize && plan.depth == depth)
+        {
+            return plan;
+        }
+    }
+
+    // Canvas large enough that the circular correlation never wraps into the frame
+    FFTPlan plan;
+    plan.frameSize = frameSize;
+    plan.depth = depth;
+    plan.canvasSize = cv::Size(cv::getOptimalDFTSize(frameSize.width + psf.cols - 1),
+                               cv::getOptimalDFTSize(frameSize.height + psf.rows - 1));
+
+    cv::Mat canvas = cv::Mat::zeros(plan.canvasSize, CV_MAKETYPE(depth, 1));
+    cv::Mat kernelArea = canvas(cv::Rect(0, 0, psf.cols, psf.rows));
+    psf.convertTo(kernelArea, depth);
+    cv::dft(canvas, plan.spectrum, 0, psf.rows);
+
+    if (plans.size() >= MAX_FFT_PLANS)
+    {
+        plans.erase(plans.begin());
+    }
+    plans.push_back(plan);
+    return plan;
+}
+
+void PSFConvolver::applyFFT(const cv::Mat &src, cv::Mat &dst) const
+{
+    const FFTPlan plan = prepareFFT(src.size(), src.depth());
+    FFTWorkspace &workspace = fftWorkspace;
+
+    // Reflect-101 halo like filter2D, zero padding up to the optimal DFT size
+    int top = psf.rows / 2;
+    int left = psf.cols / 2;
+    workspace.canvas.create(plan.canvasSize, src.type());
+    workspace.canvas.setTo(0);
+    cv::Mat padded = workspace.canvas(cv::Rect(0, 0, src.cols + psf.cols - 1, src.rows + psf.rows - 1));
+    cv::copyMakeBorder(src, padded, top, psf.rows - 1 - top, left, psf.cols - 1 - left, cv::BORDER_REFLECT_101);
+
+    cv::dft(workspace.canvas, workspace.spectrum, 0, padded.rows);
+    cv::mulSpectrums(workspace.spectrum, plan.spectrum, workspace.product, 0, true); // Conjugate: correlation, like filter2D
+    cv::dft(workspace.product, workspace.result, cv::DFT_INVERSE | cv::DFT_SCALE | cv::DFT_REAL_OUTPUT, src.rows);
+    workspace.result(cv::Rect(0, 0, src.cols, src.rows)).copyTo(dst);
+}
@@ -0,0 +1,479 @@
+#include "RawFile/RawFile.h"
+#include "Telemetry/Telemetry.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    // Byte offsets of the header fields
+    constexpr size_t OFFSET_MAGIC = 0;
+    constexpr size_t OFFSET_VERSION = 4;
+    constexpr size_t OFFSET_HEADER_BYTES = 8;
+    constexpr size_t OFFSET_WIDTH = 12;
+    constexpr size_t OFFSET_HEIGHT = 16;
+    constexpr size_t OFFSET_BIT_DEPTH = 20;
+    constexpr size_t OFFSET_PACKED_BITS = 24;
+    constexpr size_t OFFSET_FLAGS = 28;
+    constexpr size_t OFFSET_SEED = 32;
+    constexpr size_t OFFSET_FRAME_COUNT = 40;
+    constexpr size_t OFFSET_FRAME_STRIDE = 48;
+    constexpr size_t OFFSET_BLACK_LEVEL = 56;
+    constexpr size_t OFFSET_NOISE_LEVEL = 64;
+    constexpr size_t OFFSET_NOISE_PARAMETERS = 72; // 10 doubles
+    constexpr size_t OFFSET_CFA_PATTERN = 152;     // Null-terminated string
+    constexpr uint32_t FLAG_PHYSICAL_NOISE = 1u;
+
+    // Fields are copied as host values; the format is little-endian, like every supported host
+    template <typename T>
+    void put(uint8_t *bytes, size_t offset, T value)
+    {
+        std::memcpy(bytes + offset, &value, sizeof(T));
+    }
+
+    template <typename T>
+    T get(const uint8_t *bytes, size_t offset)
+    {
+        T value;
+        std::memcpy(&value, bytes + offset, sizeof(T));
+        return value;
+    }
+
+    // Noise model parameters in their on-disk order
+    double *noiseFields(NoiseModel::Parameters &noise, int index)
+    {
+        double *fields[] = {&noise.fullWellCapacity, &noise.readNoise, &noise.darkCurrent, &noise.darkCurrentReferenceTemperature,
+                            &noise.darkCurrentDoublingTemperature, &noise.temperature, &noise.exposureTime, &noise.prnu,
+                            &noise.dsnu, &noise.blackLevel};
+        return fields[index];
+    }
+    constexpr int NUM_NOISE_FIELDS = 10;
+}
+
+RawFile::Writer::Writer(const std::string &path, const Header &header, size_t bufferBytes)
+    : buffer(bufferBytes), header(header)
+{
+    validate(header);
+    this->header.frameCount = 0;
+
+    // The buffer must be installed before the file is opened
+    stream.rdbuf()->pubsetbuf(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+    stream.open(path, std::ios::binary | std::ios::trunc);
+    if (!stream)
+    {
+        throw std::runtime_error("Cannot create raw file: " + path);
+    }
+
+    std::vector<uint8_t> bytes(HEADER_BYTES, 0);
+    encodeHeader(this->header, bytes.data());
+    stream.write(reinterpret_cast<const char *>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+}
+
+RawFile::Writer::~Writer()
+{
+    try
+    {
+        close();
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "Failed to close raw file: " << e.what() << std::endl;
+    }
+}
+
+void RawFile::Writer::writeFrame(const cv::Mat &frame)
+{
+    TELEMETRY_SCOPE("RawFile::writeFrame");
+    if (frame.channels() != 1 || frame.cols != header.width || frame.rows != header.height)
+    {
+        throw std::invalid_argument("Frame does not match the raw file header");
+    }
+    if (rowsWritten != 0)
+    {
+        throw std::logic_error("A frame is partially written");
+    }
+    writeRows(frame);
+}
+
+void RawFile::Writer::writeRows(const cv::Mat &rows)
+{
+    TELEMETRY_SCOPE("RawFile::writeRows");
+    if (!stream.is_open())
+    {
+        throw std::logic_error("Raw file is closed");
+    }
+    if (rows.channels() != 1 || rows.cols != header.width || rowsWritten + rows.rows > header.height)
+    {
+        throw std::invalid_argument("Rows do not match the raw file header");
+    }
+
+    // Rows are packed in parallel into the band buffer, then written with one sequential write
+    const int storedType = cvTypeForPackedBits(header.packedBits);
+    const size_t stride = rowBytes(header.width, header.packedBits);
+    const int bits = header.packedBits;
+    packed.resize(stride * rows.rows);
+    cv::parallel_for_(cv::Range(0, rows.rows), [&](const cv::Range &range)
+    {
+        cv::Mat row(1, rows.cols, storedType);
+        for (int i = range.start; i < range.end; ++i)
+        {
+            rows.row(i).convertTo(row, storedType); // Saturating
+            uint8_t *dst = packed.data() + i * stride;
+            if (bits == 8 || bits == 16 || bits == 32)
+            {
+                std::memcpy(dst, row.ptr(), stride);
+            }
+            else
+            {
+                packRow(row.ptr<uint16_t>(), dst, rows.cols, bits);
+            }
+        }
+    });
+    stream.write(reinterpret_cast<const char *>(packed.data()), static_cast<std::streamsize>(packed.size()));
+
+    // The last rows of a frame are followed by the padding up to the next frame boundary
+    rowsWritten += rows.rows;
+    if (rowsWritten == header.height)
+    {
+        const size_t padding = frameStride(header) - stride * header.height;
+        const char zeros[FRAME_ALIGNMENT] = {};
+        stream.write(zeros, static_cast<std::streamsize>(padding));
+        rowsWritten = 0;
+        ++header.frameCount;
+    }
+    if (!stream)
+    {
+        throw std::runtime_error("Failed to write raw frame");
+    }
+}
+
+void RawFile::Writer::close()
+{
+    if (!stream.is_open())
+    {
+        return;
+    }
+
+    // Rewrite the header now that the frame count is known
+    std::vector<uint8_t> bytes(HEADER_BYTES, 0);
+    encodeHeader(header, bytes.data());
+    stream.seekp(0);
+    stream.write(reinterpret_cast<const char *>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+    stream.close();
+    if (!stream)
+    {
+        throw std::runtime_error("Failed to finish raw file");
+    }
+}
+
+uint64_t RawFile::Writer::getFrameCount() const
+{
+    return header.frameCount;
+}
+
+RawFile::Reader::Reader(const std::string &path)
+{
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        throw std::runtime_error("Cannot open raw file: " + path);
+    }
+    LARGE_INTEGER fileSize;
+    GetFileSizeEx(file, &fileSize);
+    size = static_cast<size_t>(fileSize.QuadPart);
+    mapping = (size > 0) ? CreateFileMappingA(file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr) : nullptr;
+    CloseHandle(file);
+    if (mapping != nullptr)
+    {
+        data = static_cast<const uint8_t *>(MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0));
+    }
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        throw std::runtime_error("Cannot open raw file: " + path);
+    }
+    struct stat info;
+    if (::fstat(fd, &info) == 0 && info.st_size > 0)
+    {
+        size = static_cast<size_t>(info.st_size);
+        // Private writable mapping: views handed out as cv::Mat can be written without touching the file
+        void *address = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        data = (address == MAP_FAILED) ? nullptr : static_cast<const uint8_t *>(address);
+    }
+    ::close(fd);
+#endif
+    if (data == nullptr)
+    {
+        unmap();
+        throw std::runtime_error("Cannot map raw file: " + path);
+    }
+
+    try
+    {
+        if (size < HEADER_BYTES)
+        {
+            throw std::runtime_error("Raw file is truncated: " + path);
+        }
+        header = decodeHeader(data);
+
+        // A writer that never closed leaves a zero count; recover the frames that are complete
+        const uint64_t available = (size - HEADER_BYTES) / frameStride(header);
+        if (header.frameCount == 0 || header.frameCount > available)
+        {
+            header.frameCount = available;
+        }
+    }
+    catch (...)
+    {
+        unmap();
+        throw;
+    }
+}
+
+RawFile::Reader::~Reader()
+{
+    unmap();
+}
+
+void RawFile::Reader::unmap()
+{
+#ifdef _WIN32
+    if (data != nullptr)
+    {
+        UnmapViewOfFile(data);
+    }
+    if (mapping != nullptr)
+    {
+        CloseHandle(mapping);
+    }
+#else
+    if (data != nullptr)
+    {
+        ::munmap(const_cast<uint8_t *>(data), size);
+    }
+#endif
+    data = nullptr;
+    mapping = nullptr;
+}
+
+const RawFile::Header &RawFile::Reader::getHeader() const
+{
+    return header;
+}
+
+int RawFile::Reader::getNumFrames() const
+{
+    return static_cast<int>(header.frameCount);
+}
+
+bool RawFile::Reader::isZeroCopy() const
+{
+    return header.packedBits == 8 || header.packedBits == 16 || header.packedBits == 32;
+}
+
+cv::Mat RawFile::Reader::frameView(int index) const
+{
+    if (!isZeroCopy())
+    {
+        throw std::logic_error("Bit-packed frames cannot be viewed, use readFrame");
+    }
+    return cv::Mat(header.height, header.width, cvTypeForPackedBits(header.packedBits),
+                   const_cast<uint8_t *>(framePointer(index)), rowBytes(header.width, header.packedBits));
+}
+
+void RawFile::Reader::readFrame(int index, cv::Mat &output) const
+{
+    readRows(index, 0, header.height, output);
+}
+
+void RawFile::Reader::readRows(int index, int rowStart, int rowEnd, cv::Mat &output) const
+{
+    TELEMETRY_SCOPE("RawFile::readRows");
+    if (rowStart < 0 || rowEnd > header.height || rowStart > rowEnd)
+    {
+        throw std::out_of_range("Raw row range out of range");
+    }
+    if (isZeroCopy())
+    {
+        frameView(index).rowRange(rowStart, rowEnd).copyTo(output);
+        return;
+    }
+
+    const uint8_t *frame = framePointer(index);
+    const size_t stride = rowBytes(header.width, header.packedBits);
+    output.create(rowEnd - rowStart, header.width, CV_16UC1);
+    cv::parallel_for_(cv::Range(rowStart, rowEnd), [&](const cv::Range &range)
+    {
+        for (int i = range.start; i < range.end; ++i)
+        {
+            unpackRow(frame + i * stride, output.ptr<uint16_t>(i - rowStart), header.width, header.packedBits);
+        }
+    });
+}
+
+const uint8_t *RawFile::Reader::framePointer(int index) const
+{
+    if (index < 0 || static_cast<uint64_t>(index) >= header.frameCount)
+    {
+        throw std::out_of_range("Raw frame index out of range");
+    }
+    return data + HEADER_BYTES + static_cast<size_t>(index) * frameStride(header);
+}
+
+int RawFile::packedBitsForFullScale(double fullScale, int depth)
+{
+    if (depth == CV_32F || depth == CV_64F)
+    {
+        return 32;
+    }
+    int bits = static_cast<int>(std::ceil(std::log2(fullScale + 1.0)));
+    return std::min(std::max(bits, 8), 16);
+}
+
+int RawFile::cvTypeForPackedBits(int packedBits)
+{
+    if (packedBits == 32)
+    {
+        return CV_32FC1;
+    }
+    return (packedBits <= 8) ? CV_8UC1 : CV_16UC1;
+}
+
+size_t RawFile::rowBytes(int width, int packedBits)
+{
+    return (static_cast<size_t>(width) * packedBits + 7) / 8;
+}
+
+size_t RawFile::frameStride(const Header &header)
+{
+    size_t bytes = rowBytes(header.width, header.packedBits) * header.height;
+    return (bytes + FRAME_ALIGNMENT - 1) / FRAME_ALIGNMENT * FRAME_ALIGNMENT;
+}
+
+void RawFile::validate(const Header &header)
+{
+    if (header.width <= 0 || header.height <= 0)
+    {
+        throw std::invalid_argument("Raw frame size must be positive");
+    }
+    if (header.packedBits != 32 && (header.packedBits < 8 || header.packedBits > 16))
+    {
+        throw std::invalid_argument("Raw samples must be stored with 8 to 16 bits, or 32 for float");
+    }
+    if (header.cfaPattern.size() > MAX_CFA_PATTERN_LENGTH)
+    {
+        throw std::invalid_argument("CFA pattern is too long for the raw file header");
+    }
+}
+
+void RawFile::encodeHeader(const Header &header, uint8_t *bytes)
+{
+    std::memcpy(bytes + OFFSET_MAGIC, MAGIC, sizeof(MAGIC));
+    put<uint32_t>(bytes, OFFSET_VERSION, VERSION);
+    put<uint32_t>(bytes, OFFSET_HEADER_BYTES, static_cast<uint32_t>(HEADER_BYTES));
+    put<int32_t>(bytes, OFFSET_WIDTH, header.width);
+    put<int32_t>(bytes, OFFSET_HEIGHT, header.height);
+    put<int32_t>(bytes, OFFSET_BIT_DEPTH, header.bitDepth);
+    put<int32_t>(bytes, OFFSET_PACKED_BITS, header.packedBits);
+    put<uint32_t>(bytes, OFFSET_FLAGS, header.physicalNoise ? FLAG_PHYSICAL_NOISE : 0u);
+    put<uint64_t>(bytes, OFFSET_SEED, header.seed);
+    put<uint64_t>(bytes, OFFSET_FRAME_COUNT, header.frameCount);
+    put<uint64_t>(bytes, OFFSET_FRAME_STRIDE, frameStride(header));
+    put<double>(bytes, OFFSET_BLACK_LEVEL, header.blackLevel);
+    put<double>(bytes, OFFSET_NOISE_LEVEL, header.noiseLevel);
+    NoiseModel::Parameters noise = header.noise;
+    for (int k = 0; k < NUM_NOISE_FIELDS; ++k)
+    {
+        put<double>(bytes, OFFSET_NOISE_PARAMETERS + k * sizeof(double), *noiseFields(noise, k));
+    }
+    std::memcpy(bytes + OFFSET_CFA_PATTERN, header.cfaPattern.c_str(), header.cfaPattern.size() + 1);
+}
+
+RawFile::Header RawFile::decodeHeader(const uint8_t *bytes)
+{
+    if (std::memcmp(bytes + OFFSET_MAGIC, MAGIC, sizeof(MAGIC)) != 0)
+    {
+        throw std::runtime_error("Not a raw frame file");
+    }
+    if (get<uint32_t>(bytes, OFFSET_VERSION) != VERSION || get<uint32_t>(bytes, OFFSET_HEADER_BYTES) != HEADER_BYTES)
+    {
+        throw std::runtime_error("Unsupported raw frame file version");
+    }
+
+    Header header;
+    header.width = get<int32_t>(bytes, OFFSET_WIDTH);
+    header.height = get<int32_t>(bytes, OFFSET_HEIGHT);
+    header.bitDepth = get<int32_t>(bytes, OFFSET_BIT_DEPTH);
+    header.packedBits = get<int32_t>(bytes, OFFSET_PACKED_BITS);
+    header.physicalNoise = (get<uint32_t>(bytes, OFFSET_FLAGS) & FLAG_PHYSICAL_NOISE) != 0;
+    header.seed = get<uint64_t>(bytes, OFFSET_SEED);
+    header.frameCount = get<uint64_t>(bytes, OFFSET_FRAME_COUNT);
+    header.blackLevel = get<double>(bytes, OFFSET_BLACK_LEVEL);
+    header.noiseLevel = get<double>(bytes, OFFSET_NOISE_LEVEL);
+    for (int k = 0; k < NUM_NOISE_FIELDS; ++k)
+    {
+        *noiseFields(header.noise, k) = get<double>(bytes, OFFSET_NOISE_PARAMETERS + k * sizeof(double));
+    }
+    const char *pattern = reinterpret_cast<const char *>(bytes + OFFSET_CFA_PATTERN);
+    header.cfaPattern.assign(pattern, strnlen(pattern, MAX_CFA_PATTERN_LENGTH));
+
+    validate(header);
+    if (get<uint64_t>(bytes, OFFSET_FRAME_STRIDE) != frameStride(header))
+    {
+        throw std::runtime_error("Raw frame file has an inconsistent frame size");
+    }
+    return header;
+}
+
+void RawFile::packRow(const uint16_t *src, uint8_t *dst, int count, int bits)
+{
+    const uint16_t maxValue = static_cast<uint16_t>((1u << bits) - 1);
+    uint64_t accumulator = 0;
+    int pending = 0;
+    for (int k = 0; k < count; ++k)
+    {
+        accumulator |= static_cast<uint64_t>(std::min(src[k], maxValue)) << pending;
+        pending += bits;
+        while (pending >= 8)
+        {
+            *dst++ = static_cast<uint8_t>(accumulator);
+            accumulator >>= 8;
+            pending -= 8;
+        }
+    }
+    if (pending > 0)
+    {
+        *dst = static_cast<uint8_t>(accumulator);
+    }
+}
+
+void RawFile::unpackRow(const uint8_t *src, uint16_t *dst, int count, int bits)
+{
+    const uint64_t mask = (1u << bits) - 1;
+    uint64_t accumulator = 0;
+    int available = 0;
+    for (int k = 0; k < count; ++k)
+    {
+        while (available < bits)
+        {
+            accumulator |= static_cast<uint64_t>(*src++) << available;
+            available += 8;
+        }
+        dst[k] = static_cast<uint16_t>(accumulator & mask);
+        accumulator >>= bits;
+        available -= bits;
+    }
+}
@@ -0,0 +1,262 @@
+#include "RawISP/RawISP.h"
+#include "Demosaic/Demosaic.h"
+#include "ImageSensor/ImageSensor.h"
+#include "Telemetry/Telemetry.h"
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+RawISP::RawISP(const CFAPattern &cfaPattern)
+    : cfaPattern(cfaPattern),
+      blackLevels(CFAPattern::NUM_COLORS, 0.0),
+      whiteBalanceGains(CFAPattern::NUM_COLORS, 1.0),
+      lensShading(CFAPattern::NUM_COLORS)
+{
+}
+
+void RawISP::setBlackLevel(double blackLevel)
+{
+    std::fill(blackLevels.begin(), blackLevels.end(), blackLevel);
+}
+
+void RawISP::setBlackLevel(CFAPattern::Color color, double blackLevel)
+{
+    blackLevels.at(color) = blackLevel;
+}
+
+void RawISP::setWhiteLevel(double whiteLevel)
+{
+    this->whiteLevel = whiteLevel;
+}
+
+void RawISP::setWhiteBalanceGain(CFAPattern::Color color, double gain)
+{
+    whiteBalanceGains.at(color) = gain;
+}
+
+void RawISP::setAutoWhiteBalance(bool enabled)
+{
+    autoWhiteBalance = enabled;
+}
+
+void RawISP::setLensShadingGrid(CFAPattern::Color color, const cv::Mat &grid)
+{
+    lensShading.setGrid(color, grid);
+}
+
+void RawISP::setLensShading(const LensShading &lensShading)
+{
+    if (lensShading.getNumChannels() == 1)
+    {
+        for (int c = 0; c < CFAPattern::NUM_COLORS; ++c)
+        {
+            this->lensShading.setGrid(c, lensShading.getGrid(0));
+        }
+    }
+    else if (lensShading.getNumChannels() == CFAPattern::NUM_COLORS)
+    {
+        this->lensShading = lensShading;
+    }
+    else
+    {
+        throw std::invalid_argument("Lens shading must have one channel or one channel per CFA color");
+    }
+}
+
+void RawISP::setDenoise(double sigmaColor, double sigmaSpace)
+{
+    denoiseSigmaColor = sigmaColor;
+    denoiseSigmaSpace = sigmaSpace;
+}
+
+std::vector<double> RawISP::computeWhiteBalance(const cv::Mat &raw) const
+{
+    if (raw.channels() != 1)
+    {
+        throw std::invalid_argument("Raw ISP expects a single channel mosaic");
+    }
+
+    const int tileRows = cfaPattern.getTileRows();
+    const int tileCols = cfaPattern.getTileCols();
+    std::vector<double> sums(CFAPattern::NUM_COLORS, 0.0);
+    std::vector<double> counts(CFAPattern::NUM_COLORS, 0.0);
+
+    // Sample whole tile rows so every CFA phase is represented
+    cv::Mat row(1, raw.cols, CV_32FC1);
+    for (int tileRow = 0; tileRow * tileRows < raw.rows; tileRow += STATISTICS_ROW_STRIDE)
+    {
+        for (int i = tileRow * tileRows; i < std::min((tileRow + 1) * tileRows, raw.rows); ++i)
+        {
+            raw.row(i).convertTo(row, CV_32F);
+            const float *values = row.ptr<float>();
+            for (int phase = 0; phase < tileCols; ++phase)
+            {
+                CFAPattern::Color color = cfaPattern.getColor(i, phase);
+                double sum = 0.0;
+                int count = 0;
+                for (int j = phase; j < raw.cols; j += tileCols)
+                {
+                    sum += values[j];
+                    ++count;
+                }
+                sums[color] += sum - count * blackLevels[color];
+                counts[color] += count;
+            }
+        }
+    }
+
+    // Gray world: a neutral scene gives every color its summed RGB response (clear = 3, yellow = 2, ...)
+    std::vector<double> normalized(CFAPattern::NUM_COLORS, 0.0);
+    double reference = 0.0;
+    int referenceCount = 0;
+    for (CFAPattern::Color color : cfaPattern.getColors())
+    {
+        cv::Vec3d response = Demosaic::getRGBResponse(color);
+        double mean = sums[color] / std::max(counts[color], 1.0);
+        normalized[color] = mean / (response[0] + response[1] + response[2]);
+        if (color == CFAPattern::GREEN)
+        {
+            reference = normalized[color]; // Green is the usual anchor when present
+            referenceCount = -1;
+        }
+        else if (referenceCount >= 0)
+        {
+            reference += normalized[color];
+            ++referenceCount;
+        }
+    }
+    if (referenceCount > 0)
+    {
+        reference /= referenceCount;
+    }
+
+    std::vector<double> gains(CFAPattern::NUM_COLORS, 1.0);
+    for (CFAPattern::Color color : cfaPattern.getColors())
+    {
+        gains[color] = (normalized[color] > 1e-9) ? reference / normalized[color] : 1.0;
+    }
+    return gains;
+}
+
+void RawISP::process(cv::Mat &raw) const
+{
+    TELEMETRY_SCOPE("RawISP::process");
+    if (raw.channels() != 1)
+    {
+        throw std::invalid_argument("Raw ISP expects a single channel mosaic");
+    }
+
+    correct(raw, autoWhiteBalance ? computeWhiteBalance(raw) : whiteBalanceGains);
+    if (denoiseSigmaColor > 0.0)
+    {
+        denoise(raw);
+    }
+}
+
+double RawISP::getWhiteLevel(int depth) const
+{
+    if (whiteLevel > 0.0)
+    {
+        return whiteLevel;
+    }
+    // 16-bit storage holds 10 to 16-bit sensors, so only 8-bit and float data imply their white level
+    if (depth != CV_8U && depth != CV_32F && depth != CV_64F)
+    {
+        throw std::logic_error("Raw ISP needs a white level for " + std::to_string(8 * CV_ELEM_SIZE(depth)) + "-bit mosaics");
+    }
+    return (depth == CV_8U) ? 255.0 : ImageSensor::fullScaleForBitDepth(32);
+}
+
+void RawISP::correct(cv::Mat &raw, const std::vector<double> &gains) const
+{
+    const double white = getWhiteLevel(raw.depth());
+    const int tileRows = cfaPattern.getTileRows();
+    const int tileCols = cfaPattern.getTileCols();
+
+    // Per-color offset and gain, expanded to tile rows: v = (v - black) * wb * white / (white - black)
+    std::vector<double> scales(CFAPattern::NUM_COLORS);
+    for (int c = 0; c < CFAPattern::NUM_COLORS; ++c)
+    {
+        scales[c] = gains[c] * white / std::max(white - blackLevels[c], 1e-9);
+    }
+    const cv::Mat offsetRows = cfaPattern.expandColorValues(blackLevels, raw.cols);
+    const cv::Mat scaleRows = cfaPattern.expandColorValues(scales, raw.cols);
+
+    const bool shading = !lensShading.empty();
+    cv::parallel_for_(cv::Range(0, raw.rows), [&](const cv::Range &range)
+    {
+        cv::Mat row(1, raw.cols, CV_32FC1);
+        std::vector<float> shadingGains(shading ? raw.cols : 0);
+        for (int i = range.start; i < range.end; ++i)
+        {
+            raw.row(i).convertTo(row, CV_32F);
+            float *values = row.ptr<float>();
+            const float *offset = offsetRows.ptr<float>(i % tileRows);
+            const float *scale = scaleRows.ptr<float>(i % tileRows);
+            for (int j = 0; j < raw.cols; ++j)
+            {
+                values[j] = (values[j] - offset[j]) * scale[j];
+            }
+
+            if (shading)
+            {
+                // Interleave the gains of every CFA phase into one row, then one multiply
+                for (int phase = 0; phase < tileCols; ++phase)
+                {
+                    lensShading.gainRow(cfaPattern.getColor(i, phase), i, raw.size(), shadingGains.data(), phase, tileCols);
+                }
+                for (int j = 0; j < raw.cols; ++j)
+                {
+                    values[j] *= shadingGains[j];
+                }
+            }
+
+            cv::Mat out = raw.row(i);
+            row.convertTo(out, raw.type()); // Saturates to the mosaic type
+        }
+    });
+}
+
+void RawISP::denoise(cv::Mat &raw) const
+{
+    const int tileRows = cfaPattern.getTileRows();
+    const int tileCols = cfaPattern.getTileCols();
+
+    cv::Mat mosaic;
+    raw.convertTo(mosaic, CV_32F);
+
+    // Each CFA phase is a subsampled image of one color; filtering it alone never mixes colors
+    for (int pr = 0; pr < std::min(tileRows, raw.rows); ++pr)
+    {
+        for (int pc = 0; pc < std::min(tileCols, raw.cols); ++pc)
+        {
+            int planeRows = (raw.rows - pr + tileRows - 1) / tileRows;
+            int planeCols = (raw.cols - pc + tileCols - 1) / tileCols;
+            cv::Mat plane(planeRows, planeCols, CV_32FC1);
+            for (int r = 0; r < planeRows; ++r)
+            {
+                const float *src = mosaic.ptr<float>(pr + r * tileRows);
+                float *dst = plane.ptr<float>(r);
+                for (int c = 0; c < planeCols; ++c)
+                {
+                    dst[c] = src[pc + c * tileCols];
+                }
+            }
+
+            cv::Mat filtered;
+            cv::bilateralFilter(plane, filtered, 0, denoiseSigmaColor, denoiseSigmaSpace, cv::BORDER_REFLECT_101);
+
+            for (int r = 0; r < planeRows; ++r)
+            {
+                const float *src = filtered.ptr<float>(r);
+                float *dst = mosaic.ptr<float>(pr + r * tileRows);
+                for (int c = 0; c < planeCols; ++c)
+                {
+                    dst[pc + c * tileCols] = src[c];
+                }
+            }
+        }
+    }
+
+    mosaic.convertTo(raw, raw.type());
+}
@@ -1,85 +1,193 @@
 #include "SceneGenerator/SceneGenerator.h"
+#include "Telemetry/Telemetry.h"
+#include <algorithm>
+#include <cmath>
+#include <list>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
 
-cv::Mat SceneGenerator::generateGradient(int width, int height)
+namespace
 {
-    cv::Mat gradient(height, width, CV_64FC1);
+    // Classic 24-patch color checker in 8-bit sRGB (R, G, B), row by row
+    constexpr unsigned char COLOR_CHECKER_SRGB[24][3] = {
+        {115, 82, 68}, {194, 150, 130}, {98, 122, 157}, {87, 108, 67}, {133, 128, 177}, {103, 189, 170},
+        {214, 126, 44}, {80, 91, 166}, {193, 90, 99}, {94, 60, 108}, {157, 188, 64}, {224, 163, 46},
+        {56, 61, 150}, {70, 148, 73}, {175, 54, 60}, {231, 199, 31}, {187, 86, 149}, {8, 133, 161},
+        {243, 243, 242}, {200, 200, 200}, {160, 160, 160}, {122, 122, 121}, {85, 85, 85}, {52, 52, 52}};
+    constexpr int COLOR_CHECKER_COLS = 6;
+    constexpr int COLOR_CHECKER_ROWS = 4;
+    constexpr double COLOR_CHECKER_GAP = 0.1;        // Gap between patches as a fraction of the cell
+    constexpr double COLOR_CHECKER_BACKGROUND = 0.02; // Reflectance of the chart frame
 
-    for (int i = 0; i < height; ++i)
-    {
-        for (int j = 0; j < width; ++j)
-        {
-            gradient.at<double>(i, j) = static_cast<double>(i) / height;
-        }
-    }
+    // e-SFR chart layout
+    constexpr double ISO12233_TILT = 5.0;       // Tilt of the squares in degrees
+    constexpr double ISO12233_LIGHT = 0.8;      // Background reflectance
+    constexpr double ISO12233_DARK = 0.2;       // Square reflectance (4:1 contrast)
+    constexpr double ISO12233_SQUARE = 0.5;     // Square side as a fraction of the cell
 
-    return gradient;
-}
+    // Default parameters used by generate()
+    constexpr int CHECKER_SQUARES_PER_ROW = 8;
+    constexpr int CHECKER_SQUARES_PER_COL = 8;
+    constexpr double SLANTED_EDGE_ANGLE = 20.0;
+    constexpr int RADIAL_LINES = 16;
+    constexpr int SIEMENS_STAR_SPOKES = 36;
+    constexpr double ZONE_PLATE_MAX_FREQUENCY = 0.5;
 
-cv::Mat SceneGenerator::generateCheckerboard(int width, int height, int squaresPerRow, int squaresPerCol)
-{
-    cv::Mat checkerboard(height, width, CV_64FC1);
+    const char *const SCENE_NAMES[] = {"gradient", "checkerboard", "slanted-edge", "radial-lines",
+                                       "siemens-star", "zone-plate", "iso12233", "color-checker"};
 
-    int squareWidth = width / squaresPerRow;
-    int squareHeight = height / squaresPerCol;
+    double srgbToLinear(double value)
+    {
+        return (value <= 0.04045) ? value / 12.92 : std::pow((value + 0.055) / 1.055, 2.4);
+    }
 
-    for (int i = 0; i < height; ++i)
+    // Renders kernel(x, y) row-parallel; every pixel averages samples x samples points of the kernel.
+    // The kernel is a template argument so the per-row loop is inlined and can be vectorized.
+    template <typename Kernel>
+    void renderRows(cv::Mat &output, int samples, Kernel kernel)
     {
-        for (int j = 0; j < width; ++j)
+        const int cols = output.cols;
+        const float norm = 1.0f / (samples * samples);
+        cv::parallel_for_(cv::Range(0, output.rows), [&](const cv::Range &range)
         {
-            int row = i / squareHeight;
-            int col = j / squareWidth;
-            if ((row + col) % 2 == 0)
+            std::vector<float> row(cols);
+            cv::Mat rowMat(1, cols, CV_32FC1, row.data());
+            for (int i = range.start; i < range.end; ++i)
             {
-                checkerboard.at<double>(i, j) = 1.0; // White
+                std::fill(row.begin(), row.end(), 0.0f);
+                for (int sy = 0; sy < samples; ++sy)
+                {
+                    const float y = i + (sy + 0.5f) / samples - 0.5f;
+                    for (int sx = 0; sx < samples; ++sx)
+                    {
+                        const float dx = (sx + 0.5f) / samples - 0.5f;
+                        for (int j = 0; j < cols; ++j)
+                        {
+                            row[j] += kernel(j + dx, y);
+                        }
+                    }
+                }
+                if (samples > 1)
+                {
+                    for (int j = 0; j < cols; ++j)
+                    {
+                        row[j] *= norm;
+                    }
+                }
+
+                cv::Mat out = output.row(i);
+                rowMat.convertTo(out, output.type());
             }
-            else
+        });
+    }
+
+    // Least recently used cache of rendered scenes, keyed on name, size and depth
+    struct SceneCache
+    {
+        std::mutex mutex;
+        std::list<std::string> order; // Most recently used first
+        std::unordered_map<std::string, std::pair<cv::Mat, std::list<std::string>::iterator>> entries;
+        size_t bytes = 0;
+        size_t capacity = SceneGenerator::DEFAULT_CACHE_BYTES;
+
+        void evict()
+        {
+            while (bytes > capacity && !order.empty())
             {
-                checkerboard.at<double>(i, j) = 0.0; // Black
+                auto entry = entries.find(order.back());
+                bytes -= entry->second.first.total() * entry->second.first.elemSize();
+                entries.erase(entry);
+                order.pop_back();
             }
         }
+    };
+
+    SceneCache &sceneCache()
+    {
+        static SceneCache cache;
+        return cache;
     }
+}
 
-    return checkerboard;
+cv::Mat SceneGenerator::generateGradient(int width, int height, int depth)
+{
+    checkArguments(width, height, depth);
+    cv::Mat gradient(height, width, CV_MAKETYPE(depth, 1));
+    const float scale = 1.0f / height;
+    renderRows(gradient, 1, [scale](float, float y)
+    {
+        return y * scale;
+    });
+    return gradient;
 }
 
-cv::Mat SceneGenerator::generateSlantedEdge(int width, int height, double angle)
+cv::Mat SceneGenerator::generateCheckerboard(int width, int height, int squaresPerRow, int squaresPerCol, int depth)
 {
-    cv::Mat slantedEdge(height, width, CV_64FC1, cv::Scalar(0));
+    checkArguments(width, height, depth);
+    if (squaresPerRow <= 0 || squaresPerCol <= 0)
+    {
+        throw std::invalid_argument("Number of squares must be positive");
+    }
 
-    // Calculate the slant line
-    double radians = angle * CV_PI / 180.0;
-    double tanAngle = tan(radians);
+    cv::Mat checkerboard(height, width, CV_MAKETYPE(depth, 1));
+    const int squareWidth = std::max(width / squaresPerRow, 1);
+    const int squareHeight = std::max(height / squaresPerCol, 1);
+    renderRows(checkerboard, 1, [squareWidth, squareHeight](float x, float y)
+    {
+        int row = static_cast<int>(y) / squareHeight;
+        int col = static_cast<int>(x) / squareWidth;
+        return ((row + col) % 2 == 0) ? 1.0f : 0.0f; // White / black
+    });
+    return checkerboard;
+}
 
-    int centerX = width / 2;
-    int centerY = height / 2;
+cv::Mat SceneGenerator::generateSlantedEdge(int width, int height, double angle, int depth)
+{
+    checkArguments(width, height, depth);
+    cv::Mat slantedEdge(height, width, CV_MAKETYPE(depth, 1));
+
+    // Signed distance to the edge x = y tan(angle) through the center, positive on the dark side
+    const double radians = angle * CV_PI / 180.0;
+    const float cosAngle = static_cast<float>(std::cos(radians));
+    const float sinAngle = static_cast<float>(std::sin(radians));
+    const float centerX = static_cast<float>(width / 2);
+    const float centerY = static_cast<float>(height / 2);
 
-    for (int y = 0; y < height; ++y)
+    // Exact area of the unit pixel on the light side. Across the pixel the distance is the sum
+    // of two uniform variables of widths a >= b, so the covered fraction ramps over a + b:
+    // quadratic over b at either end, linear in between
+    const float a = std::max(std::abs(cosAngle), std::abs(sinAngle));
+    const float b = std::min(std::abs(cosAngle), std::abs(sinAngle));
+    const float outer = 0.5f * (a + b);
+    const float inner = 0.5f * (a - b);
+    renderRows(slantedEdge, 1, [=](float x, float y)
     {
-        for (int x = 0; x < width; ++x)
+        float distance = (x - centerX) * cosAngle - (y - centerY) * sinAngle;
+        float t = std::abs(distance);
+        float darkArea; // Area on the far side of the edge, for a pixel at distance t >= 0
+        if (t >= outer)
         {
-            double relativeX = x - centerX;
-            double relativeY = y - centerY;
-
-            double edgePosition = relativeY * tanAngle;
-
-            // Apply the sharp light-to-dark transition
-            if (relativeX <= edgePosition)
-            {
-                slantedEdge.at<double>(y, x) = 1.0; // Light side
-            }
-            else
-            {
-                slantedEdge.at<double>(y, x) = 0.0; // Dark side
-            }
+            darkArea = 0.0f;
         }
-    }
-
+        else if (t > inner)
+        {
+            darkArea = (outer - t) * (outer - t) / (2.0f * a * b);
+        }
+        else
+        {
+            darkArea = 0.5f - t / a;
+        }
+        return (distance > 0.0f) ? darkArea : 1.0f - darkArea;
+    });
     return slantedEdge;
 }
 
-cv::Mat SceneGenerator::generateRadialLines(int width, int height, int numLines)
+cv::Mat SceneGenerator::generateRadialLines(int width, int height, int numLines, int depth)
 {
-    cv::Mat radialLines(height, width, CV_64FC1, cv::Scalar(0));
+    checkArguments(width, height, depth);
+    cv::Mat radialLines(height, width, CV_MAKETYPE(depth, 1), cv::Scalar(0));
 
     cv::Point center(width / 2, height / 2);
     double angleStep = 360.0 / numLines;
@@ -95,3 +203,269 @@ cv::Mat SceneGenerator::generateRadialLines(int width, int height, int numLines)
 
     return radialLines;
 }
+
+cv::Mat SceneGenerator::generateSiemensStar(int width, int height, int numSpokes, int depth, int supersampling)
+{
+    checkArguments(width, height, depth);
+    if (numSpokes <= 0 || supersampling <= 0)
+    {
+        throw std::invalid_argument("Number of spokes and supersampling must be positive");
+    }
+
+    cv::Mat star(height, width, CV_MAKETYPE(depth, 1));
+    const float centerX = 0.5f * (width - 1);
+    const float centerY = 0.5f * (height - 1);
+    const float radius2 = 0.25f * std::min(width, height) * std::min(width, height);
+    const float spokes = static_cast<float>(numSpokes);
+    renderRows(star, supersampling, [=](float x, float y)
+    {
+        float dx = x - centerX;
+        float dy = y - centerY;
+        if (dx * dx + dy * dy > radius2)
+        {
+            return 0.5f;
+        }
+        return (std::sin(spokes * std::atan2(dy, dx)) >= 0.0f) ? 1.0f : 0.0f;
+    });
+    return star;
+}
+
+cv::Mat SceneGenerator::generateZonePlate(int width, int height, double maxFrequency, int depth, int supersampling)
+{
+    checkArguments(width, height, depth);
+    if (maxFrequency <= 0.0 || supersampling <= 0)
+    {
+        throw std::invalid_argument("Zone plate frequency and supersampling must be positive");
+    }
+
+    // Phase pi k r^2 has a local frequency of k r cycles per pixel
+    cv::Mat zonePlate(height, width, CV_MAKETYPE(depth, 1));
+    const float centerX = 0.5f * (width - 1);
+    const float centerY = 0.5f * (height - 1);
+    const float k = static_cast<float>(CV_PI * maxFrequency / (0.5 * std::min(width, height)));
+    renderRows(zonePlate, supersampling, [=](float x, float y)
+    {
+        float dx = x - centerX;
+        float dy = y - centerY;
+        return 0.5f + 0.5f * std::cos(k * (dx * dx + dy * dy));
+    });
+    return zonePlate;
+}
+
+cv::Mat SceneGenerator::generateISO12233(int width, int height, int depth, int supersampling)
+{
+    checkArguments(width, height, depth);
+    if (supersampling <= 0)
+    {
+        throw std::invalid_argument("Supersampling must be positive");
+    }
+
+    cv::Mat chart(height, width, CV_MAKETYPE(depth, 1));
+    const float cellWidth = width / 3.0f;
+    const float cellHeight = height / 3.0f;
+    const float halfSide = 0.5f * static_cast<float>(ISO12233_SQUARE) * std::min(cellWidth, cellHeight);
+    const float cosTilt = static_cast<float>(std::cos(ISO12233_TILT * CV_PI / 180.0));
+    const float sinTilt = static_cast<float>(std::sin(ISO12233_TILT * CV_PI / 180.0));
+    renderRows(chart, supersampling, [=](float x, float y)
+    {
+        // Position relative to the center of the cell, rotated into the square's frame
+        float cx = (std::floor(x / cellWidth) + 0.5f) * cellWidth;
+        float cy = (std::floor(y / cellHeight) + 0.5f) * cellHeight;
+        float u = (x - cx) * cosTilt + (y - cy) * sinTilt;
+        float v = (y - cy) * cosTilt - (x - cx) * sinTilt;
+        bool inside = std::abs(u) <= halfSide && std::abs(v) <= halfSide;
+        return static_cast<float>(inside ? ISO12233_DARK : ISO12233_LIGHT);
+    });
+    return chart;
+}
+
+cv::Mat SceneGenerator::generateColorChecker(int width, int height, int depth)
+{
+    checkArguments(width, height, depth);
+
+    // Patch columns and rows per pixel, computed once; -1 for the gaps
+    std::vector<int> patchCol(width), patchRow(height);
+    for (int j = 0; j < width; ++j)
+    {
+        double cell = (j + 0.5) * COLOR_CHECKER_COLS / width;
+        double offset = cell - std::floor(cell);
+        patchCol[j] = (offset < COLOR_CHECKER_GAP / 2 || offset > 1.0 - COLOR_CHECKER_GAP / 2) ? -1 : static_cast<int>(cell);
+    }
+    for (int i = 0; i < height; ++i)
+    {
+        double cell = (i + 0.5) * COLOR_CHECKER_ROWS / height;
+        double offset = cell - std::floor(cell);
+        patchRow[i] = (offset < COLOR_CHECKER_GAP / 2 || offset > 1.0 - COLOR_CHECKER_GAP / 2) ? -1 : static_cast<int>(cell);
+    }
+
+    // Linear BGR reflectance of every patch
+    std::vector<cv::Vec3f> patches(COLOR_CHECKER_COLS * COLOR_CHECKER_ROWS);
+    for (size_t p = 0; p < patches.size(); ++p)
+    {
+        for (int c = 0; c < 3; ++c)
+        {
+            patches[p][2 - c] = static_cast<float>(srgbToLinear(COLOR_CHECKER_SRGB[p][c] / 255.0));
+        }
+    }
+
+    cv::Mat checker(height, width, CV_MAKETYPE(depth, 3));
+    cv::parallel_for_(cv::Range(0, height), [&](const cv::Range &range)
+    {
+        cv::Mat row(1, width, CV_32FC3);
+        for (int i = range.start; i < range.end; ++i)
+        {
+            cv::Vec3f *pixels = row.ptr<cv::Vec3f>();
+            for (int j = 0; j < width; ++j)
+            {
+                bool gap = patchRow[i] < 0 || patchCol[j] < 0;
+                float background = static_cast<float>(COLOR_CHECKER_BACKGROUND);
+                pixels[j] = gap ? cv::Vec3f(background, background, background) : patches[patchRow[i] * COLOR_CHECKER_COLS + patchCol[j]];
+            }
+
+            cv::Mat out = checker.row(i);
+            row.convertTo(out, checker.type());
+        }
+    });
+    return checker;
+}
+
+std::vector<cv::Rect> SceneGenerator::getColorCheckerPatches(int width, int height)
+{
+    checkArguments(width, height, CV_32F);
+
+    // Same pixel-center rule as generateColorChecker: a pixel belongs to a patch outside the gaps
+    auto span = [](int size, int cells, int cell)
+    {
+        int first = size, last = -1;
+        for (int k = 0; k < size; ++k)
+        {
+            double position = (k + 0.5) * cells / size;
+            double offset = position - std::floor(position);
+            if (static_cast<int>(position) == cell && offset >= COLOR_CHECKER_GAP / 2 && offset <= 1.0 - COLOR_CHECKER_GAP / 2)
+            {
+                first = std::min(first, k);
+                last = std::max(last, k);
+            }
+        }
+        return std::make_pair(first, last);
+    };
+
+    std::vector<cv::Rect> patches;
+    for (int r = 0; r < COLOR_CHECKER_ROWS; ++r)
+    {
+        auto rows = span(height, COLOR_CHECKER_ROWS, r);
+        for (int c = 0; c < COLOR_CHECKER_COLS; ++c)
+        {
+            auto cols = span(width, COLOR_CHECKER_COLS, c);
+            patches.emplace_back(cols.first, rows.first, std::max(cols.second - cols.first + 1, 0), std::max(rows.second - rows.first + 1, 0));
+        }
+    }
+    return patches;
+}
+
+cv::Mat SceneGenerator::generate(const std::string &name, int width, int height, int depth)
+{
+    std::ostringstream key;
+    key << name << "|" << width << "x" << height << "|" << depth;
+
+    SceneCache &cache = sceneCache();
+    {
+        std::lock_guard<std::mutex> lock(cache.mutex);
+        auto entry = cache.entries.find(key.str());
+        if (entry != cache.entries.end())
+        {
+            cache.order.splice(cache.order.begin(), cache.order, entry->second.second);
+            return entry->second.first;
+        }
+    }
+
+    // Render outside the lock; a concurrent miss on the same key renders twice and keeps one copy
+    cv::Mat scene = render(name, width, height, depth);
+
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    if (cache.entries.find(key.str()) == cache.entries.end())
+    {
+        cache.order.push_front(key.str());
+        cache.entries[key.str()] = std::make_pair(scene, cache.order.begin());
+        cache.bytes += scene.total() * scene.elemSize();
+        cache.evict();
+    }
+    return scene;
+}
+
+void SceneGenerator::generate(const std::string &name, cv::Mat &output, int width, int height, int depth)
+{
+    generate(name, width, height, depth).copyTo(output);
+}
+
+std::vector<std::string> SceneGenerator::getSceneNames()
+{
+    return std::vector<std::string>(std::begin(SCENE_NAMES), std::end(SCENE_NAMES));
+}
+
+void SceneGenerator::setCacheCapacity(size_t bytes)
+{
+    SceneCache &cache = sceneCache();
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    cache.capacity = bytes;
+    cache.evict();
+}
+
+void SceneGenerator::clearCache()
+{
+    SceneCache &cache = sceneCache();
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    cache.entries.clear();
+    cache.order.clear();
+    cache.bytes = 0;
+}
+
+cv::Mat SceneGenerator::render(const std::string &name, int width, int height, int depth)
+{
+    TELEMETRY_SCOPE("SceneGenerator::render");
+    if (name == "gradient")
+    {
+        return generateGradient(width, height, depth);
+    }
+    if (name == "checkerboard")
+    {
+        return generateCheckerboard(width, height, CHECKER_SQUARES_PER_ROW, CHECKER_SQUARES_PER_COL, depth);
+    }
+    if (name == "slanted-edge")
+    {
+        return generateSlantedEdge(width, height, SLANTED_EDGE_ANGLE, depth);
+    }
+    if (name == "radial-lines")
+    {
+        return generateRadialLines(width, height, RADIAL_LINES, depth);
+    }
+    if (name == "siemens-star")
+    {
+        return generateSiemensStar(width, height, SIEMENS_STAR_SPOKES, depth);
+    }
+    if (name == "zone-plate")
+    {
+        return generateZonePlate(width, height, ZONE_PLATE_MAX_FREQUENCY, depth);
+    }
+    if (name == "iso12233")
+    {
+        return generateISO12233(width, height, depth);
+    }
+    if (name == "color-checker")
+    {
+        return generateColorChecker(width, height, depth);
+    }
+    throw std::invalid_argument("Unknown pattern type: " + name);
+}
+
+void SceneGenerator::checkArguments(int width, int height, int depth)
+{
+    if (width <= 0 || height <= 0)
+    {
+        throw std::invalid_argument("Scene size must be positive");
+    }
+    if (depth != CV_32F && depth != CV_64F)
+    {
+        throw std::invalid_argument("Scenes are rendered as CV_32F or CV_64F");
+    }
+}
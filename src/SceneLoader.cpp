@@ -0,0 +1,310 @@
+#include "SceneLoader/SceneLoader.h"
+#include "ImageSensor/ImageSensor.h"
+#include "Telemetry/Telemetry.h"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <stdexcept>
+
+namespace
+{
+    // Rec. 709 luminance weights in BGR order
+    constexpr float LUMA_B = 0.0722f;
+    constexpr float LUMA_G = 0.7152f;
+    constexpr float LUMA_R = 0.2126f;
+
+    std::string extensionOf(const std::string &path)
+    {
+        size_t dot = path.find_last_of('.');
+        std::string extension = (dot == std::string::npos) ? "" : path.substr(dot + 1);
+        std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+        return extension;
+    }
+
+    // Formats holding linear radiance (or linear raw data); everything else is sRGB encoded
+    bool isLinearFormat(const std::string &extension)
+    {
+        return extension == "exr" || extension == "hdr" || extension == "pic" || extension == "pfm" ||
+               extension == "dng" || extension == "tif" || extension == "tiff";
+    }
+
+    // sRGB decoding table for every code of an 8 or 16-bit sample
+    const std::vector<float> &srgbTable(int depth)
+    {
+        auto build = [](int levels)
+        {
+            std::vector<float> table(levels);
+            for (int v = 0; v < levels; ++v)
+            {
+                double x = static_cast<double>(v) / (levels - 1);
+                table[v] = static_cast<float>((x <= 0.04045) ? x / 12.92 : std::pow((x + 0.055) / 1.055, 2.4));
+            }
+            return table;
+        };
+        static const std::vector<float> table8 = build(256);
+        static const std::vector<float> table16 = build(65536);
+        return (depth == CV_8U) ? table8 : table16;
+    }
+}
+
+SceneLoader::Prefetcher::Prefetcher(const std::vector<std::string> &paths)
+    : Prefetcher(paths, Options())
+{
+}
+
+SceneLoader::Prefetcher::Prefetcher(const std::vector<std::string> &paths, const Options &options, size_t depth)
+    : queue(depth)
+{
+    worker = std::thread([this, paths, options]
+    {
+        for (const auto &path : paths)
+        {
+            Item item;
+            try
+            {
+                item.loader = std::make_shared<const SceneLoader>(path, options);
+            }
+            catch (...)
+            {
+                item.error = std::current_exception();
+            }
+            if (!queue.push(std::move(item)))
+            {
+                return; // Closed by the destructor
+            }
+        }
+        queue.close();
+    });
+}
+
+SceneLoader::Prefetcher::~Prefetcher()
+{
+    queue.close();
+    worker.join();
+}
+
+std::shared_ptr<const SceneLoader> SceneLoader::Prefetcher::next()
+{
+    Item item;
+    if (!queue.pop(item))
+    {
+        return nullptr;
+    }
+    if (item.error)
+    {
+        std::rethrow_exception(item.error);
+    }
+    return item.loader;
+}
+
+SceneLoader::SceneLoader(const std::string &path)
+    : SceneLoader(path, Options())
+{
+}
+
+SceneLoader::SceneLoader(const std::string &path, const Options &options)
+    : options(options)
+{
+    TELEMETRY_SCOPE("SceneLoader::open");
+    if (options.depth != CV_32F && options.depth != CV_64F)
+    {
+        throw std::invalid_argument("Scenes are loaded as CV_32F or CV_64F");
+    }
+
+    const std::string extension = extensionOf(path);
+    if (extension == "sraw")
+    {
+        // Mapped, rows are read on demand; integer samples span [0, 2^bits - 1] above the black level,
+        // float samples the sensor full scale of the recorded bit depth
+        raw = std::make_shared<RawFile::Reader>(path);
+        const RawFile::Header &header = raw->getHeader();
+        if (options.frameIndex < 0 || options.frameIndex >= raw->getNumFrames())
+        {
+            throw std::out_of_range("Raw container has no frame " + std::to_string(options.frameIndex));
+        }
+        size = cv::Size(header.width, header.height);
+        double white = (header.packedBits != 32) ? std::ldexp(1.0, header.packedBits) - 1.0
+                                                 : ImageSensor::fullScaleForBitDepth(header.bitDepth);
+        scale = 1.0 / std::max(white - header.blackLevel, 1.0);
+        offset = -header.blackLevel * scale;
+    }
+    else
+    {
+        image = cv::imread(path, cv::IMREAD_ANYDEPTH | cv::IMREAD_ANYCOLOR);
+        if (image.empty())
+        {
+            throw std::runtime_error("Cannot decode scene file: " + path);
+        }
+        if (image.channels() != 1 && image.channels() != 3 && image.channels() != 4)
+        {
+            throw std::runtime_error("Unsupported number of channels in scene file: " + path);
+        }
+        size = image.size();
+        channels = (image.channels() == 1) ? 1 : 3; // Alpha is ignored
+
+        const bool integer = image.depth() == CV_8U || image.depth() == CV_16U;
+        srgb = integer && !isLinearFormat(extension);
+        if (integer && !srgb)
+        {
+            scale = (image.depth() == CV_8U) ? 1.0 / 255.0 : 1.0 / 65535.0;
+        }
+        else if (!integer && image.depth() != CV_32F && image.depth() != CV_64F)
+        {
+            image.convertTo(image, CV_32F); // Rare signed types
+        }
+    }
+
+    exposure = options.exposure;
+    if (options.autoExposure)
+    {
+        // Mean luminance on sampled rows, converted like any strip at unit exposure
+        double sum = 0.0;
+        long long count = 0;
+        cv::Mat row;
+        exposure = 1.0;
+        for (int i = 0; i < size.height; i += AUTO_EXPOSURE_ROW_STRIDE)
+        {
+            readStrip(i, i + 1, row);
+            sum += cv::sum(row)[0];
+            count += row.cols;
+        }
+        double mean = sum / std::max(count, 1LL);
+        exposure = (mean > 1e-12) ? options.exposure * AUTO_EXPOSURE_TARGET / mean : options.exposure;
+    }
+}
+
+cv::Size SceneLoader::getSize() const
+{
+    return size;
+}
+
+int SceneLoader::getChannels() const
+{
+    return channels;
+}
+
+double SceneLoader::getExposure() const
+{
+    return exposure;
+}
+
+void SceneLoader::readStrip(int rowStart, int rowEnd, cv::Mat &output) const
+{
+    convertRows(rowStart, rowEnd, 1, output);
+}
+
+void SceneLoader::readColorStrip(int rowStart, int rowEnd, cv::Mat &output) const
+{
+    convertRows(rowStart, rowEnd, 3, output);
+}
+
+cv::Mat SceneLoader::loadLuminance() const
+{
+    return loadAll(1);
+}
+
+cv::Mat SceneLoader::loadColor() const
+{
+    return loadAll(3);
+}
+
+void SceneLoader::convertRows(int rowStart, int rowEnd, int outChannels, cv::Mat &output) const
+{
+    if (rowStart < 0 || rowEnd > size.height || rowStart > rowEnd)
+    {
+        throw std::out_of_range("Scene row range out of range");
+    }
+
+    // Source rows: a view of the decoded image or of the mapping, or unpacked rows of a packed container
+    cv::Mat source;
+    if (!raw)
+    {
+        source = image.rowRange(rowStart, rowEnd);
+    }
+    else if (raw->isZeroCopy())
+    {
+        source = raw->frameView(options.frameIndex).rowRange(rowStart, rowEnd);
+    }
+    else
+    {
+        raw->readRows(options.frameIndex, rowStart, rowEnd, source);
+    }
+
+    const int sourceChannels = source.channels();
+    const int width = size.width;
+    const std::vector<float> *table = srgb ? &srgbTable(source.depth()) : nullptr;
+    const float gain = static_cast<float>(exposure);
+
+    output.create(rowEnd - rowStart, width, CV_MAKETYPE(options.depth, outChannels));
+    cv::Mat row(1, width, CV_MAKETYPE(CV_32F, sourceChannels));
+    cv::Mat result(1, width, CV_MAKETYPE(CV_32F, outChannels));
+    for (int r = 0; r < source.rows; ++r)
+    {
+        // Samples to linear radiance, through the sRGB table for encoded integer data
+        float *values = row.ptr<float>();
+        if (table == nullptr)
+        {
+            source.row(r).convertTo(row, CV_32F, scale, offset);
+        }
+        else if (source.depth() == CV_8U)
+        {
+            const uchar *codes = source.ptr<uchar>(r);
+            for (int k = 0; k < width * sourceChannels; ++k)
+            {
+                values[k] = (*table)[codes[k]];
+            }
+        }
+        else
+        {
+            const ushort *codes = source.ptr<ushort>(r);
+            for (int k = 0; k < width * sourceChannels; ++k)
+            {
+                values[k] = (*table)[codes[k]];
+            }
+        }
+
+        float *out = result.ptr<float>();
+        for (int j = 0; j < width; ++j)
+        {
+            const float *p = values + j * sourceChannels;
+            if (sourceChannels == 1)
+            {
+                for (int c = 0; c < outChannels; ++c)
+                {
+                    out[j * outChannels + c] = gain * p[0];
+                }
+            }
+            else if (outChannels == 1)
+            {
+                out[j] = gain * (LUMA_B * p[0] + LUMA_G * p[1] + LUMA_R * p[2]);
+            }
+            else
+            {
+                out[3 * j] = gain * p[0];
+                out[3 * j + 1] = gain * p[1];
+                out[3 * j + 2] = gain * p[2];
+            }
+        }
+
+        cv::Mat dst = output.row(r);
+        result.convertTo(dst, output.type());
+    }
+}
+
+cv::Mat SceneLoader::loadAll(int outChannels) const
+{
+    TELEMETRY_SCOPE("SceneLoader::load");
+    cv::Mat scene(size, CV_MAKETYPE(options.depth, outChannels));
+    const int numStrips = (size.height + DEFAULT_STRIP_ROWS - 1) / DEFAULT_STRIP_ROWS;
+    cv::parallel_for_(cv::Range(0, numStrips), [&](const cv::Range &range)
+    {
+        for (int s = range.start; s < range.end; ++s)
+        {
+            int rowStart = s * DEFAULT_STRIP_ROWS;
+            int rowEnd = std::min(rowStart + DEFAULT_STRIP_ROWS, size.height);
+            cv::Mat strip = scene.rowRange(rowStart, rowEnd); // Converted in place, no intermediate copy
+            convertRows(rowStart, rowEnd, outChannels, strip);
+        }
+    });
+    return scene;
+}
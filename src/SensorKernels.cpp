@@ -0,0 +1,278 @@
+#include "SensorKernels/SensorKernels.h"
+#include "ImageSensor/ImageSensor.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <type_traits>
+
+namespace
+{
+    // Arithmetic type of the FLOAT32 kernels: float, except for double sensors
+    template <typename T>
+    using Work = typename std::conditional<std::is_same<T, double>::value, double, float>::type;
+
+    // Fixed-point scale: one code is FIXED_ONE in Q16, and FIXED_HALF rounds a shift to nearest
+    constexpr int FIXED_BITS = SensorKernels::FIXED_POINT_BITS;
+    constexpr int64_t FIXED_ONE = int64_t(1) << FIXED_BITS;
+    constexpr int64_t FIXED_HALF = FIXED_ONE >> 1;
+
+    // Rounds and saturates to [0, maxValue] for integer types; float types are stored as they are
+    template <typename T, typename W>
+    inline T store(W value, W maxValue)
+    {
+        if constexpr (std::is_integral<T>::value)
+        {
+            return static_cast<T>(std::min(std::max(value, W(0)), maxValue) + W(0.5));
+        }
+        else
+        {
+            (void)maxValue;
+            return static_cast<T>(value);
+        }
+    }
+
+    // Rounds a Q16 value to a code and saturates it to [0, maxValue]
+    template <typename T>
+    inline T storeFixed(int64_t value, int64_t maxValue)
+    {
+        return static_cast<T>(std::min(std::max(value + FIXED_HALF, int64_t(0)) >> FIXED_BITS, maxValue));
+    }
+
+    template <typename S, typename T, typename W>
+    void quantizeRow(const S *input, uchar *output, int count, double scale, double maxValue)
+    {
+        T *out = reinterpret_cast<T *>(output);
+        const W s = static_cast<W>(scale);
+        const W m = static_cast<W>(maxValue);
+        for (int j = 0; j < count; ++j)
+        {
+            out[j] = store<T>(static_cast<W>(input[j]) * s, m);
+        }
+    }
+
+    template <typename T, typename W>
+    void addNoiseRow(uchar *row, const float *noise, int count, double sigma, double maxValue)
+    {
+        T *values = reinterpret_cast<T *>(row);
+        const W s = static_cast<W>(sigma);
+        const W m = static_cast<W>(maxValue);
+        for (int j = 0; j < count; ++j)
+        {
+            values[j] = store<T>(static_cast<W>(values[j]) + s * static_cast<W>(noise[j]), m);
+        }
+    }
+
+    // Each noise sample enters the datapath once, as a Q16 integer; the sum is integer only
+    template <typename T>
+    void addNoiseRowFixed(uchar *row, const float *noise, int count, double sigma, double maxValue)
+    {
+        T *values = reinterpret_cast<T *>(row);
+        const float s = static_cast<float>(sigma * FIXED_ONE);
+        const int64_t m = static_cast<int64_t>(maxValue);
+        for (int j = 0; j < count; ++j)
+        {
+            const int64_t sample = std::lrint(s * noise[j]);
+            values[j] = storeFixed<T>((static_cast<int64_t>(values[j]) << FIXED_BITS) + sample, m);
+        }
+    }
+
+    // The tile width is a compile-time constant, so the inner loop unrolls completely
+    template <typename T, int TILE, typename W>
+    void applyCFARow(uchar *row, const float *weights, int colOffset, int count, double maxValue)
+    {
+        T *values = reinterpret_cast<T *>(row);
+        const W m = static_cast<W>(maxValue);
+
+        // Weights rotated so that w[k] applies to every column j with j % TILE == k
+        W w[TILE];
+        for (int k = 0; k < TILE; ++k)
+        {
+            w[k] = weights[(colOffset + k) % TILE];
+        }
+
+        int j = 0;
+        for (; j + TILE <= count; j += TILE)
+        {
+            for (int k = 0; k < TILE; ++k)
+            {
+                values[j + k] = store<T>(static_cast<W>(values[j + k]) * w[k], m);
+            }
+        }
+        for (int k = 0; j < count; ++j, ++k)
+        {
+            values[j] = store<T>(static_cast<W>(values[j]) * w[k], m);
+        }
+    }
+
+    // Same layout with Q16 gains: code * gain is exact in 64 bits and rounded by the shift
+    template <typename T, int TILE>
+    void applyCFARowFixed(uchar *row, const float *weights, int colOffset, int count, double maxValue)
+    {
+        T *values = reinterpret_cast<T *>(row);
+        const int64_t m = static_cast<int64_t>(maxValue);
+
+        int64_t g[TILE];
+        for (int k = 0; k < TILE; ++k)
+        {
+            g[k] = std::llrint(static_cast<double>(weights[(colOffset + k) % TILE]) * FIXED_ONE);
+        }
+
+        int j = 0;
+        for (; j + TILE <= count; j += TILE)
+        {
+            for (int k = 0; k < TILE; ++k)
+            {
+                values[j + k] = storeFixed<T>(static_cast<int64_t>(values[j + k]) * g[k], m);
+            }
+        }
+        for (int k = 0; j < count; ++j, ++k)
+        {
+            values[j] = storeFixed<T>(static_cast<int64_t>(values[j]) * g[k], m);
+        }
+    }
+
+    template <typename T>
+    void clipRow(uchar *row, int count, double maxValue)
+    {
+        if constexpr (std::is_integral<T>::value)
+        {
+            T *values = reinterpret_cast<T *>(row);
+            const T m = static_cast<T>(maxValue);
+            for (int j = 0; j < count; ++j)
+            {
+                values[j] = std::min(values[j], m);
+            }
+        }
+        else
+        {
+            (void)row;
+            (void)count;
+            (void)maxValue;
+        }
+    }
+
+    // Instantiates every floating-point kernel for one storage type and arithmetic type
+    template <typename T, typename W>
+    SensorKernels::Table makeTable(int depth)
+    {
+        SensorKernels::Table table;
+        table.depth = depth;
+        table.quantizeF32 = &quantizeRow<float, T, W>;
+        table.quantizeF64 = &quantizeRow<double, T, W>;
+        table.addNoise = &addNoiseRow<T, W>;
+        table.applyCFA[2] = &applyCFARow<T, 2, W>;
+        table.applyCFA[3] = &applyCFARow<T, 3, W>;
+        table.applyCFA[4] = &applyCFARow<T, 4, W>;
+        table.applyCFA[5] = &applyCFARow<T, 5, W>;
+        table.applyCFA[6] = &applyCFARow<T, 6, W>;
+        table.clip = &clipRow<T>;
+        return table;
+    }
+
+    // Instantiates the fixed-point kernels for one integer storage type; the ADC rounds in the input's own type
+    template <typename T>
+    SensorKernels::Table makeFixedTable(int depth)
+    {
+        SensorKernels::Table table;
+        table.depth = depth;
+        table.precision = SensorKernels::FIXED_POINT;
+        table.quantizeF32 = &quantizeRow<float, T, float>;
+        table.quantizeF64 = &quantizeRow<double, T, double>;
+        table.addNoise = &addNoiseRowFixed<T>;
+        table.applyCFA[2] = &applyCFARowFixed<T, 2>;
+        table.applyCFA[3] = &applyCFARowFixed<T, 3>;
+        table.applyCFA[4] = &applyCFARowFixed<T, 4>;
+        table.applyCFA[5] = &applyCFARowFixed<T, 5>;
+        table.applyCFA[6] = &applyCFARowFixed<T, 6>;
+        table.clip = &clipRow<T>;
+        return table;
+    }
+
+    // Instantiates the kernels of one storage type for a precision
+    template <typename T>
+    SensorKernels::Table makePrecisionTable(int depth, SensorKernels::Precision precision)
+    {
+        SensorKernels::Table table;
+        switch (precision)
+        {
+        case SensorKernels::FLOAT64:
+            table = makeTable<T, double>(depth);
+            break;
+        case SensorKernels::FIXED_POINT:
+            if constexpr (std::is_integral<T>::value)
+            {
+                table = makeFixedTable<T>(depth);
+            }
+            else
+            {
+                throw std::invalid_argument("Fixed-point precision needs an integer bit depth");
+            }
+            break;
+        default:
+            table = makeTable<T, Work<T>>(depth);
+            break;
+        }
+        table.precision = precision;
+        return table;
+    }
+}
+
+SensorKernels::Table SensorKernels::forBitDepth(int bitDepth, Precision precision)
+{
+    static_assert(CFAPattern::MIN_TILE_SIZE == 2 && CFAPattern::MAX_TILE_SIZE == 6, "CFA kernels are instantiated for tile widths 2 to 6");
+
+    Table table;
+    switch (CV_MAT_DEPTH(ImageSensor::cvTypeForBitDepth(bitDepth))) // Throws for unsupported bit depths
+    {
+    case CV_8U:
+        table = makePrecisionTable<uchar>(CV_8U, precision);
+        break;
+    case CV_16U:
+        table = makePrecisionTable<ushort>(CV_16U, precision);
+        break;
+    case CV_32F:
+        table = makePrecisionTable<float>(CV_32F, precision);
+        break;
+    default:
+        table = makePrecisionTable<double>(CV_64F, precision);
+        break;
+    }
+    table.maxValue = ImageSensor::fullScaleForBitDepth(bitDepth);
+    return table;
+}
+
+SensorKernels::Precision SensorKernels::parsePrecision(const std::string &name)
+{
+    if (name == "float64")
+    {
+        return FLOAT64;
+    }
+    if (name == "float32")
+    {
+        return FLOAT32;
+    }
+    if (name == "fixed")
+    {
+        return FIXED_POINT;
+    }
+    throw std::invalid_argument("Unknown precision: " + name);
+}
+
+std::string SensorKernels::precisionName(Precision precision)
+{
+    switch (precision)
+    {
+    case FLOAT64:
+        return "float64";
+    case FIXED_POINT:
+        return "fixed";
+    default:
+        return "float32";
+    }
+}
+
+int SensorKernels::workingDepth(Precision precision)
+{
+    return (precision == FLOAT64) ? CV_64F : CV_32F;
+}
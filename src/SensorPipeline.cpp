@@ -0,0 +1,277 @@
+#include "SensorPipeline/SensorPipeline.h"
+#include "Telemetry/Telemetry.h"
+#include <stdexcept>
+
+SensorPipeline::SensorPipeline()
+    : tileRows(DEFAULT_TILE_ROWS), noiseGenerator(DEFAULT_SEED)
+{
+}
+
+SensorPipeline &SensorPipeline::addDiffraction(const cv::Mat &psf, PSFConvolver::Method method)
+{
+    auto convolver = std::make_shared<PSFConvolver>();
+    convolver->setPSF(psf, method);
+    return addDiffraction(std::shared_ptr<const PSFConvolver>(std::move(convolver)));
+}
+
+SensorPipeline &SensorPipeline::addDiffraction(std::shared_ptr<const PSFConvolver> convolver)
+{
+    if (!convolver || convolver->getPSF().empty())
+    {
+        throw std::invalid_argument("Diffraction needs a convolver with a PSF");
+    }
+    // Diffraction looks at neighbouring rows, which are only available untouched in the
+    // captured light, so it must come first
+    if (!stages.empty())
+    {
+        throw std::logic_error("Diffraction must be the first stage of a fused pipeline");
+    }
+    Stage stage;
+    stage.type = StageType::DIFFRACTION;
+    stage.fingerprint = StageCache::Fingerprint().add(convolver->getPSF()).add(static_cast<uint64_t>(convolver->getMethod())).get();
+    stage.convolver = std::move(convolver);
+    stages.push_back(stage);
+    return *this;
+}
+
+SensorPipeline &SensorPipeline::addNoise(double noiseLevel)
+{
+    Stage stage;
+    stage.type = StageType::NOISE;
+    stage.noiseLevel = noiseLevel;
+    stages.push_back(stage);
+    return *this;
+}
+
+SensorPipeline &SensorPipeline::addNoiseModel(std::shared_ptr<const NoiseModel> noiseModel)
+{
+    if (!noiseModel)
+    {
+        throw std::invalid_argument("Noise model must not be null");
+    }
+
+    Stage stage;
+    stage.type = StageType::NOISE_MODEL;
+    stage.noiseModel = std::move(noiseModel);
+    stages.push_back(stage);
+    return *this;
+}
+
+SensorPipeline &SensorPipeline::addCFA(const CFAPattern &cfaPattern)
+{
+    return addCFA(std::make_shared<const CFAPattern>(cfaPattern));
+}
+
+SensorPipeline &SensorPipeline::addCFA(std::shared_ptr<const CFAPattern> cfaPattern)
+{
+    if (!cfaPattern)
+    {
+        throw std::invalid_argument("CFA pattern must not be null");
+    }
+
+    Stage stage;
+    stage.type = StageType::CFA;
+    stage.cfa = std::move(cfaPattern);
+    stages.push_back(stage);
+    return *this;
+}
+
+void SensorPipeline::setTileRows(int rows)
+{
+    if (rows <= 0)
+    {
+        throw std::invalid_argument("Tile rows must be positive");
+    }
+    tileRows = rows;
+}
+
+int SensorPipeline::getTileRows() const
+{
+    return tileRows;
+}
+
+void SensorPipeline::setStageCache(std::shared_ptr<StageCache> cache)
+{
+    stageCache = std::move(cache);
+}
+
+const std::shared_ptr<StageCache> &SensorPipeline::getStageCache() const
+{
+    return stageCache;
+}
+
+void SensorPipeline::setSeed(uint64_t seed)
+{
+    noiseGenerator.setSeed(seed);
+}
+
+uint64_t SensorPipeline::getSeed() const
+{
+    return noiseGenerator.getSeed();
+}
+
+bool SensorPipeline::empty() const
+{
+    return stages.empty();
+}
+
+void SensorPipeline::captureFrame(const cv::Mat &scene, double fullScale, cv::Mat &signal, int depth) const
+{
+    if (!stageCache)
+    {
+        scene.convertTo(signal, CV_MAKETYPE(depth, 1), fullScale);
+        processFrame(signal);
+        return;
+    }
+
+    // Keys chain from stage to stage: each one covers the scene and every stage before it
+    TELEMETRY_SCOPE("SensorPipeline::captureFrame");
+    const bool diffraction = !stages.empty() && stages.front().type == StageType::DIFFRACTION;
+    const StageCache::Key captureKey = StageCache::Fingerprint().add(scene).add(fullScale).add(static_cast<uint64_t>(depth)).get();
+    const StageCache::Key diffractionKey = diffraction ? StageCache::Fingerprint(captureKey).add(stages.front().fingerprint).get() : 0;
+    if (diffraction && stageCache->find(diffractionKey, signal))
+    {
+        return;
+    }
+
+    // Fresh buffers: whatever is inserted belongs to the cache from then on
+    cv::Mat light;
+    if (!stageCache->find(captureKey, light))
+    {
+        scene.convertTo(light, CV_MAKETYPE(depth, 1), fullScale);
+        stageCache->insert(captureKey, light);
+    }
+    if (!diffraction)
+    {
+        signal = light;
+        return;
+    }
+
+    cv::Mat blurred;
+    stages.front().convolver->apply(light, blurred, depth);
+    stageCache->insert(diffractionKey, blurred);
+    signal = blurred;
+}
+
+void SensorPipeline::processFrame(cv::Mat &signal) const
+{
+    // FFT diffraction, and diffraction whose output is cached, work on whole frames; everything else runs per tile
+    if (diffractsWholeFrame())
+    {
+        cv::Mat blurred;
+        stages.front().convolver->apply(signal, blurred, signal.depth());
+        signal = blurred;
+    }
+}
+
+void SensorPipeline::processTile(const cv::Mat &signal, cv::Mat &tile, int rowStart, int rowEnd, uint64_t frameIndex, double fullScale, const SensorKernels::Table *fixedPoint) const
+{
+    // A row range of the full frame lets filter2D read the real neighbouring rows as halo
+    cv::Mat source = signal.rowRange(rowStart, rowEnd);
+
+    // Fixed-point runs keep the optics in float and convert to codes right after them
+    thread_local cv::Mat optics;
+    cv::Mat &light = fixedPoint ? optics : tile;
+
+    size_t first = 0;
+    if (!stages.empty() && stages.front().type == StageType::DIFFRACTION)
+    {
+        if (!diffractsWholeFrame())
+        {
+            stages.front().convolver->apply(source, light, signal.depth());
+        }
+        else
+        {
+            source.copyTo(light); // Already convolved by processFrame
+        }
+        first = 1;
+    }
+    else
+    {
+        source.copyTo(light);
+    }
+
+    if (fixedPoint)
+    {
+        // The ADC: every later stage works on integer codes
+        tile.create(light.size(), CV_MAKETYPE(fixedPoint->depth, 1));
+        for (int i = 0; i < light.rows; ++i)
+        {
+            if (light.depth() == CV_32F)
+            {
+                fixedPoint->quantizeF32(light.ptr<float>(i), tile.ptr(i), light.cols, 1.0, fixedPoint->maxValue);
+            }
+            else
+            {
+                fixedPoint->quantizeF64(light.ptr<double>(i), tile.ptr(i), light.cols, 1.0, fixedPoint->maxValue);
+            }
+        }
+        processCodes(tile, rowStart, frameIndex, fullScale, *fixedPoint);
+        return;
+    }
+
+    for (size_t s = first; s < stages.size(); ++s)
+    {
+        const Stage &stage = stages[s];
+        switch (stage.type)
+        {
+        case StageType::NOISE:
+            // Counter-based noise depends only on the pixel position, not on the tiling
+            noiseGenerator.addGaussian(tile, stage.noiseLevel, frameIndex, rowStart);
+            break;
+        case StageType::NOISE_MODEL:
+            stage.noiseModel->apply(tile, fullScale, frameIndex, rowStart);
+            break;
+        case StageType::CFA:
+            stage.cfa->apply(tile, rowStart);
+            break;
+        case StageType::DIFFRACTION:
+            // Rejected by addDiffraction
+            break;
+        }
+    }
+}
+
+bool SensorPipeline::diffractsWholeFrame() const
+{
+    return !stages.empty() && stages.front().type == StageType::DIFFRACTION &&
+           (stages.front().convolver->getMethod() == PSFConvolver::FFT || stageCache);
+}
+
+void SensorPipeline::processCodes(cv::Mat &tile, int rowStart, uint64_t frameIndex, double fullScale, const SensorKernels::Table &kernels) const
+{
+    thread_local std::vector<float> noise;
+    noise.resize(tile.cols);
+
+    for (const Stage &stage : stages)
+    {
+        switch (stage.type)
+        {
+        case StageType::NOISE:
+            for (int i = 0; i < tile.rows; ++i)
+            {
+                noiseGenerator.gaussianRow(frameIndex, rowStart + i, 0, tile.cols, noise.data());
+                kernels.addNoise(tile.ptr(i), noise.data(), tile.cols, stage.noiseLevel, kernels.maxValue);
+            }
+            break;
+        case StageType::NOISE_MODEL:
+            // The electron-domain model has no integer form; it reads and writes codes
+            stage.noiseModel->apply(tile, fullScale, frameIndex, rowStart);
+            break;
+        case StageType::CFA:
+        {
+            const int cfaRows = stage.cfa->getTileRows();
+            const int cfaCols = stage.cfa->getTileCols();
+            const float *weights = stage.cfa->getWeightTable();
+            for (int i = 0; i < tile.rows; ++i)
+            {
+                kernels.applyCFA[cfaCols](tile.ptr(i), weights + ((rowStart + i) % cfaRows) * cfaCols, 0, tile.cols, kernels.maxValue);
+            }
+            break;
+        }
+        case StageType::DIFFRACTION:
+            // Already applied to the light
+            break;
+        }
+    }
+}
@@ -0,0 +1,156 @@
+#include "SpectralScene/SpectralScene.h"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace
+{
+    // Smooth basis spectra used to spread BGR reflectance over the bands (center, width in nm)
+    constexpr double BASIS_CENTERS[3] = {450.0, 540.0, 610.0};
+    constexpr double BASIS_WIDTHS[3] = {35.0, 40.0, 45.0};
+
+    double gaussian(double x, double center, double width)
+    {
+        double d = (x - center) / width;
+        return std::exp(-0.5 * d * d);
+    }
+}
+
+SpectralScene::SpectralScene(const cv::Mat &reflectance, const std::vector<double> &wavelengths, const std::vector<double> &illuminant)
+    : wavelengths(wavelengths)
+{
+    if (reflectance.channels() != 1 && reflectance.channels() != 3)
+    {
+        throw std::invalid_argument("Reflectance must have 1 or 3 channels");
+    }
+    if (wavelengths.empty() || illuminant.size() != wavelengths.size())
+    {
+        throw std::invalid_argument("Illuminant must have one value per band");
+    }
+
+    reflectance.convertTo(this->reflectance, CV_MAKETYPE(CV_32F, reflectance.channels()));
+
+    // Fold the illuminant and the basis spectra into one weight per band and channel
+    bandMixes.resize(wavelengths.size());
+    for (size_t b = 0; b < wavelengths.size(); ++b)
+    {
+        if (reflectance.channels() == 1)
+        {
+            bandMixes[b] = cv::Vec3f(static_cast<float>(illuminant[b]), 0.0f, 0.0f);
+            continue;
+        }
+
+        double basis[3], total = 0.0;
+        for (int c = 0; c < 3; ++c)
+        {
+            basis[c] = gaussian(wavelengths[b], BASIS_CENTERS[c], BASIS_WIDTHS[c]);
+            total += basis[c];
+        }
+        for (int c = 0; c < 3; ++c)
+        {
+            bandMixes[b][c] = static_cast<float>(illuminant[b] * basis[c] / std::max(total, 1e-12));
+        }
+    }
+}
+
+SpectralScene::SpectralScene(const std::vector<cv::Mat> &bands, const std::vector<double> &wavelengths)
+    : wavelengths(wavelengths), bands(bands)
+{
+    if (bands.empty() || bands.size() != wavelengths.size())
+    {
+        throw std::invalid_argument("There must be one wavelength per band");
+    }
+    for (const auto &band : bands)
+    {
+        if (band.channels() != 1 || band.size() != bands.front().size())
+        {
+            throw std::invalid_argument("Bands must be single channel images of the same size");
+        }
+    }
+}
+
+int SpectralScene::getNumBands() const
+{
+    return static_cast<int>(wavelengths.size());
+}
+
+const std::vector<double> &SpectralScene::getWavelengths() const
+{
+    return wavelengths;
+}
+
+cv::Size SpectralScene::getSize() const
+{
+    return bands.empty() ? reflectance.size() : bands.front().size();
+}
+
+void SpectralScene::renderBand(int band, cv::Mat &output) const
+{
+    if (band < 0 || band >= getNumBands())
+    {
+        throw std::out_of_range("Band index out of range");
+    }
+
+    if (!bands.empty())
+    {
+        bands[band].convertTo(output, CV_32FC1);
+        return;
+    }
+
+    const cv::Vec3f &mix = bandMixes[band];
+    if (reflectance.channels() == 1)
+    {
+        reflectance.convertTo(output, CV_32FC1, mix[0]);
+        return;
+    }
+
+    output.create(reflectance.size(), CV_32FC1);
+    for (int i = 0; i < reflectance.rows; ++i)
+    {
+        const float *src = reflectance.ptr<float>(i);
+        float *dst = output.ptr<float>(i);
+        for (int j = 0; j < reflectance.cols; ++j)
+        {
+            dst[j] = mix[0] * src[3 * j] + mix[1] * src[3 * j + 1] + mix[2] * src[3 * j + 2];
+        }
+    }
+}
+
+std::vector<double> SpectralScene::sampleWavelengths(double first, double last, int count)
+{
+    if (count <= 0)
+    {
+        throw std::invalid_argument("Number of bands must be positive");
+    }
+
+    std::vector<double> wavelengths(count);
+    for (int b = 0; b < count; ++b)
+    {
+        wavelengths[b] = (count == 1) ? 0.5 * (first + last) : first + (last - first) * b / (count - 1);
+    }
+    return wavelengths;
+}
+
+std::vector<double> SpectralScene::equalEnergyIlluminant(const std::vector<double> &wavelengths)
+{
+    return std::vector<double>(wavelengths.size(), 1.0);
+}
+
+std::vector<double> SpectralScene::blackbodyIlluminant(const std::vector<double> &wavelengths, double temperature)
+{
+    // Planck's law up to a constant factor
+    constexpr double SECOND_RADIATION_CONSTANT = 1.4387769e7; // hc/k in nm K
+    std::vector<double> spectrum(wavelengths.size());
+    double peak = 0.0;
+    for (size_t b = 0; b < wavelengths.size(); ++b)
+    {
+        double lambda = wavelengths[b];
+        spectrum[b] = 1.0 / (std::pow(lambda, 5.0) * (std::exp(SECOND_RADIATION_CONSTANT / (lambda * temperature)) - 1.0));
+        peak = std::max(peak, spectrum[b]);
+    }
+    for (auto &value : spectrum)
+    {
+        value /= peak;
+    }
+    return spectrum;
+}
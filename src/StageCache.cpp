@@ -0,0 +1,306 @@
+#include "StageCache/StageCache.h"
+#include "Telemetry/Telemetry.h"
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+namespace
+{
+    // Multiplier of the word hash (the 64-bit golden ratio)
+    constexpr uint64_t HASH_MULTIPLIER = 0x9E3779B97F4A7C15ull;
+
+    // Finalizer of MurmurHash3: every input bit affects every output bit
+    inline uint64_t mix(uint64_t h)
+    {
+        h ^= h >> 33;
+        h *= 0xFF51AFD7ED558CCDull;
+        h ^= h >> 33;
+        h *= 0xC4CEB9FE1A85EC53ull;
+        h ^= h >> 33;
+        return h;
+    }
+
+    // Hashes a byte range eight bytes at a time
+    uint64_t hashBytes(const uchar *data, size_t length, uint64_t hash)
+    {
+        size_t i = 0;
+        for (; i + sizeof(uint64_t) <= length; i += sizeof(uint64_t))
+        {
+            uint64_t word;
+            std::memcpy(&word, data + i, sizeof(word));
+            hash = (hash ^ word) * HASH_MULTIPLIER;
+            hash ^= hash >> 29;
+        }
+        uint64_t tail = 0;
+        std::memcpy(&tail, data + i, length - i);
+        return mix(hash ^ tail ^ (static_cast<uint64_t>(length) << 56));
+    }
+}
+
+StageCache::Fingerprint::Fingerprint(Key seed)
+    : hash(mix(seed ^ HASH_MULTIPLIER))
+{
+}
+
+StageCache::Fingerprint &StageCache::Fingerprint::add(const cv::Mat &mat)
+{
+    add(static_cast<uint64_t>(mat.type()));
+    add(static_cast<uint64_t>(mat.rows));
+    add(static_cast<uint64_t>(mat.cols));
+
+    // Rows hash independently, then fold in order
+    std::vector<uint64_t> rowHashes(mat.rows);
+    const size_t rowBytes = mat.cols * mat.elemSize();
+    cv::parallel_for_(cv::Range(0, mat.rows), [&](const cv::Range &range)
+    {
+        for (int i = range.start; i < range.end; ++i)
+        {
+            rowHashes[i] = hashBytes(mat.ptr(i), rowBytes, static_cast<uint64_t>(i));
+        }
+    });
+    for (uint64_t rowHash : rowHashes)
+    {
+        add(rowHash);
+    }
+    return *this;
+}
+
+StageCache::Fingerprint &StageCache::Fingerprint::add(uint64_t value)
+{
+    hash = mix((hash ^ value) * HASH_MULTIPLIER);
+    return *this;
+}
+
+StageCache::Fingerprint &StageCache::Fingerprint::add(double value)
+{
+    uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return add(bits);
+}
+
+StageCache::Fingerprint &StageCache::Fingerprint::add(const std::string &value)
+{
+    hash = hashBytes(reinterpret_cast<const uchar *>(value.data()), value.size(), hash);
+    return *this;
+}
+
+StageCache::Key StageCache::Fingerprint::get() const
+{
+    return hash;
+}
+
+StageCache::StageCache(size_t capacityBytes, const std::string &spillDir, size_t spillBytes)
+    : capacity(capacityBytes), spillDir(spillDir), spillCapacity(spillBytes)
+{
+    if (!spillDir.empty())
+    {
+        std::filesystem::create_directories(spillDir);
+    }
+}
+
+StageCache::~StageCache()
+{
+    clear();
+}
+
+bool StageCache::find(Key key, cv::Mat &value)
+{
+    TELEMETRY_SCOPE("StageCache::find");
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto entry = memory.find(key);
+        if (entry != memory.end())
+        {
+            memoryOrder.splice(memoryOrder.begin(), memoryOrder, entry->second.order);
+            value = entry->second.value;
+            ++stats.hits;
+            return true;
+        }
+
+        auto spilledEntry = spilled.find(key);
+        if (spilledEntry == spilled.end())
+        {
+            ++stats.misses;
+            return false;
+        }
+
+        // Claimed before reading, so that concurrent lookups do not read it twice
+        stats.spilledBytes -= spilledEntry->second.bytes;
+        spillOrder.erase(spilledEntry->second.order);
+        spilled.erase(spilledEntry);
+    }
+
+    // Read outside the lock; a file that cannot be read counts as a miss
+    const std::string path = spillPath(key);
+    cv::Mat loaded;
+    {
+        std::ifstream file(path, std::ios::binary);
+        int32_t header[3] = {0, 0, 0};
+        if (file.read(reinterpret_cast<char *>(header), sizeof(header)) && header[0] > 0 && header[1] > 0)
+        {
+            loaded.create(header[0], header[1], header[2]);
+            const std::streamsize rowBytes = static_cast<std::streamsize>(loaded.cols * loaded.elemSize());
+            for (int i = 0; i < loaded.rows && file; ++i)
+            {
+                file.read(reinterpret_cast<char *>(loaded.ptr(i)), rowBytes);
+            }
+            if (!file)
+            {
+                loaded.release();
+            }
+        }
+    }
+    std::error_code error;
+    std::filesystem::remove(path, error);
+
+    if (loaded.empty())
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        ++stats.misses;
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        ++stats.diskHits;
+    }
+    insert(key, loaded);
+    value = loaded;
+    return true;
+}
+
+void StageCache::insert(Key key, const cv::Mat &value)
+{
+    const size_t bytes = value.total() * value.elemSize();
+    if (value.empty() || bytes > capacity)
+    {
+        return;
+    }
+
+    std::vector<std::pair<Key, cv::Mat>> victims;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (memory.find(key) != memory.end())
+        {
+            return; // Computed concurrently by another job
+        }
+        memoryOrder.push_front(key);
+        memory[key] = Entry{value, memoryOrder.begin()};
+        stats.bytes += bytes;
+        victims = evict();
+    }
+    spill(victims);
+}
+
+StageCache::Stats StageCache::getStats() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
+
+void StageCache::clear()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const auto &entry : spilled)
+    {
+        std::error_code error;
+        std::filesystem::remove(spillPath(entry.first), error);
+    }
+    memory.clear();
+    memoryOrder.clear();
+    spilled.clear();
+    spillOrder.clear();
+    stats = Stats();
+}
+
+std::vector<std::pair<StageCache::Key, cv::Mat>> StageCache::evict()
+{
+    std::vector<std::pair<Key, cv::Mat>> victims;
+    while (stats.bytes > capacity && !memoryOrder.empty())
+    {
+        Key key = memoryOrder.back();
+        auto entry = memory.find(key);
+        stats.bytes -= entry->second.value.total() * entry->second.value.elemSize();
+        ++stats.evictions;
+        if (!spillDir.empty())
+        {
+            victims.emplace_back(key, entry->second.value);
+        }
+        memory.erase(entry);
+        memoryOrder.pop_back();
+    }
+    return victims;
+}
+
+void StageCache::spill(const std::vector<std::pair<Key, cv::Mat>> &victims)
+{
+    for (const auto &victim : victims)
+    {
+        const cv::Mat &value = victim.second;
+        const size_t bytes = value.total() * value.elemSize();
+        if (bytes > spillCapacity)
+        {
+            continue;
+        }
+
+        const std::string path = spillPath(victim.first);
+        bool written = false;
+        {
+            std::ofstream file(path, std::ios::binary | std::ios::trunc);
+            const int32_t header[3] = {value.rows, value.cols, value.type()};
+            file.write(reinterpret_cast<const char *>(header), sizeof(header));
+            const std::streamsize rowBytes = static_cast<std::streamsize>(value.cols * value.elemSize());
+            for (int i = 0; i < value.rows && file; ++i)
+            {
+                file.write(reinterpret_cast<const char *>(value.ptr(i)), rowBytes);
+            }
+            file.close(); // Flushes, so a full disk shows up here rather than at the next lookup
+            written = static_cast<bool>(file);
+        }
+        std::error_code error;
+        if (written && std::filesystem::file_size(path, error) != sizeof(int32_t) * 3 + bytes)
+        {
+            written = false;
+        }
+        if (!written)
+        {
+            std::filesystem::remove(path, error);
+            std::lock_guard<std::mutex> lock(mutex);
+            ++stats.spillFailures;
+            continue;
+        }
+
+        std::vector<Key> dropped;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (spilled.find(victim.first) == spilled.end())
+            {
+                spillOrder.push_front(victim.first);
+                spilled[victim.first] = SpilledEntry{bytes, spillOrder.begin()};
+                stats.spilledBytes += bytes;
+            }
+            while (stats.spilledBytes > spillCapacity && !spillOrder.empty())
+            {
+                Key oldest = spillOrder.back();
+                stats.spilledBytes -= spilled[oldest].bytes;
+                spilled.erase(oldest);
+                spillOrder.pop_back();
+                dropped.push_back(oldest);
+            }
+        }
+        for (Key key : dropped)
+        {
+            std::error_code error;
+            std::filesystem::remove(spillPath(key), error);
+        }
+    }
+}
+
+std::string StageCache::spillPath(Key key) const
+{
+    std::ostringstream name;
+    name << std::hex << std::setw(16) << std::setfill('0') << key << ".stage";
+    return (std::filesystem::path(spillDir) / name.str()).string();
+}
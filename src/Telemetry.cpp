@@ -0,0 +1,268 @@
+#include "Telemetry/Telemetry.h"
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+
+namespace
+{
+    // Allocations of the current thread, sampled by the scopes running on it
+    thread_local uint64_t threadBytes = 0;
+    thread_local uint64_t threadMats = 0;
+
+    // Allocations of every thread, unless paused
+    std::atomic<uint64_t> totalBytes{0};
+    std::atomic<uint64_t> totalMats{0};
+    std::atomic<bool> totalsPaused{false};
+
+    // Small stable thread ids for the trace
+    std::atomic<int> nextThreadId{0};
+    thread_local int threadId = nextThreadId++;
+
+    // Counts cv::Mat allocations per thread; the allocator it wraps (standard or pooled) does the work and frees them
+    class CountingAllocator : public cv::MatAllocator
+    {
+    public:
+        cv::MatAllocator *base = cv::Mat::getStdAllocator();
+
+        cv::UMatData *allocate(int dims, const int *sizes, int type, void *data, size_t *step, cv::AccessFlag flags, cv::UMatUsageFlags usageFlags) const override
+        {
+            cv::UMatData *u = base->allocate(dims, sizes, type, data, step, flags, usageFlags);
+            if (u != nullptr && data == nullptr)
+            {
+                threadBytes += u->size;
+                ++threadMats;
+                if (!totalsPaused.load(std::memory_order_relaxed))
+                {
+                    totalBytes.fetch_add(u->size, std::memory_order_relaxed);
+                    totalMats.fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+            return u;
+        }
+
+        bool allocate(cv::UMatData *data, cv::AccessFlag accessFlags, cv::UMatUsageFlags usageFlags) const override
+        {
+            return base->allocate(data, accessFlags, usageFlags);
+        }
+
+        void deallocate(cv::UMatData *data) const override
+        {
+            base->deallocate(data);
+        }
+    };
+
+    // Never destroyed: buffers may be released during static destruction
+    CountingAllocator *countingAllocator = new CountingAllocator();
+    cv::MatAllocator *previousAllocator = nullptr;
+    bool allocationCounting = false;   // Counting requested without stage recording
+    bool allocatorInstalled = false;
+
+    struct TraceEvent
+    {
+        const char *name;
+        double startUs;
+        double durationUs;
+        int thread;
+    };
+
+    // Shared state, guarded by mutex
+    std::mutex mutex;
+    std::map<std::string, Telemetry::StageStats> stages;
+    std::vector<TraceEvent> traceEvents;
+    bool tracing = false;
+    const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+
+    // Escapes a stage name for a JSON string
+    std::string jsonEscape(const std::string &text)
+    {
+        std::string escaped;
+        for (char c : text)
+        {
+            if (c == '"' || c == '\\')
+            {
+                escaped += '\\';
+            }
+            escaped += c;
+        }
+        return escaped;
+    }
+}
+
+void Telemetry::ScopedTimer::begin()
+{
+    startBytes = threadBytes;
+    startMats = threadMats;
+    start = std::chrono::steady_clock::now();
+}
+
+void Telemetry::ScopedTimer::end()
+{
+    auto finish = std::chrono::steady_clock::now();
+    record(name, start, finish, threadBytes - startBytes, threadMats - startMats);
+}
+
+void Telemetry::setEnabled(bool on)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (on == enabled.load())
+    {
+        return;
+    }
+    enabled = on;
+    updateAllocator();
+}
+
+bool Telemetry::isEnabled()
+{
+    return enabled.load(std::memory_order_relaxed);
+}
+
+void Telemetry::setAllocationCounting(bool on)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    allocationCounting = on;
+    updateAllocator();
+}
+
+void Telemetry::pauseAllocationCounting(bool paused)
+{
+    totalsPaused = paused;
+}
+
+Telemetry::AllocationTotals Telemetry::getAllocationTotals()
+{
+    AllocationTotals totals;
+    totals.bytes = totalBytes.load();
+    totals.mats = totalMats.load();
+    return totals;
+}
+
+void Telemetry::resetAllocationTotals()
+{
+    totalBytes = 0;
+    totalMats = 0;
+}
+
+void Telemetry::updateAllocator()
+{
+    const bool wanted = enabled.load() || allocationCounting;
+    if (wanted && !allocatorInstalled)
+    {
+        previousAllocator = cv::Mat::getDefaultAllocator();
+        countingAllocator->base = previousAllocator;
+        cv::Mat::setDefaultAllocator(countingAllocator);
+    }
+    else if (!wanted && allocatorInstalled)
+    {
+        cv::Mat::setDefaultAllocator(previousAllocator);
+    }
+    allocatorInstalled = wanted;
+}
+
+void Telemetry::startTrace()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    traceEvents.clear();
+    tracing = true;
+}
+
+void Telemetry::writeTrace(const std::string &path)
+{
+    std::vector<TraceEvent> events;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        events = traceEvents;
+    }
+
+    std::ofstream file(path);
+    if (!file)
+    {
+        throw std::runtime_error("Cannot write trace file: " + path);
+    }
+
+    // Complete ("X") events with microsecond timestamps
+    file << "{\"traceEvents\":[";
+    file << std::fixed << std::setprecision(3);
+    for (size_t i = 0; i < events.size(); ++i)
+    {
+        const TraceEvent &event = events[i];
+        file << (i == 0 ? "\n" : ",\n")
+             << "{\"name\":\"" << jsonEscape(event.name) << "\",\"cat\":\"stage\",\"ph\":\"X\",\"pid\":1,\"tid\":" << event.thread
+             << ",\"ts\":" << event.startUs << ",\"dur\":" << event.durationUs << "}";
+    }
+    file << "\n],\"displayTimeUnit\":\"ms\"}\n";
+}
+
+std::vector<Telemetry::StageStats> Telemetry::getStageStats()
+{
+    std::vector<StageStats> result;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const auto &entry : stages)
+        {
+            result.push_back(entry.second);
+        }
+    }
+    std::sort(result.begin(), result.end(), [](const StageStats &a, const StageStats &b) { return a.totalMs > b.totalMs; });
+    return result;
+}
+
+void Telemetry::printReport(std::ostream &out)
+{
+    std::vector<StageStats> stats = getStageStats();
+    if (stats.empty())
+    {
+        out << "No telemetry recorded" << std::endl;
+        return;
+    }
+
+    // Nested stages are counted in their parents too, so the total column is not additive
+    out << std::left << std::setw(28) << "Stage" << std::right
+        << std::setw(8) << "Calls" << std::setw(12) << "Total ms" << std::setw(10) << "Mean ms"
+        << std::setw(10) << "Min ms" << std::setw(10) << "Max ms" << std::setw(12) << "MB alloc" << std::setw(10) << "Mats" << std::endl;
+    out << std::fixed << std::setprecision(3);
+    for (const auto &stage : stats)
+    {
+        out << std::left << std::setw(28) << stage.name << std::right
+            << std::setw(8) << stage.calls << std::setw(12) << stage.totalMs << std::setw(10) << stage.totalMs / stage.calls
+            << std::setw(10) << stage.minMs << std::setw(10) << stage.maxMs
+            << std::setw(12) << stage.bytesAllocated / (1024.0 * 1024.0) << std::setw(10) << stage.matsCreated << std::endl;
+    }
+    out.unsetf(std::ios::floatfield);
+}
+
+void Telemetry::reset()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    stages.clear();
+    traceEvents.clear();
+}
+
+void Telemetry::record(const char *name, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point finish, uint64_t bytes, uint64_t mats)
+{
+    const double ms = std::chrono::duration<double, std::milli>(finish - start).count();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    StageStats &stage = stages[name];
+    if (stage.calls == 0)
+    {
+        stage.name = name;
+        stage.minMs = ms;
+        stage.maxMs = ms;
+    }
+    ++stage.calls;
+    stage.totalMs += ms;
+    stage.minMs = std::min(stage.minMs, ms);
+    stage.maxMs = std::max(stage.maxMs, ms);
+    stage.bytesAllocated += bytes;
+    stage.matsCreated += mats;
+
+    if (tracing)
+    {
+        double startUs = std::chrono::duration<double, std::micro>(start - epoch).count();
+        traceEvents.push_back({name, startUs, ms * 1000.0, threadId});
+    }
+}
@@ -0,0 +1,171 @@
+#include "ThreadPool/ThreadPool.h"
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+
+namespace
+{
+    // Pool and index of the worker running on this thread, for local submissions
+    thread_local const ThreadPool *currentPool = nullptr;
+    thread_local size_t currentWorker = 0;
+}
+
+ThreadPool::ThreadPool(int numThreads)
+{
+    if (numThreads <= 0)
+    {
+        numThreads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    }
+
+    for (int i = 0; i < numThreads; ++i)
+    {
+        queues.push_back(std::make_unique<WorkQueue>());
+    }
+    for (int i = 0; i < numThreads; ++i)
+    {
+        workers.emplace_back(&ThreadPool::workerLoop, this, static_cast<size_t>(i));
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(stateMutex);
+        stopping = true;
+    }
+    taskAvailable.notify_all();
+    for (auto &worker : workers)
+    {
+        worker.join();
+    }
+}
+
+void ThreadPool::submit(Task task)
+{
+    // Counted and queued under one lock: a worker that pops the task cannot decrement
+    // queued or pending before they were incremented
+    std::lock_guard<std::mutex> lock(stateMutex);
+    size_t index;
+    if (currentPool == this)
+    {
+        index = currentWorker; // Keep follow-up work local, others steal it if idle
+    }
+    else
+    {
+        index = nextQueue++ % queues.size();
+    }
+
+    {
+        std::lock_guard<std::mutex> queueLock(queues[index]->mutex);
+        queues[index]->tasks.push_back(std::move(task));
+    }
+    ++queued;
+    ++pending;
+    taskAvailable.notify_one();
+}
+
+void ThreadPool::wait()
+{
+    std::unique_lock<std::mutex> lock(stateMutex);
+    allDone.wait(lock, [this]
+    {
+        return pending == 0;
+    });
+
+    if (firstError)
+    {
+        std::exception_ptr error = firstError;
+        firstError = nullptr;
+        std::rethrow_exception(error);
+    }
+}
+
+int ThreadPool::getNumThreads() const
+{
+    return static_cast<int>(workers.size());
+}
+
+bool ThreadPool::popTask(size_t index, Task &task)
+{
+    // Own deque from the back (most recent, still warm in cache), others from the front
+    bool found = false;
+    for (size_t k = 0; k < queues.size() && !found; ++k)
+    {
+        WorkQueue &queue = *queues[(index + k) % queues.size()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.tasks.empty())
+        {
+            if (k == 0)
+            {
+                task = std::move(queue.tasks.back());
+                queue.tasks.pop_back();
+            }
+            else
+            {
+                task = std::move(queue.tasks.front());
+                queue.tasks.pop_front();
+            }
+            found = true;
+        }
+    }
+
+    if (found)
+    {
+        std::lock_guard<std::mutex> lock(stateMutex);
+        --queued;
+    }
+    return found;
+}
+
+void ThreadPool::workerLoop(size_t index)
+{
+    currentPool = this;
+    currentWorker = index;
+
+    while (true)
+    {
+        Task task;
+        if (popTask(index, task))
+        {
+            try
+            {
+                task();
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock(stateMutex);
+                if (!firstError)
+                {
+                    firstError = std::current_exception();
+                }
+            }
+
+            std::lock_guard<std::mutex> lock(stateMutex);
+            if (--pending == 0)
+            {
+                allDone.notify_all();
+            }
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(stateMutex);
+        taskAvailable.wait(lock, [this]
+        {
+            return stopping || queued > 0;
+        });
+        if (stopping && queued == 0)
+        {
+            return;
+        }
+    }
+}
+
+ThreadPool::OpenCVThreadsGuard::OpenCVThreadsGuard()
+    : previous(cv::getNumThreads())
+{
+    cv::setNumThreads(1);
+}
+
+ThreadPool::OpenCVThreadsGuard::~OpenCVThreadsGuard()
+{
+    cv::setNumThreads(previous);
+}
@@ -0,0 +1,209 @@
+#include "TiledSimulator/TiledSimulator.h"
+#include "Telemetry/Telemetry.h"
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <stdexcept>
+
+namespace
+{
+    // Rounds up to a multiple of step
+    int roundUp(int value, int step)
+    {
+        return (value + step - 1) / step * step;
+    }
+}
+
+TiledSimulator::TiledSimulator(const CFAPattern &cfaPattern)
+    : TiledSimulator(cfaPattern, Config())
+{
+}
+
+TiledSimulator::TiledSimulator(const CFAPattern &cfaPattern, const Config &config)
+    : cfaPattern(cfaPattern), config(config), kernels(SensorKernels::forBitDepth(config.bitDepth)), noiseGenerator(config.seed)
+{
+    if (config.tileRows <= 0 || config.tileRows % cfaPattern.getTileRows() != 0)
+    {
+        throw std::invalid_argument("Tile rows must be a positive multiple of the CFA tile rows");
+    }
+    if (config.tileCols < 0 || config.tileCols % cfaPattern.getTileCols() != 0)
+    {
+        throw std::invalid_argument("Tile columns must be a multiple of the CFA tile columns");
+    }
+
+    // Resolved once here rather than warned about by every tile
+    if (config.demosaic && !Demosaic::supports(cfaPattern, config.algorithm))
+    {
+        std::cerr << "Warning: Demosaicing algorithm requires a 2x2 Bayer-like CFA pattern. Defaulting to bilinear." << std::endl;
+        this->config.algorithm = Demosaic::BILINEAR;
+    }
+}
+
+void TiledSimulator::setPSF(const cv::Mat &psf)
+{
+    if (psf.empty())
+    {
+        convolver.reset();
+        return;
+    }
+    auto prepared = std::make_shared<PSFConvolver>();
+    prepared->setPSF(psf);
+    convolver = prepared;
+}
+
+void TiledSimulator::setNoiseModel(const NoiseModel::Parameters &params)
+{
+    noiseParams = params;
+    physicalNoise = true;
+}
+
+cv::Size TiledSimulator::getHaloSize() const
+{
+    // Demosaicing reads blurred, noisy pixels, so the two footprints add up; whole CFA
+    // tiles keep every tile on the same CFA phase as the frame
+    const int demosaicHalo = config.demosaic ? Demosaic::getHaloSize(cfaPattern, config.algorithm) : 0;
+    const cv::Mat psf = convolver ? convolver->getPSF() : cv::Mat();
+    const int haloRows = (psf.empty() ? 0 : psf.rows / 2) + demosaicHalo;
+    const int haloCols = (psf.empty() ? 0 : psf.cols / 2) + demosaicHalo;
+    return cv::Size(roundUp(haloCols, cfaPattern.getTileCols()), roundUp(haloRows, cfaPattern.getTileRows()));
+}
+
+void TiledSimulator::run(cv::Size frameSize, const SceneSource &source, const BandSink &sink)
+{
+    TELEMETRY_SCOPE("TiledSimulator::run");
+    if (frameSize.width <= 0 || frameSize.height <= 0)
+    {
+        throw std::invalid_argument("Frame size must be positive");
+    }
+
+    const cv::Size halo = getHaloSize();
+    const int tileCols = (config.tileCols > 0) ? config.tileCols : frameSize.width;
+    const int numBands = (frameSize.height + config.tileRows - 1) / config.tileRows;
+    const int tilesPerBand = (frameSize.width + tileCols - 1) / tileCols;
+    const int bandsInFlight = std::min((config.bandsInFlight > 0) ? config.bandsInFlight : std::max(cv::getNumThreads(), 1), numBands);
+    const int cvType = ImageSensor::cvTypeForBitDepth(config.bitDepth);
+    const uint64_t frame = frameIndex++;
+
+    // Without cached maps the fixed pattern costs no frame-sized memory
+    std::unique_ptr<NoiseModel> noiseModel;
+    if (physicalNoise)
+    {
+        noiseModel = std::make_unique<NoiseModel>(noiseParams, frameSize.width, frameSize.height, config.bitDepth, config.seed, false);
+    }
+
+    bands.resize(bandsInFlight);
+    workspaces.resize(std::max(cv::getNumThreads(), 1));
+    for (int firstBand = 0; firstBand < numBands; firstBand += bandsInFlight)
+    {
+        const int count = std::min(bandsInFlight, numBands - firstBand);
+
+        // Scene rows of every band in the batch, halo included
+        cv::parallel_for_(cv::Range(0, count), [&](const cv::Range &range)
+        {
+            for (int b = range.start; b < range.end; ++b)
+            {
+                Band &band = bands[b];
+                band.rowStart = (firstBand + b) * config.tileRows;
+                band.rowEnd = std::min(band.rowStart + config.tileRows, frameSize.height);
+                band.inputStart = std::max(band.rowStart - halo.height, 0);
+                band.inputEnd = std::min(band.rowEnd + halo.height, frameSize.height);
+                source(band.inputStart, band.inputEnd, band.scene);
+                band.raw.create(band.rowEnd - band.rowStart, frameSize.width, cvType);
+                if (config.demosaic)
+                {
+                    band.bgr.create(band.rowEnd - band.rowStart, frameSize.width, CV_MAKETYPE(CV_MAT_DEPTH(cvType), 3));
+                }
+                else
+                {
+                    band.bgr.release();
+                }
+            }
+        });
+        for (int b = 0; b < count; ++b)
+        {
+            const Band &band = bands[b];
+            if (band.scene.rows != band.inputEnd - band.inputStart || band.scene.cols != frameSize.width || band.scene.channels() != 1)
+            {
+                throw std::runtime_error("Scene source returned rows of the wrong size");
+            }
+        }
+
+        // Every tile of the batch is an independent task; one stripe per workspace pulls tiles
+        // until none are left, so no two concurrent tiles share buffers
+        const int numTiles = count * tilesPerBand;
+        const int numWorkers = std::min(static_cast<int>(workspaces.size()), numTiles);
+        std::atomic<int> nextTile{0};
+        cv::parallel_for_(cv::Range(0, numWorkers), [&](const cv::Range &range)
+        {
+            for (int w = range.start; w < range.end; ++w)
+            {
+                for (int t = nextTile++; t < numTiles; t = nextTile++)
+                {
+                    int colStart = (t % tilesPerBand) * tileCols;
+                    int colEnd = std::min(colStart + tileCols, frameSize.width);
+                    processTile(bands[t / tilesPerBand], colStart, colEnd, frameSize, noiseModel.get(), frame, workspaces[w]);
+                }
+            }
+        }, numWorkers);
+
+        for (int b = 0; b < count; ++b)
+        {
+            sink(bands[b].rowStart, bands[b].raw, bands[b].bgr);
+        }
+    }
+}
+
+void TiledSimulator::run(const SceneLoader &loader, const BandSink &sink)
+{
+    run(loader.getSize(), [&loader](int rowStart, int rowEnd, cv::Mat &rows)
+    {
+        loader.readStrip(rowStart, rowEnd, rows);
+    }, sink);
+}
+
+void TiledSimulator::processTile(Band &band, int colStart, int colEnd, cv::Size frameSize, const NoiseModel *noiseModel, uint64_t frame, Workspace &workspace) const
+{
+    TELEMETRY_SCOPE("TiledSimulator::tile");
+    const cv::Size halo = getHaloSize();
+    const int inputColStart = std::max(colStart - halo.width, 0);
+    const int inputColEnd = std::min(colEnd + halo.width, frameSize.width);
+    const double fullScale = ImageSensor::fullScaleForBitDepth(config.bitDepth);
+
+    // An isolated copy: filters reflect at the frame edges and read real halo pixels everywhere else
+    band.scene.colRange(inputColStart, inputColEnd).convertTo(workspace.signal, CV_32F, fullScale);
+    if (convolver)
+    {
+        convolver->apply(workspace.signal, workspace.blurred);
+        std::swap(workspace.signal, workspace.blurred);
+    }
+
+    // Position-dependent stages take the tile origin in the frame
+    if (noiseModel != nullptr)
+    {
+        noiseModel->apply(workspace.signal, fullScale, frame, band.inputStart, inputColStart);
+    }
+    else if (config.noiseLevel > 0.0)
+    {
+        noiseGenerator.addGaussian(workspace.signal, config.noiseLevel, frame, band.inputStart, inputColStart);
+    }
+    cfaPattern.apply(workspace.signal, band.inputStart, inputColStart);
+
+    // Readout to the bit depth
+    workspace.mosaic.create(workspace.signal.size(), band.raw.type());
+    for (int i = 0; i < workspace.signal.rows; ++i)
+    {
+        kernels.quantizeF32(workspace.signal.ptr<float>(i), workspace.mosaic.ptr(i), workspace.signal.cols, 1.0, kernels.maxValue);
+    }
+
+    // Only the interior is exact; the halo was needed for its neighbourhood
+    const cv::Rect interior(colStart - inputColStart, band.rowStart - band.inputStart, colEnd - colStart, band.rowEnd - band.rowStart);
+    const cv::Rect target(colStart, 0, colEnd - colStart, band.rowEnd - band.rowStart);
+    cv::Mat rawTarget = band.raw(target);
+    workspace.mosaic(interior).copyTo(rawTarget);
+    if (config.demosaic)
+    {
+        Demosaic::process(workspace.mosaic, workspace.color, cfaPattern, config.algorithm);
+        cv::Mat bgrTarget = band.bgr(target);
+        workspace.color(interior).copyTo(bgrTarget);
+    }
+}
@@ -0,0 +1,355 @@
+#include "VideoPipeline/VideoPipeline.h"
+#include "BoundedQueue/BoundedQueue.h"
+#include "BufferPool/BufferPool.h"
+#include "ImageSensor/ImageSensor.h"
+#include "NoiseGenerator/NoiseGenerator.h"
+#include "PSFConvolver/PSFConvolver.h"
+#include "SensorKernels/SensorKernels.h"
+#include "Telemetry/Telemetry.h"
+#include <chrono>
+#include <exception>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+namespace
+{
+    // Telemetry scope of each stage, in pipeline order
+    const char *const STAGE_SCOPES[] = {"VideoPipeline::scene", "VideoPipeline::optics", "VideoPipeline::sensor", "VideoPipeline::cfa",
+                                        "VideoPipeline::demosaic", "VideoPipeline::isp", "VideoPipeline::sink"};
+}
+
+VideoPipeline::VideoPipeline(const Config &config)
+    : config(config)
+{
+    if (config.width <= 0 || config.height <= 0)
+    {
+        throw std::invalid_argument("Frame size must be positive");
+    }
+    if (config.frameRate <= 0.0 || config.exposureTime <= 0.0 || config.readoutTime < 0.0)
+    {
+        throw std::invalid_argument("Frame rate and exposure must be positive");
+    }
+    if (config.segmentRows <= 0 || config.queueDepth <= 0)
+    {
+        throw std::invalid_argument("Segment rows and queue depth must be positive");
+    }
+    ImageSensor::cvTypeForBitDepth(config.bitDepth); // Validates the bit depth
+}
+
+void VideoPipeline::setSceneSource(SceneSource source)
+{
+    sceneSource = std::move(source);
+}
+
+void VideoPipeline::setExposureSchedule(ExposureSchedule schedule)
+{
+    exposureSchedule = std::move(schedule);
+}
+
+void VideoPipeline::setPSF(const cv::Mat &psf)
+{
+    this->psf = psf.clone();
+}
+
+void VideoPipeline::setNoise(double noiseLevel)
+{
+    this->noiseLevel = noiseLevel;
+    noiseModel.reset();
+}
+
+void VideoPipeline::setNoiseModel(std::shared_ptr<const NoiseModel> noiseModel)
+{
+    if (!noiseModel)
+    {
+        throw std::invalid_argument("Noise model must not be null");
+    }
+    this->noiseModel = std::move(noiseModel);
+}
+
+void VideoPipeline::setCFA(const CFAPattern &cfaPattern)
+{
+    this->cfaPattern = cfaPattern;
+    // Resolved here rather than by every frame; setDemosaic warns about explicit requests
+    if (!Demosaic::supports(cfaPattern, demosaicAlgorithm))
+    {
+        demosaicAlgorithm = Demosaic::BILINEAR;
+    }
+}
+
+void VideoPipeline::setDemosaic(Demosaic::Algorithm algorithm)
+{
+    // Resolved once here rather than warned about by every frame
+    if (!Demosaic::supports(cfaPattern, algorithm))
+    {
+        std::cerr << "Warning: Demosaicing algorithm requires a 2x2 Bayer-like CFA pattern. Defaulting to bilinear." << std::endl;
+        algorithm = Demosaic::BILINEAR;
+    }
+    demosaicAlgorithm = algorithm;
+}
+
+void VideoPipeline::setISP(ISPStage isp)
+{
+    this->isp = std::move(isp);
+}
+
+void VideoPipeline::setSink(FrameSink sink)
+{
+    this->sink = std::move(sink);
+}
+
+VideoPipeline::Statistics VideoPipeline::run(int64_t frameCount)
+{
+    if (!sceneSource)
+    {
+        throw std::logic_error("No scene source has been set");
+    }
+
+    using Clock = std::chrono::steady_clock;
+    using FrameQueue = BoundedQueue<Frame>;
+
+    const int cvType = ImageSensor::cvTypeForBitDepth(config.bitDepth);
+    const SensorKernels::Table kernels = SensorKernels::forBitDepth(config.bitDepth);
+    const double fullScale = ImageSensor::fullScaleForBitDepth(config.bitDepth);
+    NoiseGenerator generator(config.seed);
+    cv::MatAllocator *frameAllocator = BufferPool::global().getAllocator(); // Outlives frames kept by the sink
+    PSFConvolver convolver; // Owned by the optics thread; keeps its FFT plan across frames
+    if (!psf.empty())
+    {
+        convolver.setPSF(psf);
+    }
+
+    // Stage work in pipeline order; stage 0 is the scene source
+    std::vector<std::string> names = {"scene", "optics", "sensor", "cfa", "demosaic", "isp", "sink"};
+    std::vector<std::function<void(Frame &)>> work = {
+        [&](Frame &frame)
+        {
+            renderScene(frame);
+        },
+        [&](Frame &frame)
+        {
+            if (!psf.empty())
+            {
+                cv::Mat blurred; // New pooled buffer: the previous frame may still be in flight
+                blurred.allocator = frameAllocator;
+                convolver.apply(frame.raw, blurred);
+                frame.raw = blurred;
+            }
+        },
+        [&](Frame &frame)
+        {
+            if (noiseModel)
+            {
+                // Copy shares the fixed-pattern maps; only the exposure differs
+                NoiseModel frameModel = *noiseModel;
+                frameModel.setExposureTime(frame.exposureTime);
+                frameModel.apply(frame.raw, fullScale, static_cast<uint64_t>(frame.index));
+            }
+            else if (noiseLevel > 0.0)
+            {
+                generator.addGaussian(frame.raw, noiseLevel, static_cast<uint64_t>(frame.index));
+            }
+        },
+        [&](Frame &frame)
+        {
+            // Filter gains act on the signal before the ADC, like the still pipeline, so the
+            // readout saturates filtered values at the bit depth
+            cfaPattern.apply(frame.raw);
+            cv::Mat readout;
+            readout.allocator = frameAllocator;
+            readout.create(frame.raw.size(), cvType);
+            for (int i = 0; i < frame.raw.rows; ++i)
+            {
+                // Quantize to the bit depth, not just to the storage type
+                kernels.quantizeF32(frame.raw.ptr<float>(i), readout.ptr(i), frame.raw.cols, 1.0, kernels.maxValue);
+            }
+            frame.raw = readout;
+        },
+        [&](Frame &frame)
+        {
+            frame.rgb.allocator = frameAllocator;
+            Demosaic::process(frame.raw, frame.rgb, cfaPattern, demosaicAlgorithm);
+        },
+        [&](Frame &frame)
+        {
+            if (isp)
+            {
+                isp(frame.rgb);
+            }
+        },
+        [&](Frame &frame)
+        {
+            if (sink)
+            {
+                sink(frame);
+            }
+        }};
+
+    const size_t numStages = work.size();
+    std::vector<std::unique_ptr<FrameQueue>> queues;
+    for (size_t s = 0; s + 1 < numStages; ++s)
+    {
+        queues.push_back(std::make_unique<FrameQueue>(config.queueDepth));
+    }
+
+    std::vector<double> busy(numStages, 0.0);
+    std::mutex errorMutex;
+    std::exception_ptr error;
+    auto fail = [&]
+    {
+        {
+            std::lock_guard<std::mutex> lock(errorMutex);
+            if (!error)
+            {
+                error = std::current_exception();
+            }
+        }
+        for (auto &queue : queues)
+        {
+            queue->close();
+        }
+    };
+
+    const Clock::time_point start = Clock::now();
+    std::vector<std::thread> threads;
+
+    // Source: timestamps follow the target frame rate, optionally paced in real time
+    threads.emplace_back([&]
+    {
+        try
+        {
+            for (int64_t i = 0; i < frameCount; ++i)
+            {
+                if (config.realTime)
+                {
+                    std::this_thread::sleep_until(start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(i / config.frameRate)));
+                }
+
+                Frame frame;
+                frame.index = i;
+                frame.timestamp = i / config.frameRate;
+                frame.exposureTime = exposureSchedule ? exposureSchedule(i) : config.exposureTime;
+
+                Clock::time_point begin = Clock::now();
+                {
+                    TELEMETRY_SCOPE(STAGE_SCOPES[0]);
+                    work[0](frame);
+                }
+                busy[0] += std::chrono::duration<double>(Clock::now() - begin).count();
+                if (!queues[0]->push(std::move(frame)))
+                {
+                    break;
+                }
+            }
+        }
+        catch (...)
+        {
+            fail();
+        }
+        queues[0]->close();
+    });
+
+    for (size_t s = 1; s < numStages; ++s)
+    {
+        threads.emplace_back([&, s]
+        {
+            try
+            {
+                Frame frame;
+                while (queues[s - 1]->pop(frame))
+                {
+                    Clock::time_point begin = Clock::now();
+                    {
+                        TELEMETRY_SCOPE(STAGE_SCOPES[s]);
+                        work[s](frame);
+                    }
+                    busy[s] += std::chrono::duration<double>(Clock::now() - begin).count();
+                    if (s + 1 < numStages && !queues[s]->push(std::move(frame)))
+                    {
+                        break;
+                    }
+                }
+            }
+            catch (...)
+            {
+                fail();
+            }
+            if (s + 1 < numStages)
+            {
+                queues[s]->close();
+            }
+        });
+    }
+
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+    if (error)
+    {
+        std::rethrow_exception(error);
+    }
+
+    Statistics stats;
+    stats.frames = frameCount;
+    stats.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    stats.framesPerSecond = (stats.seconds > 0.0) ? frameCount / stats.seconds : 0.0;
+    stats.stageNames = names;
+    stats.stageSeconds = busy;
+    return stats;
+}
+
+VideoPipeline::SceneSource VideoPipeline::translatingScene(const cv::Mat &scene, const cv::Point2d &velocity)
+{
+    if (scene.channels() != 1)
+    {
+        throw std::invalid_argument("Scene must be single channel");
+    }
+
+    cv::Mat image;
+    scene.convertTo(image, CV_32FC1);
+    return [image, velocity](double time, int rowStart, int rowEnd, cv::Mat &rows)
+    {
+        // Maps output pixel (x, y) to scene pixel (x - vx t, rowStart + y - vy t)
+        cv::Mat shift = (cv::Mat_<double>(2, 3) << 1.0, 0.0, -velocity.x * time, 0.0, 1.0, rowStart - velocity.y * time);
+        cv::warpAffine(image, rows, shift, cv::Size(image.cols, rowEnd - rowStart),
+                       cv::INTER_LINEAR | cv::WARP_INVERSE_MAP, cv::BORDER_REFLECT_101);
+    };
+}
+
+void VideoPipeline::renderScene(Frame &frame) const
+{
+    if (frame.exposureTime <= 0.0)
+    {
+        throw std::invalid_argument("Exposure time must be positive");
+    }
+
+    // Light collected scales with the exposure relative to the reference exposure
+    const double scale = ImageSensor::fullScaleForBitDepth(config.bitDepth) * frame.exposureTime / config.exposureTime;
+    const bool rollingShutter = config.readoutTime > 0.0;
+    const double lineTime = config.readoutTime / config.height;
+    const int segmentRows = rollingShutter ? config.segmentRows : config.height;
+
+    if (frame.raw.empty())
+    {
+        frame.raw.allocator = BufferPool::global().getAllocator();
+    }
+    frame.raw.create(config.height, config.width, CV_32FC1);
+    cv::Mat rows;
+    for (int rowStart = 0; rowStart < config.height; rowStart += segmentRows)
+    {
+        int rowEnd = std::min(rowStart + segmentRows, config.height);
+
+        // Each segment is sampled at the middle of its rows' exposure window
+        double time = frame.timestamp + 0.5 * (rowStart + rowEnd - 1) * lineTime + 0.5 * frame.exposureTime;
+        sceneSource(time, rowStart, rowEnd, rows);
+        if (rows.rows != rowEnd - rowStart || rows.cols != config.width || rows.channels() != 1)
+        {
+            throw std::runtime_error("Scene source returned rows of the wrong size");
+        }
+
+        cv::Mat segment = frame.raw.rowRange(rowStart, rowEnd);
+        rows.convertTo(segment, CV_32FC1, scale);
+    }
+}